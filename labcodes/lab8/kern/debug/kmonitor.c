@@ -4,6 +4,7 @@
 #include <trap.h>
 #include <kmonitor.h>
 #include <kdebug.h>
+#include <kmalloc.h>
 
 /* *
  * Simple command-line kernel monitor useful for controlling the
@@ -21,6 +22,7 @@ static struct command commands[] = {
     {"help", "Display this list of commands.", mon_help},
     {"kerninfo", "Display information about the kernel.", mon_kerninfo},
     {"backtrace", "Print backtrace of stack frame.", mon_backtrace},
+    {"slabinfo", "Display statistics of the slab allocator.", mon_slabinfo},
 };
 
 /* return if kernel is panic, in kern/debug/panic.c */
@@ -130,3 +132,12 @@ mon_backtrace(int argc, char **argv, struct trapframe *tf) {
     return 0;
 }
 
+/* *
+ * mon_slabinfo - call print_slabinfo in kern/mm/kmalloc.c to
+ * print objects in use, slabs and fragmentation of each kmem_cache.
+ * */
+int
+mon_slabinfo(int argc, char **argv, struct trapframe *tf) {
+    print_slabinfo();
+    return 0;
+}
@@ -5,8 +5,22 @@
 #include <fs.h>
 #include <ide.h>
 #include <x86.h>
+#include <pmm.h>
+#include <bio.h>
+#include <pci.h>
 #include <assert.h>
 
+/*
+ * IDE 驱动执行块 IO 层（bio.c）交来的请求，每个通道一个 bio_queue，同一时刻只执行一个请求。
+ *   - 请求由中断驱动：磁盘每准备好（读）或写完一个扇区就产生一次 IRQ14/15，中断处理程序传送下一个扇区，
+ *     整个请求完成后交回块 IO 层，由它调用完成回调并启动调度器选出的下一个请求；
+ *   - 提交者不能睡眠时（启动阶段、idle 进程、关中断的缺页处理）块 IO 层关中断轮询驱动，
+ *     和中断处理程序用同一个按状态寄存器推进的状态机，之后迟到的中断只会看到已经处理过的状态，什么也不做。
+ *   - 有 PCI 总线主控 IDE 控制器（qemu 的 PIIX3）时，缓冲区都在内核线性映射中的请求（页缓存、交换、块缓存的页）
+ *     用 DMA 传送：按 64KB 边界把每个 bio 的缓冲区切成 PRD 表项，设备直接读写物理页，整个请求只产生一次中断；
+ *     其他请求以及没有 DMA 时仍用 insl/outsl 逐个扇区传送（PIO）。
+ */
+
 #define ISA_DATA                0x00
 #define ISA_ERROR               0x01
 #define ISA_PRECOMP             0x01
@@ -28,6 +42,8 @@
 #define IDE_CMD_READ            0x20
 #define IDE_CMD_WRITE           0x30
 #define IDE_CMD_IDENTIFY        0xEC
+#define IDE_CMD_READ_DMA        0xC8
+#define IDE_CMD_WRITE_DMA       0xCA
 
 #define IDE_IDENT_SECTORS       20
 #define IDE_IDENT_MODEL         54
@@ -36,13 +52,36 @@
 #define IDE_IDENT_MAX_LBA       120
 #define IDE_IDENT_MAX_LBA_EXT   200
 
+#define IDE_CAP_DMA             0x100
+#define IDE_CAP_LBA             0x200
+
+/* bus master IDE registers, 8 bytes for each channel */
+#define BM_COMMAND              0x00
+#define BM_STATUS               0x02
+#define BM_PRDT                 0x04
+
+#define BM_CMD_START            0x01
+#define BM_CMD_READ             0x08            // the device writes to memory
+#define BM_STATUS_ERR           0x02
+#define BM_STATUS_INTR          0x04
+
+/* a physical region descriptor: a region must not cross a 64KB boundary */
+struct ide_prd {
+    uint32_t addr;              // physical address of the region
+    uint16_t nbytes;            // size of the region, 0 means 64KB
+    uint16_t flags;             // PRD_EOT in the last descriptor
+};
+
+#define PRD_EOT                 0x8000
+#define PRD_BOUNDARY            0x10000
+#define IDE_NPRD                64              // a request of MAX_NSECS sectors in pages, with room for unaligned bios
+
 #define IO_BASE0                0x1F0
 #define IO_BASE1                0x170
 #define IO_CTRL0                0x3F4
 #define IO_CTRL1                0x374
 
 #define MAX_IDE                 4
-#define MAX_NSECS               128
 #define MAX_DISK_NSECS          0x10000000U
 #define VALID_IDE(ideno)        (((ideno) >= 0) && ((ideno) < MAX_IDE) && (ide_devices[ideno].valid))
 
@@ -61,9 +100,30 @@ static struct ide_device {
     unsigned char valid;        // 0 or 1 (If Device Really Exists)
     unsigned int sets;          // Commend Sets Supported
     unsigned int size;          // Size in Sectors
+    unsigned char dma;          // Supports DMA
     unsigned char model[41];    // Model in String
 } ide_devices[MAX_IDE];
 
+static struct ide_queue {
+    struct bio_queue bq;        // requests of the channel, must be the first member
+    unsigned short bmbase;      // bus master registers of the channel, 0 if there is no DMA
+    struct ide_prd *prdt;       // PRD table of the active DMA request
+    bool dma;                   // the active request is transferred by DMA or by PIO
+    struct bio *bio;            // the bio of the next sector to transfer by PIO
+    size_t boff;                // # of sectors of bio transferred
+    size_t nxfer;               // # of sectors of the active request not transferred by PIO yet
+} ide_queues[2];
+
+#define bq2ideq(q)              ((struct ide_queue *)(q))
+
+static int ide_start(struct bio_queue *bq, struct bio_request *rq);
+static void ide_poll(struct bio_queue *bq);
+
+static struct ide_prd ide_prdts[2][IDE_NPRD] __attribute__((aligned(sizeof(struct ide_prd) * IDE_NPRD)));
+
+// DMA 可以通过 SYS_idedma 关闭，以便和 PIO 比较
+static bool ide_dma_on = 0;
+
 static int
 ide_wait_ready(unsigned short iobase, bool check_error) {
     int r;
@@ -75,10 +135,36 @@ ide_wait_ready(unsigned short iobase, bool check_error) {
     return 0;
 }
 
+/* ide_dma_init - find the PCI IDE controller and enable its bus master DMA */
+static void
+ide_dma_init(void) {
+    uint32_t tag, bar;
+    if (!pci_find_class(PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE, &tag)) {
+        cprintf("ide: no PCI IDE controller, transfer by PIO.\n");
+        return;
+    }
+    bar = pci_conf_read(tag, PCI_BAR(4));
+    if (!(PCI_PROG_IF(pci_conf_read(tag, PCI_CLASS)) & PCI_IDE_BUSMASTER) || !(bar & PCI_BAR_IO) || (bar & ~3) == 0) {
+        cprintf("ide: no bus master DMA, transfer by PIO.\n");
+        return;
+    }
+    pci_conf_write(tag, PCI_COMMAND, pci_conf_read(tag, PCI_COMMAND) | PCI_COMMAND_IO | PCI_COMMAND_MASTER);
+    ide_queues[0].bmbase = bar & 0xFFFC, ide_queues[1].bmbase = (bar & 0xFFFC) + 8;
+    ide_dma_on = 1;
+    cprintf("ide: bus master DMA at I/O 0x%04x.\n", bar & 0xFFFC);
+}
+
 void
 ide_init(void) {
     static_assert((SECTSIZE % 4) == 0);
+    static_assert(IDE_NPRD >= MAX_NSECS * SECTSIZE / PGSIZE + 2);
     unsigned short ideno, iobase;
+    int chan;
+    for (chan = 0; chan < 2; chan ++) {
+        struct ide_queue *q = ide_queues + chan;
+        bio_queue_init(&(q->bq), MAX_NSECS, ide_start, ide_poll);
+        q->bmbase = 0, q->prdt = ide_prdts[chan];
+    }
     for (ideno = 0; ideno < MAX_IDE; ideno ++) {
         /* assume that no device here */
         ide_devices[ideno].valid = 0;
@@ -122,7 +208,9 @@ ide_init(void) {
         ide_devices[ideno].size = sectors;
 
         /* check if supports LBA */
-        assert((*(unsigned short *)(ident + IDE_IDENT_CAPABILITIES) & 0x200) != 0);
+        unsigned short caps = *(unsigned short *)(ident + IDE_IDENT_CAPABILITIES);
+        assert((caps & IDE_CAP_LBA) != 0);
+        ide_devices[ideno].dma = ((caps & IDE_CAP_DMA) != 0);
 
         unsigned char *model = ide_devices[ideno].model, *data = ident + IDE_IDENT_MODEL;
         unsigned int i, length = 40;
@@ -136,11 +224,23 @@ ide_init(void) {
         cprintf("ide %d: %10u(sectors), '%s'.\n", ideno, ide_devices[ideno].size, ide_devices[ideno].model);
     }
 
+    ide_dma_init();
+
     // enable ide interrupt
     pic_enable(IRQ_IDE1);
     pic_enable(IRQ_IDE2);
 }
 
+/* ide_dma_enable - enable (1) or disable (0) DMA, negative only queries; return the old state */
+bool
+ide_dma_enable(int enable) {
+    bool old = ide_dma_on;
+    if (enable >= 0) {
+        ide_dma_on = (enable != 0 && ide_queues[0].bmbase != 0);
+    }
+    return old;
+}
+
 bool
 ide_device_valid(unsigned short ideno) {
     return VALID_IDE(ideno);
@@ -154,61 +254,180 @@ ide_device_size(unsigned short ideno) {
     return 0;
 }
 
-int
-ide_read_secs(unsigned short ideno, uint32_t secno, void *dst, size_t nsecs) {
-    assert(nsecs <= MAX_NSECS && VALID_IDE(ideno));
-    assert(secno < MAX_DISK_NSECS && secno + nsecs <= MAX_DISK_NSECS);
-    unsigned short iobase = IO_BASE(ideno), ioctrl = IO_CTRL(ideno);
-
-    ide_wait_ready(iobase, 0);
-
-    // generate interrupt
-    outb(ioctrl + ISA_CTRL, 0);
-    outb(iobase + ISA_SECCNT, nsecs);
-    outb(iobase + ISA_SECTOR, secno & 0xFF);
-    outb(iobase + ISA_CYL_LO, (secno >> 8) & 0xFF);
-    outb(iobase + ISA_CYL_HI, (secno >> 16) & 0xFF);
-    outb(iobase + ISA_SDH, 0xE0 | ((ideno & 1) << 4) | ((secno >> 24) & 0xF));
-    outb(iobase + ISA_COMMAND, IDE_CMD_READ);
+/* ide_bio_queue - the queue of the channel of device ideno */
+struct bio_queue *
+ide_bio_queue(unsigned short ideno) {
+    assert(VALID_IDE(ideno));
+    return &(ide_queues[ideno >> 1].bq);
+}
 
-    int ret = 0;
-    for (; nsecs > 0; nsecs --, dst += SECTSIZE) {
-        if ((ret = ide_wait_ready(iobase, 1)) != 0) {
-            goto out;
+/*
+ * ide_dma_prepare - describe the buffers of the bios of rq in the PRD table of q.
+ *                   a buffer must be in the linear mapping of the kernel to be physically contiguous,
+ *                   and 4-byte aligned. return 0 if rq can't be transferred by DMA.
+ */
+static bool
+ide_dma_prepare(struct ide_queue *q, struct bio_request *rq) {
+    struct ide_prd *prd = q->prdt;
+    struct bio *bio;
+    uintptr_t va, pa;
+    size_t resid, nbytes;
+    if (!ide_dma_on || q->bmbase == 0 || !ide_devices[rq->rq_dev].dma) {
+        return 0;
+    }
+    for (bio = rq->rq_bio; bio != NULL; bio = bio->b_next) {
+        va = (uintptr_t)bio->b_buf, resid = bio->b_nsecs * SECTSIZE;
+        if ((va & 3) != 0 || va < KERNBASE || va + resid > KERNTOP) {
+            return 0;
+        }
+        for (pa = PADDR(va); resid != 0; pa += nbytes, resid -= nbytes, prd ++) {
+            if (prd == q->prdt + IDE_NPRD) {
+                return 0;
+            }
+            if ((nbytes = PRD_BOUNDARY - (pa % PRD_BOUNDARY)) > resid) {
+                nbytes = resid;
+            }
+            prd->addr = pa, prd->nbytes = nbytes % PRD_BOUNDARY, prd->flags = 0;
         }
-        insl(iobase, dst, SECTSIZE / sizeof(uint32_t));
     }
+    prd[-1].flags = PRD_EOT;
+    return 1;
+}
 
-out:
-    return ret;
+/* ide_pio_sector - transfer the next sector of the active request by PIO */
+static void
+ide_pio_sector(struct ide_queue *q, unsigned short iobase, bool write) {
+    void *buf = q->bio->b_buf + q->boff * SECTSIZE;
+    if (write) {
+        outsl(iobase, buf, SECTSIZE / sizeof(uint32_t));
+    }
+    else {
+        insl(iobase, buf, SECTSIZE / sizeof(uint32_t));
+    }
+    q->nxfer --;
+    if (++ q->boff == q->bio->b_nsecs) {
+        q->bio = q->bio->b_next, q->boff = 0;
+    }
 }
 
-int
-ide_write_secs(unsigned short ideno, uint32_t secno, const void *src, size_t nsecs) {
-    assert(nsecs <= MAX_NSECS && VALID_IDE(ideno));
-    assert(secno < MAX_DISK_NSECS && secno + nsecs <= MAX_DISK_NSECS);
-    unsigned short iobase = IO_BASE(ideno), ioctrl = IO_CTRL(ideno);
+/* ide_account - charge the CPU cycles the driver spent since start to DMA or PIO transfers */
+static void
+ide_account(bool dma, uint64_t start) {
+    static uint32_t remainder[2];
+    uint32_t cycles = (uint32_t)(rdtsc() - start) + remainder[dma];
+    *(dma ? &(iostat.ide_dma_kcycles) : &(iostat.ide_pio_kcycles)) += cycles / 1000;
+    remainder[dma] = cycles % 1000;
+}
+
+/*
+ * ide_start - send the command of the request just dispatched by the bio layer to its device,
+ *             and start the bus master for DMA or write the first sector for a PIO write
+ */
+static int
+ide_start(struct bio_queue *bq, struct bio_request *rq) {
+    struct ide_queue *q = bq2ideq(bq);
+    unsigned short ideno = rq->rq_dev, iobase = IO_BASE(ideno), ioctrl = IO_CTRL(ideno);
+    uint32_t secno = rq->rq_secno;
+    uint64_t start = rdtsc();
+    uint8_t command = rq->rq_write ? IDE_CMD_WRITE : IDE_CMD_READ;
+    int ret = 0;
+
+    assert(rq->rq_nsecs <= MAX_NSECS && VALID_IDE(ideno));
+    assert(secno < MAX_DISK_NSECS && secno + rq->rq_nsecs <= MAX_DISK_NSECS);
 
     ide_wait_ready(iobase, 0);
 
+    q->bio = rq->rq_bio, q->boff = 0, q->nxfer = rq->rq_nsecs;
+    if ((q->dma = ide_dma_prepare(q, rq))) {
+        outl(q->bmbase + BM_PRDT, PADDR(q->prdt));
+        outb(q->bmbase + BM_COMMAND, rq->rq_write ? 0 : BM_CMD_READ);
+        // 写 1 清除上一次留下的中断和错误位
+        outb(q->bmbase + BM_STATUS, inb(q->bmbase + BM_STATUS) | BM_STATUS_INTR | BM_STATUS_ERR);
+        command = rq->rq_write ? IDE_CMD_WRITE_DMA : IDE_CMD_READ_DMA;
+        q->nxfer = 0;
+    }
+    *(q->dma ? &(iostat.ide_dma_sectors) : &(iostat.ide_pio_sectors)) += rq->rq_nsecs;
+
     // generate interrupt
     outb(ioctrl + ISA_CTRL, 0);
-    outb(iobase + ISA_SECCNT, nsecs);
+    outb(iobase + ISA_SECCNT, rq->rq_nsecs);
     outb(iobase + ISA_SECTOR, secno & 0xFF);
     outb(iobase + ISA_CYL_LO, (secno >> 8) & 0xFF);
     outb(iobase + ISA_CYL_HI, (secno >> 16) & 0xFF);
     outb(iobase + ISA_SDH, 0xE0 | ((ideno & 1) << 4) | ((secno >> 24) & 0xF));
-    outb(iobase + ISA_COMMAND, IDE_CMD_WRITE);
+    outb(iobase + ISA_COMMAND, command);
 
-    int ret = 0;
-    for (; nsecs > 0; nsecs --, src += SECTSIZE) {
-        if ((ret = ide_wait_ready(iobase, 1)) != 0) {
-            goto out;
+    if (q->dma) {
+        outb(q->bmbase + BM_COMMAND, (rq->rq_write ? 0 : BM_CMD_READ) | BM_CMD_START);
+    }
+    // 写命令的第一个扇区不产生中断，发出命令后直接写入，之后每写完一个扇区产生一次中断
+    else if (rq->rq_write) {
+        if ((ret = ide_wait_ready(iobase, 1)) == 0) {
+            ide_pio_sector(q, iobase, 1);
         }
-        outsl(iobase, src, SECTSIZE / sizeof(uint32_t));
     }
-
-out:
+    ide_account(q->dma, start);
     return ret;
 }
 
+/*
+ * ide_service - move the active request of q forward by the status of the channel, called on
+ *               IRQ14/15 and by the submitters which poll. reading the status clears the interrupt.
+ */
+static void
+ide_service(struct ide_queue *q) {
+    struct bio_request *rq = q->bq.q_active;
+    unsigned short iobase = channels[q - ide_queues].base;
+    uint64_t start = rdtsc();
+    int r, bms = 0, ret = 1;
+    if (rq == NULL) {
+        inb(iobase + ISA_STATUS);
+        return;
+    }
+    bool dma = q->dma;
+    if (dma) {
+        // DMA 进行中设备不置 BSY，由总线主控的中断位判断命令是否完成，完成后停止总线主控
+        if (!((bms = inb(q->bmbase + BM_STATUS)) & BM_STATUS_INTR)) {
+            return;
+        }
+        outb(q->bmbase + BM_COMMAND, 0);
+        outb(q->bmbase + BM_STATUS, bms);
+    }
+    r = inb(iobase + ISA_STATUS);
+    if (!dma && (r & IDE_BSY)) {
+        return;
+    }
+    if ((r & (IDE_DF | IDE_ERR)) != 0 || (bms & BM_STATUS_ERR) != 0) {
+        ret = -1;
+    }
+    else if (q->nxfer != 0) {
+        if (!(r & IDE_DRQ)) {
+            return;
+        }
+        ide_pio_sector(q, iobase, rq->rq_write);
+        // 读完最后一个扇区时请求已完成；写入的扇区要等下一次中断才表示写完
+        if (!rq->rq_write && q->nxfer == 0) {
+            ret = 0;
+        }
+    }
+    else {
+        ret = 0;
+    }
+    ide_account(dma, start);
+    if (ret <= 0) {
+        bio_queue_done(&(q->bq), ret);
+    }
+}
+
+/* ide_poll - poll the channel of bq, with interrupts disabled */
+static void
+ide_poll(struct bio_queue *bq) {
+    ide_service(bq2ideq(bq));
+}
+
+/* ide_intr - the handler of IRQ14 and IRQ15 */
+void
+ide_intr(int irq) {
+    iostat.ide_intr ++;
+    ide_service(ide_queues + ((irq == IRQ_IDE1) ? 0 : 1));
+}
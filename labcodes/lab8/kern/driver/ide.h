@@ -3,12 +3,17 @@
 
 #include <defs.h>
 
+struct bio_queue;
+
+/* a READ/WRITE SECTORS command moves at most 256 sectors (a sector count of 0 means 256) */
+#define MAX_NSECS               256
+
 void ide_init(void);
 bool ide_device_valid(unsigned short ideno);
 size_t ide_device_size(unsigned short ideno);
-
-int ide_read_secs(unsigned short ideno, uint32_t secno, void *dst, size_t nsecs);
-int ide_write_secs(unsigned short ideno, uint32_t secno, const void *src, size_t nsecs);
+void ide_intr(int irq);
+bool ide_dma_enable(int enable);
+struct bio_queue *ide_bio_queue(unsigned short ideno);
 
 #endif /* !__KERN_DRIVER_IDE_H__ */
 
@@ -0,0 +1,47 @@
+#include <defs.h>
+#include <x86.h>
+#include <pci.h>
+
+/* PCI 配置空间访问机制 #1：向 0xCF8 写入地址，再从 0xCFC 读写寄存器 */
+#define PCI_CONF_ADDR           0xCF8
+#define PCI_CONF_DATA           0xCFC
+#define PCI_CONF_ENABLE         0x80000000
+
+uint32_t
+pci_conf_read(uint32_t tag, uint32_t reg) {
+    outl(PCI_CONF_ADDR, PCI_CONF_ENABLE | tag | (reg & 0xFC));
+    return inl(PCI_CONF_DATA);
+}
+
+void
+pci_conf_write(uint32_t tag, uint32_t reg, uint32_t value) {
+    outl(PCI_CONF_ADDR, PCI_CONF_ENABLE | tag | (reg & 0xFC));
+    outl(PCI_CONF_DATA, value);
+}
+
+/*
+ * pci_find_class - find the first function of class/subclass on bus 0, where the chipset devices
+ *                  (the PIIX IDE controller in qemu) are. return 0 if there is none.
+ */
+bool
+pci_find_class(uint32_t class, uint32_t subclass, uint32_t *tag_store) {
+    uint32_t dev, func, nfuncs, tag, reg;
+    for (dev = 0; dev < 32; dev ++) {
+        if (PCI_VENDOR(pci_conf_read(PCI_TAG(0, dev, 0), PCI_ID)) == 0xFFFF) {
+            continue;
+        }
+        nfuncs = PCI_MULTIFUNC(pci_conf_read(PCI_TAG(0, dev, 0), PCI_HEADER)) ? 8 : 1;
+        for (func = 0; func < nfuncs; func ++) {
+            tag = PCI_TAG(0, dev, func);
+            if (PCI_VENDOR(pci_conf_read(tag, PCI_ID)) == 0xFFFF) {
+                continue;
+            }
+            reg = pci_conf_read(tag, PCI_CLASS);
+            if (PCI_CLASS_CODE(reg) == class && PCI_SUBCLASS(reg) == subclass) {
+                *tag_store = tag;
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,35 @@
+#ifndef __KERN_DRIVER_PCI_H__
+#define __KERN_DRIVER_PCI_H__
+
+#include <defs.h>
+
+/* registers in the configuration space of a PCI function */
+#define PCI_ID                  0x00
+#define PCI_COMMAND             0x04
+#define PCI_CLASS               0x08
+#define PCI_HEADER              0x0C
+#define PCI_BAR(n)              (0x10 + (n) * 4)
+
+#define PCI_COMMAND_IO          0x00000001      // respond to I/O space accesses
+#define PCI_COMMAND_MASTER      0x00000004      // allow the function to be a bus master
+
+#define PCI_VENDOR(id)          ((id) & 0xFFFF)
+#define PCI_CLASS_CODE(class)   (((class) >> 24) & 0xFF)
+#define PCI_SUBCLASS(class)     (((class) >> 16) & 0xFF)
+#define PCI_PROG_IF(class)      (((class) >> 8) & 0xFF)
+#define PCI_MULTIFUNC(header)   (((header) >> 16) & 0x80)
+
+#define PCI_BAR_IO              0x00000001      // the BAR is in I/O space
+
+#define PCI_CLASS_STORAGE       0x01
+#define PCI_SUBCLASS_IDE        0x01
+#define PCI_IDE_BUSMASTER       0x80            // prog-if of an IDE controller with bus master DMA (BAR4)
+
+// a PCI function is addressed by its bus, device and function numbers
+#define PCI_TAG(bus, dev, func) (((bus) << 16) | ((dev) << 11) | ((func) << 8))
+
+uint32_t pci_conf_read(uint32_t tag, uint32_t reg);
+void pci_conf_write(uint32_t tag, uint32_t reg, uint32_t value);
+bool pci_find_class(uint32_t class, uint32_t subclass, uint32_t *tag_store);
+
+#endif /* !__KERN_DRIVER_PCI_H__ */
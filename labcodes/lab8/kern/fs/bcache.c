@@ -0,0 +1,443 @@
+#include <defs.h>
+#include <string.h>
+#include <stdlib.h>
+#include <list.h>
+#include <pmm.h>
+#include <kmalloc.h>
+#include <fs.h>
+#include <dev.h>
+#include <iobuf.h>
+#include <bcache.h>
+#include <error.h>
+#include <assert.h>
+
+/*
+ * 块缓存（buffer cache）位于文件系统和块设备之间：
+ *   bread  读取一个块，若块已在缓存中则不访问设备；
+ *   bget   取得一个块的缓冲区但不读取内容，用于整块覆盖写；
+ *   bread_direct 读取连续的多个块但不放入缓存，用于文件页缓存等自己缓存内容的调用者；
+ *   bdwrite 把缓冲区标记为脏，推迟到 bcache_sync 或缓冲区被换出时才写回设备；
+ *   brelse 释放缓冲区，把它移动到 LRU 链表的头部。
+ *   bjwrite 把缓冲区标记为属于日志事务的脏块（B_JOURNAL），事务提交之前不会被换出或写回原来的位置。
+ * 缓冲区的数量固定为 BCACHE_NBUF，没有空闲缓冲区时换出 LRU 链表尾部第一个未被固定的缓冲区，
+ * 脏缓冲区在换出前先写回。bcache_sync 把块号连续的脏缓冲区拼接到一个簇缓冲区中，用一次设备 IO 写回。
+ *
+ * 哈希表和 LRU 链表只在不会睡眠的代码段中修改，在单处理器、内核不可抢占的前提下不需要额外加锁；
+ * 设备 IO 可能睡眠，期间缓冲区被固定，不会被其他进程换出。
+ */
+
+#define BCACHE_NBUF                     128
+#define BCACHE_DIRTY_MAX                (BCACHE_NBUF / 2)
+#define BCACHE_CLUSTER                  16      /* max # of contiguous dirty blocks written back in one request */
+#define BCACHE_HASH_SHIFT               6
+#define BCACHE_HASH_SIZE                (1 << BCACHE_HASH_SHIFT)
+#define bcache_hashfn(dev, blkno)       (hash32((uintptr_t)(dev) ^ (blkno), BCACHE_HASH_SHIFT))
+
+static struct buf *bcache_bufs;
+static list_entry_t bcache_hash[BCACHE_HASH_SIZE];
+static list_entry_t bcache_lru;
+static size_t bcache_nr_dirty;
+static void *bcache_cluster;
+static semaphore_t bcache_cluster_sem;
+
+void
+bcache_init(void) {
+    int i;
+    if ((bcache_bufs = kmalloc(sizeof(struct buf) * BCACHE_NBUF)) == NULL) {
+        panic("bcache: cannot alloc buffers.\n");
+    }
+    for (i = 0; i < BCACHE_HASH_SIZE; i ++) {
+        list_init(bcache_hash + i);
+    }
+    list_init(&bcache_lru);
+    for (i = 0; i < BCACHE_NBUF; i ++) {
+        struct buf *bp = bcache_bufs + i;
+        struct Page *page;
+        if ((page = alloc_page()) == NULL) {
+            panic("bcache: cannot alloc buffer pages.\n");
+        }
+        bp->b_dev = NULL, bp->b_blkno = 0, bp->b_flags = 0, bp->b_refcnt = 0;
+        bp->b_data = page2kva(page);
+        sem_init(&(bp->b_sem), 1);
+        list_init(&(bp->hash_link));
+        list_add_before(&bcache_lru, &(bp->lru_link));
+    }
+    bcache_nr_dirty = 0;
+
+    struct Page *page;
+    if ((page = alloc_pages(BCACHE_CLUSTER)) == NULL) {
+        panic("bcache: cannot alloc cluster buffer.\n");
+    }
+    bcache_cluster = page2kva(page);
+    sem_init(&bcache_cluster_sem, 1);
+}
+
+static struct buf *
+bcache_lookup(struct device *dev, uint32_t blkno) {
+    list_entry_t *list = bcache_hash + bcache_hashfn(dev, blkno), *le = list;
+    while ((le = list_next(le)) != list) {
+        struct buf *bp = le2buf(le, hash_link);
+        if (bp->b_dev == dev && bp->b_blkno == blkno) {
+            return bp;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * bcache_io - transfer the block in bp from/to the device, the caller holds bp
+ */
+static int
+bcache_io(struct buf *bp, bool write) {
+    struct iobuf __iob, *iob = iobuf_init(&__iob, bp->b_data, PGSIZE, bp->b_blkno * PGSIZE);
+    return dop_io(bp->b_dev, iob, write);
+}
+
+/*
+ * bcache_writeback - write a dirty buffer back to its device, the caller holds bp
+ */
+static int
+bcache_writeback(struct buf *bp) {
+    assert(bp->b_flags & B_DIRTY);
+    int ret;
+    if ((ret = bcache_io(bp, 1)) == 0) {
+        bp->b_flags &= ~B_DIRTY;
+        bcache_nr_dirty --;
+        iostat.bcache_writeback ++;
+    }
+    return ret;
+}
+
+static void
+bcache_hold(struct buf *bp) {
+    bp->b_refcnt ++;
+    down(&(bp->b_sem));
+}
+
+static void
+bcache_unhold(struct buf *bp) {
+    assert(bp->b_refcnt > 0);
+    up(&(bp->b_sem));
+    bp->b_refcnt --;
+}
+
+/*
+ * bcache_get - find the buffer of (dev, blkno), or take the least recently used unpinned buffer for it.
+ *              the buffer returned is held by the caller, its content is valid only if B_VALID is set.
+ */
+static int
+bcache_get(struct device *dev, uint32_t blkno, struct buf **bp_store) {
+    assert(dev->d_blocksize == PGSIZE && blkno < dev->d_blocks);
+    struct buf *bp;
+    int ret;
+    while (1) {
+        if ((bp = bcache_lookup(dev, blkno)) != NULL) {
+            // 缓冲区被固定后不会改变身份，等待其他持有者释放即可
+            bcache_hold(bp);
+            break;
+        }
+
+        list_entry_t *le = &bcache_lru;
+        bp = NULL;
+        while ((le = list_prev(le)) != &bcache_lru) {
+            if (le2buf(le, lru_link)->b_refcnt == 0 && !(le2buf(le, lru_link)->b_flags & B_JOURNAL)) {
+                bp = le2buf(le, lru_link);
+                break;
+            }
+        }
+        if (bp == NULL) {
+            return -E_NO_MEM;
+        }
+
+        bcache_hold(bp);
+        if (bp->b_flags & B_DIRTY) {
+            if ((ret = bcache_writeback(bp)) != 0) {
+                bcache_unhold(bp);
+                return ret;
+            }
+            // 写回期间可能有其他进程使用了这个缓冲区，或者已经为 (dev, blkno) 建立了缓冲区
+            if (bp->b_refcnt != 1 || bcache_lookup(dev, blkno) != NULL) {
+                bcache_unhold(bp);
+                continue;
+            }
+        }
+        list_del_init(&(bp->hash_link));
+        bp->b_dev = dev, bp->b_blkno = blkno, bp->b_flags = 0;
+        list_add(bcache_hash + bcache_hashfn(dev, blkno), &(bp->hash_link));
+        break;
+    }
+    *bp_store = bp;
+    return 0;
+}
+
+/*
+ * bread - return the held buffer of (dev, blkno) with its content read from the device if not cached
+ */
+int
+bread(struct device *dev, uint32_t blkno, struct buf **bp_store) {
+    struct buf *bp;
+    int ret;
+    if ((ret = bcache_get(dev, blkno, &bp)) != 0) {
+        return ret;
+    }
+    if (bp->b_flags & B_VALID) {
+        iostat.bcache_hit ++;
+    }
+    else {
+        iostat.bcache_miss ++;
+        if ((ret = bcache_io(bp, 0)) != 0) {
+            brelse(bp);
+            return ret;
+        }
+        bp->b_flags |= B_VALID;
+    }
+    *bp_store = bp;
+    return 0;
+}
+
+/*
+ * bget - return the held buffer of (dev, blkno) without reading it, the caller must overwrite the whole block
+ */
+int
+bget(struct device *dev, uint32_t blkno, struct buf **bp_store) {
+    return bcache_get(dev, blkno, bp_store);
+}
+
+/*
+ * bread_direct - read nblks blocks starting at blkno into data, from the cache if they are all there,
+ *                or else from the device in one request without caching them.
+ *                used by callers which cache the content themselves, such as the file page cache.
+ *                the cached buffers of the range are pinned across the device read, so that a dirty one
+ *                is not evicted while the read sleeps, and is copied over the data read afterwards.
+ */
+int
+bread_direct(struct device *dev, uint32_t blkno, uint32_t nblks, void *data) {
+    assert(dev->d_blocksize == PGSIZE && blkno + nblks <= dev->d_blocks && nblks <= BCACHE_CLUSTER);
+    struct buf *pinned[BCACHE_CLUSTER], *bp;
+    bool cached = 1;
+    uint32_t i;
+    int ret = 0;
+    for (i = 0; i < nblks; i ++) {
+        if ((pinned[i] = bp = bcache_lookup(dev, blkno + i)) != NULL) {
+            bp->b_refcnt ++;
+        }
+        if (bp == NULL || !(bp->b_flags & B_VALID)) {
+            cached = 0;
+        }
+    }
+    if (!cached) {
+        struct iobuf __iob, *iob = iobuf_init(&__iob, data, nblks * PGSIZE, blkno * PGSIZE);
+        if ((ret = dop_io(dev, iob, 0)) != 0) {
+            goto out;
+        }
+    }
+    // 缓存中的块可能比磁盘上的新（脏块），用缓存中的内容覆盖；读设备期间新建立的缓冲区也一样
+    for (i = 0; i < nblks; i ++) {
+        if ((bp = bcache_lookup(dev, blkno + i)) != NULL) {
+            bcache_hold(bp);
+            if (bp->b_flags & B_VALID) {
+                iostat.bcache_hit ++;
+                memcpy(data + i * PGSIZE, bp->b_data, PGSIZE);
+            }
+            brelse(bp);
+        }
+    }
+out:
+    for (i = 0; i < nblks; i ++) {
+        if ((bp = pinned[i]) != NULL) {
+            assert(bp->b_refcnt > 0);
+            bp->b_refcnt --;
+        }
+    }
+    return ret;
+}
+
+/*
+ * bdwrite - mark the held buffer valid and dirty, it is written back by bcache_sync or when evicted
+ */
+void
+bdwrite(struct buf *bp) {
+    assert(bp->b_refcnt > 0);
+    if (!(bp->b_flags & B_DIRTY)) {
+        bcache_nr_dirty ++;
+    }
+    bp->b_flags |= B_VALID | B_DIRTY;
+}
+
+/*
+ * bjwrite - mark the held buffer dirty in the running journal transaction, it is not written back
+ *           until the transaction is committed and bcache_journal_release clears B_JOURNAL
+ */
+void
+bjwrite(struct buf *bp) {
+    bdwrite(bp);
+    bp->b_flags |= B_JOURNAL;
+}
+
+/*
+ * brelse - release the held buffer and move it to the head of the LRU list.
+ *          write back the device if too many buffers are dirty.
+ */
+void
+brelse(struct buf *bp) {
+    struct device *dev = bp->b_dev;
+    list_del(&(bp->lru_link));
+    list_add(&bcache_lru, &(bp->lru_link));
+    bcache_unhold(bp);
+    if (bcache_nr_dirty > BCACHE_DIRTY_MAX) {
+        bcache_sync(dev);
+    }
+}
+
+/*
+ * bcache_writeback_cluster - write n contiguous dirty buffers back in one request, the caller holds them
+ */
+static int
+bcache_writeback_cluster(struct buf **run, uint32_t n) {
+    if (n == 1) {
+        return bcache_writeback(run[0]);
+    }
+    uint32_t i;
+    int ret;
+    down(&bcache_cluster_sem);
+    {
+        for (i = 0; i < n; i ++) {
+            assert((run[i]->b_flags & B_DIRTY) && run[i]->b_blkno == run[0]->b_blkno + i);
+            memcpy(bcache_cluster + i * PGSIZE, run[i]->b_data, PGSIZE);
+        }
+        struct iobuf __iob, *iob = iobuf_init(&__iob, bcache_cluster, n * PGSIZE, run[0]->b_blkno * PGSIZE);
+        ret = dop_io(run[0]->b_dev, iob, 1);
+    }
+    up(&bcache_cluster_sem);
+    if (ret == 0) {
+        for (i = 0; i < n; i ++) {
+            run[i]->b_flags &= ~B_DIRTY;
+        }
+        bcache_nr_dirty -= n;
+        iostat.bcache_writeback += n;
+    }
+    return ret;
+}
+
+/*
+ * bcache_sync - write all dirty buffers of dev back in ascending block order,
+ *               each run of up to BCACHE_CLUSTER contiguous dirty blocks in one request
+ */
+int
+bcache_sync(struct device *dev) {
+    struct buf *run[BCACHE_CLUSTER];
+    uint32_t next = 0, n, ndirty;
+    int i, ret = 0;
+    while (1) {
+        struct buf *bp = NULL;
+        for (i = 0; i < BCACHE_NBUF; i ++) {
+            struct buf *b = bcache_bufs + i;
+            if (b->b_dev == dev && (b->b_flags & (B_DIRTY | B_JOURNAL)) == B_DIRTY && b->b_blkno >= next) {
+                if (bp == NULL || b->b_blkno < bp->b_blkno) {
+                    bp = b;
+                }
+            }
+        }
+        if (bp == NULL) {
+            break;
+        }
+        run[0] = bp, n = 1;
+        while (n < BCACHE_CLUSTER && (bp = bcache_lookup(dev, run[0]->b_blkno + n)) != NULL
+               && (bp->b_flags & (B_DIRTY | B_JOURNAL)) == B_DIRTY) {
+            run[n ++] = bp;
+        }
+        // 先固定整个簇再逐个加锁，等待某个缓冲区时其他缓冲区不会被换出
+        for (i = 0; i < n; i ++) {
+            run[i]->b_refcnt ++;
+        }
+        for (i = 0; i < n; i ++) {
+            down(&(run[i]->b_sem));
+        }
+        // 等待期间可能有缓冲区已经被其他进程写回，只写回仍然是脏的前缀，剩下的留到下一轮
+        for (ndirty = 0; ndirty < n && (run[ndirty]->b_flags & (B_DIRTY | B_JOURNAL)) == B_DIRTY; ndirty ++)
+            /* nothing */ ;
+        next = run[0]->b_blkno + ((ndirty != 0) ? ndirty : 1);
+        if (ndirty != 0) {
+            ret = bcache_writeback_cluster(run, ndirty);
+        }
+        for (i = 0; i < n; i ++) {
+            bcache_unhold(run[i]);
+        }
+        if (ret != 0) {
+            break;
+        }
+    }
+    return ret;
+}
+
+/*
+ * bcache_journaled - return the # of buffers of dev in the running journal transaction
+ */
+int
+bcache_journaled(struct device *dev) {
+    int i, n = 0;
+    for (i = 0; i < BCACHE_NBUF; i ++) {
+        if (bcache_bufs[i].b_dev == dev && (bcache_bufs[i].b_flags & B_JOURNAL)) {
+            n ++;
+        }
+    }
+    return n;
+}
+
+/*
+ * bcache_journal_hold - hold all buffers of dev in the running journal transaction, at most max of them,
+ *                       and return their # in bps. the caller commits them and calls bcache_journal_release.
+ */
+int
+bcache_journal_hold(struct device *dev, struct buf **bps, int max) {
+    int i, n = 0;
+    for (i = 0; i < BCACHE_NBUF; i ++) {
+        struct buf *bp = bcache_bufs + i;
+        if (bp->b_dev == dev && (bp->b_flags & B_JOURNAL)) {
+            assert(n < max);
+            bps[n ++] = bp;
+        }
+    }
+    // 和 bcache_sync 一样先固定所有缓冲区再逐个加锁
+    for (i = 0; i < n; i ++) {
+        bps[i]->b_refcnt ++;
+    }
+    for (i = 0; i < n; i ++) {
+        down(&(bps[i]->b_sem));
+    }
+    return n;
+}
+
+/*
+ * bcache_journal_release - release the buffers held by bcache_journal_hold, if the transaction is committed
+ *                          they are left dirty and written back in place like other dirty buffers
+ */
+void
+bcache_journal_release(struct buf **bps, int n, bool committed) {
+    int i;
+    for (i = 0; i < n; i ++) {
+        if (committed) {
+            bps[i]->b_flags &= ~B_JOURNAL;
+        }
+        bcache_unhold(bps[i]);
+    }
+}
+
+/*
+ * bcache_invalidate - drop all buffers of dev, which must be clean and unpinned
+ */
+void
+bcache_invalidate(struct device *dev) {
+    int i;
+    for (i = 0; i < BCACHE_NBUF; i ++) {
+        struct buf *bp = bcache_bufs + i;
+        if (bp->b_dev == dev) {
+            assert(bp->b_refcnt == 0 && !(bp->b_flags & B_DIRTY));
+            list_del_init(&(bp->hash_link));
+            bp->b_dev = NULL, bp->b_flags = 0;
+            list_del(&(bp->lru_link));
+            list_add_before(&bcache_lru, &(bp->lru_link));
+        }
+    }
+}
+
@@ -0,0 +1,50 @@
+#ifndef __KERN_FS_BCACHE_H__
+#define __KERN_FS_BCACHE_H__
+
+#include <defs.h>
+#include <list.h>
+#include <sem.h>
+
+struct device;
+
+/*
+ * 块缓存（buffer cache）中的一个缓冲区，缓存块设备上的一个块。
+ * 缓冲区按 (b_dev, b_blkno) 组织在哈希表中，并按最近使用的顺序组织在 LRU 链表中。
+ * b_refcnt 不为 0 的缓冲区被固定（pin）在内存中，不会被换出；
+ * 持有 b_sem 的进程独占缓冲区的内容。
+ */
+struct buf {
+    struct device *b_dev;                           /* device the block belongs to, NULL if unused */
+    uint32_t b_blkno;                               /* NO. of the block on b_dev */
+    uint32_t b_flags;                               /* B_VALID, B_DIRTY, B_JOURNAL */
+    int b_refcnt;                                   /* # of holders and waiters, pinned if non-zero */
+    void *b_data;                                   /* content of the block, one page */
+    semaphore_t b_sem;                              /* semaphore for the content */
+    list_entry_t hash_link;                         /* entry in the hash list of (b_dev, b_blkno) */
+    list_entry_t lru_link;                          /* entry in the LRU list, most recently used first */
+};
+
+#define B_VALID                                     0x1     /* b_data holds the content of the block */
+#define B_DIRTY                                     0x2     /* b_data is newer than the block on disk */
+#define B_JOURNAL                                   0x4     /* dirty in a journal transaction not committed yet */
+
+#define le2buf(le, member)                          \
+    to_struct((le), struct buf, member)
+
+void bcache_init(void);
+
+int bread(struct device *dev, uint32_t blkno, struct buf **bp_store);
+int bget(struct device *dev, uint32_t blkno, struct buf **bp_store);
+int bread_direct(struct device *dev, uint32_t blkno, uint32_t nblks, void *data);
+void bdwrite(struct buf *bp);
+void bjwrite(struct buf *bp);
+void brelse(struct buf *bp);
+
+int bcache_sync(struct device *dev);
+int bcache_journaled(struct device *dev);
+int bcache_journal_hold(struct device *dev, struct buf **bps, int max);
+void bcache_journal_release(struct buf **bps, int n, bool committed);
+void bcache_invalidate(struct device *dev);
+
+#endif /* !__KERN_FS_BCACHE_H__ */
+
@@ -0,0 +1,350 @@
+#include <defs.h>
+#include <x86.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sync.h>
+#include <proc.h>
+#include <sched.h>
+#include <clock.h>
+#include <ide.h>
+#include <fs.h>
+#include <bio.h>
+#include <assert.h>
+
+/*
+ * 启动时使用的 IO 调度器，可以在编译时通过 make DEFS+=-DBIO_SCHED=iosched_cscan 选择，
+ * 可选 iosched_noop（按到达顺序）、iosched_deadline（读写分批扫描，按期限防止饥饿）和 iosched_cscan（单向扫描）
+ */
+#ifndef BIO_SCHED
+#define BIO_SCHED                   iosched_deadline
+#endif
+
+static struct iosched *bio_sched = &BIO_SCHED;
+
+static void
+bio_queue_setup(struct bio_queue *q, struct iosched *sched, size_t max_nsecs,
+                int (*start)(struct bio_queue *q, struct bio_request *rq), void (*poll)(struct bio_queue *q)) {
+    int i;
+    q->q_sched = sched;
+    list_init(&(q->q_requests));
+    q->q_active = NULL, q->q_pos = 0, q->q_max_nsecs = max_nsecs;
+    wait_queue_init(&(q->q_wait_queue));
+    q->q_start = start, q->q_poll = poll;
+    for (i = 0; i < 2; i ++) {
+        list_init(&(q->q_sort[i]));
+        list_init(&(q->q_fifo[i]));
+    }
+    q->q_dir = q->q_batch = q->q_starved = 0;
+    sched->init(q);
+}
+
+/* bio_queue_init - initialize the queue of a driver, which starts a request by start and polls the device by poll */
+void
+bio_queue_init(struct bio_queue *q, size_t max_nsecs,
+               int (*start)(struct bio_queue *q, struct bio_request *rq), void (*poll)(struct bio_queue *q)) {
+    bio_queue_setup(q, bio_sched, max_nsecs, start, poll);
+}
+
+void
+bio_setup(struct bio *bio, unsigned short dev, uint32_t secno, void *buf, size_t nsecs, bool write) {
+    bio->b_dev = dev, bio->b_write = write, bio->b_secno = secno, bio->b_nsecs = nsecs, bio->b_buf = buf;
+    bio->b_error = 0, bio->b_done = 0, bio->b_end_io = NULL, bio->b_private = NULL, bio->b_next = NULL;
+}
+
+/* bio_sort_add - insert rq into list sorted by position, after the requests of the same position */
+void
+bio_sort_add(list_entry_t *list, struct bio_request *rq) {
+    list_entry_t *le = list;
+    while ((le = list_next(le)) != list) {
+        if (BIO_RQ_POS(le2bioreq(le, rq_sort)) > BIO_RQ_POS(rq)) {
+            break;
+        }
+    }
+    list_add_before(le, &(rq->rq_sort));
+}
+
+/* bio_sort_after - return the first request in the sorted list at or after pos, NULL if there is none */
+struct bio_request *
+bio_sort_after(list_entry_t *list, uint32_t pos) {
+    list_entry_t *le = list;
+    while ((le = list_next(le)) != list) {
+        if (BIO_RQ_POS(le2bioreq(le, rq_sort)) >= pos) {
+            return le2bioreq(le, rq_sort);
+        }
+    }
+    return NULL;
+}
+
+/* bio_merge - append or prepend bio to a queued request of adjacent sectors, return 0 if there is none */
+static bool
+bio_merge(struct bio_queue *q, struct bio *bio) {
+    list_entry_t *list = &(q->q_requests), *le = list;
+    while ((le = list_next(le)) != list) {
+        struct bio_request *rq = le2bioreq(le, rq_link);
+        if (rq->rq_dev != bio->b_dev || rq->rq_write != bio->b_write || rq->rq_nsecs + bio->b_nsecs > q->q_max_nsecs) {
+            continue;
+        }
+        if (rq->rq_secno + rq->rq_nsecs == bio->b_secno) {
+            rq->rq_biotail->b_next = bio, rq->rq_biotail = bio;
+            rq->rq_nsecs += bio->b_nsecs;
+            return 1;
+        }
+        if (bio->b_secno + bio->b_nsecs == rq->rq_secno) {
+            bio->b_next = rq->rq_bio, rq->rq_bio = bio;
+            rq->rq_secno = bio->b_secno, rq->rq_nsecs += bio->b_nsecs;
+            q->q_sched->merged(q, rq);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* bio_complete - complete all bios of the active request of q with error */
+static void
+bio_complete(struct bio_queue *q, int error) {
+    struct bio *bio = q->q_active->rq_bio, *next;
+    q->q_active = NULL;
+    // 请求嵌在它的某个 bio 中，完成回调之后可能已被释放，不能再访问
+    for (; bio != NULL; bio = next) {
+        next = bio->b_next;
+        bio->b_error = error, bio->b_done = 1;
+        if (bio->b_end_io != NULL) {
+            bio->b_end_io(bio);
+        }
+    }
+}
+
+/* bio_dispatch - hand the next request chosen by the scheduler to the driver, if it is idle */
+static void
+bio_dispatch(struct bio_queue *q, uint32_t now) {
+    struct bio_request *rq;
+    int ret;
+    while (q->q_active == NULL && (rq = q->q_sched->next(q, now)) != NULL) {
+        list_del(&(rq->rq_link));
+        q->q_active = rq, q->q_pos = BIO_RQ_POS(rq) + rq->rq_nsecs;
+        if ((ret = q->q_start(q, rq)) != 0) {
+            bio_complete(q, ret);
+        }
+    }
+}
+
+/* bio_queue_add - merge bio into a queued request or queue a new request of it, at tick now */
+static void
+bio_queue_add(struct bio_queue *q, struct bio *bio, uint32_t now) {
+    assert(bio->b_nsecs != 0 && bio->b_nsecs <= q->q_max_nsecs);
+    if (q->q_active != NULL) {
+        iostat.bio_queued ++;
+    }
+    if (bio_merge(q, bio)) {
+        iostat.bio_merged ++;
+    }
+    else {
+        struct bio_request *rq = &(bio->b_rq);
+        rq->rq_dev = bio->b_dev, rq->rq_write = bio->b_write;
+        rq->rq_secno = bio->b_secno, rq->rq_nsecs = bio->b_nsecs;
+        rq->rq_bio = rq->rq_biotail = bio;
+        list_add_before(&(q->q_requests), &(rq->rq_link));
+        q->q_sched->add(q, rq, now);
+    }
+    bio_dispatch(q, now);
+}
+
+/* bio_queue_done - called by the driver when the active request of q completes, with interrupts disabled */
+void
+bio_queue_done(struct bio_queue *q, int error) {
+    bio_complete(q, error);
+    bio_dispatch(q, ticks);
+}
+
+/* bio_submit - queue bio to its device, b_end_io is called when it completes */
+void
+bio_submit(struct bio *bio) {
+    struct bio_queue *q = ide_bio_queue(bio->b_dev);
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    bio_queue_add(q, bio, ticks);
+    local_intr_restore(intr_flag);
+}
+
+static void
+bio_end_wakeup(struct bio *bio) {
+    wait_t *wait = bio->b_private;
+    if (wait != NULL) {
+        wakeup_wait(wait->wait_queue, wait, WT_BIO, 1);
+        bio->b_private = NULL;
+    }
+}
+
+/*
+ * bio_rw - read or write nsecs sectors of device dev starting at secno, and wait until it completes.
+ *          sleep if possible, otherwise poll the driver with interrupts disabled.
+ */
+int
+bio_rw(unsigned short dev, uint32_t secno, void *buf, size_t nsecs, bool write) {
+    struct bio __bio, *bio = &__bio;
+    struct bio_queue *q = ide_bio_queue(dev);
+    bool can_sleep = ((read_eflags() & FL_IF) && current != NULL && current != idleproc);
+    if (nsecs == 0) {
+        return 0;
+    }
+    bio_setup(bio, dev, secno, buf, nsecs, write);
+    bio->b_end_io = bio_end_wakeup;
+
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    bio_queue_add(q, bio, ticks);
+    while (!bio->b_done) {
+        if (can_sleep) {
+            wait_t __wait, *wait = &__wait;
+            wait_current_set(&(q->q_wait_queue), wait, WT_BIO);
+            bio->b_private = wait;
+            local_intr_restore(intr_flag);
+
+            schedule();
+
+            local_intr_save(intr_flag);
+            wait_current_del(&(q->q_wait_queue), wait);
+            bio->b_private = NULL;
+        }
+        else {
+            q->q_poll(q);
+        }
+    }
+    local_intr_restore(intr_flag);
+    return bio->b_error;
+}
+
+/*
+ * 调度器的模拟测试，沿用 related_info/lab8/disksim-homework.py 的磁盘模型：每个磁道 12 块，每块 30 度，
+ * 磁头移动一个磁道用 40 个时间单位（磁道宽度 / 寻道速度），盘片每个时间单位转 1 度，传送一块用 30 个时间单位。
+ * 按 trace 中的到达时间把 bio 交给使用各个调度器的模拟队列，完成一个请求之后再交给它下一个，
+ * 统计每个请求平均移动的磁道数，以及 bio 的平均和最大延迟。
+ */
+#define SIM_TRACK_NBLKS             12
+#define SIM_NTRACKS                 100
+#define SIM_BLK_NSECS               8
+#define SIM_SEEK_TIME               40
+#define SIM_BLK_ANGLE               30
+#define SIM_TICK                    200             // time units per tick, for the deadlines
+#define SIM_NBIOS                   256
+
+static struct bio sim_bios[SIM_NBIOS];
+static uint32_t sim_arrival[SIM_NBIOS];
+static uint32_t sim_now, sim_track, sim_nreqs, sim_seek, sim_ndone, sim_latency, sim_max_latency;
+
+static int
+sim_start(struct bio_queue *q, struct bio_request *rq) {
+    return 0;
+}
+
+static void
+sim_poll(struct bio_queue *q) {
+    panic("the simulated queue is never polled.\n");
+}
+
+static void
+sim_end_io(struct bio *bio) {
+    uint32_t latency = sim_now - sim_arrival[bio - sim_bios];
+    sim_ndone ++, sim_latency += latency;
+    if (sim_max_latency < latency) {
+        sim_max_latency = latency;
+    }
+}
+
+/* sim_service - move the head to rq and transfer it, return the time used */
+static uint32_t
+sim_service(struct bio_request *rq) {
+    uint32_t blkno = rq->rq_secno / SIM_BLK_NSECS, nblks = rq->rq_nsecs / SIM_BLK_NSECS;
+    uint32_t track = blkno / SIM_TRACK_NBLKS, distance = (track > sim_track) ? track - sim_track : sim_track - track;
+    uint32_t time = distance * SIM_SEEK_TIME;
+    // 到达磁道之后等待目标块转到磁头下
+    uint32_t angle = (sim_now + time) % 360, target = (blkno % SIM_TRACK_NBLKS) * SIM_BLK_ANGLE;
+    time += (target + 360 - angle) % 360 + nblks * SIM_BLK_ANGLE;
+    sim_track = (blkno + nblks - 1) / SIM_TRACK_NBLKS;
+    sim_nreqs ++, sim_seek += distance;
+    return time;
+}
+
+/* sim_random - reads of random blocks arriving faster than the disk serves them */
+static void
+sim_random(void) {
+    int i;
+    for (i = 0; i < SIM_NBIOS; i ++) {
+        bio_setup(sim_bios + i, 0, (rand() % (SIM_NTRACKS * SIM_TRACK_NBLKS)) * SIM_BLK_NSECS, NULL, SIM_BLK_NSECS, 0);
+        sim_arrival[i] = i * 60;
+    }
+}
+
+/* sim_mixed - a sequential writer of adjacent blocks, mixed with reads of random blocks */
+static void
+sim_mixed(void) {
+    int i;
+    for (i = 0; i < SIM_NBIOS; i ++) {
+        if (i % 2 == 0) {
+            bio_setup(sim_bios + i, 0, (SIM_NTRACKS * SIM_TRACK_NBLKS / 2 + i / 2) * SIM_BLK_NSECS, NULL, SIM_BLK_NSECS, 1);
+        }
+        else {
+            bio_setup(sim_bios + i, 0, (rand() % (SIM_NTRACKS * SIM_TRACK_NBLKS)) * SIM_BLK_NSECS, NULL, SIM_BLK_NSECS, 0);
+        }
+        sim_arrival[i] = i * 40;
+    }
+}
+
+static void
+sim_run(struct iosched *sched, const char *name, void (*trace)(void)) {
+    struct bio_queue __q, *q = &__q;
+    int i;
+    srand(1);
+    trace();
+    for (i = 0; i < SIM_NBIOS; i ++) {
+        sim_bios[i].b_end_io = sim_end_io;
+    }
+    bio_queue_setup(q, sched, 32 * SIM_BLK_NSECS, sim_start, sim_poll);
+    sim_now = sim_track = sim_nreqs = sim_seek = sim_ndone = sim_latency = sim_max_latency = 0;
+    for (i = 0; sim_ndone < SIM_NBIOS; ) {
+        // 磁盘空闲时等到下一个 bio 到达，它立即交给驱动
+        if (q->q_active == NULL) {
+            assert(i < SIM_NBIOS);
+            sim_now = sim_arrival[i];
+            bio_queue_add(q, sim_bios + i ++, sim_now / SIM_TICK);
+            continue;
+        }
+        sim_now += sim_service(q->q_active);
+        // 请求执行期间到达的 bio 进入队列，可能和排队的请求合并
+        for (; i < SIM_NBIOS && sim_arrival[i] <= sim_now; i ++) {
+            bio_queue_add(q, sim_bios + i, sim_arrival[i] / SIM_TICK);
+        }
+        bio_complete(q, 0);
+        bio_dispatch(q, sim_now / SIM_TICK);
+    }
+    assert(q->q_active == NULL && list_empty(&(q->q_requests)));
+    for (i = 0; i < SIM_NBIOS; i ++) {
+        assert(sim_bios[i].b_done && sim_bios[i].b_error == 0);
+    }
+    cprintf("  %-8s %-6s: %3d bios in %3d requests, seek %2d.%02d tracks/request, latency avg %6d, max %6d\n",
+            sched->name, name, SIM_NBIOS, sim_nreqs, sim_seek / sim_nreqs, sim_seek * 100 / sim_nreqs % 100,
+            sim_latency / SIM_NBIOS, sim_max_latency);
+}
+
+static void
+check_bio_sched(void) {
+    static struct iosched *scheds[] = {&iosched_noop, &iosched_deadline, &iosched_cscan};
+    struct iostat before = iostat;
+    int i;
+    cprintf("bio sched: %d tracks of %d blocks, seek %d per track, %d per block\n",
+            SIM_NTRACKS, SIM_TRACK_NBLKS, SIM_SEEK_TIME, SIM_BLK_ANGLE);
+    for (i = 0; i < sizeof(scheds) / sizeof(scheds[0]); i ++) {
+        sim_run(scheds[i], "random", sim_random);
+        sim_run(scheds[i], "mixed", sim_mixed);
+    }
+    // 测试不计入系统的统计信息
+    iostat = before;
+    cprintf("check_bio_sched() succeeded!\n");
+}
+
+void
+bio_init(void) {
+    cprintf("bio: I/O scheduler %s\n", bio_sched->name);
+    check_bio_sched();
+}
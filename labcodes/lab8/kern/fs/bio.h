@@ -0,0 +1,106 @@
+#ifndef __KERN_FS_BIO_H__
+#define __KERN_FS_BIO_H__
+
+#include <defs.h>
+#include <list.h>
+#include <wait.h>
+
+/*
+ * 块 IO 请求层：dev_disk0 和 swapfs 把读写扇区的请求（bio）交给设备所在的队列（bio_queue），
+ * 队列把相邻扇区的 bio 合并成一个请求（bio_request），由可替换的 IO 调度器（iosched）决定下一个交给驱动的请求，
+ * 请求完成时依次调用其中每个 bio 的完成回调。
+ */
+
+struct bio;
+struct bio_queue;
+
+typedef void (*bio_end_io_t)(struct bio *bio);
+
+/*
+ * a request to the driver: one or more bios of contiguous sectors in the same direction.
+ * the request embedded in the first bio is used, those of the bios merged into it are not.
+ */
+struct bio_request {
+    unsigned short rq_dev;              // the device
+    bool rq_write;                      // write or read
+    uint32_t rq_secno;                  // the first sector
+    size_t rq_nsecs;                    // # of sectors
+    struct bio *rq_bio;                 // the first bio, the others follow by b_next in the order of sectors
+    struct bio *rq_biotail;             // the last bio
+    uint32_t rq_deadline;               // the tick by which the request should be dispatched, for deadline
+    list_entry_t rq_link;               // entry in q_requests, all requests waiting to be dispatched
+    list_entry_t rq_sort;               // entry in a list of the scheduler
+    list_entry_t rq_fifo;               // entry in another list of the scheduler
+};
+
+#define le2bioreq(le, member)                   \
+    to_struct((le), struct bio_request, member)
+
+struct bio {
+    unsigned short b_dev;               // the device
+    bool b_write;                       // write or read
+    uint32_t b_secno;                   // the first sector
+    size_t b_nsecs;                     // # of sectors
+    void *b_buf;                        // kernel virtual address of the buffer
+    int b_error;                        // the result, valid if b_done
+    bool b_done;                        // the bio is completed
+    bio_end_io_t b_end_io;              // called on completion with interrupts disabled, maybe in an interrupt handler
+    void *b_private;                    // for b_end_io
+    struct bio *b_next;                 // the next bio of the same request
+    struct bio_request b_rq;            // the request if the bio is not merged into another one
+};
+
+/* requests of a queue are ordered by position: a queue serves two devices with 28-bit sector numbers */
+#define BIO_POS(dev, secno)             ((((uint32_t)(dev) & 1) << 28) | (secno))
+#define BIO_RQ_POS(rq)                  BIO_POS((rq)->rq_dev, (rq)->rq_secno)
+
+/* the scheduler of a queue, which keeps the requests not dispatched yet in its own lists */
+struct iosched {
+    const char *name;
+    // 初始化队列中调度器使用的部分
+    void (*init)(struct bio_queue *q);
+    // 加入一个新的请求，now 为当前的 tick
+    void (*add)(struct bio_queue *q, struct bio_request *rq, uint32_t now);
+    // 请求的第一个扇区因合并而前移
+    void (*merged)(struct bio_queue *q, struct bio_request *rq);
+    // 取出下一个要交给驱动的请求，没有请求时返回 NULL
+    struct bio_request *(*next)(struct bio_queue *q, uint32_t now);
+};
+
+/* the queue of a driver which executes one request at a time */
+struct bio_queue {
+    struct iosched *q_sched;            // the scheduler
+    list_entry_t q_requests;            // requests not dispatched yet, for merging
+    struct bio_request *q_active;       // the request being executed by the driver
+    uint32_t q_pos;                     // position after the last dispatched request, where the head is
+    size_t q_max_nsecs;                 // max # of sectors of a request
+    wait_queue_t q_wait_queue;          // submitters sleeping for their bios
+    // 启动请求，返回非 0 表示请求立即失败
+    int (*q_start)(struct bio_queue *q, struct bio_request *rq);
+    // 关中断时轮询驱动，推进正在执行的请求
+    void (*q_poll)(struct bio_queue *q);
+    // for the schedulers
+    list_entry_t q_sort[2];             // sorted lists, or fifo lists
+    list_entry_t q_fifo[2];             // fifo lists of reads and writes
+    int q_dir;                          // direction of the current batch
+    int q_batch;                        // # of requests dispatched in the current batch
+    int q_starved;                      // # of times writes lost to reads
+};
+
+extern struct iosched iosched_noop;
+extern struct iosched iosched_deadline;
+extern struct iosched iosched_cscan;
+
+void bio_init(void);
+void bio_queue_init(struct bio_queue *q, size_t max_nsecs,
+                    int (*start)(struct bio_queue *q, struct bio_request *rq), void (*poll)(struct bio_queue *q));
+void bio_queue_done(struct bio_queue *q, int error);
+
+void bio_setup(struct bio *bio, unsigned short dev, uint32_t secno, void *buf, size_t nsecs, bool write);
+void bio_submit(struct bio *bio);
+int bio_rw(unsigned short dev, uint32_t secno, void *buf, size_t nsecs, bool write);
+
+void bio_sort_add(list_entry_t *list, struct bio_request *rq);
+struct bio_request *bio_sort_after(list_entry_t *list, uint32_t pos);
+
+#endif /* !__KERN_FS_BIO_H__ */
@@ -1,31 +1,19 @@
 #include <defs.h>
 #include <mmu.h>
-#include <sem.h>
 #include <ide.h>
+#include <bio.h>
+#include <fs.h>
 #include <inode.h>
-#include <kmalloc.h>
 #include <dev.h>
+#include <kmalloc.h>
 #include <vfs.h>
 #include <iobuf.h>
 #include <error.h>
 #include <assert.h>
 
 #define DISK0_BLKSIZE                   PGSIZE
-#define DISK0_BUFSIZE                   (4 * DISK0_BLKSIZE)
 #define DISK0_BLK_NSECT                 (DISK0_BLKSIZE / SECTSIZE)
-
-static char *disk0_buffer;
-static semaphore_t disk0_sem;
-
-static void
-lock_disk0(void) {
-    down(&(disk0_sem));
-}
-
-static void
-unlock_disk0(void) {
-    up(&(disk0_sem));
-}
+#define DISK0_MAX_NBLKS                 (MAX_NSECS / DISK0_BLK_NSECT)
 
 static int
 disk0_open(struct device *dev, uint32_t open_flags) {
@@ -38,31 +26,29 @@ disk0_close(struct device *dev) {
 }
 
 static void
-disk0_read_blks_nolock(uint32_t blkno, uint32_t nblks) {
+disk0_rw_secs(uint32_t secno, void *buf, size_t nsecs, bool write) {
     int ret;
-    uint32_t sectno = blkno * DISK0_BLK_NSECT, nsecs = nblks * DISK0_BLK_NSECT;
-    if ((ret = ide_read_secs(DISK0_DEV_NO, sectno, disk0_buffer, nsecs)) != 0) {
-        panic("disk0: read blkno = %d (sectno = %d), nblks = %d (nsecs = %d): 0x%08x.\n",
-                blkno, sectno, nblks, nsecs, ret);
-    }
-}
-
-static void
-disk0_write_blks_nolock(uint32_t blkno, uint32_t nblks) {
-    int ret;
-    uint32_t sectno = blkno * DISK0_BLK_NSECT, nsecs = nblks * DISK0_BLK_NSECT;
-    if ((ret = ide_write_secs(DISK0_DEV_NO, sectno, disk0_buffer, nsecs)) != 0) {
-        panic("disk0: write blkno = %d (sectno = %d), nblks = %d (nsecs = %d): 0x%08x.\n",
-                blkno, sectno, nblks, nsecs, ret);
+    if ((ret = bio_rw(DISK0_DEV_NO, secno, buf, nsecs, write)) != 0) {
+        panic("disk0: %s sectno = %d, nsecs = %d: 0x%08x.\n", write ? "write" : "read", secno, nsecs, ret);
     }
 }
 
+/*
+ * disk0_io - transfer the blocks between disk0 and the buffer of iob directly,
+ *            up to DISK0_MAX_NBLKS blocks per IDE command.
+ *            a user buffer is transferred page by page through the kernel addresses of its pinned pages;
+ *            if it is not aligned to sectors, the whole sectors in each page are transferred directly and
+ *            only the sector crossing the page boundary goes through a bounce sector.
+ *            the bio layer queues, merges and orders the requests of concurrent callers, no lock is needed here.
+ */
 static int
 disk0_io(struct device *dev, struct iobuf *iob, bool write) {
     off_t offset = iob->io_offset;
-    size_t resid = iob->io_resid;
+    size_t resid = iob->io_resid, len;
     uint32_t blkno = offset / DISK0_BLKSIZE;
     uint32_t nblks = resid / DISK0_BLKSIZE;
+    uint32_t secno = blkno * DISK0_BLK_NSECT;
+    void *bounce = NULL;
 
     /* don't allow I/O that isn't block-aligned */
     if ((offset % DISK0_BLKSIZE) != 0 || (resid % DISK0_BLKSIZE) != 0) {
@@ -79,27 +65,39 @@ disk0_io(struct device *dev, struct iobuf *iob, bool write) {
         return 0;
     }
 
-    lock_disk0();
     while (resid != 0) {
-        size_t copied, alen = DISK0_BUFSIZE;
-        if (write) {
-            iobuf_move(iob, disk0_buffer, alen, 0, &copied);
-            assert(copied != 0 && copied <= resid && copied % DISK0_BLKSIZE == 0);
-            nblks = copied / DISK0_BLKSIZE;
-            disk0_write_blks_nolock(blkno, nblks);
-        }
-        else {
-            if (alen > resid) {
-                alen = resid;
+        void *buf = iobuf_kva(iob, &len);
+        if (len < SECTSIZE) {
+            if (bounce == NULL && (bounce = kmalloc(SECTSIZE)) == NULL) {
+                return -E_NO_MEM;
             }
-            nblks = alen / DISK0_BLKSIZE;
-            disk0_read_blks_nolock(blkno, nblks);
-            iobuf_move(iob, disk0_buffer, alen, 1, &copied);
-            assert(copied == alen && copied % DISK0_BLKSIZE == 0);
+            if (!write) {
+                disk0_rw_secs(secno, bounce, 1, 0);
+            }
+            iobuf_move(iob, bounce, SECTSIZE, !write, NULL);
+            if (write) {
+                disk0_rw_secs(secno, bounce, 1, 1);
+            }
+            resid -= SECTSIZE, secno ++;
+            continue;
+        }
+        if (len > DISK0_MAX_NBLKS * DISK0_BLKSIZE) {
+            len = DISK0_MAX_NBLKS * DISK0_BLKSIZE;
         }
-        resid -= copied, blkno += nblks;
+        len = ROUNDDOWN(len, SECTSIZE);
+        disk0_rw_secs(secno, buf, len / SECTSIZE, write);
+        iobuf_skip(iob, len);
+        resid -= len, secno += len / SECTSIZE;
+    }
+    if (bounce != NULL) {
+        kfree(bounce);
+    }
+    if (write) {
+        iostat.disk_write += nblks;
+    }
+    else {
+        iostat.disk_read += nblks;
     }
-    unlock_disk0();
     return 0;
 }
 
@@ -110,7 +108,7 @@ disk0_ioctl(struct device *dev, int op, void *data) {
 
 static void
 disk0_device_init(struct device *dev) {
-    static_assert(DISK0_BLKSIZE % SECTSIZE == 0);
+    static_assert(DISK0_BLKSIZE % SECTSIZE == 0 && DISK0_MAX_NBLKS > 0);
     if (!ide_device_valid(DISK0_DEV_NO)) {
         panic("disk0 device isn't available.\n");
     }
@@ -120,12 +118,6 @@ disk0_device_init(struct device *dev) {
     dev->d_close = disk0_close;
     dev->d_io = disk0_io;
     dev->d_ioctl = disk0_ioctl;
-    sem_init(&(disk0_sem), 1);
-
-    static_assert(DISK0_BUFSIZE % DISK0_BLKSIZE == 0);
-    if ((disk0_buffer = kmalloc(DISK0_BUFSIZE)) == NULL) {
-        panic("disk0 alloc buffer failed.\n");
-    }
 }
 
 void
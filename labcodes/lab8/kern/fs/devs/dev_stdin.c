@@ -83,9 +83,16 @@ stdin_close(struct device *dev) {
 static int
 stdin_io(struct device *dev, struct iobuf *iob, bool write) {
     if (!write) {
-        int ret;
-        if ((ret = dev_stdin_read(iob->io_base, iob->io_resid)) > 0) {
-            iob->io_resid -= ret;
+        int ret = 0;
+        size_t len;
+        while (iob->io_resid != 0) {
+            char *buf = iobuf_kva(iob, &len);
+            if ((ret = dev_stdin_read(buf, len)) > 0) {
+                iobuf_skip(iob, ret);
+            }
+            if (ret != len) {
+                break;
+            }
         }
         return ret;
     }
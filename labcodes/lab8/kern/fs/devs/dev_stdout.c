@@ -24,9 +24,13 @@ stdout_close(struct device *dev) {
 static int
 stdout_io(struct device *dev, struct iobuf *iob, bool write) {
     if (write) {
-        char *data = iob->io_base;
-        for (; iob->io_resid != 0; iob->io_resid --) {
-            cputchar(*data ++);
+        size_t len, i;
+        while (iob->io_resid != 0) {
+            char *data = iobuf_kva(iob, &len);
+            for (i = 0; i < len; i ++) {
+                cputchar(data[i]);
+            }
+            iobuf_skip(iob, len);
         }
         return 0;
     }
@@ -8,6 +8,7 @@
 #include <inode.h>
 #include <stat.h>
 #include <dirent.h>
+#include <pipe.h>
 #include <error.h>
 #include <assert.h>
 
@@ -114,6 +115,7 @@ fd_array_dup(struct file *to, struct file *from) {
     //cprintf("[fd_array_dup]from fd=%d, to fd=%d\n",from->fd, to->fd);
     assert(to->status == FD_INIT && from->status == FD_OPENED);
     to->pos = from->pos;
+    filemap_ra_init(&(to->ra));
     to->readable = from->readable;
     to->writable = from->writable;
     struct inode *node = from->node;
@@ -190,6 +192,7 @@ file_open(char *path, uint32_t open_flags) {
     }
 
     file->node = node;
+    filemap_ra_init(&(file->ra));
     file->readable = readable;
     file->writable = writable;
     fd_array_open(file);
@@ -208,9 +211,9 @@ file_close(int fd) {
     return 0;
 }
 
-// read file
+// read file, pages are the pinned pages of the user buffer base, NULL if base is a kernel buffer
 int
-file_read(int fd, void *base, size_t len, size_t *copied_store) {
+file_read(int fd, void *base, size_t len, struct Page **pages, size_t *copied_store) {
     int ret;
     struct file *file;
     *copied_store = 0;
@@ -222,11 +225,13 @@ file_read(int fd, void *base, size_t len, size_t *copied_store) {
     }
     fd_array_acquire(file);
 
-    struct iobuf __iob, *iob = iobuf_init(&__iob, base, len, file->pos);
+    struct iobuf __iob, *iob = (pages != NULL) ? iobuf_init_user(&__iob, base, len, file->pos, pages)
+                                               : iobuf_init(&__iob, base, len, file->pos);
     ret = vop_read(file->node, iob);
 
     size_t copied = iobuf_used(iob);
     if (file->status == FD_OPENED) {
+        filemap_ra_update(&(file->ra), file->node, file->pos, copied);
         file->pos += copied;
     }
     *copied_store = copied;
@@ -234,9 +239,9 @@ file_read(int fd, void *base, size_t len, size_t *copied_store) {
     return ret;
 }
 
-// write file
+// write file, pages are the pinned pages of the user buffer base, NULL if base is a kernel buffer
 int
-file_write(int fd, void *base, size_t len, size_t *copied_store) {
+file_write(int fd, void *base, size_t len, struct Page **pages, size_t *copied_store) {
     int ret;
     struct file *file;
     *copied_store = 0;
@@ -248,7 +253,8 @@ file_write(int fd, void *base, size_t len, size_t *copied_store) {
     }
     fd_array_acquire(file);
 
-    struct iobuf __iob, *iob = iobuf_init(&__iob, base, len, file->pos);
+    struct iobuf __iob, *iob = (pages != NULL) ? iobuf_init_user(&__iob, base, len, file->pos, pages)
+                                               : iobuf_init(&__iob, base, len, file->pos);
     ret = vop_write(file->node, iob);
 
     size_t copied = iobuf_used(iob);
@@ -353,4 +359,63 @@ file_dup(int fd1, int fd2) {
     return file2->fd;
 }
 
+// create a pipe, fd[0] for reading and fd[1] for writing
+int
+file_pipe(int fd[]) {
+    int ret;
+    struct file *rfile, *wfile;
+    if ((ret = fd_array_alloc(NO_FD, &rfile)) != 0) {
+        return ret;
+    }
+    if ((ret = fd_array_alloc(NO_FD, &wfile)) != 0) {
+        goto failed_cleanup_rfile;
+    }
+
+    struct inode *rnode, *wnode;
+    if ((ret = pipe_create(&rnode, &wnode)) != 0) {
+        goto failed_cleanup_wfile;
+    }
+    vop_open_inc(rnode), vop_open_inc(wnode);
+
+    rfile->pos = wfile->pos = 0;
+    rfile->node = rnode, wfile->node = wnode;
+    filemap_ra_init(&(rfile->ra));
+    filemap_ra_init(&(wfile->ra));
+    rfile->readable = 1, rfile->writable = 0;
+    wfile->readable = 0, wfile->writable = 1;
+    fd_array_open(rfile);
+    fd_array_open(wfile);
+    fd[0] = rfile->fd, fd[1] = wfile->fd;
+    return 0;
+
+failed_cleanup_wfile:
+    fd_array_free(wfile);
+failed_cleanup_rfile:
+    fd_array_free(rfile);
+    return ret;
+}
+
+// open the FIFO named name, O_RDONLY for its read end or O_WRONLY for its write end
+int
+file_mkfifo(const char *name, uint32_t open_flags) {
+    int ret;
+    struct file *file;
+    if ((ret = fd_array_alloc(NO_FD, &file)) != 0) {
+        return ret;
+    }
+
+    struct inode *node;
+    if ((ret = pipe_fifo_open(name, open_flags, &node)) != 0) {
+        fd_array_free(file);
+        return ret;
+    }
+    vop_open_inc(node);
 
+    file->pos = 0;
+    file->node = node;
+    filemap_ra_init(&(file->ra));
+    file->readable = ((open_flags & O_ACCMODE) == O_RDONLY);
+    file->writable = !file->readable;
+    fd_array_open(file);
+    return file->fd;
+}
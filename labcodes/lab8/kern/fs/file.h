@@ -3,6 +3,7 @@
 
 //#include <types.h>
 #include <fs.h>
+#include <filemap.h>
 #include <proc.h>
 #include <atomic.h>
 #include <assert.h>
@@ -10,6 +11,7 @@
 struct inode;
 struct stat;
 struct dirent;
+struct Page;
 
 struct file {
     enum {
@@ -21,6 +23,7 @@ struct file {
     off_t pos;
     struct inode *node;
     int open_count;
+    struct file_ra ra;      // sequential read detection and readahead window
 };
 
 void fd_array_init(struct file *fd_array);
@@ -31,8 +34,8 @@ bool file_testfd(int fd, bool readable, bool writable);
 
 int file_open(char *path, uint32_t open_flags);
 int file_close(int fd);
-int file_read(int fd, void *base, size_t len, size_t *copied_store);
-int file_write(int fd, void *base, size_t len, size_t *copied_store);
+int file_read(int fd, void *base, size_t len, struct Page **pages, size_t *copied_store);
+int file_write(int fd, void *base, size_t len, struct Page **pages, size_t *copied_store);
 int file_seek(int fd, off_t pos, int whence);
 int file_fstat(int fd, struct stat *stat);
 int file_fsync(int fd);
@@ -0,0 +1,197 @@
+#include <defs.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <list.h>
+#include <sync.h>
+#include <pmm.h>
+#include <proc.h>
+#include <sched.h>
+#include <fs.h>
+#include <inode.h>
+#include <filemap.h>
+#include <assert.h>
+
+/*
+ * 文件页缓存（page cache）：以 (设备, inode 号, 文件块号) 为键缓存文件数据块的 struct Page，
+ * 以 inode 号而不是内存中的 struct inode 为键，inode 被回收后再次打开时缓存仍然有效。
+ *   - 页面通过 page_link 链入哈希表，通过 pra_page_link 链入全局 LRU 链表（页缓存中的页面不会映射到用户空间）；
+ *   - 页面中的内容总是和块设备（包括块缓存）中的一致：写文件时同时更新块缓存和页缓存，
+ *     因此页缓存中没有脏页，内存不足时 filemap_reclaim 可以直接释放 LRU 链表尾部的页面；
+ *   - 调用者只在不会分配内存、不会睡眠的代码段中使用查找到的页面，因此页面不需要引用计数。
+ *
+ * 顺序读时由 kreadahead 线程在后台把后续的块读入页缓存（预读），
+ * 读者进入当前预读窗口时提交下一个窗口，窗口从 FILEMAP_RA_MIN 个块开始每次翻倍，最大 FILEMAP_RA_MAX 个块。
+ */
+
+#define FILEMAP_HASH_SHIFT              10
+#define FILEMAP_HASH_SIZE               (1 << FILEMAP_HASH_SHIFT)
+#define filemap_hashfn(dev, ino, index) (hash32((uintptr_t)(dev) ^ ((ino) << 12) ^ (index), FILEMAP_HASH_SHIFT))
+
+#define RA_QUEUE_SIZE                   16
+
+static list_entry_t filemap_hash[FILEMAP_HASH_SIZE];
+static list_entry_t filemap_lru;
+
+// 预读请求队列，请求持有 inode 的引用直到 kreadahead 处理完
+static struct ra_request {
+    struct inode *node;
+    uint32_t index, nblks;
+} ra_queue[RA_QUEUE_SIZE];
+static int ra_head, ra_count;
+
+struct proc_struct *readahead_proc = NULL;
+
+struct Page *
+filemap_lookup(struct device *dev, uint32_t ino, uint32_t index) {
+    list_entry_t *list = filemap_hash + filemap_hashfn(dev, ino, index), *le = list;
+    while ((le = list_next(le)) != list) {
+        struct Page *page = le2page(le, page_link);
+        if (page->fm_dev == dev && page->fm_ino == ino && page->fm_index == index) {
+            list_del(&(page->pra_page_link));
+            list_add(&filemap_lru, &(page->pra_page_link));
+            return page;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * filemap_add - insert a page filled with the content of block index of file (dev, ino)
+ */
+void
+filemap_add(struct device *dev, uint32_t ino, uint32_t index, struct Page *page) {
+    assert(page->fm_dev == NULL && page_ref(page) == 0);
+    page->fm_dev = dev, page->fm_ino = ino, page->fm_index = index;
+    list_add(filemap_hash + filemap_hashfn(dev, ino, index), &(page->page_link));
+    list_add(&filemap_lru, &(page->pra_page_link));
+}
+
+static void
+filemap_del(struct Page *page) {
+    assert(page->fm_dev != NULL);
+    list_del(&(page->page_link));
+    list_del_init(&(page->pra_page_link));
+    page->fm_dev = NULL;
+    free_page(page);
+}
+
+/*
+ * filemap_truncate - drop the cached pages of file (dev, ino) from block index on
+ */
+void
+filemap_truncate(struct device *dev, uint32_t ino, uint32_t index) {
+    list_entry_t *le = list_next(&filemap_lru);
+    while (le != &filemap_lru) {
+        struct Page *page = le2page(le, pra_page_link);
+        le = list_next(le);
+        if (page->fm_dev == dev && page->fm_ino == ino && page->fm_index >= index) {
+            filemap_del(page);
+        }
+    }
+}
+
+/*
+ * filemap_reclaim - free up to n least recently used pages, called by alloc_pages and kswapd
+ */
+size_t
+filemap_reclaim(size_t n) {
+    size_t reclaimed = 0;
+    while (reclaimed < n && !list_empty(&filemap_lru)) {
+        filemap_del(le2page(list_prev(&filemap_lru), pra_page_link));
+        reclaimed ++;
+    }
+    return reclaimed;
+}
+
+/*
+ * filemap_readahead - queue a request to read [index, index + nblks) of node in the background
+ */
+static void
+filemap_readahead(struct inode *node, uint32_t index, uint32_t nblks) {
+    if (readahead_proc == NULL || node->in_ops->vop_readahead == NULL || ra_count == RA_QUEUE_SIZE) {
+        return;
+    }
+    struct ra_request *req = ra_queue + (ra_head + ra_count) % RA_QUEUE_SIZE;
+    vop_ref_inc(node);
+    req->node = node, req->index = index, req->nblks = nblks;
+    ra_count ++;
+    if (readahead_proc->wait_state == WT_READAHEAD) {
+        wakeup_proc(readahead_proc);
+    }
+}
+
+void
+filemap_ra_init(struct file_ra *ra) {
+    ra->ra_next = ra->ra_start = ra->ra_size = 0;
+}
+
+/*
+ * filemap_ra_update - called after [pos, pos + len) of node is read through the file owning ra.
+ *                     a read starting in the block where the last one ended or the next one is sequential.
+ */
+void
+filemap_ra_update(struct file_ra *ra, struct inode *node, off_t pos, size_t len) {
+    if (len == 0) {
+        return;
+    }
+    uint32_t first = pos / PGSIZE, last = (pos + len - 1) / PGSIZE;
+    bool sequential = (first == ra->ra_next || first + 1 == ra->ra_next);
+    ra->ra_next = last + 1;
+    if (!sequential) {
+        ra->ra_size = 0;
+        return;
+    }
+    if (ra->ra_size == 0) {
+        ra->ra_start = last + 1, ra->ra_size = FILEMAP_RA_MIN;
+    }
+    else if (last >= ra->ra_start) {
+        // 读者进入了当前窗口，提交下一个窗口
+        uint32_t start = ra->ra_start + ra->ra_size;
+        ra->ra_start = (start > last) ? start : last + 1;
+        if ((ra->ra_size *= 2) > FILEMAP_RA_MAX) {
+            ra->ra_size = FILEMAP_RA_MAX;
+        }
+    }
+    else {
+        return;
+    }
+    filemap_readahead(node, ra->ra_start, ra->ra_size);
+}
+
+static int
+readahead_main(void *arg) {
+    while (1) {
+        while (ra_count != 0) {
+            struct ra_request req = ra_queue[ra_head];
+            ra_head = (ra_head + 1) % RA_QUEUE_SIZE, ra_count --;
+            vop_readahead(req.node, req.index, req.nblks);
+            vop_ref_dec(req.node);
+        }
+        bool intr_flag;
+        local_intr_save(intr_flag);
+        {
+            current->state = PROC_SLEEPING;
+            current->wait_state = WT_READAHEAD;
+        }
+        local_intr_restore(intr_flag);
+        schedule();
+    }
+    return 0;
+}
+
+void
+filemap_init(void) {
+    int i;
+    for (i = 0; i < FILEMAP_HASH_SIZE; i ++) {
+        list_init(filemap_hash + i);
+    }
+    list_init(&filemap_lru);
+    ra_head = ra_count = 0;
+
+    int pid = kernel_thread(readahead_main, NULL, 0);
+    if (pid <= 0 || (readahead_proc = find_proc(pid)) == NULL) {
+        panic("create kreadahead failed.\n");
+    }
+    set_proc_name(readahead_proc, "kreadahead");
+}
+
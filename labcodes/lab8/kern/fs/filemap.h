@@ -0,0 +1,36 @@
+#ifndef __KERN_FS_FILEMAP_H__
+#define __KERN_FS_FILEMAP_H__
+
+#include <defs.h>
+
+struct Page;
+struct device;
+struct inode;
+struct proc_struct;
+
+#define FILEMAP_RA_MIN                              4       /* initial readahead window in blocks */
+#define FILEMAP_RA_MAX                              32      /* max readahead window in blocks */
+
+/*
+ * 每个打开的文件（struct file）的顺序读检测和预读窗口
+ */
+struct file_ra {
+    uint32_t ra_next;                               /* block a sequential read would start at */
+    uint32_t ra_start;                              /* first block of the current readahead window */
+    uint32_t ra_size;                               /* # of blocks in the window, 0 if not sequential */
+};
+
+extern struct proc_struct *readahead_proc;
+
+void filemap_init(void);
+
+struct Page *filemap_lookup(struct device *dev, uint32_t ino, uint32_t index);
+void filemap_add(struct device *dev, uint32_t ino, uint32_t index, struct Page *page);
+void filemap_truncate(struct device *dev, uint32_t ino, uint32_t index);
+size_t filemap_reclaim(size_t n);
+
+void filemap_ra_init(struct file_ra *ra);
+void filemap_ra_update(struct file_ra *ra, struct inode *node, off_t pos, size_t len);
+
+#endif /* !__KERN_FS_FILEMAP_H__ */
+
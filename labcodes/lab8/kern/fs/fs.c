@@ -6,13 +6,23 @@
 #include <file.h>
 #include <sfs.h>
 #include <inode.h>
+#include <bcache.h>
+#include <filemap.h>
+#include <pipe.h>
 #include <assert.h>
+
+// 文件系统与块设备 IO 的事件计数器，可通过 SYS_iostat 读取
+struct iostat iostat;
+
 //called when init_main proc start
 void
 fs_init(void) {
     vfs_init();
+    bcache_init();
+    filemap_init();
     dev_init();
     sfs_init();
+    pipe_init();
 }
 
 void
@@ -29,13 +39,24 @@ void
 unlock_files(struct files_struct *filesp) {
     up(&(filesp->files_sem));
 }
+// slab cache of files_struct, each object holds the fd_array behind the header
+static struct kmem_cache *files_cachep;
+
+//Called by proc_init before the first files_create
+void
+files_init(void) {
+    if ((files_cachep = kmem_cache_create("files_struct", sizeof(struct files_struct) + FILES_STRUCT_BUFSIZE)) == NULL) {
+        panic("cannot create files_struct cache.\n");
+    }
+}
+
 //Called when a new proc init
 struct files_struct *
 files_create(void) {
     //cprintf("[files_create]\n");
     static_assert((int)FILES_STRUCT_NENTRY > 128);
     struct files_struct *filesp;
-    if ((filesp = kmalloc(sizeof(struct files_struct) + FILES_STRUCT_BUFSIZE)) != NULL) {
+    if ((filesp = kmem_cache_alloc(files_cachep)) != NULL) {
         filesp->pwd = NULL;
         filesp->fd_array = (void *)(filesp + 1);
         filesp->files_count = 0;
@@ -60,7 +81,7 @@ files_destroy(struct files_struct *filesp) {
         }
         assert(file->status == FD_NONE);
     }
-    kfree(filesp);
+    kmem_cache_free(files_cachep, filesp);
 }
 
 void
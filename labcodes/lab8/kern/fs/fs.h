@@ -5,6 +5,7 @@
 #include <mmu.h>
 #include <sem.h>
 #include <atomic.h>
+#include <iostat.h>
 
 #define SECTSIZE            512
 #define PAGE_NSECT          (PGSIZE / SECTSIZE)
@@ -16,6 +17,8 @@
 void fs_init(void);
 void fs_cleanup(void);
 
+extern struct iostat iostat;
+
 struct inode;
 struct file;
 
@@ -29,12 +32,14 @@ struct files_struct {
     semaphore_t files_sem;  // lock protect sem
 };
 
-#define FILES_STRUCT_BUFSIZE                       (PGSIZE - sizeof(struct files_struct))
+// files_struct and its fd_array share one slab object of two pages
+#define FILES_STRUCT_BUFSIZE                       (2 * PGSIZE - sizeof(struct files_struct))
 #define FILES_STRUCT_NENTRY                        (FILES_STRUCT_BUFSIZE / sizeof(struct file))
 
 void lock_files(struct files_struct *filesp);
 void unlock_files(struct files_struct *filesp);
 
+void files_init(void);
 struct files_struct *files_create(void);
 void files_destroy(struct files_struct *filesp);
 void files_closeall(struct files_struct *filesp);
@@ -1,6 +1,8 @@
 #include <defs.h>
 #include <string.h>
+#include <pmm.h>
 #include <iobuf.h>
+#include <fs.h>
 #include <error.h>
 #include <assert.h>
 
@@ -15,31 +17,67 @@ iobuf_init(struct iobuf *iob, void *base, size_t len, off_t offset) {
     iob->io_base = base;
     iob->io_offset = offset;
     iob->io_len = iob->io_resid = len;
+    iob->io_pages = NULL, iob->io_pgbase = 0;
     return iob;
 }
 
+/*
+ * iobuf_init_user - init io buffer struct for the user buffer [base, base + len), whose pages are pinned in pages
+ */
+struct iobuf *
+iobuf_init_user(struct iobuf *iob, void *base, size_t len, off_t offset, struct Page **pages) {
+    iobuf_init(iob, base, len, offset);
+    iob->io_pages = pages, iob->io_pgbase = ROUNDDOWN((uintptr_t)base, PGSIZE);
+    return iob;
+}
+
+/*
+ * iobuf_kva - return the kernel address of the current position of io buffer,
+ *             *lenp gets the # of contiguous bytes from there: all of io_resid for a kernel buffer,
+ *             up to the end of the page for a user buffer.
+ */
+void *
+iobuf_kva(struct iobuf *iob, size_t *lenp) {
+    *lenp = iob->io_resid;
+    if (iob->io_pages == NULL) {
+        return iob->io_base;
+    }
+    uintptr_t addr = (uintptr_t)iob->io_base;
+    size_t off = addr % PGSIZE;
+    if (*lenp > PGSIZE - off) {
+        *lenp = PGSIZE - off;
+    }
+    return page2kva(iob->io_pages[(addr - iob->io_pgbase) / PGSIZE]) + off;
+}
+
 /* iobuf_move - move data  (iob->io_base ---> data OR  data --> iob->io.base) in memory
  * @copiedp:  the size of data memcopied
  *
  * iobuf_move may be called repeatedly on the same io to transfer
  * additional data until the available buffer space the io refers to
  * is exhausted.
+ * a user buffer is moved page by page through the kernel addresses of its pinned pages.
  */
 int
 iobuf_move(struct iobuf *iob, void *data, size_t len, bool m2b, size_t *copiedp) {
-    size_t alen;
+    size_t alen, n, moved;
     if ((alen = iob->io_resid) > len) {
         alen = len;
     }
-    if (alen > 0) {
-        void *src = iob->io_base, *dst = data;
+    for (moved = 0; moved < alen; moved += n) {
+        void *src = iobuf_kva(iob, &n), *dst = data + moved;
+        if (n > alen - moved) {
+            n = alen - moved;
+        }
         if (m2b) {
             void *tmp = src;
             src = dst, dst = tmp;
         }
-        memmove(dst, src, alen);
-        iobuf_skip(iob, alen), len -= alen;
+        memmove(dst, src, n);
+        iobuf_skip(iob, n);
     }
+    len -= alen;
+    iostat.iobuf_copied += alen;
     if (copiedp != NULL) {
         *copiedp = alen;
     }
@@ -52,14 +90,19 @@ iobuf_move(struct iobuf *iob, void *data, size_t len, bool m2b, size_t *copiedp)
  */
 int
 iobuf_move_zeros(struct iobuf *iob, size_t len, size_t *copiedp) {
-    size_t alen;
+    size_t alen, n, moved;
     if ((alen = iob->io_resid) > len) {
         alen = len;
     }
-    if (alen > 0) {
-        memset(iob->io_base, 0, alen);
-        iobuf_skip(iob, alen), len -= alen;
+    for (moved = 0; moved < alen; moved += n) {
+        void *dst = iobuf_kva(iob, &n);
+        if (n > alen - moved) {
+            n = alen - moved;
+        }
+        memset(dst, 0, n);
+        iobuf_skip(iob, n);
     }
+    len -= alen;
     if (copiedp != NULL) {
         *copiedp = alen;
     }
@@ -74,4 +117,3 @@ iobuf_skip(struct iobuf *iob, size_t n) {
     assert(iob->io_resid >= n);
     iob->io_base += n, iob->io_offset += n, iob->io_resid -= n;
 }
-
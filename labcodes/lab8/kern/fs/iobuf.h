@@ -3,19 +3,27 @@
 
 #include <defs.h>
 
+struct Page;
+
 /*
  * iobuf is a buffer Rd/Wr status record
+ * a user buffer is described by its pages pinned by user_mem_pin, io_base is then a user address
+ * which only locates the data in them: the data are moved through the kernel addresses of the pages.
  */
 struct iobuf {
     void *io_base;     // the base addr of buffer (used for Rd/Wr)
     off_t io_offset;   // current Rd/Wr position in buffer, will have been incremented by the amount transferred
     size_t io_len;     // the length of buffer  (used for Rd/Wr)
     size_t io_resid;   // current resident length need to Rd/Wr, will have been decremented by the amount transferred.
+    struct Page **io_pages; // the pinned pages of a user buffer, NULL if io_base is a kernel address
+    uintptr_t io_pgbase;    // the user address of the first page in io_pages
 };
 
 #define iobuf_used(iob)                         ((size_t)((iob)->io_len - (iob)->io_resid))
 
 struct iobuf *iobuf_init(struct iobuf *iob, void *base, size_t len, off_t offset);
+struct iobuf *iobuf_init_user(struct iobuf *iob, void *base, size_t len, off_t offset, struct Page **pages);
+void *iobuf_kva(struct iobuf *iob, size_t *lenp);
 int iobuf_move(struct iobuf *iob, void *data, size_t len, bool m2b, size_t *copiedp);
 int iobuf_move_zeros(struct iobuf *iob, size_t len, size_t *copiedp);
 void iobuf_skip(struct iobuf *iob, size_t n);
@@ -0,0 +1,45 @@
+#include <defs.h>
+#include <list.h>
+#include <bio.h>
+
+/*
+ * C-SCAN: 请求按位置排序，磁头只朝扇区号增大的方向扫描，依次服务不小于当前位置的请求，
+ * 扫到最后一个请求后跳回位置最小的请求开始下一圈（不移到磁盘的尽头，即 C-LOOK），排队的请求最多等待一圈。
+ */
+
+static void
+cscan_init(struct bio_queue *q) {
+}
+
+static void
+cscan_add(struct bio_queue *q, struct bio_request *rq, uint32_t now) {
+    bio_sort_add(&(q->q_sort[0]), rq);
+}
+
+static void
+cscan_merged(struct bio_queue *q, struct bio_request *rq) {
+    list_del(&(rq->rq_sort));
+    bio_sort_add(&(q->q_sort[0]), rq);
+}
+
+static struct bio_request *
+cscan_next(struct bio_queue *q, uint32_t now) {
+    list_entry_t *list = &(q->q_sort[0]);
+    struct bio_request *rq;
+    if (list_empty(list)) {
+        return NULL;
+    }
+    if ((rq = bio_sort_after(list, q->q_pos)) == NULL) {
+        rq = le2bioreq(list_next(list), rq_sort);
+    }
+    list_del(&(rq->rq_sort));
+    return rq;
+}
+
+struct iosched iosched_cscan = {
+    .name = "cscan",
+    .init = cscan_init,
+    .add = cscan_add,
+    .merged = cscan_merged,
+    .next = cscan_next,
+};
@@ -0,0 +1,82 @@
+#include <defs.h>
+#include <list.h>
+#include <bio.h>
+
+/*
+ * deadline: 读和写各有一个按位置排序的链表和一个按到达顺序的链表（q_sort[dir]、q_fifo[dir]，dir 为 0 读、1 写）。
+ *   - 每次选定一个方向后，沿排序链表从磁头位置向后连续服务最多 DEADLINE_FIFO_BATCH 个请求；
+ *   - 一批结束时优先选择读（进程通常在等待读），但写连续输给读 DEADLINE_WRITES_STARVED 次后必须选择写；
+ *   - 选定方向上最早到达的请求已过期限时，从它开始新的一批，否则从磁头位置继续扫描，
+ *     因此读请求的延迟大致不超过 DEADLINE_READ_EXPIRE，写请求的不超过 DEADLINE_WRITE_EXPIRE。
+ */
+
+#define DEADLINE_READ_EXPIRE            50          // ticks, 0.5s
+#define DEADLINE_WRITE_EXPIRE           500         // ticks, 5s
+#define DEADLINE_FIFO_BATCH             16
+#define DEADLINE_WRITES_STARVED         2
+
+static void
+deadline_init(struct bio_queue *q) {
+    q->q_dir = 0, q->q_batch = DEADLINE_FIFO_BATCH, q->q_starved = 0;
+}
+
+static void
+deadline_add(struct bio_queue *q, struct bio_request *rq, uint32_t now) {
+    int dir = rq->rq_write ? 1 : 0;
+    rq->rq_deadline = now + (rq->rq_write ? DEADLINE_WRITE_EXPIRE : DEADLINE_READ_EXPIRE);
+    bio_sort_add(&(q->q_sort[dir]), rq);
+    list_add_before(&(q->q_fifo[dir]), &(rq->rq_fifo));
+}
+
+static void
+deadline_merged(struct bio_queue *q, struct bio_request *rq) {
+    list_del(&(rq->rq_sort));
+    bio_sort_add(&(q->q_sort[rq->rq_write ? 1 : 0]), rq);
+}
+
+static struct bio_request *
+deadline_next(struct bio_queue *q, uint32_t now) {
+    bool reads = !list_empty(&(q->q_fifo[0])), writes = !list_empty(&(q->q_fifo[1]));
+    struct bio_request *rq;
+    int dir = q->q_dir;
+
+    // 继续当前的一批
+    if (q->q_batch < DEADLINE_FIFO_BATCH && (rq = bio_sort_after(&(q->q_sort[dir]), q->q_pos)) != NULL) {
+        goto dispatch;
+    }
+
+    if (reads && (!writes || q->q_starved < DEADLINE_WRITES_STARVED)) {
+        dir = 0;
+        if (writes) {
+            q->q_starved ++;
+        }
+    }
+    else if (writes) {
+        dir = 1, q->q_starved = 0;
+    }
+    else {
+        return NULL;
+    }
+
+    rq = le2bioreq(list_next(&(q->q_fifo[dir])), rq_fifo);
+    if ((int32_t)(now - rq->rq_deadline) < 0) {
+        if ((rq = bio_sort_after(&(q->q_sort[dir]), q->q_pos)) == NULL) {
+            rq = le2bioreq(list_next(&(q->q_sort[dir])), rq_sort);
+        }
+    }
+    q->q_batch = 0;
+
+dispatch:
+    q->q_dir = dir, q->q_batch ++;
+    list_del(&(rq->rq_sort));
+    list_del(&(rq->rq_fifo));
+    return rq;
+}
+
+struct iosched iosched_deadline = {
+    .name = "deadline",
+    .init = deadline_init,
+    .add = deadline_add,
+    .merged = deadline_merged,
+    .next = deadline_next,
+};
@@ -0,0 +1,36 @@
+#include <defs.h>
+#include <list.h>
+#include <bio.h>
+
+/* noop: 请求按到达顺序交给驱动，只做相邻扇区的合并 */
+
+static void
+noop_init(struct bio_queue *q) {
+}
+
+static void
+noop_add(struct bio_queue *q, struct bio_request *rq, uint32_t now) {
+    list_add_before(&(q->q_sort[0]), &(rq->rq_sort));
+}
+
+static void
+noop_merged(struct bio_queue *q, struct bio_request *rq) {
+}
+
+static struct bio_request *
+noop_next(struct bio_queue *q, uint32_t now) {
+    list_entry_t *le = list_next(&(q->q_sort[0]));
+    if (le == &(q->q_sort[0])) {
+        return NULL;
+    }
+    list_del(le);
+    return le2bioreq(le, rq_sort);
+}
+
+struct iosched iosched_noop = {
+    .name = "noop",
+    .init = noop_init,
+    .add = noop_add,
+    .merged = noop_merged,
+    .next = noop_next,
+};
@@ -0,0 +1,429 @@
+#include <defs.h>
+#include <string.h>
+#include <stat.h>
+#include <list.h>
+#include <wait.h>
+#include <sync.h>
+#include <proc.h>
+#include <sched.h>
+#include <kmalloc.h>
+#include <fs.h>
+#include <vfs.h>
+#include <inode.h>
+#include <iobuf.h>
+#include <pipe.h>
+#include <unistd.h>
+#include <error.h>
+#include <assert.h>
+
+/*
+ * 管道的环形缓冲区：
+ *   - 缓冲区中的数据是 [p_rpos, p_wpos)，两个位置只增不减，对 p_size（2 的幂）取模得到在 p_buf 中的下标；
+ *   - 缓冲区从一页开始，写者发现空间不够时先把它加倍，直到 PIPE_BUFSIZE_MAX，之后才等待读者；
+ *   - 唤醒是成批的：写者只在一次写入结束，或者缓冲区已满要睡眠时唤醒读者，一次写入无论多少字节最多唤醒读者一次；
+ *     读者只在缓冲区空出一半以上时唤醒写者，写者每次醒来都能写入一大块数据；
+ *   - 读者取走缓冲区中已有的数据就返回，缓冲区为空并且写端已关闭时读到文件尾；写端在读端关闭之后写入返回 -E_PIPE。
+ * 数据由 iobuf_move 在缓冲区和（固定的）用户页面之间直接复制，写入和读出各复制一次。
+ *
+ * 命名管道（mkfifo）按名字链入 fifo_list，打开一端时要等待另一端也被打开；
+ * 两端的 inode 都被回收之后命名管道从 fifo_list 中删除，其中剩余的数据被丢弃。
+ */
+
+struct pipe_state {
+    char *p_buf;                                    // the ring buffer
+    size_t p_size;                                  // size of p_buf, a power of 2
+    size_t p_rpos, p_wpos;                          // the data are [p_rpos, p_wpos), modulo p_size in p_buf
+    bool p_reader, p_writer;                        // the read end / the write end is open
+    uint32_t p_nopens[2];                           // # of times the read end / the write end was opened
+    struct inode *p_node[2];                        // the read end and the write end, NULL if not in use
+    char *p_name;                                   // name of a FIFO, NULL for a pipe
+    wait_queue_t p_rqueue;                          // readers waiting for data, and FIFO readers for a writer
+    wait_queue_t p_wqueue;                          // writers waiting for space, and FIFO writers for a reader
+    list_entry_t p_link;                            // entry in fifo_list
+};
+
+#define le2pipe(le, member)                         \
+    to_struct((le), struct pipe_state, member)
+
+#define pipe_used(p)                                ((p)->p_wpos - (p)->p_rpos)
+#define pipe_free(p)                                ((p)->p_size - pipe_used(p))
+
+static list_entry_t fifo_list;
+
+static const struct inode_ops pipe_node_ops;
+
+/* pipe_state_create - create an empty pipe with a buffer of PIPE_BUFSIZE_MIN bytes, named name if not NULL */
+static struct pipe_state *
+pipe_state_create(const char *name) {
+    struct pipe_state *p;
+    if ((p = kmalloc(sizeof(struct pipe_state))) == NULL) {
+        return NULL;
+    }
+    if ((p->p_buf = kmalloc(PIPE_BUFSIZE_MIN)) == NULL) {
+        goto failed_cleanup_p;
+    }
+    p->p_name = NULL;
+    if (name != NULL && (p->p_name = strdup(name)) == NULL) {
+        goto failed_cleanup_buf;
+    }
+    p->p_size = PIPE_BUFSIZE_MIN;
+    p->p_rpos = p->p_wpos = 0;
+    p->p_reader = p->p_writer = 0;
+    p->p_nopens[0] = p->p_nopens[1] = 0;
+    p->p_node[0] = p->p_node[1] = NULL;
+    wait_queue_init(&(p->p_rqueue));
+    wait_queue_init(&(p->p_wqueue));
+    list_init(&(p->p_link));
+    return p;
+
+failed_cleanup_buf:
+    kfree(p->p_buf);
+failed_cleanup_p:
+    kfree(p);
+    return NULL;
+}
+
+static void
+pipe_state_destroy(struct pipe_state *p) {
+    assert(p->p_node[0] == NULL && p->p_node[1] == NULL);
+    assert(wait_queue_empty(&(p->p_rqueue)) && wait_queue_empty(&(p->p_wqueue)));
+    list_del(&(p->p_link));
+    if (p->p_name != NULL) {
+        kfree(p->p_name);
+    }
+    kfree(p->p_buf);
+    kfree(p);
+}
+
+/* pipe_node_create - create the inode of the write end if writer, or the read end, of pipe p */
+static struct inode *
+pipe_node_create(struct pipe_state *p, bool writer) {
+    struct inode *node;
+    assert(p->p_node[writer] == NULL);
+    if ((node = alloc_inode(pipe_inode)) != NULL) {
+        vop_init(node, &pipe_node_ops, NULL);
+        struct pipe_inode *pin = vop_info(node, pipe_inode);
+        pin->state = p, pin->writer = writer;
+        p->p_node[writer] = node;
+    }
+    return node;
+}
+
+/*
+ * pipe_wait - sleep on queue until the other end wakes us up, return -E_KILLED if the process is killed.
+ *             the caller checks the condition again after waking up.
+ */
+static int
+pipe_wait(wait_queue_t *queue) {
+    bool intr_flag;
+    wait_t __wait, *wait = &__wait;
+    if (current->flags & PF_EXITING) {
+        return -E_KILLED;
+    }
+    local_intr_save(intr_flag);
+    wait_current_set(queue, wait, WT_PIPE);
+    local_intr_restore(intr_flag);
+
+    schedule();
+
+    local_intr_save(intr_flag);
+    wait_current_del(queue, wait);
+    local_intr_restore(intr_flag);
+    return (wait->wakeup_flags == WT_PIPE) ? 0 : -E_KILLED;
+}
+
+static void
+pipe_wakeup(wait_queue_t *queue) {
+    if (!wait_queue_empty(queue)) {
+        iostat.pipe_wakeup ++;
+        wakeup_queue(queue, WT_PIPE, 1);
+    }
+}
+
+/*
+ * pipe_grow - double the ring buffer of p. kmalloc may sleep, another writer may have grown it meanwhile.
+ */
+static int
+pipe_grow(struct pipe_state *p) {
+    size_t size = p->p_size * 2, used, off, len;
+    char *buf;
+    assert(size <= PIPE_BUFSIZE_MAX);
+    if ((buf = kmalloc(size)) == NULL) {
+        return -E_NO_MEM;
+    }
+    if (size <= p->p_size) {
+        kfree(buf);
+        return 0;
+    }
+    // 数据移到新缓冲区的开头
+    used = pipe_used(p), off = p->p_rpos % p->p_size;
+    if ((len = p->p_size - off) > used) {
+        len = used;
+    }
+    memcpy(buf, p->p_buf + off, len);
+    memcpy(buf + len, p->p_buf, used - len);
+    kfree(p->p_buf);
+    p->p_buf = buf, p->p_size = size;
+    p->p_rpos = 0, p->p_wpos = used;
+    return 0;
+}
+
+/* pipe_copy - move n bytes from iob into the ring buffer if write, or from the ring buffer to iob */
+static void
+pipe_copy(struct pipe_state *p, struct iobuf *iob, size_t n, bool write) {
+    size_t *posp = (write) ? &(p->p_wpos) : &(p->p_rpos), off, len;
+    while (n != 0) {
+        off = *posp % p->p_size;
+        if ((len = p->p_size - off) > n) {
+            len = n;
+        }
+        iobuf_move(iob, p->p_buf + off, len, !write, NULL);
+        *posp += len, n -= len;
+    }
+}
+
+static int
+pipe_open(struct inode *node, uint32_t open_flags) {
+    struct pipe_inode *pin = vop_info(node, pipe_inode);
+    return ((open_flags & O_ACCMODE) == ((pin->writer) ? O_WRONLY : O_RDONLY)) ? 0 : -E_INVAL;
+}
+
+/*
+ * pipe_close - the last close of an end: readers see the end of file once the buffer is drained,
+ *              writers get -E_PIPE
+ */
+static int
+pipe_close(struct inode *node) {
+    struct pipe_inode *pin = vop_info(node, pipe_inode);
+    struct pipe_state *p = pin->state;
+    if (pin->writer) {
+        p->p_writer = 0;
+        pipe_wakeup(&(p->p_rqueue));
+    }
+    else {
+        p->p_reader = 0;
+        pipe_wakeup(&(p->p_wqueue));
+    }
+    return 0;
+}
+
+/*
+ * pipe_read - read what is in the buffer, up to the size of iob, waiting if it is empty.
+ *             return 0 with nothing read at the end of file.
+ */
+static int
+pipe_read(struct inode *node, struct iobuf *iob) {
+    struct pipe_inode *pin = vop_info(node, pipe_inode);
+    struct pipe_state *p = pin->state;
+    size_t n;
+    int ret;
+    if (pin->writer) {
+        return -E_INVAL;
+    }
+    while (pipe_used(p) == 0) {
+        if (!p->p_writer) {
+            return 0;
+        }
+        if ((ret = pipe_wait(&(p->p_rqueue))) != 0) {
+            return ret;
+        }
+    }
+    if ((n = pipe_used(p)) > iob->io_resid) {
+        n = iob->io_resid;
+    }
+    pipe_copy(p, iob, n, 0);
+    if (pipe_free(p) >= p->p_size / 2) {
+        pipe_wakeup(&(p->p_wqueue));
+    }
+    return 0;
+}
+
+/*
+ * pipe_write - write all of iob, growing the buffer or waiting for readers when it is full.
+ *              a write of up to PIPE_BUF bytes goes into the buffer at once, not interleaved with other writers.
+ */
+static int
+pipe_write(struct inode *node, struct iobuf *iob) {
+    struct pipe_inode *pin = vop_info(node, pipe_inode);
+    struct pipe_state *p = pin->state;
+    size_t n, need;
+    int ret = 0;
+    if (!pin->writer) {
+        return -E_INVAL;
+    }
+    while (iob->io_resid != 0) {
+        if (!p->p_reader) {
+            ret = -E_PIPE;
+            break;
+        }
+        need = (iob->io_resid <= PIPE_BUF) ? iob->io_resid : 1;
+        if ((n = pipe_free(p)) < need) {
+            if (p->p_size < PIPE_BUFSIZE_MAX && pipe_grow(p) == 0) {
+                continue;
+            }
+            pipe_wakeup(&(p->p_rqueue));
+            if ((ret = pipe_wait(&(p->p_wqueue))) != 0) {
+                break;
+            }
+            continue;
+        }
+        if (n > iob->io_resid) {
+            n = iob->io_resid;
+        }
+        pipe_copy(p, iob, n, 1);
+    }
+    if (pipe_used(p) != 0) {
+        pipe_wakeup(&(p->p_rqueue));
+    }
+    return ret;
+}
+
+static int
+pipe_fstat(struct inode *node, struct stat *stat) {
+    struct pipe_state *p = vop_info(node, pipe_inode)->state;
+    memset(stat, 0, sizeof(struct stat));
+    stat->st_mode = S_IFIFO;
+    stat->st_nlinks = 1;
+    stat->st_size = pipe_used(p);
+    return 0;
+}
+
+static int
+pipe_fsync(struct inode *node) {
+    return 0;
+}
+
+static int
+pipe_gettype(struct inode *node, uint32_t *type_store) {
+    *type_store = S_IFIFO;
+    return 0;
+}
+
+static int
+pipe_tryseek(struct inode *node, off_t pos) {
+    return -E_SEEK;
+}
+
+static int
+pipe_ioctl(struct inode *node, int op, void *data) {
+    return -E_INVAL;
+}
+
+/* pipe_reclaim - the end is not referenced any more, the pipe is destroyed with its second end */
+static int
+pipe_reclaim(struct inode *node) {
+    struct pipe_inode *pin = vop_info(node, pipe_inode);
+    struct pipe_state *p = pin->state;
+    assert(p->p_node[pin->writer] == node);
+    p->p_node[pin->writer] = NULL;
+    if (p->p_node[!pin->writer] == NULL) {
+        pipe_state_destroy(p);
+    }
+    vop_kill(node);
+    return 0;
+}
+
+static const struct inode_ops pipe_node_ops = {
+    .vop_magic                      = VOP_MAGIC,
+    .vop_open                       = pipe_open,
+    .vop_close                      = pipe_close,
+    .vop_read                       = pipe_read,
+    .vop_write                      = pipe_write,
+    .vop_fstat                      = pipe_fstat,
+    .vop_fsync                      = pipe_fsync,
+    .vop_reclaim                    = pipe_reclaim,
+    .vop_gettype                    = pipe_gettype,
+    .vop_tryseek                    = pipe_tryseek,
+    .vop_ioctl                      = pipe_ioctl,
+};
+
+void
+pipe_init(void) {
+    list_init(&fifo_list);
+}
+
+/*
+ * pipe_create - create a pipe, store the referenced inodes of its read end and its write end.
+ *               both ends are open, the caller opens them with vop_open_inc.
+ */
+int
+pipe_create(struct inode **rnode_store, struct inode **wnode_store) {
+    struct pipe_state *p;
+    struct inode *rnode, *wnode;
+    if ((p = pipe_state_create(NULL)) == NULL) {
+        return -E_NO_MEM;
+    }
+    if ((rnode = pipe_node_create(p, 0)) == NULL) {
+        pipe_state_destroy(p);
+        return -E_NO_MEM;
+    }
+    if ((wnode = pipe_node_create(p, 1)) == NULL) {
+        // 回收读端时管道也被删除
+        vop_ref_dec(rnode);
+        return -E_NO_MEM;
+    }
+    p->p_reader = p->p_writer = 1;
+    p->p_nopens[0] = p->p_nopens[1] = 1;
+    *rnode_store = rnode, *wnode_store = wnode;
+    return 0;
+}
+
+/*
+ * pipe_fifo_open - open the read end (O_RDONLY) or the write end (O_WRONLY) of the FIFO named name,
+ *                  creating it if there is none, and wait until the other end is opened too.
+ *                  store the referenced inode of the end, the caller opens it with vop_open_inc.
+ */
+int
+pipe_fifo_open(const char *name, uint32_t open_flags, struct inode **node_store) {
+    bool writer;
+    switch (open_flags & O_ACCMODE) {
+    case O_RDONLY: writer = 0; break;
+    case O_WRONLY: writer = 1; break;
+    default:
+        return -E_INVAL;
+    }
+
+    struct pipe_state *p = NULL;
+    list_entry_t *le = &fifo_list;
+    while ((le = list_next(le)) != &fifo_list) {
+        if (strcmp(le2pipe(le, p_link)->p_name, name) == 0) {
+            p = le2pipe(le, p_link);
+            break;
+        }
+    }
+    if (p == NULL) {
+        if ((p = pipe_state_create(name)) == NULL) {
+            return -E_NO_MEM;
+        }
+        list_add(&fifo_list, &(p->p_link));
+    }
+
+    struct inode *node;
+    if ((node = p->p_node[writer]) != NULL) {
+        vop_ref_inc(node);
+    }
+    else if ((node = pipe_node_create(p, writer)) == NULL) {
+        if (p->p_node[!writer] == NULL) {
+            pipe_state_destroy(p);
+        }
+        return -E_NO_MEM;
+    }
+
+    // 打开这一端，唤醒等待它的另一端，再等待另一端被打开（在此之前已经打开的也算）
+    uint32_t nopens = p->p_nopens[!writer];
+    bool *openp = (writer) ? &(p->p_writer) : &(p->p_reader);
+    *openp = 1, p->p_nopens[writer] ++;
+    pipe_wakeup((writer) ? &(p->p_rqueue) : &(p->p_wqueue));
+    while (!((writer) ? p->p_reader : p->p_writer) && p->p_nopens[!writer] == nopens) {
+        int ret;
+        if ((ret = pipe_wait((writer) ? &(p->p_wqueue) : &(p->p_rqueue))) != 0) {
+            if (inode_open_count(node) == 0) {
+                *openp = 0;
+            }
+            vop_ref_dec(node);
+            return ret;
+        }
+    }
+    *node_store = node;
+    return 0;
+}
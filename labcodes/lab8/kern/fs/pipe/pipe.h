@@ -0,0 +1,29 @@
+#ifndef __KERN_FS_PIPE_PIPE_H__
+#define __KERN_FS_PIPE_PIPE_H__
+
+#include <defs.h>
+#include <mmu.h>
+
+/*
+ * 管道：两端各是一个 inode（pipe_inode），共享一个保存数据的环形缓冲区（pipe_state）。
+ * 一端的 inode 被所有打开它的文件共享（dup、fork），它的最后一次关闭（vop_close）就是这一端的关闭。
+ */
+
+#define PIPE_BUFSIZE_MIN                            PGSIZE          /* initial size of the ring buffer */
+#define PIPE_BUFSIZE_MAX                            (16 * PGSIZE)   /* the ring buffer grows up to this size */
+#define PIPE_BUF                                    PGSIZE          /* writes of up to PIPE_BUF bytes are atomic */
+
+struct inode;
+struct pipe_state;
+
+struct pipe_inode {
+    struct pipe_state *state;                       /* the buffer shared with the other end */
+    bool writer;                                    /* the write end, or the read end */
+};
+
+void pipe_init(void);
+int pipe_create(struct inode **rnode_store, struct inode **wnode_store);
+int pipe_fifo_open(const char *name, uint32_t open_flags, struct inode **node_store);
+
+#endif /* !__KERN_FS_PIPE_PIPE_H__ */
+
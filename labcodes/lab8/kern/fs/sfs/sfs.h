@@ -17,17 +17,32 @@
 #define SFS_NDIRECT                                 12                      /* # of direct blocks in inode */
 #define SFS_MAX_INFO_LEN                            31                      /* max length of infomation */
 #define SFS_MAX_FNAME_LEN                           FS_MAX_FNAME_LEN        /* max length of filename */
-#define SFS_MAX_FILE_SIZE                           (1024UL * 1024 * 128)   /* max file size (128M) */
+#define SFS_MAX_FILE_SIZE                           (1024UL * 1024 * 1024)  /* max file size (1G) */
 #define SFS_BLKN_SUPER                              0                       /* block the superblock lives in */
 #define SFS_BLKN_ROOT                               1                       /* location of the root dir inode */
 #define SFS_BLKN_FREEMAP                            2                       /* 1st block of the freemap */
 
+/* format revisions, images made before revisions existed have 0 in sfs_super.version and are SFS_VERSION_1 */
+#define SFS_VERSION_1                               1                       /* one directory entry per block */
+#define SFS_VERSION_2                               2                       /* packed directory entries with a hash index */
+#define SFS_VERSION_3                               3                       /* the first blocks of a file are mapped by extents */
+
 /* # of bits in a block */
 #define SFS_BLKBITS                                 (SFS_BLKSIZE * CHAR_BIT)
 
 /* # of entries in a block */
 #define SFS_BLK_NENTRY                              (SFS_BLKSIZE / sizeof(uint32_t))
 
+/* # of extents in inode */
+#define SFS_NEXTENT                                 16
+
+/* metadata journal, see sfs_journal.c */
+#define SFS_JOURNAL_MAGIC                           0x6a726e6c              /* magic number of a log descriptor block */
+#define SFS_JOURNAL_TXMAX                           128                     /* max # of blocks logged by a transaction */
+#define SFS_JOURNAL_SLOT                            (1 + SFS_JOURNAL_TXMAX) /* # of blocks of a log slot */
+#define SFS_JOURNAL_NBLKS                           (2 * SFS_JOURNAL_SLOT)  /* size of the journal (in blocks) */
+#define SFS_JOURNAL_CSUM_INIT                       2166136261U
+
 /* file types */
 #define SFS_TYPE_INVAL                              0       /* Should not appear on disk */
 #define SFS_TYPE_FILE                               1
@@ -42,9 +57,32 @@ struct sfs_super {
     uint32_t blocks;                                /* # of blocks in fs */
     uint32_t unused_blocks;                         /* # of unused blocks in fs */
     char info[SFS_MAX_INFO_LEN + 1];                /* infomation for sfs  */
+    uint32_t version;                               /* format revision, SFS_VERSION_* */
+    uint32_t journal;                               /* 1st block of the journal, 0 if none */
+    uint32_t nfreecounts;                           /* # of free counts after the superblock, 0 if none */
+};
+
+/*
+ * 超级块所在的块中紧跟在超级块之后的是 nfreecounts 个 uint16_t，依次是每个 freemap 块中空闲块的个数，
+ * 挂载时不需要读出整个 freemap，分配时也不需要读出没有空闲块的 freemap 块。
+ * nfreecounts 为 0 时（旧的磁盘映像，或 freemap 块太多）这些个数未知，freemap 块第一次用到时才知道。
+ */
+#define SFS_FREECOUNT_MAX                           ((SFS_BLKSIZE - sizeof(struct sfs_super)) / sizeof(uint16_t))
+#define SFS_FREECOUNT_UNKNOWN                       0xFFFF                  /* free count of a freemap block not known */
+
+/* a run of len contiguous blocks on disk starting at block start */
+struct sfs_extent {
+    uint32_t start;
+    uint32_t len;
 };
 
-/* inode (on disk) */
+/*
+ * inode (on disk)
+ * 第 3 版格式中文件的前若干块由 extents 映射（按文件中的顺序，每个 extent 是磁盘上连续的一段块），
+ * 之后的块由 direct/indirect/db_indirect 组成的块指针树映射，块在树中的序号是文件块号减去 extents 映射的块数。
+ * 追加的块紧跟在最后一个 extent 之后时延长这个 extent，否则使用一个新的 extent，extent 用完后才使用块指针树。
+ * 旧格式中 nextents 总是 0，所有块都由块指针树映射。
+ */
 struct sfs_disk_inode {
     uint32_t size;                                  /* size of the file (in bytes) */
     uint16_t type;                                  /* one of SYS_TYPE_* above */
@@ -52,8 +90,9 @@ struct sfs_disk_inode {
     uint32_t blocks;                                /* # of blocks */
     uint32_t direct[SFS_NDIRECT];                   /* direct blocks */
     uint32_t indirect;                              /* indirect blocks */
-//    uint32_t db_indirect;                           /* double indirect blocks */
-//   unused
+    uint32_t db_indirect;                           /* double indirect blocks */
+    uint32_t nextents;                              /* # of extents in use, 0 before SFS_VERSION_3 */
+    struct sfs_extent extents[SFS_NEXTENT];         /* extents mapping the first blocks of the file */
 };
 
 /* file entry (on disk) */
@@ -65,6 +104,59 @@ struct sfs_disk_entry {
 #define sfs_dentry_size                             \
     sizeof(((struct sfs_disk_entry *)0)->name)
 
+/*
+ * 第 2 版格式中目录的内容：第 0 块是哈希索引，由 SFS_DIR_NBUCKET 个链表头组成；
+ * 之后的块中紧密排列着变长的目录项，每个目录项不跨块，一个块中所有目录项的 rec_len 之和正好是一个块。
+ * 目录项按名字的哈希值链入对应的链表，链表头和 next 记录目录项在目录内容中的字节位置，0 表示链表结束。
+ */
+#define SFS_DIR_NBUCKET                             SFS_BLK_NENTRY          /* # of hash chains of a packed dir */
+
+/* packed file entry (on disk) */
+struct sfs_disk_dirent {
+    uint32_t ino;                                   /* inode number, 0 if unused */
+    uint32_t next;                                  /* position of the next entry in the hash chain */
+    uint32_t hash;                                  /* sfs_name_hash of the name */
+    uint16_t rec_len;                               /* length of the entry, including the padding */
+    uint8_t name_len;                               /* length of the name */
+    uint8_t unused;
+    char name[0];                                   /* file name, not nul-terminated */
+};
+
+#define sfs_dirent_size(name_len)                   \
+    ROUNDUP(sizeof(struct sfs_disk_dirent) + (name_len), sizeof(uint32_t))
+
+/*
+ * 日志由两个槽组成，第 seq 号事务写入 seq & 1 号槽：槽的第 0 块是描述块，之后依次是事务中各个块的新内容。
+ * checksum 覆盖 checksum 为 0 时的整个描述块和之后的 nblks 个块，校验和正确说明整个事务都已写入日志。
+ */
+struct sfs_journal_desc {
+    uint32_t magic;                                 /* magic number, should be SFS_JOURNAL_MAGIC */
+    uint32_t seq;                                   /* sequence # of the transaction */
+    uint32_t nblks;                                 /* # of blocks logged */
+    uint32_t checksum;                              /* sfs_journal_csum of the descriptor and the blocks */
+    uint32_t blkno[SFS_JOURNAL_TXMAX];              /* where the blocks logged belong */
+};
+
+/* FNV-1a hash of 32-bit words, used as the checksum of journal transactions */
+static inline uint32_t
+sfs_journal_csum(uint32_t hash, const void *data, size_t len) {
+    const uint32_t *word = data;
+    for (; len >= sizeof(uint32_t); len -= sizeof(uint32_t)) {
+        hash = (hash ^ *word ++) * 16777619U;
+    }
+    return hash;
+}
+
+/* FNV-1a hash of file names, used by the hash index of packed dirs */
+static inline uint32_t
+sfs_name_hash(const char *name, size_t len) {
+    uint32_t hash = 2166136261U;
+    while (len -- > 0) {
+        hash = (hash ^ (uint8_t)*name ++) * 16777619U;
+    }
+    return hash;
+}
+
 /* inode for sfs */
 struct sfs_inode {
     struct sfs_disk_inode *din;                     /* on-disk inode */
@@ -72,6 +164,7 @@ struct sfs_inode {
     bool dirty;                                     /* true if inode modified */
     int reclaim_count;                              /* kill inode if it hits zero */
     semaphore_t sem;                                /* semaphore for din */
+    uint32_t rsv_start, rsv_count;                  /* free blocks reserved for the next appends */
     list_entry_t inode_link;                        /* entry for linked-list in sfs_fs */
     list_entry_t hash_link;                         /* entry for hash linked-list in sfs_fs */
 };
@@ -79,13 +172,45 @@ struct sfs_inode {
 #define le2sin(le, member)                          \
     to_struct((le), struct sfs_inode, member)
 
+/* a block of the freemap in memory, read from disk the first time it is used */
+struct sfs_freemap_chunk {
+    uint32_t *map;                                  /* bits of the block, blocks in use are marked 0, NULL if not loaded */
+    uint16_t nfree;                                 /* # of free blocks, SFS_FREECOUNT_UNKNOWN if not known yet */
+    bool dirty;                                     /* true if modified since written to the buffer cache */
+    uint32_t *freed;                                /* blocks freed in the running journal transaction are marked 1,
+                                                       NULL if sfs has no journal */
+};
+
+/* freemap of a mounted sfs, see sfs_freemap.c */
+struct sfs_freemap {
+    uint32_t nbits;                                 /* # of blocks in fs */
+    uint32_t nchunks;                               /* # of freemap blocks */
+    uint32_t next;                                  /* next-fit: an allocation without a goal starts searching here */
+    struct sfs_freemap_chunk *chunks;               /* nchunks blocks of the freemap */
+};
+
+/* write-ahead metadata journal of a mounted sfs */
+struct sfs_journal {
+    struct sfs_fs *sfs;                             /* the fs, NULL after it is unmounted */
+    uint32_t seq;                                   /* sequence # of the running transaction */
+    int nhandles;                                   /* # of operations in the running transaction */
+    bool committing;                                /* true if the running transaction is being committed */
+    int error;                                      /* result of the last commit */
+    wait_queue_t wait_queue;                        /* processes waiting for the commit or the operations */
+    uint32_t nfreed;                                /* # of blocks freed in the running transaction */
+    uint32_t nlast;                                 /* # of blocks logged by the last transaction */
+    uint32_t last[SFS_JOURNAL_TXMAX];               /* home blocks logged by the last transaction */
+    void *buffer;                                   /* SFS_JOURNAL_CLUSTER blocks for log IO */
+};
+
 /* filesystem for sfs */
 struct sfs_fs {
     struct sfs_super super;                         /* on-disk superblock */
     struct device *dev;                             /* device mounted on */
-    struct bitmap *freemap;                         /* blocks in use are mared 0 */
+    struct sfs_freemap *freemap;                    /* blocks in use are mared 0 */
     bool super_dirty;                               /* true if super/freemap modified */
-    void *sfs_buffer;                               /* buffer for non-block aligned io */
+    struct sfs_journal *journal;                    /* metadata journal, NULL if the fs has none */
+    void *sfs_buffer;                               /* buffer for reading superblock at mount */
     semaphore_t fs_sem;                             /* semaphore for fs */
     semaphore_t io_sem;                             /* semaphore for io */
     semaphore_t mutex_sem;                          /* semaphore for link/unlink and rename */
@@ -93,6 +218,11 @@ struct sfs_fs {
     list_entry_t *hash_list;                        /* inode hash linked-list */
 };
 
+/* true if the directories of sfs are packed (SFS_VERSION_2) */
+#define sfs_packed_dir(sfs)                         ((sfs)->super.version >= SFS_VERSION_2)
+/* true if new blocks of sfs are mapped by extents (SFS_VERSION_3) */
+#define sfs_use_extents(sfs)                        ((sfs)->super.version >= SFS_VERSION_3)
+
 /* hash for sfs */
 #define SFS_HLIST_SHIFT                             10
 #define SFS_HLIST_SIZE                              (1 << SFS_HLIST_SHIFT)
@@ -106,8 +236,10 @@ struct sfs_fs {
 
 struct fs;
 struct inode;
+struct iobuf;
 
 void sfs_init(void);
+void sfs_inode_cache_init(void);
 int sfs_mount(const char *devname);
 
 void lock_sfs_fs(struct sfs_fs *sfs);
@@ -119,11 +251,36 @@ int sfs_rblock(struct sfs_fs *sfs, void *buf, uint32_t blkno, uint32_t nblks);
 int sfs_wblock(struct sfs_fs *sfs, void *buf, uint32_t blkno, uint32_t nblks);
 int sfs_rbuf(struct sfs_fs *sfs, void *buf, size_t len, uint32_t blkno, off_t offset);
 int sfs_wbuf(struct sfs_fs *sfs, void *buf, size_t len, uint32_t blkno, off_t offset);
+int sfs_wdata(struct sfs_fs *sfs, struct iobuf *iob, size_t len, uint32_t blkno, off_t offset);
 int sfs_sync_super(struct sfs_fs *sfs);
 int sfs_sync_freemap(struct sfs_fs *sfs);
 int sfs_clear_block(struct sfs_fs *sfs, uint32_t blkno, uint32_t nblks);
+int sfs_sync_blocks(struct sfs_fs *sfs);
+
+struct sfs_freemap *sfs_freemap_create(uint32_t nbits, const uint16_t *counts, uint32_t ncounts);
+void sfs_freemap_destroy(struct sfs_freemap *freemap);
+int sfs_freemap_load(struct sfs_fs *sfs, uint32_t blkno);
+bool sfs_freemap_test(struct sfs_freemap *freemap, uint32_t blkno);
+int sfs_freemap_alloc(struct sfs_fs *sfs, uint32_t goal, uint32_t *blkno_store);
+uint32_t sfs_freemap_claim(struct sfs_freemap *freemap, uint32_t blkno, uint32_t n);
+void sfs_freemap_dirty(struct sfs_freemap *freemap, uint32_t blkno);
+void sfs_freemap_free(struct sfs_freemap *freemap, uint32_t blkno);
+void sfs_freemap_defer(struct sfs_freemap *freemap, uint32_t blkno);
+void sfs_freemap_release(struct sfs_freemap *freemap, uint32_t n);
+uint32_t sfs_freemap_counts(struct sfs_freemap *freemap, uint16_t *counts, uint32_t max);
+uint32_t sfs_rsv_mask(struct sfs_fs *sfs, uint32_t index, uint32_t *map);
+
+int sfs_journal_replay(struct device *dev, uint32_t start);
+int sfs_journal_init(struct sfs_fs *sfs);
+void sfs_journal_destroy(struct sfs_fs *sfs);
+void sfs_journal_start(struct sfs_fs *sfs);
+void sfs_journal_stop(struct sfs_fs *sfs);
+int sfs_journal_commit(struct sfs_fs *sfs);
+void sfs_journal_free(struct sfs_fs *sfs, uint32_t blkno);
+bool sfs_journal_logged(struct sfs_fs *sfs, uint32_t blkno);
 
 int sfs_load_inode(struct sfs_fs *sfs, struct inode **node_store, uint32_t ino);
+int sfs_sync_inode(struct inode *node);
 
 #endif /* !__KERN_FS_SFS_SFS_H__ */
 
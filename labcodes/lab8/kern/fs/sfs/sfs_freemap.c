@@ -0,0 +1,277 @@
+#include <defs.h>
+#include <x86.h>
+#include <stdio.h>
+#include <string.h>
+#include <kmalloc.h>
+#include <fs.h>
+#include <sfs.h>
+#include <error.h>
+#include <assert.h>
+
+/*
+ * sfs 的 freemap 按块（chunk，每块映射 SFS_BLKBITS 个磁盘块）读入内存：挂载时只建立每个 freemap 块的描述，
+ * 分配、释放或检查某个磁盘块时才读入它所在的 freemap 块，之后一直留在内存中。
+ *   - 超级块之后保存的空闲块数使分配时可以跳过已满的 freemap 块，不需要读出它们；
+ *     读入之后以位图中实际的空闲块数为准，保存的个数只是提示。
+ *   - 修改过的 freemap 块标记为 dirty，sfs_sync_freemap 只写回这些块。
+ *   - 有日志时每个读入的 freemap 块还带有一个同样大小的位图，记录当前事务中释放的块，
+ *     提交时才把它们标记为空闲；内存占用只和用到的 freemap 块数有关，不随磁盘大小增长。
+ *   - 读入 freemap 块时会睡眠，其他进程可能在此期间读入了同一块并已经修改，这时丢弃自己读出的内容；
+ *     读入之后的查找和修改都不会睡眠。
+ */
+
+#define WORD_BITS                       (sizeof(uint32_t) * CHAR_BIT)
+#define CHUNK_NWORDS                    (SFS_BLKBITS / WORD_BITS)
+
+/*
+ * sfs_freemap_create - describe a freemap of nbits blocks, no block of it is loaded.
+ *                      counts are the free counts saved after the superblock, used if there is one for every block.
+ */
+struct sfs_freemap *
+sfs_freemap_create(uint32_t nbits, const uint16_t *counts, uint32_t ncounts) {
+    struct sfs_freemap *freemap;
+    uint32_t i;
+    if ((freemap = kmalloc(sizeof(struct sfs_freemap))) == NULL) {
+        return NULL;
+    }
+    freemap->nbits = nbits, freemap->nchunks = ROUNDUP_DIV(nbits, SFS_BLKBITS), freemap->next = 0;
+    if ((freemap->chunks = kmalloc(sizeof(struct sfs_freemap_chunk) * freemap->nchunks)) == NULL) {
+        kfree(freemap);
+        return NULL;
+    }
+    for (i = 0; i < freemap->nchunks; i ++) {
+        struct sfs_freemap_chunk *chunk = freemap->chunks + i;
+        chunk->map = chunk->freed = NULL, chunk->dirty = 0;
+        chunk->nfree = (ncounts == freemap->nchunks) ? counts[i] : SFS_FREECOUNT_UNKNOWN;
+    }
+    return freemap;
+}
+
+void
+sfs_freemap_destroy(struct sfs_freemap *freemap) {
+    uint32_t i;
+    for (i = 0; i < freemap->nchunks; i ++) {
+        if (freemap->chunks[i].map != NULL) {
+            assert(!freemap->chunks[i].dirty);
+            kfree(freemap->chunks[i].map);
+        }
+    }
+    kfree(freemap->chunks);
+    kfree(freemap);
+}
+
+/*
+ * sfs_freemap_load - read the freemap block which maps block blkno, if it is not in memory yet.
+ *                    with a journal, the bitmap of blocks freed in the running transaction is allocated with it.
+ */
+int
+sfs_freemap_load(struct sfs_fs *sfs, uint32_t blkno) {
+    struct sfs_freemap *freemap = sfs->freemap;
+    assert(blkno < freemap->nbits);
+    uint32_t index = blkno / SFS_BLKBITS, *map, nbits, nfree, word, i;
+    struct sfs_freemap_chunk *chunk = freemap->chunks + index;
+    bool journaled = (sfs->journal != NULL);
+    int ret;
+    if (chunk->map != NULL) {
+        return 0;
+    }
+    if ((map = kmalloc(SFS_BLKSIZE * (journaled ? 2 : 1))) == NULL) {
+        return -E_NO_MEM;
+    }
+    if ((ret = sfs_rblock(sfs, map, SFS_BLKN_FREEMAP + index, 1)) != 0) {
+        kfree(map);
+        return ret;
+    }
+    if (chunk->map != NULL) {
+        kfree(map);
+        return 0;
+    }
+    // 最后一块中超出 fs 的位总是已用
+    nbits = (freemap->nbits - index * SFS_BLKBITS < SFS_BLKBITS) ? freemap->nbits - index * SFS_BLKBITS : SFS_BLKBITS;
+    for (i = nbits; i < SFS_BLKBITS; i ++) {
+        map[i / WORD_BITS] &= ~(1 << (i % WORD_BITS));
+    }
+    for (nfree = 0, i = 0; i < CHUNK_NWORDS; i ++) {
+        for (word = map[i]; word != 0; word &= word - 1) {
+            nfree ++;
+        }
+    }
+    if (journaled) {
+        chunk->freed = memset(map + CHUNK_NWORDS, 0, SFS_BLKSIZE);
+    }
+    chunk->map = map, chunk->nfree = nfree;
+    iostat.freemap_load ++;
+    return 0;
+}
+
+/*
+ * sfs_freemap_test - return true if block blkno is free, the freemap block which maps it must be loaded
+ */
+bool
+sfs_freemap_test(struct sfs_freemap *freemap, uint32_t blkno) {
+    assert(blkno < freemap->nbits);
+    uint32_t *map = freemap->chunks[blkno / SFS_BLKBITS].map, bit = blkno % SFS_BLKBITS;
+    assert(map != NULL);
+    return (map[bit / WORD_BITS] & (1 << (bit % WORD_BITS))) != 0;
+}
+
+/*
+ * sfs_freemap_search - find the first free bit at or after bit start in a loaded freemap block
+ */
+static bool
+sfs_freemap_search(struct sfs_freemap_chunk *chunk, uint32_t start, uint32_t *bit_store) {
+    uint32_t *map = chunk->map, ix = start / WORD_BITS, word;
+    word = map[ix] & ~((1 << (start % WORD_BITS)) - 1);
+    while (1) {
+        if (word != 0) {
+            *bit_store = ix * WORD_BITS + bsf(word);
+            return 1;
+        }
+        if (++ ix == CHUNK_NWORDS) {
+            return 0;
+        }
+        word = map[ix];
+    }
+}
+
+/*
+ * sfs_freemap_alloc - mark the free block at goal or the first one after it in use, goal is 0 if there is none.
+ *                     the freemap blocks known to be full are skipped without being read.
+ */
+int
+sfs_freemap_alloc(struct sfs_fs *sfs, uint32_t goal, uint32_t *blkno_store) {
+    struct sfs_freemap *freemap = sfs->freemap;
+    uint32_t start = (goal != 0 && goal < freemap->nbits) ? goal : freemap->next;
+    uint32_t index = start / SFS_BLKBITS, bit = start % SFS_BLKBITS, blkno, n;
+    int ret;
+    // 从 start 所在的块开始依次查找，绕回一圈后最后再从头查找一次起始的块
+    for (n = 0; n <= freemap->nchunks; n ++) {
+        struct sfs_freemap_chunk *chunk = freemap->chunks + index;
+        if (chunk->nfree != 0) {
+            if ((ret = sfs_freemap_load(sfs, index * SFS_BLKBITS)) != 0) {
+                return ret;
+            }
+            if (chunk->nfree != 0 && sfs_freemap_search(chunk, bit, &bit)) {
+                chunk->map[bit / WORD_BITS] ^= (1 << (bit % WORD_BITS));
+                chunk->nfree --, chunk->dirty = 1;
+                blkno = index * SFS_BLKBITS + bit;
+                freemap->next = (blkno + 1 < freemap->nbits) ? blkno + 1 : 0;
+                *blkno_store = blkno;
+                return 0;
+            }
+        }
+        bit = 0;
+        if (++ index == freemap->nchunks) {
+            index = 0;
+        }
+    }
+    return -E_NO_MEM;
+}
+
+/*
+ * sfs_freemap_claim - mark up to n free blocks starting at blkno in use, for reservations.
+ *                     stop at the first block in use and at the end of the freemap block, which must be loaded.
+ *                     return the # of blocks claimed. the blocks are still free on disk, see sfs_rsv_mask.
+ */
+uint32_t
+sfs_freemap_claim(struct sfs_freemap *freemap, uint32_t blkno, uint32_t n) {
+    uint32_t claimed = 0, bit = blkno % SFS_BLKBITS;
+    if (blkno >= freemap->nbits) {
+        return 0;
+    }
+    struct sfs_freemap_chunk *chunk = freemap->chunks + blkno / SFS_BLKBITS;
+    if (chunk->map == NULL) {
+        return 0;
+    }
+    for (; claimed < n && bit < SFS_BLKBITS && blkno < freemap->nbits; claimed ++, bit ++, blkno ++) {
+        uint32_t *word = chunk->map + bit / WORD_BITS, mask = (1 << (bit % WORD_BITS));
+        if (!(*word & mask)) {
+            break;
+        }
+        *word ^= mask;
+    }
+    if (claimed != 0) {
+        chunk->nfree -= claimed, chunk->dirty = 1;
+    }
+    return claimed;
+}
+
+/*
+ * sfs_freemap_dirty - the freemap block which maps block blkno is to be written, though the bitmap in memory is unchanged
+ */
+void
+sfs_freemap_dirty(struct sfs_freemap *freemap, uint32_t blkno) {
+    assert(blkno < freemap->nbits);
+    freemap->chunks[blkno / SFS_BLKBITS].dirty = 1;
+}
+
+/*
+ * sfs_freemap_free - mark block blkno free, the freemap block which maps it must be loaded
+ */
+void
+sfs_freemap_free(struct sfs_freemap *freemap, uint32_t blkno) {
+    assert(blkno < freemap->nbits);
+    struct sfs_freemap_chunk *chunk = freemap->chunks + blkno / SFS_BLKBITS;
+    uint32_t bit = blkno % SFS_BLKBITS, *word, mask = (1 << (bit % WORD_BITS));
+    assert(chunk->map != NULL);
+    word = chunk->map + bit / WORD_BITS;
+    assert(!(*word & mask));
+    *word |= mask;
+    chunk->nfree ++, chunk->dirty = 1;
+}
+
+/*
+ * sfs_freemap_defer - remember that block blkno is freed in the running journal transaction, it stays in use
+ *                     until sfs_freemap_release. the freemap block which maps it must be loaded.
+ */
+void
+sfs_freemap_defer(struct sfs_freemap *freemap, uint32_t blkno) {
+    assert(blkno < freemap->nbits);
+    struct sfs_freemap_chunk *chunk = freemap->chunks + blkno / SFS_BLKBITS;
+    uint32_t bit = blkno % SFS_BLKBITS, *word, mask = (1 << (bit % WORD_BITS));
+    assert(chunk->freed != NULL);
+    word = chunk->freed + bit / WORD_BITS;
+    assert(!(*word & mask) && !(chunk->map[bit / WORD_BITS] & mask));
+    *word |= mask;
+}
+
+/*
+ * sfs_freemap_release - mark the n blocks freed in the running journal transaction free
+ */
+void
+sfs_freemap_release(struct sfs_freemap *freemap, uint32_t n) {
+    uint32_t index, i, word;
+    for (index = 0; n != 0; index ++) {
+        assert(index < freemap->nchunks);
+        struct sfs_freemap_chunk *chunk = freemap->chunks + index;
+        if (chunk->freed == NULL) {
+            continue;
+        }
+        for (i = 0; i < CHUNK_NWORDS && n != 0; i ++) {
+            if ((word = chunk->freed[i]) != 0) {
+                chunk->map[i] |= word, chunk->freed[i] = 0, chunk->dirty = 1;
+                for (; word != 0; word &= word - 1) {
+                    chunk->nfree ++, n --;
+                }
+            }
+        }
+    }
+}
+
+/*
+ * sfs_freemap_counts - store the free count of every freemap block to counts, to be saved after the superblock.
+ *                      return the # of counts, 0 if there are more than max or some of them are not known.
+ */
+uint32_t
+sfs_freemap_counts(struct sfs_freemap *freemap, uint16_t *counts, uint32_t max) {
+    uint32_t i;
+    if (freemap->nchunks > max) {
+        return 0;
+    }
+    for (i = 0; i < freemap->nchunks; i ++) {
+        if ((counts[i] = freemap->chunks[i].nfree) == SFS_FREECOUNT_UNKNOWN) {
+            return 0;
+        }
+    }
+    return freemap->nchunks;
+}
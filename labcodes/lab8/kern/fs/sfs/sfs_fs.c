@@ -9,27 +9,34 @@
 #include <sfs.h>
 #include <inode.h>
 #include <iobuf.h>
-#include <bitmap.h>
+#include <bcache.h>
 #include <error.h>
 #include <assert.h>
 
 /*
- * sfs_sync - sync sfs's superblock and freemap in memroy into disk
+ * sfs_sync - sync sfs's inodes, superblock and freemap in memroy into the buffer cache, then write the cache into disk.
+ *            with a journal, they are committed first and then written back in place.
  */
 static int
 sfs_sync(struct fs *fs) {
     struct sfs_fs *sfs = fsop_info(fs, sfs);
+    int ret;
+    if (sfs->journal != NULL) {
+        if ((ret = sfs_journal_commit(sfs)) != 0) {
+            return ret;
+        }
+        return sfs_sync_blocks(sfs);
+    }
     lock_sfs_fs(sfs);
     {
         list_entry_t *list = &(sfs->inode_list), *le = list;
         while ((le = list_next(le)) != list) {
             struct sfs_inode *sin = le2sin(le, inode_link);
-            vop_fsync(info2node(sin, sfs_inode));
+            sfs_sync_inode(info2node(sin, sfs_inode));
         }
     }
     unlock_sfs_fs(sfs);
 
-    int ret;
     if (sfs->super_dirty) {
         sfs->super_dirty = 0;
         if ((ret = sfs_sync_super(sfs)) != 0) {
@@ -41,7 +48,7 @@ sfs_sync(struct fs *fs) {
             return ret;
         }
     }
-    return 0;
+    return sfs_sync_blocks(sfs);
 }
 
 /*
@@ -67,7 +74,11 @@ sfs_unmount(struct fs *fs) {
         return -E_BUSY;
     }
     assert(!sfs->super_dirty);
-    bitmap_destroy(sfs->freemap);
+    if (sfs->journal != NULL) {
+        sfs_journal_destroy(sfs);
+    }
+    bcache_invalidate(sfs->dev);
+    sfs_freemap_destroy(sfs->freemap);
     kfree(sfs->sfs_buffer);
     kfree(sfs->hash_list);
     kfree(sfs);
@@ -112,33 +123,6 @@ sfs_init_read(struct device *dev, uint32_t blkno, void *blk_buffer) {
     return dop_io(dev, iob, 0);
 }
 
-/*
- * sfs_init_freemap - used in sfs_do_mount to read freemap data info in disk block(blkno, nblks) directly.
- *
- * @dev:        the block device
- * @bitmap:     the bitmap in memroy
- * @blkno:      the NO. of disk block
- * @nblks:      Rd number of disk block
- * @blk_buffer: the buffer used for read
- *
- *      (1) get data addr in bitmap
- *      (2) read dev into iobuf
- */
-static int
-sfs_init_freemap(struct device *dev, struct bitmap *freemap, uint32_t blkno, uint32_t nblks, void *blk_buffer) {
-    size_t len;
-    void *data = bitmap_getdata(freemap, &len);
-    assert(data != NULL && len == nblks * SFS_BLKSIZE);
-    while (nblks != 0) {
-        int ret;
-        if ((ret = sfs_init_read(dev, blkno, data)) != 0) {
-            return ret;
-        }
-        blkno ++, nblks --, data += SFS_BLKSIZE;
-    }
-    return 0;
-}
-
 /*
  * sfs_do_mount - mount sfs file system.
  *
@@ -183,11 +167,29 @@ sfs_do_mount(struct device *dev, struct fs **fs_store) {
                 super->magic, SFS_MAGIC);
         goto failed_cleanup_sfs_buffer;
     }
+    /* replay the journal, the superblock itself may be in it */
+    if (super->journal != 0) {
+        if ((ret = sfs_journal_replay(dev, super->journal)) != 0) {
+            cprintf("sfs: journal replay failed: %e.\n", ret);
+            goto failed_cleanup_sfs_buffer;
+        }
+        if ((ret = sfs_init_read(dev, SFS_BLKN_SUPER, sfs_buffer)) != 0) {
+            goto failed_cleanup_sfs_buffer;
+        }
+        ret = -E_INVAL;
+    }
     if (super->blocks > dev->d_blocks) {
         cprintf("sfs: fs has %u blocks, device has %u blocks.\n",
                 super->blocks, dev->d_blocks);
         goto failed_cleanup_sfs_buffer;
     }
+    if (super->version == 0) {
+        super->version = SFS_VERSION_1;
+    }
+    if (super->version > SFS_VERSION_3) {
+        cprintf("sfs: unsupported format revision %u.\n", super->version);
+        goto failed_cleanup_sfs_buffer;
+    }
     super->info[SFS_MAX_INFO_LEN] = '\0';
     sfs->super = *super;
 
@@ -204,33 +206,38 @@ sfs_do_mount(struct device *dev, struct fs **fs_store) {
         list_init(hash_list + i);
     }
 
-    /* load and check freemap */
-    struct bitmap *freemap;
-    uint32_t freemap_size_nbits = sfs_freemap_bits(super);
-    if ((sfs->freemap = freemap = bitmap_create(freemap_size_nbits)) == NULL) {
-        goto failed_cleanup_hash_list;
+    /* the freemap is read block by block when it is used, only check the free counts after the superblock */
+    struct sfs_freemap *freemap;
+    uint16_t *counts = sfs_buffer + sizeof(struct sfs_super);
+    uint32_t blocks = sfs->super.blocks, unused_blocks = 0, ncounts = super->nfreecounts;
+    if (ncounts != sfs_freemap_blocks(super)) {
+        ncounts = 0;
     }
-    uint32_t freemap_size_nblks = sfs_freemap_blocks(super);
-    if ((ret = sfs_init_freemap(dev, freemap, SFS_BLKN_FREEMAP, freemap_size_nblks, sfs_buffer)) != 0) {
-        goto failed_cleanup_freemap;
+    for (i = 0; i < ncounts; i ++) {
+        unused_blocks += counts[i];
     }
-
-    uint32_t blocks = sfs->super.blocks, unused_blocks = 0;
-    for (i = 0; i < freemap_size_nbits; i ++) {
-        if (bitmap_test(freemap, i)) {
-            unused_blocks ++;
-        }
+    if (ncounts != 0 && unused_blocks != sfs->super.unused_blocks) {
+        cprintf("sfs: free counts of the freemap (%u) do not match the superblock (%u), ignored.\n",
+                unused_blocks, sfs->super.unused_blocks);
+        ncounts = 0;
+    }
+    unused_blocks = sfs->super.unused_blocks;
+    if ((sfs->freemap = freemap = sfs_freemap_create(blocks, counts, ncounts)) == NULL) {
+        goto failed_cleanup_hash_list;
     }
-    assert(unused_blocks == sfs->super.unused_blocks);
 
     /* and other fields */
     sfs->super_dirty = 0;
+    sfs->journal = NULL;
+    if (sfs->super.journal != 0 && (ret = sfs_journal_init(sfs)) != 0) {
+        goto failed_cleanup_freemap;
+    }
     sem_init(&(sfs->fs_sem), 1);
     sem_init(&(sfs->io_sem), 1);
     sem_init(&(sfs->mutex_sem), 1);
     list_init(&(sfs->inode_list));
-    cprintf("sfs: mount: '%s' (%d/%d/%d)\n", sfs->super.info,
-            blocks - unused_blocks, unused_blocks, blocks);
+    cprintf("sfs: mount: '%s' rev %d%s (%d/%d/%d)\n", sfs->super.info, sfs->super.version,
+            (sfs->journal != NULL) ? " journaled" : "", blocks - unused_blocks, unused_blocks, blocks);
 
     /* link addr of sync/get_root/unmount/cleanup funciton  fs's function pointers*/
     fs->fs_sync = sfs_sync;
@@ -241,7 +248,7 @@ sfs_do_mount(struct device *dev, struct fs **fs_store) {
     return 0;
 
 failed_cleanup_freemap:
-    bitmap_destroy(freemap);
+    sfs_freemap_destroy(freemap);
 failed_cleanup_hash_list:
     kfree(hash_list);
 failed_cleanup_sfs_buffer:
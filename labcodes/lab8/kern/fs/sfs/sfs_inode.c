@@ -9,12 +9,35 @@
 #include <sfs.h>
 #include <inode.h>
 #include <iobuf.h>
-#include <bitmap.h>
+#include <bcache.h>
+#include <filemap.h>
+#include <dcache.h>
+#include <pmm.h>
 #include <error.h>
 #include <assert.h>
 
+#define SFS_FILL_MAX                    16      /* max # of contiguous blocks read into the page cache in one request */
+#define SFS_MAX_LINK_DEPTH              8       /* max # of symbolic links followed in one lookup */
+#define SFS_RSV_NBLKS                   16      /* max # of free blocks reserved for an appending writer */
+
 static const struct inode_ops sfs_node_dirops;  // dir operations
 static const struct inode_ops sfs_node_fileops; // file operations
+static const struct inode_ops sfs_node_linkops; // symbolic link operations
+
+// slab caches of the in-memory copy of disk inode and of directory entry
+static struct kmem_cache *sfs_din_cachep, *sfs_entry_cachep;
+
+/*
+ * sfs_inode_cache_init - create the slab caches used by sfs inodes
+ */
+void
+sfs_inode_cache_init(void) {
+    sfs_din_cachep = kmem_cache_create("sfs_disk_inode", sizeof(struct sfs_disk_inode));
+    sfs_entry_cachep = kmem_cache_create("sfs_disk_entry", sizeof(struct sfs_disk_entry));
+    if (sfs_din_cachep == NULL || sfs_entry_cachep == NULL) {
+        panic("cannot create sfs inode caches.\n");
+    }
+}
 
 /*
  * lock_sin - lock the process of inode Rd/Wr
@@ -33,7 +56,7 @@ unlock_sin(struct sfs_inode *sin) {
 }
 
 /*
- * sfs_get_ops - return function addr of fs_node_dirops/sfs_node_fileops
+ * sfs_get_ops - return function addr of fs_node_dirops/sfs_node_fileops/sfs_node_linkops
  */
 static const struct inode_ops *
 sfs_get_ops(uint16_t type) {
@@ -42,6 +65,8 @@ sfs_get_ops(uint16_t type) {
         return &sfs_node_dirops;
     case SFS_TYPE_FILE:
         return &sfs_node_fileops;
+    case SFS_TYPE_LINK:
+        return &sfs_node_linkops;
     }
     panic("invalid file type %d.\n", type);
 }
@@ -73,41 +98,133 @@ sfs_remove_links(struct sfs_inode *sin) {
 }
 
 /*
- * sfs_block_inuse - check the inode with NO. ino inuse info in bitmap
+ * sfs_block_inuse - check the inode with NO. ino inuse info in bitmap, the freemap block is read if necessary
  */
 static bool
 sfs_block_inuse(struct sfs_fs *sfs, uint32_t ino) {
     if (ino != 0 && ino < sfs->super.blocks) {
-        return !bitmap_test(sfs->freemap, ino);
+        int ret;
+        if ((ret = sfs_freemap_load(sfs, ino)) != 0) {
+            panic("sfs_block_inuse: load freemap of %u failed: %e.\n", ino, ret);
+        }
+        return !sfs_freemap_test(sfs->freemap, ino);
     }
     panic("sfs_block_inuse: called out of range (0, %u) %u.\n", sfs->super.blocks, ino);
 }
 
 /*
- * sfs_block_alloc -  check and get a free disk block
+ * sfs_block_alloc -  check and get a free disk block, at goal or the nearest free one after it if goal != 0
  */
 static int
-sfs_block_alloc(struct sfs_fs *sfs, uint32_t *ino_store) {
+sfs_block_alloc(struct sfs_fs *sfs, uint32_t goal, uint32_t *ino_store) {
     int ret;
-    if ((ret = bitmap_alloc(sfs->freemap, ino_store)) != 0) {
+    if ((ret = sfs_freemap_alloc(sfs, goal, ino_store)) != 0) {
         return ret;
     }
     assert(sfs->super.unused_blocks > 0);
     sfs->super.unused_blocks --, sfs->super_dirty = 1;
     assert(sfs_block_inuse(sfs, *ino_store));
+    iostat.sfs_alloc ++;
+    if (*ino_store == goal) {
+        iostat.sfs_alloc_goal ++;
+    }
     return sfs_clear_block(sfs, *ino_store, 1);
 }
 
 /*
  * sfs_block_free - set related bits for ino block to 1(means free) in bitmap, add sfs->super.unused_blocks, set superblock dirty *
+ *                  with a journal, the block is not reused until the running transaction is committed
  */
 static void
 sfs_block_free(struct sfs_fs *sfs, uint32_t ino) {
-    assert(sfs_block_inuse(sfs, ino));
-    bitmap_free(sfs->freemap, ino);
+    bool inuse = sfs_block_inuse(sfs, ino);
+    assert(inuse);
+    if (sfs->journal != NULL) {
+        sfs_journal_free(sfs, ino);
+        return;
+    }
+    sfs_freemap_free(sfs->freemap, ino);
     sfs->super.unused_blocks ++, sfs->super_dirty = 1;
 }
 
+/*
+ * sfs_rsv_release - give the blocks reserved for sin back to the freemap.
+ *                   nothing on disk refers to them, so they are freed at once even with a journal.
+ */
+static void
+sfs_rsv_release(struct sfs_fs *sfs, struct sfs_inode *sin) {
+    for (; sin->rsv_count > 0; sin->rsv_count --, sin->rsv_start ++) {
+        assert(sfs_block_inuse(sfs, sin->rsv_start));
+        // 磁盘上的位图不变，但 freemap 块被标记为修改过，仍要写回
+        sfs_freemap_free(sfs->freemap, sin->rsv_start);
+        sfs->super_dirty = 1;
+    }
+}
+
+/*
+ * sfs_rsv_mask - count the blocks reserved for appends among those mapped by freemap block index,
+ *                and mark them free in map, a copy of that freemap block to be written to disk, if map is not NULL.
+ *                reservations live only in memory: on disk the reserved blocks are free, and so are they counted
+ *                in super.unused_blocks, nothing is leaked by a crash while files are open.
+ */
+uint32_t
+sfs_rsv_mask(struct sfs_fs *sfs, uint32_t index, uint32_t *map) {
+    uint32_t n = 0, blkno, bit;
+    list_entry_t *list = &(sfs->inode_list), *le = list;
+    while ((le = list_next(le)) != list) {
+        struct sfs_inode *sin = le2sin(le, inode_link);
+        // 预留的块不会跨过 freemap 块的边界
+        if (sin->rsv_count == 0 || sin->rsv_start / SFS_BLKBITS != index) {
+            continue;
+        }
+        for (blkno = sin->rsv_start; map != NULL && blkno < sin->rsv_start + sin->rsv_count; blkno ++) {
+            bit = blkno % SFS_BLKBITS;
+            map[bit / 32] |= (1 << (bit % 32));
+        }
+        n += sin->rsv_count;
+    }
+    return n;
+}
+
+/*
+ * sfs_block_alloc_sin - allocate a block for file sin which is appended after block prev (0 if none).
+ *
+ * 文件追加写时新的块尽量紧跟在前一个块之后：先看为这个文件预留的块，再以 prev + 1 为目标在位图中查找。
+ * 从位图中分配到块后，把紧随其后的至多 SFS_RSV_NBLKS 个空闲块预留给这个文件，
+ * 多个文件交替追加时各自的块仍然连续。预留的块在内存的位图中标记为已用，关闭或回收文件时归还；
+ * 磁盘空间不足时先归还所有文件的预留再分配。预留只存在于内存中，写回磁盘的位图和空闲块数中它们仍是空闲的（见 sfs_rsv_mask），
+ * 真正分配给文件时才从 super.unused_blocks 中减去。
+ */
+static int
+sfs_block_alloc_sin(struct sfs_fs *sfs, struct sfs_inode *sin, uint32_t prev, uint32_t *ino_store) {
+    uint32_t goal = (prev != 0 && prev + 1 < sfs->super.blocks) ? prev + 1 : 0;
+    int ret;
+    if (sin->rsv_count != 0) {
+        if (sin->rsv_start == goal) {
+            *ino_store = sin->rsv_start ++, sin->rsv_count --;
+            // 块在磁盘上的位图中从空闲变为已用
+            sfs_freemap_dirty(sfs->freemap, *ino_store);
+            assert(sfs->super.unused_blocks > 0);
+            sfs->super.unused_blocks --, sfs->super_dirty = 1;
+            iostat.sfs_alloc ++, iostat.sfs_alloc_goal ++;
+            return sfs_clear_block(sfs, *ino_store, 1);
+        }
+        sfs_rsv_release(sfs, sin);
+    }
+    if ((ret = sfs_block_alloc(sfs, goal, ino_store)) == -E_NO_MEM) {
+        list_entry_t *list = &(sfs->inode_list), *le = list;
+        while ((le = list_next(le)) != list) {
+            sfs_rsv_release(sfs, le2sin(le, inode_link));
+        }
+        ret = sfs_block_alloc(sfs, goal, ino_store);
+    }
+    if (ret == 0 && *ino_store + 1 < sfs->super.blocks) {
+        sin->rsv_start = *ino_store + 1;
+        sin->rsv_count = sfs_freemap_claim(sfs->freemap, sin->rsv_start, SFS_RSV_NBLKS);
+    }
+    return ret;
+}
+
 /*
  * sfs_create_inode - alloc a inode in memroy, and init din/ino/dirty/reclian_count/sem fields in sfs_inode in inode
  */
@@ -118,6 +235,7 @@ sfs_create_inode(struct sfs_fs *sfs, struct sfs_disk_inode *din, uint32_t ino, s
         vop_init(node, sfs_get_ops(din->type), info2fs(sfs, sfs));
         struct sfs_inode *sin = vop_info(node, sfs_inode);
         sin->din = din, sin->ino = ino, sin->dirty = 0, sin->reclaim_count = 1;
+        sin->rsv_start = sin->rsv_count = 0;
         sem_init(&(sin->sem), 1);
         *node_store = node;
         return 0;
@@ -161,7 +279,7 @@ sfs_load_inode(struct sfs_fs *sfs, struct inode **node_store, uint32_t ino) {
 
     int ret = -E_NO_MEM;
     struct sfs_disk_inode *din;
-    if ((din = kmalloc(sizeof(struct sfs_disk_inode))) == NULL) {
+    if ((din = kmem_cache_alloc(sfs_din_cachep)) == NULL) {
         goto failed_unlock;
     }
 
@@ -182,7 +300,7 @@ out_unlock:
     return 0;
 
 failed_cleanup_din:
-    kfree(din);
+    kmem_cache_free(sfs_din_cachep, din);
 failed_unlock:
     unlock_sfs_fs(sfs);
     return ret;
@@ -192,20 +310,30 @@ failed_unlock:
  * sfs_bmap_get_sub_nolock - according entry pointer entp and index, find the index of indrect disk block
  *                           return the index of indrect disk block to ino_store. no lock protect
  * @sfs:      sfs file system
+ * @sin:      sfs inode the indirect block belongs to
  * @entp:     the pointer of index of entry disk block
  * @index:    the index of block in indrect block
  * @create:   BOOL, if the block isn't allocated, if create = 1 the alloc a block,  otherwise just do nothing
+ * @prev:     the block of the file before the 1st one in the indirect block, new blocks are allocated after it
  * @ino_store: 0 OR the index of already inused block or new allocated block.
  */
 static int
-sfs_bmap_get_sub_nolock(struct sfs_fs *sfs, uint32_t *entp, uint32_t index, bool create, uint32_t *ino_store) {
+sfs_bmap_get_sub_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, uint32_t *entp, uint32_t index, bool create,
+                        uint32_t prev, uint32_t *ino_store) {
     assert(index < SFS_BLK_NENTRY);
     int ret;
-    uint32_t ent, ino = 0;
+    uint32_t ent, ino = 0, pair[2];
     off_t offset = index * sizeof(uint32_t);  // the offset of entry in entry block
-	// if entry block is existd, read the content of entry block into  sfs->sfs_buffer
+	// if entry block is existd, read the content of entry block
     if ((ent = *entp) != 0) {
-        if ((ret = sfs_rbuf(sfs, &ino, sizeof(uint32_t), ent, offset)) != 0) {
+        if (create && index != 0) {
+            // 同时读出前一个表项，新的块分配在文件的前一个块之后
+            if ((ret = sfs_rbuf(sfs, pair, sizeof(pair), ent, offset - sizeof(uint32_t))) != 0) {
+                return ret;
+            }
+            prev = pair[0], ino = pair[1];
+        }
+        else if ((ret = sfs_rbuf(sfs, &ino, sizeof(uint32_t), ent, offset)) != 0) {
             return ret;
         }
         if (ino != 0 || !create) {
@@ -217,12 +345,13 @@ sfs_bmap_get_sub_nolock(struct sfs_fs *sfs, uint32_t *entp, uint32_t index, bool
             goto out;
         }
 		//if entry block isn't existd, allocated a entry block (for indrect block)
-        if ((ret = sfs_block_alloc(sfs, &ent)) != 0) {
+        if ((ret = sfs_block_alloc_sin(sfs, sin, prev, &ent)) != 0) {
             return ret;
         }
+        prev = ent;
     }
     
-    if ((ret = sfs_block_alloc(sfs, &ino)) != 0) {
+    if ((ret = sfs_block_alloc_sin(sfs, sin, prev, &ino)) != 0) {
         goto failed_cleanup;
     }
     if ((ret = sfs_wbuf(sfs, &ino, sizeof(uint32_t), ent, offset)) != 0) {
@@ -244,6 +373,27 @@ failed_cleanup:
     return ret;
 }
 
+/*
+ * sfs_bmap_free_sub_nolock - set the entry item to 0 (free) in the indirect block
+ */
+static int
+sfs_bmap_free_sub_nolock(struct sfs_fs *sfs, uint32_t ent, uint32_t index) {
+    assert(sfs_block_inuse(sfs, ent) && index < SFS_BLK_NENTRY);
+    int ret;
+    uint32_t ino, zero = 0;
+    off_t offset = index * sizeof(uint32_t);
+    if ((ret = sfs_rbuf(sfs, &ino, sizeof(uint32_t), ent, offset)) != 0) {
+        return ret;
+    }
+    if (ino != 0) {
+        if ((ret = sfs_wbuf(sfs, &zero, sizeof(uint32_t), ent, offset)) != 0) {
+            return ret;
+        }
+        sfs_block_free(sfs, ino);
+    }
+    return 0;
+}
+
 /*
  * sfs_bmap_get_nolock - according sfs_inode and index of block, find the NO. of disk block
  *                       no lock protect
@@ -257,11 +407,48 @@ static int
 sfs_bmap_get_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, uint32_t index, bool create, uint32_t *ino_store) {
     struct sfs_disk_inode *din = sin->din;
     int ret;
-    uint32_t ent, ino;
+    uint32_t ent, ino, i, prev = sin->ino;
+    // the index of disk block is in the extents, no disk access is needed
+    for (i = 0; i < din->nextents; i ++) {
+        struct sfs_extent *ext = din->extents + i;
+        if (index < ext->len) {
+            ino = ext->start + index;
+            goto out;
+        }
+        index -= ext->len;
+        prev = ext->start + ext->len - 1;
+    }
+    // 追加第一个不在 extents 中的块：紧跟在最后一个 extent 之后时延长它，否则在还有空位时使用一个新的 extent
+    if (index == 0 && create && sfs_use_extents(sfs)) {
+        struct sfs_extent *last = (din->nextents != 0) ? din->extents + din->nextents - 1 : NULL;
+        uint32_t goal = prev + 1;
+        bool contig = (last != NULL && goal < sfs->super.blocks &&
+                ((sin->rsv_count != 0 && sin->rsv_start == goal) || !sfs_block_inuse(sfs, goal)));
+        if (contig || din->nextents < SFS_NEXTENT) {
+            if ((ret = sfs_block_alloc_sin(sfs, sin, prev, &ino)) != 0) {
+                return ret;
+            }
+            if (last != NULL && ino == last->start + last->len) {
+                last->len ++;
+            }
+            else {
+                assert(din->nextents < SFS_NEXTENT);
+                last = din->extents + din->nextents ++;
+                last->start = ino, last->len = 1;
+            }
+            sin->dirty = 1;
+            goto out;
+        }
+    }
+    // index is the index in the block pointer tree now
 	// the index of disk block is in the fist SFS_NDIRECT  direct blocks
     if (index < SFS_NDIRECT) {
         if ((ino = din->direct[index]) == 0 && create) {
-            if ((ret = sfs_block_alloc(sfs, &ino)) != 0) {
+            // 树中第 0 块紧跟在 extents 的最后一块之后，没有 extent 时紧跟在 inode 所在的块之后
+            if (index != 0) {
+                prev = din->direct[index - 1];
+            }
+            if ((ret = sfs_block_alloc_sin(sfs, sin, prev, &ino)) != 0) {
                 return ret;
             }
             din->direct[index] = ino;
@@ -273,7 +460,7 @@ sfs_bmap_get_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, uint32_t index, b
     index -= SFS_NDIRECT;
     if (index < SFS_BLK_NENTRY) {
         ent = din->indirect;
-        if ((ret = sfs_bmap_get_sub_nolock(sfs, &ent, index, create, &ino)) != 0) {
+        if ((ret = sfs_bmap_get_sub_nolock(sfs, sin, &ent, index, create, din->direct[SFS_NDIRECT - 1], &ino)) != 0) {
             return ret;
         }
         if (ent != din->indirect) {
@@ -282,44 +469,62 @@ sfs_bmap_get_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, uint32_t index, b
             sin->dirty = 1;
         }
         goto out;
-    } else {
-		panic ("sfs_bmap_get_nolock - index out of range");
-	}
-out:
-    assert(ino == 0 || sfs_block_inuse(sfs, ino));
-    *ino_store = ino;
-    return 0;
-}
-
-/*
- * sfs_bmap_free_sub_nolock - set the entry item to 0 (free) in the indirect block
- */
-static int
-sfs_bmap_free_sub_nolock(struct sfs_fs *sfs, uint32_t ent, uint32_t index) {
-    assert(sfs_block_inuse(sfs, ent) && index < SFS_BLK_NENTRY);
-    int ret;
-    uint32_t ino, zero = 0;
-    off_t offset = index * sizeof(uint32_t);
-    if ((ret = sfs_rbuf(sfs, &ino, sizeof(uint32_t), ent, offset)) != 0) {
-        return ret;
     }
-    if (ino != 0) {
-        if ((ret = sfs_wbuf(sfs, &zero, sizeof(uint32_t), ent, offset)) != 0) {
+    // the index of disk block is in the double indirect blocks: the entries of db_indirect are indirect blocks
+    index -= SFS_BLK_NENTRY;
+    if (index < SFS_BLK_NENTRY * SFS_BLK_NENTRY) {
+        uint32_t ind;
+        ent = din->db_indirect;
+        if ((ret = sfs_bmap_get_sub_nolock(sfs, sin, &ent, index / SFS_BLK_NENTRY, create, din->indirect, &ind)) != 0) {
             return ret;
         }
-        sfs_block_free(sfs, ino);
+        if (ent != din->db_indirect) {
+            assert(din->db_indirect == 0);
+            din->db_indirect = ent;
+            sin->dirty = 1;
+        }
+        ino = 0;
+        if (ind != 0 && (ret = sfs_bmap_get_sub_nolock(sfs, sin, &ind, index % SFS_BLK_NENTRY, create, ind, &ino)) != 0) {
+            // 一级间接块中还没有任何表项，释放它，db_indirect 中也没有表项时一并释放
+            if (index % SFS_BLK_NENTRY == 0 && sfs_bmap_free_sub_nolock(sfs, ent, index / SFS_BLK_NENTRY) == 0 && index == 0) {
+                sfs_block_free(sfs, ent);
+                din->db_indirect = 0;
+            }
+            return ret;
+        }
+        goto out;
     }
+    panic ("sfs_bmap_get_nolock - index out of range");
+out:
+    assert(ino == 0 || sfs_block_inuse(sfs, ino));
+    *ino_store = ino;
     return 0;
 }
 
 /*
- * sfs_bmap_free_nolock - free a block with logical index in inode and reset the inode's fields
+ * sfs_bmap_free_nolock - free a block with logical index in inode and reset the inode's fields.
+ *                        the block is the last one of the file, an indirect block is freed with its first entry.
  */
 static int
 sfs_bmap_free_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, uint32_t index) {
     struct sfs_disk_inode *din = sin->din;
     int ret;
-    uint32_t ent, ino;
+    uint32_t ent, ino, i;
+    for (i = 0; i < din->nextents; i ++) {
+        struct sfs_extent *ext = din->extents + i;
+        if (index < ext->len) {
+            // 文件的最后一块是最后一个 extent 的最后一块
+            assert(i == din->nextents - 1 && index == ext->len - 1);
+            sfs_block_free(sfs, ext->start + index);
+            if (-- ext->len == 0) {
+                ext->start = 0, din->nextents --;
+            }
+            sin->dirty = 1;
+            return 0;
+        }
+        index -= ext->len;
+    }
+
     if (index < SFS_NDIRECT) {
         if ((ino = din->direct[index]) != 0) {
 			// free the block
@@ -337,9 +542,37 @@ sfs_bmap_free_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, uint32_t index)
             if ((ret = sfs_bmap_free_sub_nolock(sfs, ent, index)) != 0) {
                 return ret;
             }
+            if (index == 0) {
+                sfs_block_free(sfs, ent);
+                din->indirect = 0;
+                sin->dirty = 1;
+            }
         }
         return 0;
     }
+
+    index -= SFS_BLK_NENTRY;
+    if ((ent = din->db_indirect) != 0) {
+        uint32_t ind;
+        off_t offset = index / SFS_BLK_NENTRY * sizeof(uint32_t);
+        if ((ret = sfs_rbuf(sfs, &ind, sizeof(uint32_t), ent, offset)) != 0) {
+            return ret;
+        }
+        if (ind != 0 && (ret = sfs_bmap_free_sub_nolock(sfs, ind, index % SFS_BLK_NENTRY)) != 0) {
+            return ret;
+        }
+        if (index % SFS_BLK_NENTRY == 0) {
+            // free the indirect block, then the double indirect block if it has no entry
+            if ((ret = sfs_bmap_free_sub_nolock(sfs, ent, index / SFS_BLK_NENTRY)) != 0) {
+                return ret;
+            }
+            if (index == 0) {
+                sfs_block_free(sfs, ent);
+                din->db_indirect = 0;
+                sin->dirty = 1;
+            }
+        }
+    }
     return 0;
 }
 
@@ -427,6 +660,103 @@ sfs_dirent_read_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, int slot, stru
         }                                                                           \
     } while (0)
 
+/*
+ * sfs_pdirent_search_nolock - find the entry of name in the packed DIR through its hash index,
+ *                             only the entries in the hash chain of name are read
+ * @entry:      buffer for the names read
+ * @pos_store:  position of the entry in the DIR
+ */
+static int
+sfs_pdirent_search_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, const char *name, struct sfs_disk_entry *entry, uint32_t *ino_store, int *pos_store) {
+    size_t len = strlen(name);
+    uint32_t hash = sfs_name_hash(name, len), pos, index, blkno;
+    struct sfs_disk_dirent de;
+    off_t offset;
+    int ret;
+    if (sin->din->blocks == 0) {
+        return -E_NOENT;
+    }
+    if ((ret = sfs_bmap_load_nolock(sfs, sin, 0, &blkno)) != 0) {
+        return ret;
+    }
+    if ((ret = sfs_rbuf(sfs, &pos, sizeof(pos), blkno, (hash % SFS_DIR_NBUCKET) * sizeof(uint32_t))) != 0) {
+        return ret;
+    }
+    for (; pos != 0; pos = de.next) {
+        index = pos / SFS_BLKSIZE, offset = pos % SFS_BLKSIZE;
+        if (index == 0 || index >= sin->din->blocks || offset + sizeof(de) > SFS_BLKSIZE) {
+            return -E_INVAL;
+        }
+        if ((ret = sfs_bmap_load_nolock(sfs, sin, index, &blkno)) != 0) {
+            return ret;
+        }
+        if ((ret = sfs_rbuf(sfs, &de, sizeof(de), blkno, offset)) != 0) {
+            return ret;
+        }
+        // 哈希值和长度都相同时才读出名字比较
+        if (de.ino == 0 || de.hash != hash || de.name_len != len) {
+            continue;
+        }
+        if (offset + sizeof(de) + len > SFS_BLKSIZE) {
+            return -E_INVAL;
+        }
+        if ((ret = sfs_rbuf(sfs, entry->name, len, blkno, offset + sizeof(de))) != 0) {
+            return ret;
+        }
+        if (memcmp(entry->name, name, len) == 0) {
+            *ino_store = de.ino;
+            if (pos_store != NULL) {
+                *pos_store = pos;
+            }
+            return 0;
+        }
+    }
+    return -E_NOENT;
+}
+
+/*
+ * sfs_pdirent_scan_nolock - walk the entries of the packed DIR in order, stop at the first entry in use of inode ino,
+ *                           or at the slot-th entry in use if ino is 0, and copy it into entry
+ */
+static int
+sfs_pdirent_scan_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, uint32_t ino, int slot, struct sfs_disk_entry *entry) {
+    void *buffer;
+    if ((buffer = kmalloc(SFS_BLKSIZE)) == NULL) {
+        return -E_NO_MEM;
+    }
+    uint32_t index, blkno;
+    off_t offset;
+    int ret;
+    for (index = 1; index < sin->din->blocks; index ++) {
+        if ((ret = sfs_bmap_load_nolock(sfs, sin, index, &blkno)) != 0) {
+            goto out;
+        }
+        if ((ret = sfs_rblock(sfs, buffer, blkno, 1)) != 0) {
+            goto out;
+        }
+        for (offset = 0; offset < SFS_BLKSIZE; ) {
+            struct sfs_disk_dirent *de = buffer + offset;
+            if (offset + sizeof(*de) > SFS_BLKSIZE || de->rec_len < sfs_dirent_size(de->name_len)
+                    || offset + de->rec_len > SFS_BLKSIZE) {
+                ret = -E_INVAL;
+                goto out;
+            }
+            if (de->ino != 0 && ((ino != 0) ? de->ino == ino : slot -- == 0)) {
+                entry->ino = de->ino;
+                memcpy(entry->name, de->name, de->name_len);
+                entry->name[de->name_len] = '\0';
+                ret = 0;
+                goto out;
+            }
+            offset += de->rec_len;
+        }
+    }
+    ret = -E_NOENT;
+out:
+    kfree(buffer);
+    return ret;
+}
+
 /*
  * sfs_dirent_search_nolock - read every file entry in the DIR, compare file name with each entry->name
  *                            If equal, then return slot and NO. of disk of this file's inode
@@ -436,17 +766,24 @@ sfs_dirent_read_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, int slot, stru
  * @ino_store:  NO. of disk of this file (with the filename)'s inode
  * @slot:       logical index of file entry (NOTICE: each file entry ocupied one  disk block)
  * @empty_slot: the empty logical index of file entry.
+ *              a packed DIR is searched through its hash index instead, slot is set to the position of the entry
+ *              and empty_slot is not used.
  */
 static int
 sfs_dirent_search_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, const char *name, uint32_t *ino_store, int *slot, int *empty_slot) {
     assert(strlen(name) <= SFS_MAX_FNAME_LEN);
     struct sfs_disk_entry *entry;
-    if ((entry = kmalloc(sizeof(struct sfs_disk_entry))) == NULL) {
+    if ((entry = kmem_cache_alloc(sfs_entry_cachep)) == NULL) {
         return -E_NO_MEM;
     }
+    int ret;
+    if (sfs_packed_dir(sfs)) {
+        ret = sfs_pdirent_search_nolock(sfs, sin, name, entry, ino_store, slot);
+        goto out;
+    }
 
 #define set_pvalue(x, v)            do { if ((x) != NULL) { *(x) = (v); } } while (0)
-    int ret, i, nslots = sin->din->blocks;
+    int i, nslots = sin->din->blocks;
     set_pvalue(empty_slot, nslots);
     for (i = 0; i < nslots; i ++) {
         if ((ret = sfs_dirent_read_nolock(sfs, sin, i, entry)) != 0) {
@@ -465,7 +802,7 @@ sfs_dirent_search_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, const char *
 #undef set_pvalue
     ret = -E_NOENT;
 out:
-    kfree(entry);
+    kmem_cache_free(sfs_entry_cachep, entry);
     return ret;
 }
 
@@ -475,6 +812,9 @@ out:
 
 static int
 sfs_dirent_findino_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, uint32_t ino, struct sfs_disk_entry *entry) {
+    if (sfs_packed_dir(sfs)) {
+        return sfs_pdirent_scan_nolock(sfs, sin, ino, 0, entry);
+    }
     int ret, i, nslots = sin->din->blocks;
     for (i = 0; i < nslots; i ++) {
         if ((ret = sfs_dirent_read_nolock(sfs, sin, i, entry)) != 0) {
@@ -511,6 +851,14 @@ sfs_lookup_once(struct sfs_fs *sfs, struct sfs_inode *sin, const char *name, str
     return ret;
 }
 
+/*
+ * sfs_lookup_dentry - the dcache miss handler of sfs_lookup, find a single component in directory dir
+ */
+static int
+sfs_lookup_dentry(struct inode *dir, const char *name, struct inode **node_store) {
+    return sfs_lookup_once(fsop_info(vop_fs(dir), sfs), vop_info(dir, sfs_inode), name, node_store, NULL);
+}
+
 // sfs_opendir - just check the opne_flags, now support readonly
 static int
 sfs_opendir(struct inode *node, uint32_t open_flags) {
@@ -534,23 +882,114 @@ sfs_openfile(struct inode *node, uint32_t open_flags) {
     return 0;
 }
 
-// sfs_close - close file
+// sfs_close - close file, the inode info is left in the buffer cache, and the blocks reserved for appends are freed
 static int
 sfs_close(struct inode *node) {
-    return vop_fsync(node);
+    struct sfs_fs *sfs = fsop_info(vop_fs(node), sfs);
+    struct sfs_inode *sin = vop_info(node, sfs_inode);
+    int ret;
+    sfs_journal_start(sfs);
+    if (sin->rsv_count != 0) {
+        lock_sin(sin);
+        sfs_rsv_release(sfs, sin);
+        unlock_sin(sin);
+    }
+    ret = sfs_sync_inode(node);
+    sfs_journal_stop(sfs);
+    return ret;
+}
+
+/*
+ * sfs_filemap_run - return the # of blocks, up to max, from block index (disk block ino) of the file on
+ *                   which are not in the page cache and lie contiguously on disk, so they can be read in one request
+ */
+static uint32_t
+sfs_filemap_run(struct sfs_fs *sfs, struct sfs_inode *sin, uint32_t index, uint32_t ino, uint32_t max) {
+    uint32_t nblks = 1, next;
+    while (nblks < max && index + nblks < sin->din->blocks
+            && filemap_lookup(sfs->dev, sin->ino, index + nblks) == NULL
+            && sfs_bmap_load_nolock(sfs, sin, index + nblks, &next) == 0 && next == ino + nblks) {
+        nblks ++;
+    }
+    return nblks;
+}
+
+/*
+ * sfs_filemap_fill - read blocks [index, index + nblks) of the file, which lie at disk blocks [ino, ino + nblks),
+ *                    into new pages and add them to the page cache.
+ *                    the blocks are read in one request into contiguous pages when free memory is plenty,
+ *                    or else only block index is read. *nblks_store gets the # of blocks filled.
+ */
+static int
+sfs_filemap_fill(struct sfs_fs *sfs, struct sfs_inode *sin, uint32_t index, uint32_t ino, uint32_t nblks, uint32_t *nblks_store) {
+    struct Page *page = NULL;
+    uint32_t i;
+    int ret;
+    if (nblks > 1 && (nr_free_pages() < pages_high + nblks || (page = alloc_pages(nblks)) == NULL)) {
+        nblks = 1;
+    }
+    if (page == NULL && (page = alloc_page()) == NULL) {
+        return -E_NO_MEM;
+    }
+    if ((ret = bread_direct(sfs->dev, ino, nblks, page2kva(page))) != 0) {
+        free_pages(page, nblks);
+        return ret;
+    }
+    for (i = 0; i < nblks; i ++) {
+        filemap_add(sfs->dev, sin->ino, index + i, page + i);
+    }
+    *nblks_store = nblks;
+    return 0;
+}
+
+/*
+ * sfs_rwpage_nolock - Rd/Wr len bytes at offset in block index (disk block ino) of the file, from or to iob
+ *                     reads are served from the page cache, a miss fills the contiguous blocks up to block endblk
+ *                     the caller is going to read; writes go to the buffer cache and update the cached page,
+ *                     so the pages in the page cache are never dirty.
+ *                     the data are moved between the caches and iob directly, iob may be a user buffer.
+ */
+static int
+sfs_rwpage_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, struct iobuf *iob, size_t len, uint32_t index, uint32_t ino, off_t offset, uint32_t endblk, bool write) {
+    struct Page *page;
+    uint32_t nblks;
+    int ret;
+    if (write) {
+        // 缓存的页面从 iob 中同一位置再复制一次
+        struct iobuf from = *iob;
+        ret = sfs_wdata(sfs, iob, len, ino, offset);
+        if (ret == 0 && (page = filemap_lookup(sfs->dev, sin->ino, index)) != NULL) {
+            iobuf_move(&from, page2kva(page) + offset, len, 0, NULL);
+        }
+        return ret;
+    }
+    if ((page = filemap_lookup(sfs->dev, sin->ino, index)) != NULL) {
+        iostat.filemap_hit ++;
+    }
+    else {
+        nblks = sfs_filemap_run(sfs, sin, index, ino, (endblk - index < SFS_FILL_MAX) ? endblk - index : SFS_FILL_MAX);
+        if ((ret = sfs_filemap_fill(sfs, sin, index, ino, nblks, &nblks)) != 0) {
+            return ret;
+        }
+        iostat.filemap_miss ++;
+        page = filemap_lookup(sfs->dev, sin->ino, index);
+        assert(page != NULL);
+    }
+    iobuf_move(iob, page2kva(page) + offset, len, 1, NULL);
+    return 0;
 }
 
 /*  
  * sfs_io_nolock - Rd/Wr a file contentfrom offset position to offset+ length  disk blocks<-->buffer (in memroy)
  * @sfs:      sfs file system
  * @sin:      sfs inode in memory
- * @buf:      the buffer Rd/Wr
+ * @iob:      the buffer Rd/Wr, which is advanced by the really Rd/Wr length
  * @offset:   the offset of file
  * @alenp:    the length need to read (is a pointer). and will RETURN the really Rd/Wr lenght
  * @write:    BOOL, 0 read, 1 write
  */
 static int
-sfs_io_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, void *buf, off_t offset, size_t *alenp, bool write) {
+sfs_io_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, struct iobuf *iob, off_t offset, size_t *alenp, bool write) {
     struct sfs_disk_inode *din = sin->din;
     assert(din->type != SFS_TYPE_DIR);
     off_t endpos = offset + *alenp, blkoff;
@@ -574,24 +1013,15 @@ sfs_io_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, void *buf, off_t offset
         }
     }
 
-    int (*sfs_buf_op)(struct sfs_fs *sfs, void *buf, size_t len, uint32_t blkno, off_t offset);
-    int (*sfs_block_op)(struct sfs_fs *sfs, void *buf, uint32_t blkno, uint32_t nblks);
-    if (write) {
-        sfs_buf_op = sfs_wbuf, sfs_block_op = sfs_wblock;
-    }
-    else {
-        sfs_buf_op = sfs_rbuf, sfs_block_op = sfs_rblock;
-    }
-
     int ret = 0;
     size_t size, alen = 0;
     uint32_t ino;
     uint32_t blkno = offset / SFS_BLKSIZE;          // The NO. of Rd/Wr begin block
     uint32_t nblks = endpos / SFS_BLKSIZE - blkno;  // The size of Rd/Wr blocks
+    uint32_t endblk = ROUNDUP_DIV(endpos, SFS_BLKSIZE);    // The NO. of the block after the last Rd/Wr one
 
-    // LAB8:EXERCISE1 YOUR CODE HINT: call sfs_bmap_load_nolock, sfs_rbuf, sfs_rblock,etc. read different kind of blocks in file
 	// (1) If offset isn't aligned with the first block, Rd/Wr some content from offset to the end of the first block
-	//       NOTICE: useful function: sfs_bmap_load_nolock, sfs_buf_op
+	//       NOTICE: useful function: sfs_bmap_load_nolock, sfs_rwpage_nolock
 	//               Rd/Wr size = (nblks != 0) ? (SFS_BLKSIZE - blkoff) : (endpos - offset)
     if ((blkoff = offset % SFS_BLKSIZE) != 0) {
         // size 为不足页大小的连续数据读取量
@@ -599,36 +1029,36 @@ sfs_io_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, void *buf, off_t offset
         if ((ret = sfs_bmap_load_nolock(sfs, sin, blkno, &ino)) != 0) {
             goto out;
         }
-        if ((ret = sfs_buf_op(sfs, buf, size, ino, blkoff)) != 0) {
+        if ((ret = sfs_rwpage_nolock(sfs, sin, iob, size, blkno, ino, blkoff, endblk, write)) != 0) {
             goto out;
         }
         alen += size;
         if (nblks == 0) {
             goto out;
         }
-        buf += size, blkno ++, nblks --;
+        blkno ++, nblks --;
     }
 
 	// (2) Rd/Wr aligned blocks 
-	//       NOTICE: useful function: sfs_bmap_load_nolock, sfs_block_op
+	//       NOTICE: useful function: sfs_bmap_load_nolock, sfs_rwpage_nolock
     size = SFS_BLKSIZE;
     while (nblks != 0) {
         if ((ret = sfs_bmap_load_nolock(sfs, sin, blkno, &ino)) != 0) {
             goto out;
         }
-        if ((ret = sfs_block_op(sfs, buf, ino, 1)) != 0) {
+        if ((ret = sfs_rwpage_nolock(sfs, sin, iob, size, blkno, ino, 0, endblk, write)) != 0) {
             goto out;
         }
-        alen += size, buf += size, blkno ++, nblks --;
+        alen += size, blkno ++, nblks --;
     }
 
     // (3) If end position isn't aligned with the last block, Rd/Wr some content from begin to the (endpos % SFS_BLKSIZE) of the last block
-	//       NOTICE: useful function: sfs_bmap_load_nolock, sfs_buf_op
+	//       NOTICE: useful function: sfs_bmap_load_nolock, sfs_rwpage_nolock
     if ((size = endpos % SFS_BLKSIZE) != 0) {
         if ((ret = sfs_bmap_load_nolock(sfs, sin, blkno, &ino)) != 0) {
             goto out;
         }
-        if ((ret = sfs_buf_op(sfs, buf, size, ino, 0)) != 0) {
+        if ((ret = sfs_rwpage_nolock(sfs, sin, iob, size, blkno, ino, 0, endblk, write)) != 0) {
             goto out;
         }
         alen += size;
@@ -644,22 +1074,25 @@ out:
 
 /*
  * sfs_io - Rd/Wr file. the wrapper of sfs_io_nolock
-            with lock protect
+            with lock protect, a write is an operation of the journal
  */
 static inline int
 sfs_io(struct inode *node, struct iobuf *iob, bool write) {
     struct sfs_fs *sfs = fsop_info(vop_fs(node), sfs);
     struct sfs_inode *sin = vop_info(node, sfs_inode);
     int ret;
+    if (write) {
+        sfs_journal_start(sfs);
+    }
     lock_sin(sin);
     {
         size_t alen = iob->io_resid;
-        ret = sfs_io_nolock(sfs, sin, iob->io_base, iob->io_offset, &alen, write);
-        if (alen != 0) {
-            iobuf_skip(iob, alen);
-        }
+        ret = sfs_io_nolock(sfs, sin, iob, iob->io_offset, &alen, write);
     }
     unlock_sin(sin);
+    if (write) {
+        sfs_journal_stop(sfs);
+    }
     return ret;
 }
 
@@ -675,6 +1108,45 @@ sfs_write(struct inode *node, struct iobuf *iob) {
     return sfs_io(node, iob, 1);
 }
 
+/*
+ * sfs_readahead - read blocks [index, index + nblks) of file into the page cache, called by kreadahead.
+ *                 contiguous blocks are read in one request; the inode is locked for one request at a time,
+ *                 so the reader is not held up by the whole window.
+ */
+static int
+sfs_readahead(struct inode *node, uint32_t index, uint32_t nblks) {
+    struct sfs_fs *sfs = fsop_info(vop_fs(node), sfs);
+    struct sfs_inode *sin = vop_info(node, sfs_inode);
+    uint32_t ino, filled;
+    int ret = 0;
+    while (nblks != 0) {
+        // 内存紧张时放弃预读
+        if (pages_low != 0 && nr_free_pages() < pages_low) {
+            break;
+        }
+        lock_sin(sin);
+        if (index >= sin->din->blocks) {
+            unlock_sin(sin);
+            break;
+        }
+        filled = 1;
+        if (filemap_lookup(sfs->dev, sin->ino, index) == NULL) {
+            if ((ret = sfs_bmap_load_nolock(sfs, sin, index, &ino)) == 0) {
+                filled = sfs_filemap_run(sfs, sin, index, ino, (nblks < SFS_FILL_MAX) ? nblks : SFS_FILL_MAX);
+                if ((ret = sfs_filemap_fill(sfs, sin, index, ino, filled, &filled)) == 0) {
+                    iostat.readahead += filled;
+                }
+            }
+        }
+        unlock_sin(sin);
+        if (ret != 0) {
+            break;
+        }
+        index += filled, nblks -= filled;
+    }
+    return ret;
+}
+
 /*
  * sfs_fstat - Return nlinks/block/size, etc. info about a file. The pointer is a pointer to struct stat;
  */
@@ -693,10 +1165,10 @@ sfs_fstat(struct inode *node, struct stat *stat) {
 }
 
 /*
- * sfs_fsync - Force any dirty inode info associated with this file to stable storage.
+ * sfs_sync_inode - write the dirty inode info into its cached disk block, the block itself is written back later.
  */
-static int
-sfs_fsync(struct inode *node) {
+int
+sfs_sync_inode(struct inode *node) {
     struct sfs_fs *sfs = fsop_info(vop_fs(node), sfs);
     struct sfs_inode *sin = vop_info(node, sfs_inode);
     int ret = 0;
@@ -715,6 +1187,24 @@ sfs_fsync(struct inode *node) {
     return ret;
 }
 
+/*
+ * sfs_fsync - Force any dirty inode info associated with this file to stable storage.
+ *             the dirty blocks in the buffer cache are not tracked per file, so all of them are written back.
+ *             with a journal, the running transaction is committed instead.
+ */
+static int
+sfs_fsync(struct inode *node) {
+    struct sfs_fs *sfs = fsop_info(vop_fs(node), sfs);
+    int ret;
+    if (sfs->journal != NULL) {
+        return sfs_journal_commit(sfs);
+    }
+    if ((ret = sfs_sync_inode(node)) != 0) {
+        return ret;
+    }
+    return sfs_sync_blocks(sfs);
+}
+
 /*
  *sfs_namefile -Compute pathname relative to filesystem root of the file and copy to the specified io buffer.
  *  
@@ -722,7 +1212,7 @@ sfs_fsync(struct inode *node) {
 static int
 sfs_namefile(struct inode *node, struct iobuf *iob) {
     struct sfs_disk_entry *entry;
-    if (iob->io_resid <= 2 || (entry = kmalloc(sizeof(struct sfs_disk_entry))) == NULL) {
+    if (iob->io_resid <= 2 || (entry = kmem_cache_alloc(sfs_entry_cachep)) == NULL) {
         return -E_NO_MEM;
     }
 
@@ -770,14 +1260,14 @@ sfs_namefile(struct inode *node, struct iobuf *iob) {
     ptr = memmove(iob->io_base + 1, ptr, alen);
     ptr[-1] = '/', ptr[alen] = '\0';
     iobuf_skip(iob, alen);
-    kfree(entry);
+    kmem_cache_free(sfs_entry_cachep, entry);
     return 0;
 
 failed_nomem:
     ret = -E_NO_MEM;
 failed:
     vop_ref_dec(node);
-    kfree(entry);
+    kmem_cache_free(sfs_entry_cachep, entry);
     return ret;
 }
 
@@ -786,6 +1276,9 @@ failed:
  */
 static int
 sfs_getdirentry_sub_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, int slot, struct sfs_disk_entry *entry) {
+    if (sfs_packed_dir(sfs)) {
+        return sfs_pdirent_scan_nolock(sfs, sin, 0, slot, entry);
+    }
     int ret, i, nslots = sin->din->blocks;
     for (i = 0; i < nslots; i ++) {
         if ((ret = sfs_dirent_read_nolock(sfs, sin, i, entry)) != 0) {
@@ -808,7 +1301,7 @@ sfs_getdirentry_sub_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, int slot,
 static int
 sfs_getdirentry(struct inode *node, struct iobuf *iob) {
     struct sfs_disk_entry *entry;
-    if ((entry = kmalloc(sizeof(struct sfs_disk_entry))) == NULL) {
+    if ((entry = kmem_cache_alloc(sfs_entry_cachep)) == NULL) {
         return -E_NO_MEM;
     }
 
@@ -818,11 +1311,12 @@ sfs_getdirentry(struct inode *node, struct iobuf *iob) {
     int ret, slot;
     off_t offset = iob->io_offset;
     if (offset < 0 || offset % sfs_dentry_size != 0) {
-        kfree(entry);
+        kmem_cache_free(sfs_entry_cachep, entry);
         return -E_INVAL;
     }
-    if ((slot = offset / sfs_dentry_size) > sin->din->blocks) {
-        kfree(entry);
+    // 第 1 版的目录每块只有一个目录项，可以直接排除超出范围的 slot
+    if ((slot = offset / sfs_dentry_size) > sin->din->blocks && !sfs_packed_dir(sfs)) {
+        kmem_cache_free(sfs_entry_cachep, entry);
         return -E_NOENT;
     }
     lock_sin(sin);
@@ -833,7 +1327,53 @@ sfs_getdirentry(struct inode *node, struct iobuf *iob) {
     unlock_sin(sin);
     ret = iobuf_move(iob, entry->name, sfs_dentry_size, 1, NULL);
 out:
-    kfree(entry);
+    kmem_cache_free(sfs_entry_cachep, entry);
+    return ret;
+}
+
+/*
+ * sfs_truncate - resize file sin with new length, in the journal operation of the caller
+ */
+static int
+sfs_truncate(struct sfs_fs *sfs, struct sfs_inode *sin, off_t len) {
+    struct sfs_disk_inode *din = sin->din;
+
+    int ret = 0;
+	//new number of disk blocks of file
+    uint32_t nblks, tblks = ROUNDUP_DIV(len, SFS_BLKSIZE);
+    if (din->size == len) {
+        assert(tblks == din->blocks);
+        return 0;
+    }
+
+    lock_sin(sin);
+	// old number of disk blocks of file
+    nblks = din->blocks;
+    if (nblks < tblks) {
+		// try to enlarge the file size by add new disk block at the end of file
+        while (nblks != tblks) {
+            if ((ret = sfs_bmap_load_nolock(sfs, sin, nblks, NULL)) != 0) {
+                goto out_unlock;
+            }
+            nblks ++;
+        }
+    }
+    else if (tblks < nblks) {
+		// try to reduce the file size 
+        while (tblks != nblks) {
+            if ((ret = sfs_bmap_truncate_nolock(sfs, sin)) != 0) {
+                goto out_unlock;
+            }
+            nblks --;
+        }
+        filemap_truncate(sfs->dev, sin->ino, tblks);
+    }
+    assert(din->blocks == tblks);
+    din->size = len;
+    sin->dirty = 1;
+
+out_unlock:
+    unlock_sin(sin);
     return ret;
 }
 
@@ -847,18 +1387,20 @@ sfs_reclaim(struct inode *node) {
 
     int  ret = -E_BUSY;
     uint32_t ent;
+    sfs_journal_start(sfs);
     lock_sfs_fs(sfs);
     assert(sin->reclaim_count > 0);
     if ((-- sin->reclaim_count) != 0 || inode_ref_count(node) != 0) {
         goto failed_unlock;
     }
+    sfs_rsv_release(sfs, sin);
     if (sin->din->nlinks == 0) {
-        if ((ret = vop_truncate(node, 0)) != 0) {
+        if ((ret = sfs_truncate(sfs, sin, 0)) != 0) {
             goto failed_unlock;
         }
     }
     if (sin->dirty) {
-        if ((ret = vop_fsync(node)) != 0) {
+        if ((ret = sfs_sync_inode(node)) != 0) {
             goto failed_unlock;
         }
     }
@@ -871,12 +1413,14 @@ sfs_reclaim(struct inode *node) {
             sfs_block_free(sfs, ent);
         }
     }
-    kfree(sin->din);
+    sfs_journal_stop(sfs);
+    kmem_cache_free(sfs_din_cachep, sin->din);
     vop_kill(node);
     return 0;
 
 failed_unlock:
     unlock_sfs_fs(sfs);
+    sfs_journal_stop(sfs);
     return ret;
 }
 
@@ -924,71 +1468,136 @@ sfs_truncfile(struct inode *node, off_t len) {
         return -E_INVAL;
     }
     struct sfs_fs *sfs = fsop_info(vop_fs(node), sfs);
-    struct sfs_inode *sin = vop_info(node, sfs_inode);
-    struct sfs_disk_inode *din = sin->din;
+    int ret;
+    sfs_journal_start(sfs);
+    ret = sfs_truncate(sfs, vop_info(node, sfs_inode), len);
+    sfs_journal_stop(sfs);
+    return ret;
+}
 
-    int ret = 0;
-	//new number of disk blocks of file
-    uint32_t nblks, tblks = ROUNDUP_DIV(len, SFS_BLKSIZE);
-    if (din->size == len) {
-        assert(tblks == din->blocks);
-        return 0;
-    }
+/*
+ * sfs_openlink - a symbolic link is always followed by sfs_lookup, the link itself cannot be opened
+ */
+static int
+sfs_openlink(struct inode *node, uint32_t open_flags) {
+    return -E_INVAL;
+}
 
-    lock_sin(sin);
-	// old number of disk blocks of file
-    nblks = din->blocks;
-    if (nblks < tblks) {
-		// try to enlarge the file size by add new disk block at the end of file
-        while (nblks != tblks) {
-            if ((ret = sfs_bmap_load_nolock(sfs, sin, nblks, NULL)) != 0) {
-                goto out_unlock;
-            }
-            nblks ++;
-        }
+/*
+ * sfs_readlink - read the target path of the symbolic link sin into buf, return its length
+ */
+static int
+sfs_readlink(struct sfs_fs *sfs, struct sfs_inode *sin, char *buf, size_t len) {
+    struct sfs_disk_inode *din = sin->din;
+    int ret;
+    uint32_t ino;
+    if (din->size == 0 || din->size > len) {
+        return (din->size == 0) ? -E_NOENT : -E_TOO_BIG;
     }
-    else if (tblks < nblks) {
-		// try to reduce the file size 
-        while (tblks != nblks) {
-            if ((ret = sfs_bmap_truncate_nolock(sfs, sin)) != 0) {
-                goto out_unlock;
-            }
-            nblks --;
+    lock_sin(sin);
+    {
+        if ((ret = sfs_bmap_load_nolock(sfs, sin, 0, &ino)) == 0) {
+            ret = sfs_rbuf(sfs, buf, din->size, ino, 0);
         }
     }
-    assert(din->blocks == tblks);
-    din->size = len;
-    sin->dirty = 1;
-
-out_unlock:
     unlock_sin(sin);
-    return ret;
+    return (ret != 0) ? ret : din->size;
 }
 
 /*
  * sfs_lookup - Parse path relative to the passed directory
  *              DIR, and hand back the inode for the file it
  *              refers to.
+ *
+ * 逐个分量地解析路径：只持有当前所在目录的引用，查找到下一个分量后立即释放；
+ * "." 不访问磁盘，其他分量（包括 ".."）经过目录项缓存查找，未命中时才读目录。
+ * 遇到符号链接时把路径改写为 "链接内容/剩余路径" 继续解析，
+ * 链接内容以 '/' 开头时从文件系统的根目录重新开始，最多跟随 SFS_MAX_LINK_DEPTH 个链接。
+ * 分量名复制到栈上的 name 中，只有遇到符号链接时才分配缓冲区保存改写后的路径。
  */
 static int
 sfs_lookup(struct inode *node, char *path, struct inode **node_store) {
     struct sfs_fs *sfs = fsop_info(vop_fs(node), sfs);
     assert(*path != '\0' && *path != '/');
+    char name[SFS_MAX_FNAME_LEN + 1], *buf = NULL;
+    const char *rest;
+    struct inode *subnode;
+    int ret, len, nlinks = 0;
     vop_ref_inc(node);
-    struct sfs_inode *sin = vop_info(node, sfs_inode);
-    if (sin->din->type != SFS_TYPE_DIR) {
-        vop_ref_dec(node);
-        return -E_NOTDIR;
+    while (1) {
+        while (*path == '/') {
+            path ++;
+        }
+        if (*path == '\0') {
+            break;
+        }
+        if (vop_info(node, sfs_inode)->din->type != SFS_TYPE_DIR) {
+            ret = -E_NOTDIR;
+            goto failed;
+        }
+        if ((rest = strchr(path, '/')) == NULL) {
+            rest = path + strlen(path);
+        }
+        if ((len = rest - path) > SFS_MAX_FNAME_LEN) {
+            ret = -E_TOO_BIG;
+            goto failed;
+        }
+        if (len == 1 && path[0] == '.') {
+            path = (char *)rest;
+            continue;
+        }
+        memcpy(name, path, len);
+        name[len] = '\0';
+        if ((ret = dcache_lookup(node, name, &subnode, sfs_lookup_dentry)) != 0) {
+            goto failed;
+        }
+        struct sfs_inode *sin = vop_info(subnode, sfs_inode);
+        if (sin->din->type != SFS_TYPE_LINK) {
+            vop_ref_dec(node);
+            node = subnode, path = (char *)rest;
+            continue;
+        }
+
+        // 符号链接：在 buf 中组成 "链接内容/剩余路径"，rest 可能就在 buf 中，先移动 rest 再读入链接内容
+        if (++ nlinks > SFS_MAX_LINK_DEPTH) {
+            ret = -E_LOOP;
+            goto failed_put_link;
+        }
+        if (buf == NULL && (buf = kmalloc(FS_MAX_FPATH_LEN + 1)) == NULL) {
+            ret = -E_NO_MEM;
+            goto failed_put_link;
+        }
+        size_t restlen = strlen(rest);
+        if (sin->din->size + 1 + restlen > FS_MAX_FPATH_LEN) {
+            ret = -E_TOO_BIG;
+            goto failed_put_link;
+        }
+        memmove(buf + sin->din->size, rest, restlen + 1);
+        if ((ret = sfs_readlink(sfs, sin, buf, sin->din->size)) < 0) {
+            goto failed_put_link;
+        }
+        vop_ref_dec(subnode);
+        if (buf[0] == '/') {
+            vop_ref_dec(node);
+            if ((ret = sfs_load_inode(sfs, &node, SFS_BLKN_ROOT)) != 0) {
+                goto out;
+            }
+        }
+        path = buf;
     }
-    struct inode *subnode;
-    int ret = sfs_lookup_once(sfs, sin, path, &subnode, NULL);
+    *node_store = node;
+    ret = 0;
+out:
+    if (buf != NULL) {
+        kfree(buf);
+    }
+    return ret;
 
+failed_put_link:
+    vop_ref_dec(subnode);
+failed:
     vop_ref_dec(node);
-    if (ret != 0) {
-        return ret;
-    }
-    *node_store = subnode;
-    return 0;
+    goto out;
 }
 
 // The sfs specific DIR operations correspond to the abstract operations on a inode.
@@ -1017,5 +1626,16 @@ static const struct inode_ops sfs_node_fileops = {
     .vop_gettype                    = sfs_gettype,
     .vop_tryseek                    = sfs_tryseek,
     .vop_truncate                   = sfs_truncfile,
+    .vop_readahead                  = sfs_readahead,
 };
 
+/// The sfs specific LINK operations, a link is only read by sfs_lookup.
+static const struct inode_ops sfs_node_linkops = {
+    .vop_magic                      = VOP_MAGIC,
+    .vop_open                       = sfs_openlink,
+    .vop_close                      = sfs_close,
+    .vop_fstat                      = sfs_fstat,
+    .vop_fsync                      = sfs_fsync,
+    .vop_reclaim                    = sfs_reclaim,
+    .vop_gettype                    = sfs_gettype,
+};
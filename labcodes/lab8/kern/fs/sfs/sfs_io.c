@@ -3,13 +3,32 @@
 #include <dev.h>
 #include <sfs.h>
 #include <iobuf.h>
-#include <bitmap.h>
+#include <bcache.h>
+#include <kmalloc.h>
+#include <error.h>
 #include <assert.h>
 
 //Basic block-level I/O routines
 
-/* sfs_rwblock_nolock - Basic block-level I/O routine for Rd/Wr one disk block,
+/*
+ * sfs_bdwrite - mark the held buffer dirty. if sfs has a journal, the metadata blocks (meta) and the blocks
+ *               logged by the last transaction are added to the running transaction instead of being
+ *               written back in place.
+ */
+static void
+sfs_bdwrite(struct sfs_fs *sfs, struct buf *bp, bool meta) {
+    if (sfs->journal != NULL && (meta || sfs_journal_logged(sfs, bp->b_blkno))) {
+        bjwrite(bp);
+    }
+    else {
+        bdwrite(bp);
+    }
+}
+
+/* sfs_rwblock_nolock - Basic block-level I/O routine for Rd/Wr one disk block through the buffer cache,
  *                      without lock protect for mutex process on Rd/Wr disk block
+ *                      a write only dirties the cached block, it reaches the disk on sfs_sync/fsync or eviction;
+ *                      the blocks written are metadata, logged by the journal if sfs has one
  * @sfs:   sfs_fs which will be process
  * @buf:   the buffer uesed for Rd/Wr
  * @blkno: the NO. of disk block
@@ -19,8 +38,21 @@
 static int
 sfs_rwblock_nolock(struct sfs_fs *sfs, void *buf, uint32_t blkno, bool write, bool check) {
     assert((blkno != 0 || !check) && blkno < sfs->super.blocks);
-    struct iobuf __iob, *iob = iobuf_init(&__iob, buf, SFS_BLKSIZE, blkno * SFS_BLKSIZE);
-    return dop_io(sfs->dev, iob, write);
+    struct buf *bp;
+    int ret;
+    if (write) {
+        // 整块覆盖写，不需要先读出原来的内容
+        if ((ret = bget(sfs->dev, blkno, &bp)) == 0) {
+            memcpy(bp->b_data, buf, SFS_BLKSIZE);
+            sfs_bdwrite(sfs, bp, 1);
+            brelse(bp);
+        }
+    }
+    else if ((ret = bread(sfs->dev, blkno, &bp)) == 0) {
+        memcpy(buf, bp->b_data, SFS_BLKSIZE);
+        brelse(bp);
+    }
+    return ret;
 }
 
 /* sfs_rwblock - Basic block-level I/O routine for Rd/Wr N disk blocks ,
@@ -72,7 +104,7 @@ sfs_wblock(struct sfs_fs *sfs, void *buf, uint32_t blkno, uint32_t nblks) {
     return sfs_rwblock(sfs, buf, blkno, nblks, 1);
 }
 
-/* sfs_rbuf - The Basic block-level I/O routine for  Rd( non-block & non-aligned io) one disk block(using sfs->sfs_buffer)
+/* sfs_rbuf - The Basic block-level I/O routine for  Rd( non-block & non-aligned io) one disk block(using the buffer cache)
  *            with lock protect for mutex process on Rd/Wr disk block
  * @sfs:    sfs_fs which will be process
  * @buf:    the buffer uesed for Rd
@@ -83,11 +115,14 @@ sfs_wblock(struct sfs_fs *sfs, void *buf, uint32_t blkno, uint32_t nblks) {
 int
 sfs_rbuf(struct sfs_fs *sfs, void *buf, size_t len, uint32_t blkno, off_t offset) {
     assert(offset >= 0 && offset < SFS_BLKSIZE && offset + len <= SFS_BLKSIZE);
+    assert(blkno != 0 && blkno < sfs->super.blocks);
+    struct buf *bp;
     int ret;
     lock_sfs_io(sfs);
     {
-        if ((ret = sfs_rwblock_nolock(sfs, sfs->sfs_buffer, blkno, 0, 1)) == 0) {
-            memcpy(buf, sfs->sfs_buffer + offset, len);
+        if ((ret = bread(sfs->dev, blkno, &bp)) == 0) {
+            memcpy(buf, bp->b_data + offset, len);
+            brelse(bp);
         }
     }
     unlock_sfs_io(sfs);
@@ -96,8 +131,9 @@ sfs_rbuf(struct sfs_fs *sfs, void *buf, size_t len, uint32_t blkno, off_t offset
 
 /**
  * @brief 基础的块级 IO 写操作（支持不足块大小/不对齐的 IO 操作）
- * sfs_wbuf - The Basic block-level I/O routine for  Wr( non-block & non-aligned io) one disk block(using sfs->sfs_buffer)
+ * sfs_wbuf - The Basic block-level I/O routine for  Wr( non-block & non-aligned io) one disk block(using the buffer cache)
  *            with lock protect for mutex process on Rd/Wr disk block
+ *            修改只写入缓存中的块并将其标记为脏，不会立即写回磁盘
  * @sfs:    sfs_fs which will be process
  * @buf:    the buffer uesed for Wr
  * @len:    the length need to Wr
@@ -107,12 +143,38 @@ sfs_rbuf(struct sfs_fs *sfs, void *buf, size_t len, uint32_t blkno, off_t offset
 int
 sfs_wbuf(struct sfs_fs *sfs, void *buf, size_t len, uint32_t blkno, off_t offset) {
     assert(offset >= 0 && offset < SFS_BLKSIZE && offset + len <= SFS_BLKSIZE);
+    assert(blkno != 0 && blkno < sfs->super.blocks);
+    struct buf *bp;
+    int ret;
+    lock_sfs_io(sfs);
+    {
+        if ((ret = bread(sfs->dev, blkno, &bp)) == 0) {
+            memcpy(bp->b_data + offset, buf, len);
+            sfs_bdwrite(sfs, bp, 1);
+            brelse(bp);
+        }
+    }
+    unlock_sfs_io(sfs);
+    return ret;
+}
+
+/*
+ * sfs_wdata - write len bytes of file data from iob at offset in disk block blkno, a whole block is not read first.
+ *             unlike sfs_wbuf, the block is file data and is written back in place, not through the journal.
+ *             the data are moved from iob, which may be a user buffer, straight into the cached block.
+ */
+int
+sfs_wdata(struct sfs_fs *sfs, struct iobuf *iob, size_t len, uint32_t blkno, off_t offset) {
+    assert(offset >= 0 && offset < SFS_BLKSIZE && offset + len <= SFS_BLKSIZE);
+    assert(blkno != 0 && blkno < sfs->super.blocks);
+    struct buf *bp;
     int ret;
     lock_sfs_io(sfs);
     {
-        if ((ret = sfs_rwblock_nolock(sfs, sfs->sfs_buffer, blkno, 0, 1)) == 0) {
-            memcpy(sfs->sfs_buffer + offset, buf, len);
-            ret = sfs_rwblock_nolock(sfs, sfs->sfs_buffer, blkno, 1, 1);
+        if ((ret = (len == SFS_BLKSIZE) ? bget(sfs->dev, blkno, &bp) : bread(sfs->dev, blkno, &bp)) == 0) {
+            iobuf_move(iob, bp->b_data + offset, len, 0, NULL);
+            sfs_bdwrite(sfs, bp, 0);
+            brelse(bp);
         }
     }
     unlock_sfs_io(sfs);
@@ -120,46 +182,91 @@ sfs_wbuf(struct sfs_fs *sfs, void *buf, size_t len, uint32_t blkno, off_t offset
 }
 
 /*
- * sfs_sync_super - write sfs->super (in memory) into disk (SFS_BLKN_SUPER, 1) with lock protect.
+ * sfs_sync_super - write sfs->super (in memory) into the cached block (SFS_BLKN_SUPER, 1) with lock protect.
+ *                  the free counts of the freemap blocks follow the superblock, the blocks reserved for appends
+ *                  counted as free.
  */
 int
 sfs_sync_super(struct sfs_fs *sfs) {
+    struct buf *bp;
     int ret;
     lock_sfs_io(sfs);
     {
-        memset(sfs->sfs_buffer, 0, SFS_BLKSIZE);
-        memcpy(sfs->sfs_buffer, &(sfs->super), sizeof(sfs->super));
-        ret = sfs_rwblock_nolock(sfs, sfs->sfs_buffer, SFS_BLKN_SUPER, 1, 0);
+        if ((ret = bget(sfs->dev, SFS_BLKN_SUPER, &bp)) == 0) {
+            memset(bp->b_data, 0, SFS_BLKSIZE);
+            uint16_t *counts = (uint16_t *)(bp->b_data + sizeof(sfs->super));
+            uint32_t i;
+            sfs->super.nfreecounts = sfs_freemap_counts(sfs->freemap, counts, SFS_FREECOUNT_MAX);
+            for (i = 0; i < sfs->super.nfreecounts; i ++) {
+                counts[i] += sfs_rsv_mask(sfs, i, NULL);
+            }
+            memcpy(bp->b_data, &(sfs->super), sizeof(sfs->super));
+            sfs_bdwrite(sfs, bp, 1);
+            brelse(bp);
+        }
     }
     unlock_sfs_io(sfs);
     return ret;
 }
 
 /*
- * sfs_sync_freemap - write sfs bitmap into disk (SFS_BLKN_FREEMAP, nblks)  without lock protect.
+ * sfs_sync_freemap - write the freemap blocks modified since the last sync into the buffer cache.
+ *                    a block is marked clean before it is copied, so changes made meanwhile are written next time.
+ *                    a block with blocks reserved for appends is written from a copy where they are free.
  */
 int
 sfs_sync_freemap(struct sfs_fs *sfs) {
-    uint32_t nblks = sfs_freemap_blocks(&(sfs->super));
-    return sfs_wblock(sfs, bitmap_getdata(sfs->freemap, NULL), SFS_BLKN_FREEMAP, nblks);
+    struct sfs_freemap *freemap = sfs->freemap;
+    uint32_t i, *buf = NULL, *map;
+    int ret = 0;
+    for (i = 0; i < freemap->nchunks; i ++) {
+        struct sfs_freemap_chunk *chunk = freemap->chunks + i;
+        if (chunk->dirty) {
+            map = chunk->map;
+            if (sfs_rsv_mask(sfs, i, NULL) != 0) {
+                if (buf == NULL && (buf = kmalloc(SFS_BLKSIZE)) == NULL) {
+                    ret = -E_NO_MEM;
+                    break;
+                }
+                memcpy(buf, chunk->map, SFS_BLKSIZE);
+                sfs_rsv_mask(sfs, i, buf);
+                map = buf;
+            }
+            chunk->dirty = 0;
+            if ((ret = sfs_wblock(sfs, map, SFS_BLKN_FREEMAP + i, 1)) != 0) {
+                chunk->dirty = 1;
+                break;
+            }
+        }
+    }
+    if (buf != NULL) {
+        kfree(buf);
+    }
+    return ret;
 }
 
 /*
- * sfs_clear_block - write zero info into disk (blkno, nblks)  with lock protect.
+ * sfs_clear_block - write zero info into the cached blocks (blkno, nblks)  with lock protect.
+ *                   the blocks are newly allocated and written back in place, the journal logs them
+ *                   only when they are modified later as metadata.
  * @sfs:   sfs_fs which will be process
  * @blkno: the NO. of disk block
  * @nblks: Rd/Wr number of disk block
  */
 int
 sfs_clear_block(struct sfs_fs *sfs, uint32_t blkno, uint32_t nblks) {
-    int ret;
+    struct buf *bp;
+    int ret = 0;
     lock_sfs_io(sfs);
     {
-        memset(sfs->sfs_buffer, 0, SFS_BLKSIZE);
         while (nblks != 0) {
-            if ((ret = sfs_rwblock_nolock(sfs, sfs->sfs_buffer, blkno, 1, 1)) != 0) {
+            assert(blkno != 0 && blkno < sfs->super.blocks);
+            if ((ret = bget(sfs->dev, blkno, &bp)) != 0) {
                 break;
             }
+            memset(bp->b_data, 0, SFS_BLKSIZE);
+            sfs_bdwrite(sfs, bp, 0);
+            brelse(bp);
             blkno ++, nblks --;
         }
     }
@@ -167,3 +274,10 @@ sfs_clear_block(struct sfs_fs *sfs, uint32_t blkno, uint32_t nblks) {
     return ret;
 }
 
+/*
+ * sfs_sync_blocks - write all dirty cached blocks of sfs back to disk.
+ */
+int
+sfs_sync_blocks(struct sfs_fs *sfs) {
+    return bcache_sync(sfs->dev);
+}
@@ -0,0 +1,425 @@
+#include <defs.h>
+#include <stdio.h>
+#include <string.h>
+#include <x86.h>
+#include <list.h>
+#include <sync.h>
+#include <wait.h>
+#include <pmm.h>
+#include <kmalloc.h>
+#include <proc.h>
+#include <sched.h>
+#include <dev.h>
+#include <vfs.h>
+#include <inode.h>
+#include <iobuf.h>
+#include <sfs.h>
+#include <bcache.h>
+#include <error.h>
+#include <assert.h>
+
+/*
+ * sfs 的元数据日志（write-ahead journal），占用 super.journal 开始的 SFS_JOURNAL_NBLKS 个块：
+ *   - 超级块、freemap、inode 和间接块只修改块缓存中的内容，缓冲区标记为 B_JOURNAL，
+ *     在所属的事务提交之前不会被写回原来的位置；文件数据照常写回（ordered 模式）。
+ *   - 修改元数据的操作（写文件、截断、关闭和回收 inode）由 sfs_journal_start/sfs_journal_stop 包围，
+ *     只在没有进行中的操作时提交，事务中总是若干个完整的操作。
+ *   - 提交时先写回所有不属于事务的脏块：事务引用的文件数据，以及上一个事务中已提交的元数据；
+ *     然后把事务中的所有块连同描述块一次顺序写入日志，描述块中的校验和说明整个事务都已写入，不需要单独的提交块。
+ *   - 事务轮流写入日志的两个槽，写入一个事务时另一个槽中的上一个事务仍然完整；
+ *     上一个事务记录的块在当前事务中作为文件数据写入时也记入日志，重放上一个事务后会被当前事务覆盖。
+ *   - 事务中释放的块提交时才放回 freemap，提交之前不会被重新分配，未提交的修改不会覆盖已提交的元数据。
+ *   - kjournald 每隔 SFS_JOURNAL_INTERVAL 提交一次；fsync 立即提交，提交进行中调用 fsync 时
+ *     它之前的修改都在这次提交中，等待提交结束即可（group commit）。
+ *   - 挂载时按事务号的顺序重放两个槽中完整的事务，然后清除描述块。
+ */
+
+#define SFS_JOURNAL_CLUSTER             16      /* max # of blocks in one log IO */
+#define SFS_JOURNAL_HIWAT               32      /* commit before an operation if so many buffers are in the transaction */
+#define SFS_JOURNAL_INTERVAL            50      /* ticks between two commits of kjournald */
+
+/* sfs_journal_slot - 1st block of the log slot of transaction seq */
+static uint32_t
+sfs_journal_slot(uint32_t start, uint32_t seq) {
+    return start + (seq & 1) * SFS_JOURNAL_SLOT;
+}
+
+static int
+sfs_journal_io(struct device *dev, void *buf, uint32_t blkno, uint32_t nblks, bool write) {
+    struct iobuf __iob, *iob = iobuf_init(&__iob, buf, nblks * SFS_BLKSIZE, blkno * SFS_BLKSIZE);
+    return dop_io(dev, iob, write);
+}
+
+/*
+ * sfs_journal_check - read the log slot at blkno into buffer (SFS_JOURNAL_CLUSTER blocks) and verify its checksum.
+ *                     return the # of blocks logged if the slot holds a complete transaction, 0 if not.
+ */
+static int
+sfs_journal_check(struct device *dev, uint32_t blkno, void *buffer, uint32_t *seq_store) {
+    struct sfs_journal_desc *desc = buffer;
+    void *data = buffer + SFS_BLKSIZE;
+    uint32_t checksum, hash, nblks, i, n;
+    int ret;
+    if ((ret = sfs_journal_io(dev, desc, blkno, 1, 0)) != 0) {
+        return ret;
+    }
+    if (desc->magic != SFS_JOURNAL_MAGIC || desc->nblks == 0 || desc->nblks > SFS_JOURNAL_TXMAX) {
+        return 0;
+    }
+    checksum = desc->checksum, desc->checksum = 0;
+    hash = sfs_journal_csum(SFS_JOURNAL_CSUM_INIT, desc, SFS_BLKSIZE);
+    *seq_store = desc->seq, nblks = desc->nblks;
+    for (i = 0; i < nblks; i += n) {
+        n = (nblks - i < SFS_JOURNAL_CLUSTER - 1) ? nblks - i : SFS_JOURNAL_CLUSTER - 1;
+        if ((ret = sfs_journal_io(dev, data, blkno + 1 + i, n, 0)) != 0) {
+            return ret;
+        }
+        hash = sfs_journal_csum(hash, data, n * SFS_BLKSIZE);
+    }
+    return (hash == checksum) ? nblks : 0;
+}
+
+/*
+ * sfs_journal_apply - write the blocks logged in the slot at blkno to where they belong
+ */
+static int
+sfs_journal_apply(struct device *dev, uint32_t blkno, void *buffer) {
+    struct sfs_journal_desc *desc = buffer;
+    void *data = buffer + SFS_BLKSIZE;
+    uint32_t nblks, i, k, n;
+    int ret;
+    if ((ret = sfs_journal_io(dev, desc, blkno, 1, 0)) != 0) {
+        return ret;
+    }
+    for (nblks = desc->nblks, i = 0; i < nblks; i += n) {
+        n = (nblks - i < SFS_JOURNAL_CLUSTER - 1) ? nblks - i : SFS_JOURNAL_CLUSTER - 1;
+        if ((ret = sfs_journal_io(dev, data, blkno + 1 + i, n, 0)) != 0) {
+            return ret;
+        }
+        for (k = 0; k < n; k ++) {
+            if (desc->blkno[i + k] >= dev->d_blocks) {
+                return -E_INVAL;
+            }
+            if ((ret = sfs_journal_io(dev, data + k * SFS_BLKSIZE, desc->blkno[i + k], 1, 1)) != 0) {
+                return ret;
+            }
+        }
+    }
+    return 0;
+}
+
+/*
+ * sfs_journal_replay - called by sfs_do_mount before the superblock and the freemap are loaded:
+ *                      write the complete transactions in the journal at start to where they belong,
+ *                      the older one first if both slots hold one, then clear the log.
+ */
+int
+sfs_journal_replay(struct device *dev, uint32_t start) {
+    if (start + SFS_JOURNAL_NBLKS > dev->d_blocks) {
+        return -E_INVAL;
+    }
+    struct Page *page;
+    if ((page = alloc_pages(SFS_JOURNAL_CLUSTER)) == NULL) {
+        return -E_NO_MEM;
+    }
+    void *buffer = page2kva(page);
+    uint32_t seq[2];
+    int nblks[2], i, newer, older, ret;
+    for (i = 0; i < 2; i ++) {
+        if ((ret = nblks[i] = sfs_journal_check(dev, start + i * SFS_JOURNAL_SLOT, buffer, seq + i)) < 0) {
+            goto out;
+        }
+    }
+    ret = 0;
+    if (nblks[0] == 0 && nblks[1] == 0) {
+        goto out;
+    }
+    newer = (nblks[0] == 0 || (nblks[1] != 0 && (int32_t)(seq[1] - seq[0]) > 0)) ? 1 : 0, older = !newer;
+    if (nblks[older] != 0 && seq[older] + 1 == seq[newer]) {
+        if ((ret = sfs_journal_apply(dev, start + older * SFS_JOURNAL_SLOT, buffer)) != 0) {
+            goto out;
+        }
+        cprintf("sfs: journal: replay transaction %u (%d blocks).\n", seq[older], nblks[older]);
+    }
+    if ((ret = sfs_journal_apply(dev, start + newer * SFS_JOURNAL_SLOT, buffer)) != 0) {
+        goto out;
+    }
+    cprintf("sfs: journal: replay transaction %u (%d blocks).\n", seq[newer], nblks[newer]);
+
+    // 日志中的块都已写回原来的位置，清除两个描述块；先清除较早的事务，中途崩溃时不会只剩下它被再次重放
+    memset(buffer, 0, SFS_BLKSIZE);
+    if ((ret = sfs_journal_io(dev, buffer, start + older * SFS_JOURNAL_SLOT, 1, 1)) == 0) {
+        ret = sfs_journal_io(dev, buffer, start + newer * SFS_JOURNAL_SLOT, 1, 1);
+    }
+out:
+    free_pages(page, SFS_JOURNAL_CLUSTER);
+    return ret;
+}
+
+static void
+sfs_journal_wait(struct sfs_journal *j) {
+    bool intr_flag;
+    wait_t __wait, *wait = &__wait;
+    local_intr_save(intr_flag);
+    wait_current_set(&(j->wait_queue), wait, WT_JOURNAL);
+    local_intr_restore(intr_flag);
+
+    schedule();
+
+    local_intr_save(intr_flag);
+    wait_current_del(&(j->wait_queue), wait);
+    local_intr_restore(intr_flag);
+}
+
+static void
+sfs_journal_wakeup(struct sfs_journal *j) {
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    wakeup_queue(&(j->wait_queue), WT_JOURNAL, 1);
+    local_intr_restore(intr_flag);
+}
+
+/*
+ * sfs_journal_release - put the blocks freed in the running transaction back into the freemap
+ */
+static void
+sfs_journal_release(struct sfs_fs *sfs, struct sfs_journal *j) {
+    if (j->nfreed != 0) {
+        sfs_freemap_release(sfs->freemap, j->nfreed);
+        sfs->super.unused_blocks += j->nfreed, sfs->super_dirty = 1;
+        j->nfreed = 0;
+    }
+}
+
+/*
+ * sfs_journal_log - write the n held buffers of the running transaction into its log slot,
+ *                   after the descriptor block, in requests of up to SFS_JOURNAL_CLUSTER blocks
+ */
+static int
+sfs_journal_log(struct sfs_fs *sfs, struct buf **bps, int n) {
+    struct sfs_journal *j = sfs->journal;
+    struct sfs_journal_desc *desc = j->buffer;
+    uint32_t hash, blkno = sfs_journal_slot(sfs->super.journal, j->seq), pos;
+    int i, ret;
+
+    memset(desc, 0, SFS_BLKSIZE);
+    desc->magic = SFS_JOURNAL_MAGIC, desc->seq = j->seq, desc->nblks = n;
+    for (i = 0; i < n; i ++) {
+        desc->blkno[i] = bps[i]->b_blkno;
+    }
+    hash = sfs_journal_csum(SFS_JOURNAL_CSUM_INIT, desc, SFS_BLKSIZE);
+    for (i = 0; i < n; i ++) {
+        hash = sfs_journal_csum(hash, bps[i]->b_data, SFS_BLKSIZE);
+    }
+    desc->checksum = hash;
+
+    for (i = 0, pos = 1; i < n; i ++) {
+        memcpy(j->buffer + pos * SFS_BLKSIZE, bps[i]->b_data, SFS_BLKSIZE);
+        if (++ pos == SFS_JOURNAL_CLUSTER || i + 1 == n) {
+            if ((ret = sfs_journal_io(sfs->dev, j->buffer, blkno, pos, 1)) != 0) {
+                return ret;
+            }
+            blkno += pos, pos = 0;
+        }
+    }
+    iostat.journal_write += 1 + n;
+    return 0;
+}
+
+/*
+ * sfs_journal_write - commit the running transaction, no operation is in progress
+ */
+static int
+sfs_journal_write(struct sfs_fs *sfs) {
+    struct sfs_journal *j = sfs->journal;
+    struct buf *bps[SFS_JOURNAL_TXMAX];
+    int i, n, ret = 0;
+
+    // 内存中的 inode、超级块和 freemap 写入块缓存，都记入当前事务
+    lock_sfs_fs(sfs);
+    {
+        list_entry_t *list = &(sfs->inode_list), *le = list;
+        while ((le = list_next(le)) != list) {
+            if ((ret = sfs_sync_inode(info2node(le2sin(le, inode_link), sfs_inode))) != 0) {
+                break;
+            }
+        }
+    }
+    unlock_sfs_fs(sfs);
+    if (ret != 0) {
+        return ret;
+    }
+    sfs_journal_release(sfs, j);
+    if (sfs->super_dirty) {
+        sfs->super_dirty = 0;
+        if ((ret = sfs_sync_super(sfs)) != 0 || (ret = sfs_sync_freemap(sfs)) != 0) {
+            sfs->super_dirty = 1;
+            return ret;
+        }
+    }
+
+    // ordered：先写回事务引用的文件数据；上一个事务的元数据也一起写回，之后才能覆盖更早的事务所在的槽
+    if ((ret = sfs_sync_blocks(sfs)) != 0) {
+        return ret;
+    }
+    if ((n = bcache_journal_hold(sfs->dev, bps, SFS_JOURNAL_TXMAX)) == 0) {
+        return 0;
+    }
+    if ((ret = sfs_journal_log(sfs, bps, n)) == 0) {
+        for (i = 0; i < n; i ++) {
+            j->last[i] = bps[i]->b_blkno;
+        }
+        j->nlast = n, j->seq ++;
+        iostat.journal_commit ++;
+    }
+    bcache_journal_release(bps, n, ret == 0);
+    return ret;
+}
+
+/*
+ * sfs_journal_commit - commit the running transaction of sfs and wait for it to reach the disk.
+ *                      if a commit is in progress, the changes made before the call are already in it.
+ */
+int
+sfs_journal_commit(struct sfs_fs *sfs) {
+    struct sfs_journal *j = sfs->journal;
+    if (j->committing) {
+        while (j->committing) {
+            sfs_journal_wait(j);
+        }
+        return j->error;
+    }
+    j->committing = 1;
+    while (j->nhandles != 0) {
+        sfs_journal_wait(j);
+    }
+    j->error = sfs_journal_write(sfs);
+    j->committing = 0;
+    sfs_journal_wakeup(j);
+    return j->error;
+}
+
+/*
+ * sfs_journal_start - begin an operation which modifies the metadata of sfs, it goes into the running transaction.
+ *                     the caller must not hold any lock of sfs.
+ */
+void
+sfs_journal_start(struct sfs_fs *sfs) {
+    struct sfs_journal *j = sfs->journal;
+    int ret;
+    if (j == NULL) {
+        return;
+    }
+    // 事务中的缓冲区不能被换出，太多时先提交，避免块缓存被占满
+    if (!j->committing && bcache_journaled(sfs->dev) >= SFS_JOURNAL_HIWAT) {
+        if ((ret = sfs_journal_commit(sfs)) != 0) {
+            warn("sfs: journal: commit failed: %e.\n", ret);
+        }
+    }
+    while (j->committing) {
+        sfs_journal_wait(j);
+    }
+    j->nhandles ++;
+}
+
+/*
+ * sfs_journal_stop - end an operation begun by sfs_journal_start
+ */
+void
+sfs_journal_stop(struct sfs_fs *sfs) {
+    struct sfs_journal *j = sfs->journal;
+    if (j == NULL) {
+        return;
+    }
+    assert(j->nhandles > 0);
+    if (-- j->nhandles == 0 && j->committing) {
+        sfs_journal_wakeup(j);
+    }
+}
+
+/*
+ * sfs_journal_free - free block blkno in the running transaction, it goes back to the freemap when the
+ *                    transaction is committed
+ */
+void
+sfs_journal_free(struct sfs_fs *sfs, uint32_t blkno) {
+    sfs_freemap_defer(sfs->freemap, blkno);
+    sfs->journal->nfreed ++;
+}
+
+/*
+ * sfs_journal_logged - check if block blkno is logged by the last transaction committed
+ */
+bool
+sfs_journal_logged(struct sfs_fs *sfs, uint32_t blkno) {
+    struct sfs_journal *j = sfs->journal;
+    uint32_t i;
+    for (i = 0; i < j->nlast; i ++) {
+        if (j->last[i] == blkno) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int
+sfs_journal_main(void *arg) {
+    struct sfs_journal *j = arg;
+    int ret;
+    while (1) {
+        do_sleep(SFS_JOURNAL_INTERVAL);
+        if (j->sfs == NULL) {
+            break;
+        }
+        if ((ret = sfs_journal_commit(j->sfs)) != 0) {
+            warn("sfs: journal: commit failed: %e.\n", ret);
+        }
+    }
+    free_pages(kva2page(j->buffer), SFS_JOURNAL_CLUSTER);
+    kfree(j);
+    return 0;
+}
+
+/*
+ * sfs_journal_init - set up the journal of sfs after it is replayed and the freemap is loaded, and start kjournald
+ */
+int
+sfs_journal_init(struct sfs_fs *sfs) {
+    struct sfs_journal *j;
+    struct Page *page;
+    int pid, ret = -E_NO_MEM;
+    if ((j = kmalloc(sizeof(struct sfs_journal))) == NULL) {
+        return ret;
+    }
+    if ((page = alloc_pages(SFS_JOURNAL_CLUSTER)) == NULL) {
+        goto failed_cleanup_j;
+    }
+    j->buffer = page2kva(page);
+    j->sfs = sfs, j->seq = 1, j->nhandles = 0, j->committing = 0, j->error = 0;
+    j->nfreed = j->nlast = 0;
+    wait_queue_init(&(j->wait_queue));
+
+    if ((pid = kernel_thread(sfs_journal_main, j, 0)) <= 0) {
+        ret = -E_NO_FREE_PROC;
+        goto failed_cleanup_buffer;
+    }
+    set_proc_name(find_proc(pid), "kjournald");
+    sfs->journal = j;
+    return 0;
+
+failed_cleanup_buffer:
+    free_pages(page, SFS_JOURNAL_CLUSTER);
+failed_cleanup_j:
+    kfree(j);
+    return ret;
+}
+
+/*
+ * sfs_journal_destroy - called by sfs_unmount after the last commit, kjournald frees the journal when it wakes up
+ */
+void
+sfs_journal_destroy(struct sfs_fs *sfs) {
+    struct sfs_journal *j = sfs->journal;
+    assert(!j->committing && j->nhandles == 0 && j->nfreed == 0);
+    j->sfs = NULL, sfs->journal = NULL;
+}
@@ -3,6 +3,7 @@
 #include <mmu.h>
 #include <fs.h>
 #include <ide.h>
+#include <bio.h>
 #include <pmm.h>
 #include <assert.h>
 
@@ -17,11 +18,11 @@ swapfs_init(void) {
 
 int
 swapfs_read(swap_entry_t entry, struct Page *page) {
-    return ide_read_secs(SWAP_DEV_NO, swap_offset(entry) * PAGE_NSECT, page2kva(page), PAGE_NSECT);
+    return bio_rw(SWAP_DEV_NO, swap_offset(entry) * PAGE_NSECT, page2kva(page), PAGE_NSECT, 0);
 }
 
 int
 swapfs_write(swap_entry_t entry, struct Page *page) {
-    return ide_write_secs(SWAP_DEV_NO, swap_offset(entry) * PAGE_NSECT, page2kva(page), PAGE_NSECT);
+    return bio_rw(SWAP_DEV_NO, swap_offset(entry) * PAGE_NSECT, page2kva(page), PAGE_NSECT, 1);
 }
 
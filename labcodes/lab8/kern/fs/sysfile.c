@@ -13,7 +13,7 @@
 #include <error.h>
 #include <assert.h>
 
-#define IOBUF_SIZE                          4096
+#define IOBUF_NPAGES                        32      // max # of user pages pinned for a read or write at a time
 
 /* copy_path - copy path name */
 static int
@@ -56,100 +56,83 @@ sysfile_close(int fd) {
     return file_close(fd);
 }
 
-/* sysfile_read - read file */
-int
-sysfile_read(int fd, void *base, size_t len) {
+/*
+ * sysfile_rw - read or write file fd from or to the buffer [base, base + len) without copying it to a kernel buffer:
+ *              a user buffer is pinned IOBUF_NPAGES pages at a time, and the file system or the device moves
+ *              the data between its caches and the pinned pages. a kernel thread (mm is NULL) passes a kernel buffer.
+ */
+static int
+sysfile_rw(int fd, void *base, size_t len, bool write) {
     struct mm_struct *mm = current->mm;
+    struct Page *pages[IOBUF_NPAGES];
+    int ret = 0, npages = 0;
+    size_t copied = 0, alen;
     if (len == 0) {
         return 0;
     }
-    if (!file_testfd(fd, 1, 0)) {
+    if (!file_testfd(fd, !write, write)) {
         return -E_INVAL;
     }
-    void *buffer;
-    if ((buffer = kmalloc(IOBUF_SIZE)) == NULL) {
-        return -E_NO_MEM;
+    lock_mm(mm);
+    {
+        // 读文件时写入用户缓冲区
+        if (!user_mem_check(mm, (uintptr_t)base, len, !write)) {
+            ret = -E_INVAL;
+        }
+    }
+    unlock_mm(mm);
+    if (ret != 0) {
+        return ret;
     }
 
-    int ret = 0;
-    size_t copied = 0, alen;
     while (len != 0) {
-        if ((alen = IOBUF_SIZE) > len) {
+        uintptr_t start = (uintptr_t)base;
+        size_t n;
+        if ((alen = ROUNDDOWN(start, PGSIZE) + IOBUF_NPAGES * PGSIZE - start) > len) {
             alen = len;
         }
-        ret = file_read(fd, buffer, alen, &alen);
-        if (alen != 0) {
+        n = alen;
+        if (mm != NULL) {
             lock_mm(mm);
-            {
-                if (copy_to_user(mm, base, buffer, alen)) {
-                    assert(len >= alen);
-                    base += alen, len -= alen, copied += alen;
-                }
-                else if (ret == 0) {
-                    ret = -E_INVAL;
-                }
-            }
+            ret = user_mem_pin(mm, start, alen, !write, pages);
             unlock_mm(mm);
+            if (ret < 0) {
+                goto out;
+            }
+            npages = ret;
         }
-        if (ret != 0 || alen == 0) {
+        ret = (write) ? file_write(fd, base, alen, (mm != NULL) ? pages : NULL, &alen)
+                      : file_read(fd, base, alen, (mm != NULL) ? pages : NULL, &alen);
+        if (mm != NULL) {
+            user_mem_unpin(pages, npages);
+        }
+        if (alen != 0) {
+            assert(len >= alen);
+            base += alen, len -= alen, copied += alen;
+        }
+        // 读到文件尾，或者管道中只有这么多数据
+        if (ret != 0 || alen < n) {
             goto out;
         }
     }
 
 out:
-    kfree(buffer);
     if (copied != 0) {
         return copied;
     }
     return ret;
 }
 
+/* sysfile_read - read file */
+int
+sysfile_read(int fd, void *base, size_t len) {
+    return sysfile_rw(fd, base, len, 0);
+}
+
 /* sysfile_write - write file */
 int
 sysfile_write(int fd, void *base, size_t len) {
-    struct mm_struct *mm = current->mm;
-    if (len == 0) {
-        return 0;
-    }
-    if (!file_testfd(fd, 0, 1)) {
-        return -E_INVAL;
-    }
-    void *buffer;
-    if ((buffer = kmalloc(IOBUF_SIZE)) == NULL) {
-        return -E_NO_MEM;
-    }
-
-    int ret = 0;
-    size_t copied = 0, alen;
-    while (len != 0) {
-        if ((alen = IOBUF_SIZE) > len) {
-            alen = len;
-        }
-        lock_mm(mm);
-        {
-            if (!copy_from_user(mm, buffer, base, alen, 0)) {
-                ret = -E_INVAL;
-            }
-        }
-        unlock_mm(mm);
-        if (ret == 0) {
-            ret = file_write(fd, buffer, alen, &alen);
-            if (alen != 0) {
-                assert(len >= alen);
-                base += alen, len -= alen, copied += alen;
-            }
-        }
-        if (ret != 0 || alen == 0) {
-            goto out;
-        }
-    }
-
-out:
-    kfree(buffer);
-    if (copied != 0) {
-        return copied;
-    }
-    return ret;
+    return sysfile_rw(fd, base, len, 1);
 }
 
 /* sysfile_seek - seek file */
@@ -305,13 +288,37 @@ sysfile_dup(int fd1, int fd2) {
     return file_dup(fd1, fd2);
 }
 
+/* sysfile_pipe - create a pipe, store the fds of its read end and its write end in fd_store[0] and fd_store[1] */
 int
 sysfile_pipe(int *fd_store) {
-    return -E_UNIMP;
+    struct mm_struct *mm = current->mm;
+    int ret, fd[2];
+    if ((ret = file_pipe(fd)) != 0) {
+        return ret;
+    }
+    lock_mm(mm);
+    {
+        if (!copy_to_user(mm, fd_store, fd, sizeof(fd))) {
+            ret = -E_INVAL;
+        }
+    }
+    unlock_mm(mm);
+    if (ret != 0) {
+        file_close(fd[0]), file_close(fd[1]);
+    }
+    return ret;
 }
 
+/* sysfile_mkfifo - open the FIFO named __name for reading or for writing, creating it if there is none */
 int
 sysfile_mkfifo(const char *__name, uint32_t open_flags) {
-    return -E_UNIMP;
+    int ret;
+    char *name;
+    if ((ret = copy_path(&name, __name)) != 0) {
+        return ret;
+    }
+    ret = file_mkfifo(name, open_flags);
+    kfree(name);
+    return ret;
 }
 
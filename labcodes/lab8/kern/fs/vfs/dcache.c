@@ -0,0 +1,169 @@
+#include <defs.h>
+#include <string.h>
+#include <stdlib.h>
+#include <list.h>
+#include <kmalloc.h>
+#include <fs.h>
+#include <vfs.h>
+#include <inode.h>
+#include <dcache.h>
+#include <error.h>
+#include <assert.h>
+
+/*
+ * 目录项缓存：按 (目录 inode, 名字) 缓存文件系统逐个分量查找的结果，包括名字不存在的结果（负项），
+ * 命中时不需要调用文件系统读目录。缓存的是目录中名字本身对应的 inode，符号链接不展开。
+ *
+ * 哈希表和 LRU 链表只在不会睡眠的代码段中修改；淘汰目录项时先把它从链表中摘下，
+ * 再释放它持有的 inode 引用（可能调用 vop_reclaim 而睡眠）。
+ */
+
+#define DCACHE_HASH_SHIFT               8
+#define DCACHE_HASH_SIZE                (1 << DCACHE_HASH_SHIFT)
+
+static list_entry_t dcache_hash[DCACHE_HASH_SIZE];
+static list_entry_t dcache_lru;
+static size_t dcache_size;
+
+void
+dcache_init(void) {
+    int i;
+    for (i = 0; i < DCACHE_HASH_SIZE; i ++) {
+        list_init(dcache_hash + i);
+    }
+    list_init(&dcache_lru);
+    dcache_size = 0;
+}
+
+static uint32_t
+dcache_hashfn(struct inode *dir, const char *name) {
+    uint32_t hash = (uintptr_t)dir;
+    while (*name != '\0') {
+        hash = hash * 31 + (uint8_t)*name ++;
+    }
+    return hash;
+}
+
+static struct dentry *
+dcache_find(struct inode *dir, const char *name, uint32_t hash) {
+    list_entry_t *list = dcache_hash + hash32(hash, DCACHE_HASH_SHIFT), *le = list;
+    while ((le = list_next(le)) != list) {
+        struct dentry *dentry = le2dentry(le, hash_link);
+        if (dentry->d_hash == hash && dentry->d_dir == dir && strcmp(dentry->d_name, name) == 0) {
+            return dentry;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * dcache_free - free an entry which is already off the lists, and drop its references
+ */
+static void
+dcache_free(struct dentry *dentry) {
+    struct inode *dir = dentry->d_dir, *node = dentry->d_inode;
+    kfree(dentry);
+    if (node != NULL) {
+        vop_ref_dec(node);
+    }
+    vop_ref_dec(dir);
+}
+
+static void
+dcache_unlink(struct dentry *dentry) {
+    list_del(&(dentry->hash_link));
+    list_del(&(dentry->lru_link));
+    dcache_size -= dentry->d_size;
+}
+
+/*
+ * dcache_add - remember that name in dir is node (NULL if it does not exist), then evict the least recently
+ *              used entries if the cache takes too much memory
+ */
+static void
+dcache_add(struct inode *dir, const char *name, uint32_t hash, struct inode *node) {
+    struct dentry *dentry;
+    size_t len = strlen(name), size = sizeof(struct dentry) + len + 1;
+    // 查找可能睡眠，期间其他进程可能已经加入了同一个名字
+    if (dcache_find(dir, name, hash) != NULL || (dentry = kmalloc(size)) == NULL) {
+        return;
+    }
+    dentry->d_dir = dir, dentry->d_inode = node;
+    dentry->d_hash = hash, dentry->d_size = size;
+    memcpy(dentry->d_name, name, len + 1);
+    vop_ref_inc(dir);
+    if (node != NULL) {
+        vop_ref_inc(node);
+    }
+    list_add(dcache_hash + hash32(hash, DCACHE_HASH_SHIFT), &(dentry->hash_link));
+    list_add(&dcache_lru, &(dentry->lru_link));
+    dcache_size += size;
+
+    while (dcache_size > DCACHE_MAX_SIZE) {
+        dentry = le2dentry(list_prev(&dcache_lru), lru_link);
+        dcache_unlink(dentry);
+        dcache_free(dentry);
+    }
+}
+
+/*
+ * dcache_lookup - look the single component name up in dir through the cache, call lookup and remember
+ *                 the result on a miss. on success the inode returned has its refcount incremented.
+ */
+int
+dcache_lookup(struct inode *dir, const char *name, struct inode **node_store, dcache_lookup_t lookup) {
+    uint32_t hash = dcache_hashfn(dir, name);
+    struct dentry *dentry;
+    if ((dentry = dcache_find(dir, name, hash)) != NULL) {
+        list_del(&(dentry->lru_link));
+        list_add(&dcache_lru, &(dentry->lru_link));
+        if (dentry->d_inode == NULL) {
+            iostat.dcache_negative ++;
+            return -E_NOENT;
+        }
+        iostat.dcache_hit ++;
+        vop_ref_inc(dentry->d_inode);
+        *node_store = dentry->d_inode;
+        return 0;
+    }
+
+    iostat.dcache_miss ++;
+    int ret = lookup(dir, name, node_store);
+    if (ret == 0) {
+        dcache_add(dir, name, hash, *node_store);
+    }
+    else if (ret == -E_NOENT) {
+        dcache_add(dir, name, hash, NULL);
+    }
+    return ret;
+}
+
+/*
+ * dcache_remove - forget name in dir, called after the name is created, linked, unlinked or renamed
+ */
+void
+dcache_remove(struct inode *dir, const char *name) {
+    struct dentry *dentry;
+    if ((dentry = dcache_find(dir, name, dcache_hashfn(dir, name))) != NULL) {
+        dcache_unlink(dentry);
+        dcache_free(dentry);
+    }
+}
+
+/*
+ * dcache_purge - forget all names in the directories of fs, called before fs is unmounted
+ */
+void
+dcache_purge(struct fs *fs) {
+    list_entry_t *le = list_next(&dcache_lru);
+    while (le != &dcache_lru) {
+        struct dentry *dentry = le2dentry(le, lru_link);
+        le = list_next(le);
+        if (dentry->d_dir->in_fs == fs) {
+            dcache_unlink(dentry);
+            dcache_free(dentry);
+            // 释放引用时可能睡眠，链表可能已经改变，从头开始
+            le = list_next(&dcache_lru);
+        }
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef __KERN_FS_VFS_DCACHE_H__
+#define __KERN_FS_VFS_DCACHE_H__
+
+#include <defs.h>
+#include <list.h>
+
+struct inode;
+struct fs;
+
+/*
+ * 目录项缓存（dentry cache）记住 (目录 inode, 名字) 查找的结果：
+ *   d_inode 不为 NULL 时是正项，名字对应的 inode；
+ *   d_inode 为 NULL 时是负项，目录中没有这个名字。
+ * 每个目录项持有 d_dir 和 d_inode 的引用，按最近使用的顺序组织在 LRU 链表中，
+ * 所有目录项占用的内存超过 DCACHE_MAX_SIZE 时从 LRU 链表尾部淘汰。
+ * 文件系统在解析路径时对每个分量调用 dcache_lookup，未命中时由 lookup 读目录查找这一个分量。
+ *
+ * 在目录中增加或删除名字的操作（create、link、unlink、rename）成功后必须对改变的名字调用 dcache_remove，
+ * 卸载文件系统之前必须调用 dcache_purge 释放它的 inode。
+ */
+struct dentry {
+    struct inode *d_dir;                            /* directory the name is looked up in */
+    struct inode *d_inode;                          /* inode of the name, NULL for a negative entry */
+    uint32_t d_hash;                                /* hash of (d_dir, d_name) */
+    size_t d_size;                                  /* bytes of memory the entry takes */
+    list_entry_t hash_link;                         /* entry in the hash list of (d_dir, d_name) */
+    list_entry_t lru_link;                          /* entry in the LRU list, most recently used first */
+    char d_name[0];                                 /* the name, nul-terminated */
+};
+
+#define le2dentry(le, member)                       \
+    to_struct((le), struct dentry, member)
+
+#define DCACHE_MAX_SIZE                             (64 * 1024)     /* max bytes of memory for dentries */
+
+typedef int (*dcache_lookup_t)(struct inode *dir, const char *name, struct inode **node_store);
+
+void dcache_init(void);
+int dcache_lookup(struct inode *dir, const char *name, struct inode **node_store, dcache_lookup_t lookup);
+void dcache_remove(struct inode *dir, const char *name);
+void dcache_purge(struct fs *fs);
+
+#endif /* !__KERN_FS_VFS_DCACHE_H__ */
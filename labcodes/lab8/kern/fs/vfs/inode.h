@@ -4,6 +4,7 @@
 #include <defs.h>
 #include <dev.h>
 #include <sfs.h>
+#include <pipe.h>
 #include <atomic.h>
 #include <assert.h>
 
@@ -30,10 +31,12 @@ struct inode {
     union {
         struct device __device_info;
         struct sfs_inode __sfs_inode_info;
+        struct pipe_inode __pipe_inode_info;
     } in_info;
     enum {
         inode_type_device_info = 0x1234,
         inode_type_sfs_inode_info,
+        inode_type_pipe_inode_info,
     } in_type;
     int ref_count;
     int open_count;
@@ -57,6 +60,7 @@ struct inode {
 #define info2node(info, type)                                       \
     to_struct((info), struct inode, in_info.__##type##_info)
 
+void inode_cache_init(void);
 struct inode *__alloc_inode(int type);
 
 #define alloc_inode(type)                                           __alloc_inode(__in_type(type))
@@ -151,6 +155,11 @@ void inode_kill(struct inode *node);
  *                      Need not work on objects that are not
  *                      directories.
  *
+ *    vop_readahead   - Read NBLKS blocks of the file starting at block
+ *                      INDEX into the page cache, skipping those already
+ *                      cached. Called by the readahead thread; may be
+ *                      NULL, in which case the file is never read ahead.
+ *
  *****************************************
  *
  *    vop_creat       - Create a regular file named NAME in the passed
@@ -183,6 +192,7 @@ struct inode_ops {
     int (*vop_create)(struct inode *node, const char *name, bool excl, struct inode **node_store);
     int (*vop_lookup)(struct inode *node, char *path, struct inode **node_store);
     int (*vop_ioctl)(struct inode *node, int op, void *data);
+    int (*vop_readahead)(struct inode *node, uint32_t index, uint32_t nblks);
 };
 
 /*
@@ -213,6 +223,7 @@ void inode_check(struct inode *node, const char *opstr);
 #define vop_truncate(node, len)                                     (__vop_op(node, truncate)(node, len))
 #define vop_create(node, name, excl, node_store)                    (__vop_op(node, create)(node, name, excl, node_store))
 #define vop_lookup(node, path, node_store)                          (__vop_op(node, lookup)(node, path, node_store))
+#define vop_readahead(node, index, nblks)                           (__vop_op(node, readahead)(node, index, nblks))
 
 
 #define vop_fs(node)                                                ((node)->in_fs)
@@ -3,6 +3,7 @@
 #include <string.h>
 #include <vfs.h>
 #include <inode.h>
+#include <dcache.h>
 #include <sem.h>
 #include <kmalloc.h>
 #include <error.h>
@@ -26,6 +27,8 @@ __alloc_fs(int type) {
 void
 vfs_init(void) {
     sem_init(&bootfs_sem, 1);
+    inode_cache_init();
+    dcache_init();
     vfs_devlist_init();
 }
 
@@ -2,6 +2,7 @@
 #include <string.h>
 #include <vfs.h>
 #include <inode.h>
+#include <dcache.h>
 #include <unistd.h>
 #include <error.h>
 #include <assert.h>
@@ -41,7 +42,10 @@ vfs_open(char *path, uint32_t open_flags, struct inode **node_store) {
             if ((ret = vfs_lookup_parent(path, &dir, &name)) != 0) {
                 return ret;
             }
-            ret = vop_create(dir, name, excl, &node);
+            if ((ret = vop_create(dir, name, excl, &node)) == 0) {
+                // 丢掉这个名字的负项
+                dcache_remove(dir, name);
+            }
         } else return ret;
     } else if (excl && create) {
         return -E_EXISTS;
@@ -10,6 +10,7 @@
 #include <pmm.h>
 #include <vmm.h>
 #include <ide.h>
+#include <bio.h>
 #include <swap.h>
 #include <proc.h>
 #include <fs.h>
@@ -42,6 +43,7 @@ kern_init(void) {
     sched_init();               // init scheduler
     proc_init();                // init process table
     
+    bio_init();                 // init block I/O layer
     ide_init();                 // init ide devices
     swap_init();                // init swap
     fs_init();                  // init fs
@@ -0,0 +1,317 @@
+#include <pmm.h>
+#include <list.h>
+#include <string.h>
+#include <buddy_pmm.h>
+
+/* Buddy System 算法：按块大小（2 的幂）维护 BUDDY_MAX_ORDER 条空闲链表，
+ * 第 order 条链表中的块大小为 2^order 个页面，且首页面的页号按 2^order 对齐。
+ * 分配时从满足大小的最小阶开始寻找，找不到则从更高阶的块中逐级对半切分；
+ * 释放时检查伙伴块（页号 ^ 2^order）是否空闲，若空闲则合并并继续向上检查。
+ * 分配与释放的时间复杂度均为 O(log n)，与空闲块的数量无关。
+ *
+ * 本算法将空闲块头页面的 Page->property 用于记录块的阶数，PG_property 标记
+ * 该页面为空闲块的头页面。
+ *
+ * 为了不浪费内存，alloc_pages(n) 中 n 不是 2 的幂时会把多出来的尾部页面还给
+ * 分配器，free_pages 也允许释放任意一段连续页面：这段页面会被拆分成若干
+ * 对齐的 2 的幂大小的块分别释放。
+ */
+
+/**
+ * 各阶的空闲块链表，nr_free 记录该阶空闲块的个数
+ */
+static free_area_t buddy_area[BUDDY_MAX_ORDER];
+
+#define free_list(order) (buddy_area[order].free_list)
+#define nr_block(order) (buddy_area[order].nr_free)
+
+// 空闲页面总数
+static size_t nr_free;
+
+/**
+ * 求满足 2^order >= n 的最小 order
+ */
+static inline size_t
+order_of(size_t n) {
+    size_t order = 0;
+    while (((size_t)1 << order) < n) {
+        order ++;
+    }
+    return order;
+}
+
+/**
+ * 找到 page 开始的 2^order 个页面的伙伴块，超出物理内存范围时返回 NULL
+ */
+static inline struct Page *
+buddy_of(struct Page *page, size_t order) {
+    size_t ppn = page2ppn(page) ^ ((size_t)1 << order);
+    return ppn < npage ? pages + ppn : NULL;
+}
+
+static inline void
+buddy_add_block(struct Page *page, size_t order) {
+    page->property = order;
+    SetPageProperty(page);
+    // 插入到表头，最近释放的块会被最先分配出去
+    list_add(&free_list(order), &(page->page_link));
+    nr_block(order) ++;
+}
+
+static inline void
+buddy_del_block(struct Page *page, size_t order) {
+    list_del(&(page->page_link));
+    ClearPageProperty(page);
+    page->property = 0;
+    nr_block(order) --;
+}
+
+/**
+ * 释放 base 开始的 2^order 个页面，并与空闲的伙伴块逐级合并
+ */
+static void
+buddy_free_block(struct Page *base, size_t order) {
+    while (order < BUDDY_MAX_ORDER - 1) {
+        struct Page *buddy = buddy_of(base, order);
+        // 伙伴块必须是同阶的空闲块头页面才能合并，保留页永远不会被标记为 PG_property
+        if (buddy == NULL || !PageProperty(buddy) || buddy->property != order) {
+            break;
+        }
+        buddy_del_block(buddy, order);
+        if (buddy < base) {
+            base = buddy;
+        }
+        order ++;
+    }
+    buddy_add_block(base, order);
+}
+
+/**
+ * 将 base 开始的连续 n 个页面拆分成尽可能大的对齐块释放
+ */
+static void
+buddy_free_range(struct Page *base, size_t n) {
+    while (n > 0) {
+        size_t ppn = page2ppn(base), order = 0;
+        while (order + 1 < BUDDY_MAX_ORDER && ((size_t)2 << order) <= n
+                && (ppn & (((size_t)2 << order) - 1)) == 0) {
+            order ++;
+        }
+        buddy_free_block(base, order);
+        base += (size_t)1 << order, n -= (size_t)1 << order;
+    }
+}
+
+static void
+buddy_init(void) {
+    int i;
+    for (i = 0; i < BUDDY_MAX_ORDER; i ++) {
+        list_init(&free_list(i));
+        nr_block(i) = 0;
+    }
+    nr_free = 0;
+}
+
+/**
+ * 将一段连续的物理内存加入到伙伴系统中。
+ *
+ * @param base 空闲块的头页面
+ * @param n 空闲块的页面数，在页表中连续
+ */
+static void
+buddy_init_memmap(struct Page *base, size_t n) {
+    assert(n > 0);
+    struct Page *p = base;
+    for (; p != base + n; p ++) {
+        assert(PageReserved(p));
+        p->flags = p->property = 0;
+        set_page_ref(p, 0);
+    }
+    nr_free += n;
+    buddy_free_range(base, n);
+}
+
+/**
+ * 分配 n 个连续页面：取出阶数不小于 order_of(n) 的最小空闲块，
+ * 将其逐级对半切分，多出来的尾部页面再还给分配器。
+ * @return 分配的内存的首页面，若分配失败返回 NULL
+ */
+static struct Page *
+buddy_alloc_pages(size_t n) {
+    assert(n > 0);
+    if (n > nr_free) {
+        return NULL;
+    }
+    size_t order = order_of(n), cur;
+    if (order >= BUDDY_MAX_ORDER) {
+        return NULL;
+    }
+    for (cur = order; cur < BUDDY_MAX_ORDER; cur ++) {
+        if (!list_empty(&free_list(cur))) {
+            break;
+        }
+    }
+    if (cur == BUDDY_MAX_ORDER) {
+        return NULL;
+    }
+    struct Page *page = le2page(list_next(&free_list(cur)), page_link);
+    buddy_del_block(page, cur);
+    // 把高地址的一半放回低一阶的链表中
+    while (cur > order) {
+        cur --;
+        buddy_add_block(page + ((size_t)1 << cur), cur);
+    }
+    if (n < ((size_t)1 << order)) {
+        buddy_free_range(page + n, ((size_t)1 << order) - n);
+    }
+    nr_free -= n;
+    return page;
+}
+
+/**
+ * 释放 base 开始的连续 n 个页面。
+ */
+static void
+buddy_free_pages(struct Page *base, size_t n) {
+    assert(n > 0);
+    struct Page *p = base;
+    for (; p != base + n; p ++) {
+        assert(!PageReserved(p) && !PageProperty(p));
+        p->flags = 0;
+        set_page_ref(p, 0);
+    }
+    nr_free += n;
+    buddy_free_range(base, n);
+}
+
+static size_t
+buddy_nr_free_pages(void) {
+    return nr_free;
+}
+
+/**
+ * 检查各阶空闲链表：每个块都是对齐的空闲头页面，页面总数与 nr_free 一致
+ */
+static size_t
+buddy_count_blocks(void) {
+    size_t order, count = 0, total = 0;
+    for (order = 0; order < BUDDY_MAX_ORDER; order ++) {
+        size_t blocks = 0;
+        list_entry_t *le = &free_list(order);
+        while ((le = list_next(le)) != &free_list(order)) {
+            struct Page *p = le2page(le, page_link);
+            assert(PageProperty(p) && p->property == order);
+            assert((page2ppn(p) & (((size_t)1 << order) - 1)) == 0);
+            blocks ++, total += (size_t)1 << order;
+        }
+        assert(blocks == nr_block(order));
+        count += blocks;
+    }
+    assert(total == nr_free);
+    return count;
+}
+
+/**
+ * 暂存所有空闲链表，使分配器变为空，便于在隔离的环境中测试
+ */
+static void
+buddy_stash(free_area_t *area_store, size_t *nr_free_store) {
+    int i;
+    for (i = 0; i < BUDDY_MAX_ORDER; i ++) {
+        area_store[i] = buddy_area[i];
+        list_init(&free_list(i));
+        nr_block(i) = 0;
+    }
+    *nr_free_store = nr_free;
+    nr_free = 0;
+}
+
+static void
+buddy_restore(free_area_t *area_store, size_t nr_free_store) {
+    int i;
+    for (i = 0; i < BUDDY_MAX_ORDER; i ++) {
+        assert(list_empty(&free_list(i)));
+        buddy_area[i] = area_store[i];
+    }
+    nr_free = nr_free_store;
+}
+
+static void
+buddy_check(void) {
+    size_t count = buddy_count_blocks();
+    assert(nr_free == nr_free_pages());
+
+    // 先取出一个 64 页的块，只把前 32 页交给空的分配器。
+    // 这样测试中合并的块最大为 32 页，它的伙伴（后 32 页）一直处于分配状态，
+    // 不会与暂存起来的空闲块合并。
+    struct Page *arena = alloc_pages(64), *p0, *p1, *p2, *p;
+    assert(arena != NULL && !PageProperty(arena));
+    assert((page2ppn(arena) & 63) == 0);
+
+    free_area_t area_store[BUDDY_MAX_ORDER];
+    size_t nr_free_store;
+    buddy_stash(area_store, &nr_free_store);
+    assert(alloc_page() == NULL);
+
+    free_pages(arena, 32);
+    assert(nr_free == 32 && nr_block(5) == 1);
+    assert(PageProperty(arena) && arena->property == 5);
+
+    // 单页分配：逐级切分，低地址优先
+    assert((p0 = alloc_page()) == arena);
+    assert((p1 = alloc_page()) == arena + 1);
+    assert((p2 = alloc_page()) == arena + 2);
+    assert(page_ref(p0) == 0 && page_ref(p1) == 0 && page_ref(p2) == 0);
+    assert(nr_free == 29);
+
+    // 伙伴合并
+    free_page(p1);
+    free_page(p0);
+    assert(PageProperty(p0) && p0->property == 1);
+    free_page(p2);
+    assert(nr_free == 32 && nr_block(5) == 1);
+    assert(PageProperty(arena) && arena->property == 5);
+    assert(buddy_count_blocks() == 1);
+
+    // 非 2 的幂的分配：多出来的尾部页面还给分配器
+    assert((p0 = alloc_pages(5)) == arena);
+    assert(!PageProperty(p0));
+    assert(PageProperty(p0 + 5) && p0[5].property == 0);
+    assert(PageProperty(p0 + 6) && p0[6].property == 1);
+    assert(nr_free == 27);
+    assert((p1 = alloc_pages(3)) == arena + 8);
+    assert(PageProperty(p1 + 3) && p1[3].property == 0);
+    assert(PageProperty(p1 + 4) && p1[4].property == 2);
+
+    // 释放一个块的一部分
+    free_pages(p0 + 2, 3);
+    assert(PageProperty(p0 + 2) && p0[2].property == 1);
+    assert(PageProperty(p0 + 4) && p0[4].property == 2);
+    free_pages(p0, 2);
+    assert(PageProperty(p0) && p0->property == 3);
+    free_pages(p1, 3);
+    assert(nr_free == 32 && nr_block(5) == 1);
+    assert(PageProperty(arena) && arena->property == 5);
+
+    // 超出容量的分配会失败
+    assert(alloc_pages(33) == NULL);
+    assert((p = alloc_pages(32)) == arena);
+    assert(alloc_page() == NULL);
+    assert(nr_free == 0);
+
+    buddy_restore(area_store, nr_free_store);
+    free_pages(arena, 64);
+
+    assert(buddy_count_blocks() == count);
+    assert(nr_free == nr_free_pages());
+}
+
+const struct pmm_manager buddy_pmm_manager = {
+    .name = "buddy_pmm_manager",
+    .init = buddy_init,
+    .init_memmap = buddy_init_memmap,
+    .alloc_pages = buddy_alloc_pages,
+    .free_pages = buddy_free_pages,
+    .nr_free_pages = buddy_nr_free_pages,
+    .check = buddy_check,
+};
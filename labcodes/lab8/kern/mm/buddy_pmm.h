@@ -0,0 +1,11 @@
+#ifndef __KERN_MM_BUDDY_PMM_H__
+#define  __KERN_MM_BUDDY_PMM_H__
+
+#include <pmm.h>
+
+// 伙伴系统支持的阶数，最大的块为 2^(BUDDY_MAX_ORDER-1) 个页面（4MB）
+#define BUDDY_MAX_ORDER             11
+
+extern const struct pmm_manager buddy_pmm_manager;
+
+#endif /* ! __KERN_MM_BUDDY_PMM_H__ */
@@ -8,303 +8,440 @@
 #include <stdio.h>
 
 /*
- * SLOB Allocator: Simple List Of Blocks
+ * Slab Allocator
  *
- * Matt Mackall <mpm@selenic.com> 12/30/03
+ * 每种大小的对象由一个 kmem_cache 管理。cache 从 pmm 申请 2^order 个连续页面
+ * 作为一个 slab，slab 的开头是 struct slab 与一个 kmem_bufctl_t 数组，之后是
+ * num 个大小为 objsize 的对象。bufctl 数组把 slab 中的空闲对象串成一个链表
+ * （bufctl[i] 记录第 i 个对象之后的下一个空闲对象），因此分配与释放都是 O(1)，
+ * 而且不会写入对象本身，由构造函数初始化过的对象在释放后依然保持构造好的状态。
  *
- * How SLOB works:
+ * 每个 cache 维护三条 slab 链表：
+ *   slabs_full:    所有对象都已分配
+ *   slabs_partial: 部分对象已分配，分配时优先使用
+ *   slabs_free:    所有对象都空闲，至多保留 KMEM_MAX_FREE_SLABS 个，多余的还给 pmm
  *
- * The core of SLOB is a traditional K&R style heap allocator, with
- * support for returning aligned objects. The granularity of this
- * allocator is 8 bytes on x86, though it's perhaps possible to reduce
- * this to 4 if it's deemed worth the effort. The slob heap is a
- * singly-linked list of pages from __get_free_page, grown on demand
- * and allocation from the heap is currently first-fit.
+ * slab 中每个页面的 Page 结构都会设置 PG_slab，并借用 page_link 的两个指针
+ * 记录所属的 cache 和 slab，这样 kfree 可以由地址直接找到对象所在的 slab。
  *
- * Above this is an implementation of kmalloc/kfree. Blocks returned
- * from kmalloc are 8-byte aligned and prepended with a 8-byte header.
- * If kmalloc is asked for objects of PAGE_SIZE or larger, it calls
- * __get_free_pages directly so that it can return page-aligned blocks
- * and keeps a linked list of such pages and their orders. These
- * objects are detected in kfree() by their page alignment.
- *
- * SLAB is emulated on top of SLOB by simply calling constructors and
- * destructors for every SLAB allocation. Objects are returned with
- * the 8-byte alignment unless the SLAB_MUST_HWCACHE_ALIGN flag is
- * set, in which case the low-level allocator will fragment blocks to
- * create the proper alignment. Again, objects of page-size or greater
- * are allocated by calling __get_free_pages. As SLAB objects know
- * their size, no separate size bookkeeping is necessary and there is
- * essentially no allocation space overhead.
+ * kmalloc 建立在 32 ~ 2048 字节的 2 的幂大小的 cache 之上，更大的请求直接
+ * 向 pmm 申请页面，申请的页面数记录在首页面的 property 中。
  */
 
+typedef uint16_t kmem_bufctl_t;
 
-//some helper
-#define spin_lock_irqsave(l, f) local_intr_save(f)
-#define spin_unlock_irqrestore(l, f) local_intr_restore(f)
-typedef unsigned int gfp_t;
-#ifndef PAGE_SIZE
-#define PAGE_SIZE PGSIZE
-#endif
-
-#ifndef L1_CACHE_BYTES
-#define L1_CACHE_BYTES 64
-#endif
+#define BUFCTL_END                  ((kmem_bufctl_t)0xFFFF)
 
-#ifndef ALIGN
-#define ALIGN(addr,size)   (((addr)+(size)-1)&(~((size)-1))) 
-#endif
+// 对象的对齐字节数
+#define KMEM_ALIGN                  8
+// 一个 slab 最多占用 2^KMEM_MAX_SLAB_ORDER 个页面
+#define KMEM_MAX_SLAB_ORDER         3
+// 每个 cache 最多保留的空闲 slab 数
+#define KMEM_MAX_FREE_SLABS         1
 
+// kmalloc 使用的 cache 大小：2^KMALLOC_MIN_SHIFT ~ 2^KMALLOC_MAX_SHIFT 字节
+#define KMALLOC_MIN_SHIFT           5
+#define KMALLOC_MAX_SHIFT           11
+#define KMALLOC_NR_CACHES           (KMALLOC_MAX_SHIFT - KMALLOC_MIN_SHIFT + 1)
 
-struct slob_block {
-	int units;
-	struct slob_block *next;
+struct slab {
+    list_entry_t slab_link;         // 链入 cache 的 slabs_full/partial/free 链表
+    void *s_mem;                    // 第一个对象的地址
+    size_t inuse;                   // 已分配的对象数
+    kmem_bufctl_t free;             // 第一个空闲对象的编号
 };
-typedef struct slob_block slob_t;
 
-#define SLOB_UNIT sizeof(slob_t)
-#define SLOB_UNITS(size) (((size) + SLOB_UNIT - 1)/SLOB_UNIT)
-#define SLOB_ALIGN L1_CACHE_BYTES
-
-struct bigblock {
-	int order;
-	void *pages;
-	struct bigblock *next;
+#define le2slab(le, member)                 \
+    to_struct((le), struct slab, member)
+
+#define slab_bufctl(slabp)                  \
+    ((kmem_bufctl_t *)(((struct slab *)(slabp)) + 1))
+
+struct kmem_cache {
+    list_entry_t slabs_full;
+    list_entry_t slabs_partial;
+    list_entry_t slabs_free;
+    size_t objsize;                 // 对齐后的对象大小
+    size_t num;                     // 每个 slab 中的对象数
+    size_t order;                   // 每个 slab 占用 2^order 个页面
+    const char *name;
+    size_t nr_slabs;                // slab 总数
+    size_t nr_free_slabs;           // slabs_free 中的 slab 数
+    size_t nr_active;               // 已分配的对象数
+    list_entry_t cache_link;        // 链入 cache_chain
 };
-typedef struct bigblock bigblock_t;
 
-static slob_t arena = { .next = &arena, .units = 1 };
-static slob_t *slobfree = &arena;
-static bigblock_t *bigblocks;
+#define le2cache(le, member)                \
+    to_struct((le), struct kmem_cache, member)
 
+// 用 page_link 记录页面所属的 cache 与 slab
+#define SET_PAGE_CACHE(page, cachep)        ((page)->page_link.next = (list_entry_t *)(cachep))
+#define GET_PAGE_CACHE(page)                ((struct kmem_cache *)((page)->page_link.next))
+#define SET_PAGE_SLAB(page, slabp)          ((page)->page_link.prev = (list_entry_t *)(slabp))
+#define GET_PAGE_SLAB(page)                 ((struct slab *)((page)->page_link.prev))
 
-static void* __slob_get_free_pages(gfp_t gfp, int order)
-{
-  struct Page * page = alloc_pages(1 << order);
-  if(!page)
-    return NULL;
-  return page2kva(page);
-}
+// 所有 cache 组成的链表，用于输出统计信息
+static list_entry_t cache_chain;
 
-#define __slob_get_free_page(gfp) __slob_get_free_pages(gfp, 0)
+// 用来分配 struct kmem_cache 的 cache
+static struct kmem_cache cache_cache;
 
-static inline void __slob_free_pages(unsigned long kva, int order)
-{
-  free_pages(kva2page(kva), 1 << order);
-}
-
-static void slob_free(void *b, int size);
-
-static void *slob_alloc(size_t size, gfp_t gfp, int align)
-{
-  assert( (size + SLOB_UNIT) < PAGE_SIZE );
-
-	slob_t *prev, *cur, *aligned = 0;
-	int delta = 0, units = SLOB_UNITS(size);
-	unsigned long flags;
-
-	spin_lock_irqsave(&slob_lock, flags);
-	prev = slobfree;
-	for (cur = prev->next; ; prev = cur, cur = cur->next) {
-		if (align) {
-			aligned = (slob_t *)ALIGN((unsigned long)cur, align);
-			delta = aligned - cur;
-		}
-		if (cur->units >= units + delta) { /* room enough? */
-			if (delta) { /* need to fragment head to align? */
-				aligned->units = cur->units - delta;
-				aligned->next = cur->next;
-				cur->next = aligned;
-				cur->units = delta;
-				prev = cur;
-				cur = aligned;
-			}
-
-			if (cur->units == units) /* exact fit? */
-				prev->next = cur->next; /* unlink */
-			else { /* fragment */
-				prev->next = cur + units;
-				prev->next->units = cur->units - units;
-				prev->next->next = cur->next;
-				cur->units = units;
-			}
-
-			slobfree = prev;
-			spin_unlock_irqrestore(&slob_lock, flags);
-			return cur;
-		}
-		if (cur == slobfree) {
-			spin_unlock_irqrestore(&slob_lock, flags);
-
-			if (size == PAGE_SIZE) /* trying to shrink arena? */
-				return 0;
-
-			cur = (slob_t *)__slob_get_free_page(gfp);
-			if (!cur)
-				return 0;
-
-			slob_free(cur, PAGE_SIZE);
-			spin_lock_irqsave(&slob_lock, flags);
-			cur = slobfree;
-		}
-	}
-}
+static struct kmem_cache *size_caches[KMALLOC_NR_CACHES];
 
-static void slob_free(void *block, int size)
-{
-	slob_t *cur, *b = (slob_t *)block;
-	unsigned long flags;
-
-	if (!block)
-		return;
-
-	if (size)
-		b->units = SLOB_UNITS(size);
-
-	/* Find reinsertion point */
-	spin_lock_irqsave(&slob_lock, flags);
-	for (cur = slobfree; !(b > cur && b < cur->next); cur = cur->next)
-		if (cur >= cur->next && (b > cur || b < cur->next))
-			break;
-
-	if (b + b->units == cur->next) {
-		b->units += cur->next->units;
-		b->next = cur->next->next;
-	} else
-		b->next = cur->next;
+static const char *size_cache_names[KMALLOC_NR_CACHES] = {
+    "size-32", "size-64", "size-128", "size-256", "size-512", "size-1024", "size-2048",
+};
 
-	if (cur + cur->units == b) {
-		cur->units += b->units;
-		cur->next = b->next;
-	} else
-		cur->next = b;
+// 直接从 pmm 申请的大块内存所占的页面数
+static size_t big_pages;
 
-	slobfree = cur;
+/**
+ * 计算 2^order 个页面的 slab 能容纳的对象数
+ */
+static size_t
+slab_capacity(size_t objsize, size_t order, size_t *offset_store) {
+    size_t slab_size = (PGSIZE << order), num;
+    num = (slab_size - sizeof(struct slab)) / (objsize + sizeof(kmem_bufctl_t));
+    while (num > 0 && ROUNDUP(sizeof(struct slab) + num * sizeof(kmem_bufctl_t), KMEM_ALIGN) + num * objsize > slab_size) {
+        num --;
+    }
+    if (num >= BUFCTL_END) {
+        num = BUFCTL_END - 1;
+    }
+    *offset_store = ROUNDUP(sizeof(struct slab) + num * sizeof(kmem_bufctl_t), KMEM_ALIGN);
+    return num;
+}
 
-	spin_unlock_irqrestore(&slob_lock, flags);
+/**
+ * 初始化 cache，选择浪费空间不超过 1/8 的最小 slab 大小
+ */
+static void
+kmem_cache_setup(struct kmem_cache *cachep, const char *name, size_t size) {
+    size_t order, num = 0, offset;
+    cachep->objsize = ROUNDUP(size, KMEM_ALIGN);
+    for (order = 0; order <= KMEM_MAX_SLAB_ORDER; order ++) {
+        if ((num = slab_capacity(cachep->objsize, order, &offset)) == 0) {
+            continue;
+        }
+        if ((offset + num * cachep->objsize) * 8 >= (PGSIZE << order) * 7) {
+            break;
+        }
+    }
+    if (order > KMEM_MAX_SLAB_ORDER) {
+        order = KMEM_MAX_SLAB_ORDER;
+        num = slab_capacity(cachep->objsize, order, &offset);
+    }
+    assert(num > 0);
+
+    list_init(&(cachep->slabs_full));
+    list_init(&(cachep->slabs_partial));
+    list_init(&(cachep->slabs_free));
+    cachep->num = num, cachep->order = order;
+    cachep->name = name;
+    cachep->nr_slabs = cachep->nr_free_slabs = cachep->nr_active = 0;
+    list_add_before(&cache_chain, &(cachep->cache_link));
 }
 
+/**
+ * 为 cache 新建一个空闲 slab
+ */
+static bool
+kmem_cache_grow(struct kmem_cache *cachep) {
+    struct Page *page = alloc_pages(1 << cachep->order);
+    if (page == NULL) {
+        return 0;
+    }
+    struct slab *slabp = page2kva(page);
+    size_t i, offset;
+    slab_capacity(cachep->objsize, cachep->order, &offset);
+    slabp->s_mem = (void *)slabp + offset;
+    slabp->inuse = 0;
+    slabp->free = 0;
+
+    for (i = 0; i < (1 << cachep->order); i ++) {
+        SetPageSlab(page + i);
+        SET_PAGE_CACHE(page + i, cachep);
+        SET_PAGE_SLAB(page + i, slabp);
+    }
+
+    kmem_bufctl_t *bufctl = slab_bufctl(slabp);
+    for (i = 0; i < cachep->num; i ++) {
+        bufctl[i] = (i + 1 < cachep->num) ? i + 1 : BUFCTL_END;
+    }
+
+    list_add(&(cachep->slabs_free), &(slabp->slab_link));
+    cachep->nr_slabs ++, cachep->nr_free_slabs ++;
+    return 1;
+}
 
+/**
+ * 把一个空闲 slab 的页面还给 pmm，调用者需要先将其从链表中移除
+ */
+static void
+kmem_slab_destroy(struct kmem_cache *cachep, struct slab *slabp) {
+    assert(slabp->inuse == 0);
+    struct Page *page = kva2page(slabp);
+    size_t i;
+    for (i = 0; i < (1 << cachep->order); i ++) {
+        ClearPageSlab(page + i);
+    }
+    free_pages(page, 1 << cachep->order);
+    cachep->nr_slabs --;
+}
 
-void check_slab(void) {
-  cprintf("check_slab() success\n");
+/**
+ * 创建一个大小为 size 的对象的 cache
+ * @param name 用于统计信息的名字，需要在 cache 的整个生命周期内有效
+ */
+struct kmem_cache *
+kmem_cache_create(const char *name, size_t size) {
+    assert(size > 0 && size <= (PGSIZE << KMEM_MAX_SLAB_ORDER) / 2);
+    struct kmem_cache *cachep;
+    if ((cachep = kmem_cache_alloc(&cache_cache)) != NULL) {
+        bool intr_flag;
+        local_intr_save(intr_flag);
+        {
+            kmem_cache_setup(cachep, name, size);
+        }
+        local_intr_restore(intr_flag);
+    }
+    return cachep;
 }
 
+/**
+ * 销毁 cache，所有对象都必须已经被释放
+ */
 void
-slab_init(void) {
-  cprintf("use SLOB allocator\n");
-  check_slab();
+kmem_cache_destroy(struct kmem_cache *cachep) {
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        assert(cachep->nr_active == 0);
+        assert(list_empty(&(cachep->slabs_full)) && list_empty(&(cachep->slabs_partial)));
+        list_entry_t *le;
+        while ((le = list_next(&(cachep->slabs_free))) != &(cachep->slabs_free)) {
+            list_del(le);
+            kmem_slab_destroy(cachep, le2slab(le, slab_link));
+        }
+        list_del(&(cachep->cache_link));
+    }
+    local_intr_restore(intr_flag);
+    kmem_cache_free(&cache_cache, cachep);
 }
 
-inline void 
-kmalloc_init(void) {
-    slab_init();
-    cprintf("kmalloc_init() succeeded!\n");
+/**
+ * 从 cache 中分配一个对象，优先使用部分分配的 slab
+ */
+void *
+kmem_cache_alloc(struct kmem_cache *cachep) {
+    void *objp = NULL;
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        list_entry_t *le = list_next(&(cachep->slabs_partial));
+        if (le == &(cachep->slabs_partial)) {
+            if (list_empty(&(cachep->slabs_free)) && !kmem_cache_grow(cachep)) {
+                goto out;
+            }
+            le = list_next(&(cachep->slabs_free));
+            cachep->nr_free_slabs --;
+        }
+        struct slab *slabp = le2slab(le, slab_link);
+        assert(slabp->free != BUFCTL_END);
+        objp = slabp->s_mem + slabp->free * cachep->objsize;
+        slabp->free = slab_bufctl(slabp)[slabp->free];
+        slabp->inuse ++, cachep->nr_active ++;
+
+        list_del(le);
+        if (slabp->inuse == cachep->num) {
+            list_add(&(cachep->slabs_full), le);
+        }
+        else {
+            list_add(&(cachep->slabs_partial), le);
+        }
+    }
+out:
+    local_intr_restore(intr_flag);
+    return objp;
 }
 
-size_t
-slab_allocated(void) {
-  return 0;
+/**
+ * 将对象释放回 cache
+ */
+void
+kmem_cache_free(struct kmem_cache *cachep, void *objp) {
+    struct Page *page = kva2page(objp);
+    assert(PageSlab(page) && GET_PAGE_CACHE(page) == cachep);
+    struct slab *slabp = GET_PAGE_SLAB(page);
+    size_t objnr = (objp - slabp->s_mem) / cachep->objsize;
+    assert(objnr < cachep->num && slabp->s_mem + objnr * cachep->objsize == objp);
+
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        assert(slabp->inuse > 0);
+        slab_bufctl(slabp)[objnr] = slabp->free;
+        slabp->free = objnr;
+        slabp->inuse --, cachep->nr_active --;
+
+        list_del(&(slabp->slab_link));
+        if (slabp->inuse != 0) {
+            list_add(&(cachep->slabs_partial), &(slabp->slab_link));
+        }
+        else if (cachep->nr_free_slabs < KMEM_MAX_FREE_SLABS) {
+            list_add(&(cachep->slabs_free), &(slabp->slab_link));
+            cachep->nr_free_slabs ++;
+        }
+        else {
+            kmem_slab_destroy(cachep, slabp);
+        }
+    }
+    local_intr_restore(intr_flag);
 }
 
-size_t
-kallocated(void) {
-   return slab_allocated();
+/**
+ * 打印每个 cache 的使用情况：对象数、slab 数以及碎片率
+ * （slab 占用的内存中没有被已分配对象使用的比例）
+ */
+void
+print_slabinfo(void) {
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        cprintf("%-16s %7s %7s %7s %6s %6s %5s\n", "name", "objsize", "active", "total", "slabs", "pages", "frag");
+        list_entry_t *le = &cache_chain;
+        while ((le = list_next(le)) != &cache_chain) {
+            struct kmem_cache *cachep = le2cache(le, cache_link);
+            size_t pages = cachep->nr_slabs << cachep->order;
+            size_t frag = 0;
+            if (pages != 0) {
+                frag = (pages * PGSIZE - cachep->nr_active * cachep->objsize) * 100 / (pages * PGSIZE);
+            }
+            cprintf("%-16s %7d %7d %7d %6d %6d %4d%%\n", cachep->name, cachep->objsize,
+                    cachep->nr_active, cachep->nr_slabs * cachep->num, cachep->nr_slabs, pages, frag);
+        }
+        cprintf("large kmalloc pages: %d\n", big_pages);
+    }
+    local_intr_restore(intr_flag);
 }
 
-static int find_order(int size)
-{
-	int order = 0;
-	for ( ; size > 4096 ; size >>=1)
-		order++;
-	return order;
+static void
+check_slab(void) {
+    size_t nr_free_pages_store = nr_free_pages(), kallocated_store = kallocated();
+    struct kmem_cache *cachep = kmem_cache_create("check", 40);
+    assert(cachep != NULL && cachep->objsize == 40 && cachep->order == 0);
+
+    // 分配超过一个 slab 的对象
+    int i, n = cachep->num + 2;
+    void *objs[n];
+    for (i = 0; i < n; i ++) {
+        assert((objs[i] = kmem_cache_alloc(cachep)) != NULL);
+    }
+    assert(cachep->nr_slabs == 2 && cachep->nr_active == n);
+    assert(!list_empty(&(cachep->slabs_full)) && !list_empty(&(cachep->slabs_partial)));
+
+    // 刚释放的对象会被最先重新分配
+    kmem_cache_free(cachep, objs[1]);
+    assert(kmem_cache_alloc(cachep) == objs[1]);
+
+    for (i = 0; i < n; i ++) {
+        kmem_cache_free(cachep, objs[i]);
+    }
+    assert(cachep->nr_active == 0 && cachep->nr_slabs == KMEM_MAX_FREE_SLABS);
+    kmem_cache_destroy(cachep);
+    assert(nr_free_pages_store == nr_free_pages());
+
+    // kmalloc 的小对象来自对应大小的 cache，大对象直接使用页面
+    void *p0 = kmalloc(1), *p1 = kmalloc(33), *p2 = kmalloc(2048), *p3 = kmalloc(2049), *p4 = kmalloc(5 * PGSIZE);
+    assert(p0 != NULL && p1 != NULL && p2 != NULL && p3 != NULL && p4 != NULL);
+    assert(GET_PAGE_CACHE(kva2page(p0)) == size_caches[0]);
+    assert(GET_PAGE_CACHE(kva2page(p1)) == size_caches[1]);
+    assert(GET_PAGE_CACHE(kva2page(p2)) == size_caches[KMALLOC_NR_CACHES - 1]);
+    assert(!PageSlab(kva2page(p3)) && kva2page(p3)->property == 1);
+    assert(!PageSlab(kva2page(p4)) && kva2page(p4)->property == 5);
+    assert(kallocated() == kallocated_store + 32 + 64 + 2048 + 6 * PGSIZE);
+    kfree(p0), kfree(p1), kfree(p2), kfree(p3), kfree(p4);
+
+    assert(kallocated() == kallocated_store);
+    cprintf("check_slab() succeeded!\n");
 }
 
-static void *__kmalloc(size_t size, gfp_t gfp)
-{
-	slob_t *m;
-	bigblock_t *bb;
-	unsigned long flags;
-
-	if (size < PAGE_SIZE - SLOB_UNIT) {
-		m = slob_alloc(size + SLOB_UNIT, gfp, 0);
-		return m ? (void *)(m + 1) : 0;
-	}
-
-	bb = slob_alloc(sizeof(bigblock_t), gfp, 0);
-	if (!bb)
-		return 0;
-
-	bb->order = find_order(size);
-	bb->pages = (void *)__slob_get_free_pages(gfp, bb->order);
-
-	if (bb->pages) {
-		spin_lock_irqsave(&block_lock, flags);
-		bb->next = bigblocks;
-		bigblocks = bb;
-		spin_unlock_irqrestore(&block_lock, flags);
-		return bb->pages;
-	}
-
-	slob_free(bb, sizeof(bigblock_t));
-	return 0;
+void
+kmalloc_init(void) {
+    list_init(&cache_chain);
+    kmem_cache_setup(&cache_cache, "kmem_cache", sizeof(struct kmem_cache));
+    int i;
+    for (i = 0; i < KMALLOC_NR_CACHES; i ++) {
+        size_caches[i] = kmem_cache_create(size_cache_names[i], 1 << (KMALLOC_MIN_SHIFT + i));
+        assert(size_caches[i] != NULL);
+    }
+    check_slab();
+    cprintf("kmalloc_init() succeeded!\n");
 }
 
-void *
-kmalloc(size_t size)
-{
-  return __kmalloc(size, 0);
+/**
+ * 已分配的内存总量（字节）
+ */
+size_t
+kallocated(void) {
+    size_t allocated;
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        allocated = big_pages * PGSIZE;
+        list_entry_t *le = &cache_chain;
+        while ((le = list_next(le)) != &cache_chain) {
+            struct kmem_cache *cachep = le2cache(le, cache_link);
+            allocated += cachep->nr_active * cachep->objsize;
+        }
+    }
+    local_intr_restore(intr_flag);
+    return allocated;
 }
 
-
-void kfree(void *block)
-{
-	bigblock_t *bb, **last = &bigblocks;
-	unsigned long flags;
-
-	if (!block)
-		return;
-
-	if (!((unsigned long)block & (PAGE_SIZE-1))) {
-		/* might be on the big block list */
-		spin_lock_irqsave(&block_lock, flags);
-		for (bb = bigblocks; bb; last = &bb->next, bb = bb->next) {
-			if (bb->pages == block) {
-				*last = bb->next;
-				spin_unlock_irqrestore(&block_lock, flags);
-				__slob_free_pages((unsigned long)block, bb->order);
-				slob_free(bb, sizeof(bigblock_t));
-				return;
-			}
-		}
-		spin_unlock_irqrestore(&block_lock, flags);
-	}
-
-	slob_free((slob_t *)block - 1, 0);
-	return;
+void *
+kmalloc(size_t size) {
+    if (size <= (1 << KMALLOC_MAX_SHIFT)) {
+        int i = 0;
+        while ((1 << (KMALLOC_MIN_SHIFT + i)) < size) {
+            i ++;
+        }
+        return kmem_cache_alloc(size_caches[i]);
+    }
+
+    size_t n = ROUNDUP(size, PGSIZE) / PGSIZE;
+    assert(n <= (1 << KMALLOC_MAX_ORDER));
+    struct Page *page;
+    if ((page = alloc_pages(n)) == NULL) {
+        return NULL;
+    }
+    page->property = n;
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        big_pages += n;
+    }
+    local_intr_restore(intr_flag);
+    return page2kva(page);
 }
 
-
-unsigned int ksize(const void *block)
-{
-	bigblock_t *bb;
-	unsigned long flags;
-
-	if (!block)
-		return 0;
-
-	if (!((unsigned long)block & (PAGE_SIZE-1))) {
-		spin_lock_irqsave(&block_lock, flags);
-		for (bb = bigblocks; bb; bb = bb->next)
-			if (bb->pages == block) {
-				spin_unlock_irqrestore(&slob_lock, flags);
-				return PAGE_SIZE << bb->order;
-			}
-		spin_unlock_irqrestore(&block_lock, flags);
-	}
-
-	return ((slob_t *)block - 1)->units * SLOB_UNIT;
+void
+kfree(void *objp) {
+    if (objp == NULL) {
+        return;
+    }
+    struct Page *page = kva2page(objp);
+    if (PageSlab(page)) {
+        kmem_cache_free(GET_PAGE_CACHE(page), objp);
+        return;
+    }
+    size_t n = page->property;
+    assert(page2kva(page) == objp && n > 0);
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        big_pages -= n;
+    }
+    local_intr_restore(intr_flag);
+    free_pages(page, n);
 }
-
-
-
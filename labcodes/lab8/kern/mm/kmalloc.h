@@ -5,6 +5,8 @@
 
 #define KMALLOC_MAX_ORDER       10
 
+struct kmem_cache;
+
 void kmalloc_init(void);
 
 void *kmalloc(size_t n);
@@ -12,5 +14,12 @@ void kfree(void *objp);
 
 size_t kallocated(void);
 
+struct kmem_cache *kmem_cache_create(const char *name, size_t size);
+void kmem_cache_destroy(struct kmem_cache *cachep);
+void *kmem_cache_alloc(struct kmem_cache *cachep);
+void kmem_cache_free(struct kmem_cache *cachep, void *objp);
+
+void print_slabinfo(void);
+
 #endif /* !__KERN_MM_KMALLOC_H__ */
 
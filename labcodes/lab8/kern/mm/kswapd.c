@@ -0,0 +1,110 @@
+#include <defs.h>
+#include <stdio.h>
+#include <assert.h>
+#include <sync.h>
+#include <pmm.h>
+#include <vmm.h>
+#include <swap.h>
+#include <proc.h>
+#include <sched.h>
+#include <kswapd.h>
+#include <filemap.h>
+
+/* *
+ * kswapd - 后台页面回收线程
+ *
+ * alloc_pages 分配后发现空闲页面少于 pages_low 时唤醒 kswapd，
+ * kswapd 轮流从所有 mm 中换出页面，直到空闲页面不少于 pages_high 后重新睡眠，
+ * 这样缺页的进程通常不需要自己等待换出页面写入磁盘。
+ * 只有当分配速度超过 kswapd 的回收速度、空闲页面降到 pages_min 以下时，
+ * 分配页面的进程才会直接回收（见 alloc_pages）。
+ *
+ * kswapd 每轮先释放上一轮换出、仍留在交换缓存中的页面和文件页缓存中最久未用的页面，
+ * 还不够 SWAP_CLUSTER 个页面时再换出新的一批页面，然后让出 CPU。
+ * 换出的页面在下一轮之前被再次访问时可以直接从交换缓存中取回，不需要读磁盘。
+ * */
+
+struct proc_struct *kswapd_proc = NULL;
+
+static size_t kswapd_min, kswapd_low, kswapd_high;
+
+static int
+kswapd_main(void *arg) {
+    while (1) {
+        size_t reclaimed = 0, evicted = 0;
+        if (pages_high != 0 && nr_free_pages() < pages_high) {
+            reclaimed = swap_cache_reclaim(SWAP_CLUSTER);
+            reclaimed += filemap_reclaim(SWAP_CLUSTER - reclaimed);
+            vmstat.kswapd_reclaim += reclaimed;
+            if (reclaimed < SWAP_CLUSTER) {
+                evicted = swap_shrink(SWAP_CLUSTER);
+            }
+        }
+        if (reclaimed == 0 && evicted == 0) {
+            // 空闲页面已经足够，或者没有可以换出的页面了，等待下一次唤醒
+            bool intr_flag;
+            local_intr_save(intr_flag);
+            {
+                current->state = PROC_SLEEPING;
+                current->wait_state = WT_KSWAPD;
+            }
+            local_intr_restore(intr_flag);
+        }
+        schedule();
+    }
+    return 0;
+}
+
+/**
+ * 空闲页面少于 pages_low 时由 alloc_pages 调用
+ */
+void
+kswapd_wakeup(void) {
+    if (kswapd_proc != NULL && kswapd_proc->wait_state == WT_KSWAPD) {
+        vmstat.kswapd_wakeup ++;
+        wakeup_proc(kswapd_proc);
+    }
+}
+
+/**
+ * 启用或停用 kswapd，返回原来的状态。
+ * 停用时水位线被清零，只有分配失败时才直接回收。
+ */
+bool
+kswapd_enable(bool enable) {
+    bool old = (pages_high != 0);
+    if (kswapd_proc != NULL) {
+        if (enable) {
+            pages_min = kswapd_min, pages_low = kswapd_low, pages_high = kswapd_high;
+        }
+        else {
+            pages_min = pages_low = pages_high = 0;
+        }
+    }
+    return old;
+}
+
+/**
+ * 根据当前的空闲页面数设置水位线并创建 kswapd，由 swap_init 在自检之后调用
+ */
+void
+kswapd_init(void) {
+    size_t nr_free = nr_free_pages();
+    kswapd_min = nr_free / 128;
+    if (kswapd_min < SWAP_CLUSTER * 4) {
+        kswapd_min = SWAP_CLUSTER * 4;
+    }
+    else if (kswapd_min > 1024) {
+        kswapd_min = 1024;
+    }
+    kswapd_low = kswapd_min * 2, kswapd_high = kswapd_min * 3;
+
+    int pid = kernel_thread(kswapd_main, NULL, 0);
+    if (pid <= 0 || (kswapd_proc = find_proc(pid)) == NULL) {
+        panic("create kswapd failed.\n");
+    }
+    set_proc_name(kswapd_proc, "kswapd");
+    kswapd_enable(1);
+    cprintf("kswapd: watermarks min %d, low %d, high %d of %d free pages\n",
+            pages_min, pages_low, pages_high, nr_free);
+}
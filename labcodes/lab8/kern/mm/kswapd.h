@@ -0,0 +1,13 @@
+#ifndef __KERN_MM_KSWAPD_H__
+#define __KERN_MM_KSWAPD_H__
+
+#include <defs.h>
+#include <proc.h>
+
+extern struct proc_struct *kswapd_proc;
+
+void kswapd_init(void);
+void kswapd_wakeup(void);
+bool kswapd_enable(bool enable);
+
+#endif /* !__KERN_MM_KSWAPD_H__ */
@@ -182,6 +182,9 @@ struct e820map {
  * 
  * 在 kern/mm/pmm.h 中包含了很多页管理的工具函数。
  * */
+struct device;
+struct mm_struct;
+
 struct Page {
     int ref;                        // 页帧的引用计数器，若被页表引用的次数为 0，那么这个页帧将被释放
     uint32_t flags;                 // array of flags that describe the status of the page frame
@@ -190,6 +193,13 @@ struct Page {
     list_entry_t page_link;         // 空闲块列表 free_list 的链表项
     list_entry_t pra_page_link;     // 先进先出队列列表，used for pra (page replace algorithm)
     uintptr_t pra_vaddr;            // 页面的虚拟地址，used for pra (page replace algorithm)
+    struct mm_struct *pra_mm;       // 页面所在置换链表所属的 mm，页面在 pra_page_link 链入某个 mm 的置换链表时有效
+    unsigned int pra_age;           // 页面的老化计数器，used for aging pra
+    swap_entry_t swap_entry;        // 页面在交换区中仍然有效的副本，0 表示没有
+    int pinned;                     // 用户页面被进行中的 IO 固定的次数，不为 0 时不会被换出
+    struct device *fm_dev;          // 文件页缓存中的页面所属文件所在的设备，NULL 表示不在文件页缓存中
+    uint32_t fm_ino;                // 文件页缓存中的页面所属文件的 inode 号
+    uint32_t fm_index;              // 文件页缓存中的页面在文件中的块号
 };
 
 /* Flags describing the status of a page frame */
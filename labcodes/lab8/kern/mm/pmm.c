@@ -6,11 +6,15 @@
 #include <memlayout.h>
 #include <pmm.h>
 #include <default_pmm.h>
+#include <buddy_pmm.h>
 #include <sync.h>
 #include <error.h>
 #include <swap.h>
+#include <kswapd.h>
 #include <vmm.h>
 #include <kmalloc.h>
+#include <stdlib.h>
+#include <filemap.h>
 
 /**
  * 任务状态段（Task State Segment）:
@@ -35,6 +39,8 @@ static struct taskstate ts = {0};
 struct Page *pages;
 size_t npage = 0;
 
+size_t pages_min = 0, pages_low = 0, pages_high = 0;
+
 /**
  * 启动时期的页表
  * 在 entry.S 中定义。
@@ -90,6 +96,9 @@ static struct pseudodesc gdt_pd = {
 };
 
 static void check_alloc_page(void);
+#ifdef CHECK_ALLOC_PERF
+static void check_alloc_perf(void);
+#endif
 static void check_pgdir(void);
 static void check_boot_pgdir(void);
 
@@ -131,10 +140,18 @@ gdt_init(void) {
     ltr(GD_TSS);
 }
 
+/**
+ * 使用的物理内存管理器，可以在编译时通过 make DEFS+=-DPMM_MANAGER=default_pmm_manager 选择，
+ * 可选 default_pmm_manager（first fit）和 buddy_pmm_manager（buddy system）
+ */
+#ifndef PMM_MANAGER
+#define PMM_MANAGER                 buddy_pmm_manager
+#endif
+
 // initialize a pmm_manager instance
 static void
 init_pmm_manager(void) {
-    pmm_manager = &default_pmm_manager;
+    pmm_manager = &PMM_MANAGER;
     cprintf("memory management: %s\n", pmm_manager->name);
     pmm_manager->init();
 }
@@ -145,27 +162,161 @@ init_memmap(struct Page *base, size_t n) {
     pmm_manager->init_memmap(base, n);
 }
 
+/**
+ * 单页缓存：
+ * 缺页处理和页表分配几乎都只申请一个页面，为此在 pmm_manager 前面维护一个
+ * 最近释放的单页的 LIFO 链表。刚释放的页面很可能还在 CPU 缓存中，所以优先
+ * 把它们分配出去。链表为空时从 pmm_manager 批量取 PAGE_CACHE_BATCH 个页面，
+ * 超过 PAGE_CACHE_HIGH 个页面时把最冷的 PAGE_CACHE_BATCH 个页面还给 pmm_manager。
+ *
+ * 缓存中的页面对 pmm_manager 来说是已分配的，但 nr_free_pages 会把它们计入空闲页面。
+ * 缓存在 pmm_manager 的自检之后才启用，以免干扰自检对空闲链表的检查。
+ */
+#define PAGE_CACHE_HIGH             64
+#define PAGE_CACHE_BATCH            16
+
+static struct page_cache {
+    bool enabled;
+    list_entry_t list;              // 表头为最近释放的页面
+    size_t count;
+    size_t hit, miss;               // 单页分配的命中/未命中次数
+    size_t refill, refill_pages;    // 批量填充的次数和取到的页面数
+    uint64_t refill_cycles;         // 批量填充所花费的总周期数
+    size_t drain;                   // 批量归还的次数
+} page_cache;
+
+static void
+page_cache_init(void) {
+    list_init(&(page_cache.list));
+    page_cache.count = 0;
+    page_cache.enabled = 1;
+}
+
+// 从 pmm_manager 批量取出页面放入缓存尾部，返回取到的页面数
+static size_t
+page_cache_refill(void) {
+    uint64_t start = rdtsc();
+    size_t i;
+    for (i = 0; i < PAGE_CACHE_BATCH; i ++) {
+        struct Page *page = pmm_manager->alloc_pages(1);
+        if (page == NULL) {
+            break;
+        }
+        list_add_before(&(page_cache.list), &(page->page_link));
+    }
+    page_cache.count += i;
+    page_cache.refill ++, page_cache.refill_pages += i;
+    page_cache.refill_cycles += rdtsc() - start;
+    return i;
+}
+
+// 把缓存尾部（最冷的）页面批量还给 pmm_manager
+static void
+page_cache_drain(size_t n) {
+    while (n -- > 0 && page_cache.count > 0) {
+        list_entry_t *le = list_prev(&(page_cache.list));
+        list_del(le);
+        page_cache.count --;
+        pmm_manager->free_pages(le2page(le, page_link), 1);
+    }
+    page_cache.drain ++;
+}
+
+static struct Page *
+page_cache_alloc(void) {
+    if (page_cache.count != 0) {
+        page_cache.hit ++;
+    }
+    else {
+        page_cache.miss ++;
+        if (page_cache_refill() == 0) {
+            return NULL;
+        }
+    }
+    list_entry_t *le = list_next(&(page_cache.list));
+    list_del(le);
+    page_cache.count --;
+    return le2page(le, page_link);
+}
+
+static void
+page_cache_free(struct Page *page) {
+    assert(!PageReserved(page) && !PageProperty(page));
+    page->flags = 0;
+    set_page_ref(page, 0);
+    list_add(&(page_cache.list), &(page->page_link));
+    if (++ page_cache.count > PAGE_CACHE_HIGH) {
+        page_cache_drain(PAGE_CACHE_BATCH);
+    }
+}
+
+/**
+ * 打印单页缓存的命中率与批量填充开销
+ */
+void
+print_page_cache(void) {
+    size_t total = page_cache.hit + page_cache.miss;
+    uint64_t cycles = page_cache.refill_cycles;
+    if (page_cache.refill != 0) {
+        do_div(cycles, page_cache.refill);
+    }
+    cprintf("page cache: %d cached, hit %d/%d (%d%%), refill %d times %d pages %llu cycles/refill, drain %d times\n",
+            page_cache.count, page_cache.hit, total, total != 0 ? page_cache.hit * 100 / total : 0,
+            page_cache.refill, page_cache.refill_pages, cycles, page_cache.drain);
+}
+
 // call pmm->alloc_pages to allocate a continuous n*PAGESIZE memory 
 struct Page *
 alloc_pages(size_t n) {
     struct Page *page=NULL;
     bool intr_flag;
+
+    // 空闲页面低于最低水位线，kswapd 来不及回收，先直接回收一批页面
+    if (n == 1 && pages_min != 0 && nr_free_pages() < pages_min && current != kswapd_proc) {
+         vmstat.direct_reclaim += swap_reclaim(SWAP_CLUSTER);
+    }
     
     while (1)
     {
          local_intr_save(intr_flag);
          {
-              page = pmm_manager->alloc_pages(n);
+              if (n == 1 && page_cache.enabled) {
+                   page = page_cache_alloc();
+              }
+              else {
+                   page = pmm_manager->alloc_pages(n);
+              }
          }
          local_intr_restore(intr_flag);
 
-         if (page != NULL || n > 1 || swap_init_ok == 0) break;
+         if (page != NULL) break;
+         // 单页缓存中的页面无法合并成连续的页面，多页分配失败时先把它们全部还给 pmm_manager 再试，
+         // 下面回收的页面也会先释放到单页缓存中
+         if (n > 1 && page_cache.count != 0) {
+              local_intr_save(intr_flag);
+              page_cache_drain(page_cache.count);
+              local_intr_restore(intr_flag);
+              continue;
+         }
+         if (swap_init_ok == 0) break;
+         // 先回收已经换出、仍留在交换缓存中的页面，以及文件页缓存中的干净页面
+         if (swap_cache_reclaim(n) != 0 || filemap_reclaim(n) != 0) continue;
+         if (n > 1) break;
          
          extern struct mm_struct *check_mm_struct;
-         //cprintf("page %x, call swap_out in alloc_pages %d\n",page, n);
-         swap_out(check_mm_struct, n, 0);
+         if (check_mm_struct != NULL) {
+              swap_out(check_mm_struct, n, 0);
+         }
+         else {
+              // 直接回收：从所有 mm 中换出页面，没有可以换出的页面时分配失败
+              size_t reclaimed = swap_reclaim(SWAP_CLUSTER);
+              if (reclaimed == 0) break;
+              vmstat.direct_reclaim += reclaimed;
+         }
+    }
+    if (page != NULL && pages_low != 0 && nr_free_pages() < pages_low) {
+         kswapd_wakeup();
     }
-    //cprintf("n %d,get page %x, No %d in alloc_pages\n",n,page,(page-pages));
     return page;
 }
 
@@ -175,7 +326,12 @@ free_pages(struct Page *base, size_t n) {
     bool intr_flag;
     local_intr_save(intr_flag);
     {
-        pmm_manager->free_pages(base, n);
+        if (n == 1 && page_cache.enabled) {
+            page_cache_free(base);
+        }
+        else {
+            pmm_manager->free_pages(base, n);
+        }
     }
     local_intr_restore(intr_flag);
 }
@@ -188,7 +344,7 @@ nr_free_pages(void) {
     bool intr_flag;
     local_intr_save(intr_flag);
     {
-        ret = pmm_manager->nr_free_pages();
+        ret = pmm_manager->nr_free_pages() + page_cache.count;
     }
     local_intr_restore(intr_flag);
     return ret;
@@ -236,6 +392,8 @@ page_init(void) {
     pages = (struct Page *)ROUNDUP((void *)end, PGSIZE);
 
     // 先保留所有页面，然后再调用 pmm_manager 进行分配
+    // pmm_manager 不会初始化的字段（如 swap_entry）必须从 0 开始
+    memset(pages, 0, sizeof(struct Page) * npage);
     for (i = 0; i < npage; i ++) {
         SetPageReserved(pages + i);
     }
@@ -322,6 +480,12 @@ pmm_init(void) {
     //use pmm->check to verify the correctness of the alloc/free function in a pmm
     check_alloc_page();
 
+    page_cache_init();
+
+#ifdef CHECK_ALLOC_PERF
+    check_alloc_perf();
+#endif
+
     check_pgdir();
 
     static_assert(KERNBASE % PTSIZE == 0 && KERNTOP % PTSIZE == 0);
@@ -389,11 +553,19 @@ page_remove_pte(pde_t *pgdir, uintptr_t la, pte_t *ptep) {
     if (*ptep & PTE_P) {                        // (1) check if this page table entry is present
         struct Page *page = pte2page(*ptep);    // (2) find corresponding page to pte
         if (!page_ref_dec(page)) {              // (3) decrease page reference
+            if (page->swap_entry != 0) {
+                swap_cache_del(page);           //     页面不再使用，交换缓存中的副本也不再需要
+            }
             free_page(page);                    // (4) and free this page when page reference reachs 0
         }
         *ptep = 0;                              // (5) clear second page table entry
         tlb_invalidate(pgdir, la);              // (6) flush tlb
     }
+    else if (*ptep != 0) {
+        // 页面已经被换出，释放页表项对交换区槽位的引用
+        swap_free(*ptep);
+        *ptep = 0;
+    }
 }
 
 void
@@ -430,8 +602,17 @@ exit_range(pde_t *pgdir, uintptr_t start, uintptr_t end) {
     } while (start != 0 && start < end);
 }
 
-// TODO: LAB5
-int copy_range(pde_t *to, pde_t *from, uintptr_t start, uintptr_t end, bool share) {
+/**
+ * 将 from 页表中 [start, end) 区间内的用户页面复制到 to 页表中，fork 时由 dup_mmap 调用。
+ *
+ * @param share 为真时采用 copy-on-write：不复制页面内容，两个页表都以只读方式映射
+ *              同一个物理页面并增加其引用计数，等到某一方写入时再由 do_pgfault 复制；
+ *              为假时立即为 to 分配新页面并复制内容。
+ * @note 共享的页面留在 from 的页面置换链表中，但在被多个 mm 映射期间不会被换出（见 swap_out），
+ *       子进程退出或写时复制之后它重新被 from 独占，又可以被换出了。
+ */
+int
+copy_range(pde_t *to, pde_t *from, uintptr_t start, uintptr_t end, bool share) {
     assert(start % PGSIZE == 0 && end % PGSIZE == 0);
     assert(USER_ACCESS(start, end));
     // copy content by page unit.
@@ -455,31 +636,40 @@ int copy_range(pde_t *to, pde_t *from, uintptr_t start, uintptr_t end, bool shar
             struct Page *npage;
             assert(page != NULL);
             int ret = 0;
-            // LAB5:EXERCISE2 YOUR CODE
             if (share) {
+                // 页面即将变为只读共享，page_insert 会清除 D 位，交换缓存中过时的副本必须先删除
+                if (page->swap_entry != 0 && (*ptep & PTE_D)) {
+                    swap_cache_del(page);
+                }
                 if (perm & PTE_W) {
-                    // 设置页面为不可读写的，更新页表并刷新 TLB
+                    // 设置页面为只读的，更新页表并刷新 TLB
                     ret = page_insert(from, page, start, perm &= ~PTE_W);
                     assert(ret == 0);
                 }
                 npage = page;
+                vmstat.fork_shared ++;
             } else {
                 // 为进程 B 分配页面
-                npage = alloc_page();
-                assert(npage != NULL);
-                // replicate content of page to npage, build the map of phy addr of nage with the linear addr start
-                // (1) find src_kvaddr: the kernel virtual address of page
-                void *src_kvaddr = page2kva(page);
-                // (2) find dst_kvaddr: the kernel virtual address of npage
-                void *dst_kvaddr = page2kva(npage);
-                // (3) memory copy from src_kvaddr to dst_kvaddr, size is PGSIZE
-                memcpy(dst_kvaddr, src_kvaddr, PGSIZE);
+                if ((npage = alloc_page()) == NULL) {
+                    return -E_NO_MEM;
+                }
+                pra_page_init(npage);
+                memcpy(page2kva(npage), page2kva(page), PGSIZE);
+                vmstat.fork_copied ++;
             }
-            // (4) build the map of phy addr of  nage with the linear addr start
+            // build the map of phy addr of npage with the linear addr start
             ret = page_insert(to, npage, start, perm);
             // 我们已经通过 nptep 检查了 get_pte 的合法性，因此 page_insert 必正常结束
             assert(ret == 0);
         }
+        else if (*ptep != 0) {
+            // 页面已经被换出，子进程和父进程共享交换区中的槽位
+            if ((nptep = get_pte(to, start, 1)) == NULL) {
+                return -E_NO_MEM;
+            }
+            swap_duplicate(*ptep);
+            *nptep = *ptep;
+        }
         start += PGSIZE;
     } while (start != 0 && start < end);
     return 0;
@@ -535,6 +725,8 @@ struct Page *
 pgdir_alloc_page(pde_t *pgdir, uintptr_t la, uint32_t perm) {
     struct Page *page = alloc_page();
     if (page != NULL) {
+        // 用户页面初始时不在任何置换链表中
+        pra_page_init(page);
         if (page_insert(pgdir, page, la, perm) != 0) {
             // 插入页面失败，回滚操作
             free_page(page);
@@ -566,6 +758,76 @@ check_alloc_page(void) {
     cprintf("check_alloc_page() succeeded!\n");
 }
 
+#ifdef CHECK_ALLOC_PERF
+
+#define PERF_NSLOT                  512
+#define PERF_NROUND                 8192
+
+static struct Page *perf_page[PERF_NSLOT];
+static size_t perf_npage[PERF_NSLOT];
+
+/**
+ * 测量 pmm_manager 在碎片化负载下每次分配/释放的平均周期数。
+ * 先分配 PERF_NSLOT 个单页并释放其中一半，使空闲内存中出现大量小块，
+ * 然后随机地分配（大多为单页，偶尔为 2~8 页）或释放，只统计
+ * alloc_pages/free_pages 本身花费的周期。
+ * 这是一个性能测试，默认不编译，通过 make DEFS+=-DCHECK_ALLOC_PERF 在启动时运行。
+ */
+static void
+check_alloc_perf(void) {
+    size_t nr_free_store = nr_free_pages();
+    uint64_t alloc_cycles = 0, free_cycles = 0, start;
+    uint32_t nalloc = 0, nfree = 0;
+    int i;
+
+    srand(0x5eed);
+    for (i = 0; i < PERF_NSLOT; i ++) {
+        perf_page[i] = alloc_page(), perf_npage[i] = 1;
+        assert(perf_page[i] != NULL);
+    }
+    for (i = 0; i < PERF_NSLOT; i += 2) {
+        free_page(perf_page[i]);
+        perf_page[i] = NULL;
+    }
+
+    for (i = 0; i < PERF_NROUND; i ++) {
+        int slot = rand() % PERF_NSLOT;
+        if (perf_page[slot] != NULL) {
+            start = rdtsc();
+            free_pages(perf_page[slot], perf_npage[slot]);
+            free_cycles += rdtsc() - start, nfree ++;
+            perf_page[slot] = NULL;
+        }
+        else {
+            size_t n = (rand() % 4 == 0) ? (1 << (rand() % 4)) : 1;
+            start = rdtsc();
+            perf_page[slot] = alloc_pages(n);
+            alloc_cycles += rdtsc() - start, nalloc ++;
+            assert(perf_page[slot] != NULL);
+            perf_npage[slot] = n;
+        }
+    }
+
+    for (i = 0; i < PERF_NSLOT; i ++) {
+        if (perf_page[i] != NULL) {
+            free_pages(perf_page[i], perf_npage[i]);
+            perf_page[i] = NULL;
+        }
+    }
+    assert(nr_free_pages() == nr_free_store);
+
+    if (nalloc != 0) {
+        do_div(alloc_cycles, nalloc);
+    }
+    if (nfree != 0) {
+        do_div(free_cycles, nfree);
+    }
+    cprintf("check_alloc_perf: %s, alloc %u ops %llu cycles/op, free %u ops %llu cycles/op\n",
+            pmm_manager->name, nalloc, alloc_cycles, nfree, free_cycles);
+}
+
+#endif /* CHECK_ALLOC_PERF */
+
 static void
 check_pgdir(void) {
     assert(npage <= KMEMSIZE / PGSIZE);
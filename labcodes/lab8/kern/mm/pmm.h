@@ -35,6 +35,14 @@ void pmm_init(void);
 struct Page *alloc_pages(size_t n);
 void free_pages(struct Page *base, size_t n);
 size_t nr_free_pages(void);
+void print_page_cache(void);
+
+/**
+ * 空闲页面的水位线，启用 kswapd 后由 kswapd_init 根据可用内存设置，为 0 时不生效：
+ *   分配后空闲页面少于 pages_low 时唤醒 kswapd 在后台回收，直到不少于 pages_high；
+ *   分配前空闲页面已经少于 pages_min 时 kswapd 来不及回收，由分配页面的进程直接回收。
+ */
+extern size_t pages_min, pages_low, pages_high;
 
 #define alloc_page() alloc_pages(1)
 #define free_page(page) free_pages(page, 1)
@@ -169,6 +177,17 @@ pde2page(pde_t pde) {
     return pa2page(PDE_ADDR(pde));
 }
 
+// pra_page_init - 初始化刚分配给用户的页面中页面置换算法使用的字段，页面不在任何置换链表中
+static inline void
+pra_page_init(struct Page *page) {
+    list_init(&(page->pra_page_link));
+    page->pra_vaddr = 0;
+    page->pra_mm = NULL;
+    page->pra_age = 0;
+    page->swap_entry = 0;
+    page->pinned = 0;
+}
+
 static inline int
 page_ref(struct Page *page) {
     return page->ref;
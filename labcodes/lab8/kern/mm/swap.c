@@ -2,13 +2,19 @@
 #include <swapfs.h>
 #include <swap_fifo.h>
 #include <swap_clock.h>
+#include <swap_aging.h>
+#include <kswapd.h>
 #include <stdio.h>
 #include <string.h>
 #include <memlayout.h>
 #include <pmm.h>
 #include <mmu.h>
-#include <default_pmm.h>
 #include <kdebug.h>
+#include <stdlib.h>
+#include <kmalloc.h>
+#include <error.h>
+#include <filemap.h>
+#include <proc.h>
 
 // the valid vaddr for check is between 0~CHECK_VALID_VADDR-1
 #define CHECK_VALID_VIR_PAGE_NUM 5
@@ -19,6 +25,14 @@
 // the max access seq number
 #define MAX_SEQ_NO 10
 
+/**
+ * 启动时使用的页面置换算法，可以在编译时通过 make DEFS+=-DSWAP_MANAGER=swap_manager_aging 选择，
+ * 可选 swap_manager_fifo、swap_manager_clock（改进的时钟算法）和 swap_manager_aging（老化算法）
+ */
+#ifndef SWAP_MANAGER
+#define SWAP_MANAGER                swap_manager_clock
+#endif
+
 static struct swap_manager *sm;
 size_t max_swap_offset;
 
@@ -28,7 +42,11 @@ unsigned int swap_page[CHECK_VALID_VIR_PAGE_NUM];
 
 unsigned int swap_in_seq_no[MAX_SEQ_NO],swap_out_seq_no[MAX_SEQ_NO];
 
+static void swap_slot_init(void);
 static void check_swap(void);
+#ifdef CHECK_SWAP_LOCALITY
+static void check_swap_locality(void);
+#endif
 
 int
 swap_init(void)
@@ -39,9 +57,9 @@ swap_init(void)
      {
           panic("bad max_swap_offset %08x.\n", max_swap_offset);
      }
-     
+     swap_slot_init();
 
-     sm = &swap_manager_clock;
+     sm = &SWAP_MANAGER;
      int r = sm->init();
      
      if (r == 0)
@@ -49,6 +67,10 @@ swap_init(void)
           swap_init_ok = 1;
           cprintf("SWAP: manager = %s\n", sm->name);
           check_swap();
+#ifdef CHECK_SWAP_LOCALITY
+          check_swap_locality();
+#endif
+          kswapd_init();
      }
 
      return r;
@@ -69,17 +91,272 @@ swap_tick_event(struct mm_struct *mm)
 int
 swap_map_swappable(struct mm_struct *mm, uintptr_t addr, struct Page *page, int swap_in)
 {
+     page->pra_mm = mm;
      return sm->map_swappable(mm, addr, page, swap_in);
 }
 
+/**
+ * mm 不再映射 page（写时复制了一个新页面，或者 mm 正在退出），page 已经移出 mm 的置换链表。
+ * 页面仍被 fork 出来的其它 mm 在同一地址映射时，把它交给其中一个 mm 的置换链表，否则它再也不能被换出。
+ */
+void
+swap_page_handoff(struct mm_struct *mm, struct Page *page)
+{
+     if (page_ref(page) <= 1) {
+          return;
+     }
+     uintptr_t v = page->pra_vaddr;
+     list_entry_t *le = &mm_list;
+     while ((le = list_next(le)) != &mm_list) {
+          struct mm_struct *other = le2mm(le, mm_link);
+          if (other == mm || other->sm_priv == NULL || other->pgdir == NULL) {
+               continue;
+          }
+          pte_t *ptep = get_pte(other->pgdir, v, 0);
+          if (ptep != NULL && (*ptep & PTE_P) && pte2page(*ptep) == page) {
+               swap_map_swappable(other, v, page, 0);
+               return;
+          }
+     }
+}
+
 int
 swap_set_unswappable(struct mm_struct *mm, uintptr_t addr)
 {
      return sm->set_unswappable(mm, addr);
 }
 
+/* *
+ * 交换区槽位分配与交换缓存
+ *
+ * 交换区的每个页面大小的槽位（offset 0 保留，表示没有交换项）由位图 swap_bitmap 管理分配，
+ * 按照 next-fit 从上次分配的位置继续查找空闲槽位。swap_map[offset] 记录槽位的引用数：
+ *   - 每个保存着该交换项的页表项（换出的页面，以及 fork 时复制的交换项）算一个引用；
+ *   - 若槽位中的数据在内存中还有一份相同的副本，即页面在交换缓存中，交换缓存也算一个引用。
+ * 引用数降为 0 时槽位被释放。
+ *
+ * 交换缓存以交换项为键把槽位映射到内存中的页面（page->swap_entry 即该页面对应的交换项，
+ * 用 page->page_link 链入哈希表），这样：
+ *   - 多个页表项共享的槽位只需要读入一次，之后的缺页直接映射缓存中的页面；
+ *   - 换出时页面写入交换区后并不立刻释放，而是移入 swap_inactive 链表，
+ *     在真正需要内存之前再次发生缺页（re-fault）时不需要读磁盘；
+ *   - 换入后没有被修改过（PTE_D 为 0）的页面再次换出时不需要写回。
+ * 交换缓存中的页面必须和槽位中的数据保持一致，页面被写时复制重新变为可写之前要从交换缓存中删除。
+ * */
+
+#define SWAP_HASH_SHIFT             10
+#define SWAP_HASH_SIZE              (1 << SWAP_HASH_SHIFT)
+#define swap_hashfn(entry)          (hash32(swap_offset(entry), SWAP_HASH_SHIFT))
+
+static uint32_t *swap_bitmap;           // 槽位分配位图，1 表示已分配
+static unsigned short *swap_map;        // 槽位的引用数
+static size_t swap_next;                // next-fit 的查找起点
+static size_t swap_nr_used;             // 已分配的槽位数
+static list_entry_t swap_hash[SWAP_HASH_SIZE];
+static list_entry_t swap_inactive;      // 交换缓存中不再被映射的页面，最早换出的在最前面
+static size_t swap_nr_inactive;
+
+static void
+swap_slot_init(void) {
+     size_t words = ROUNDUP(max_swap_offset, 32) / 32, i;
+     if ((swap_bitmap = kmalloc(words * sizeof(uint32_t))) == NULL ||
+         (swap_map = kmalloc(max_swap_offset * sizeof(unsigned short))) == NULL) {
+          panic("swap: no memory for swap map.\n");
+     }
+     memset(swap_bitmap, 0, words * sizeof(uint32_t));
+     memset(swap_map, 0, max_swap_offset * sizeof(unsigned short));
+     // offset 0 不能使用
+     swap_bitmap[0] |= 1, swap_map[0] = 1;
+     swap_next = 1, swap_nr_used = 0;
+     for (i = 0; i < SWAP_HASH_SIZE; i ++) {
+          list_init(swap_hash + i);
+     }
+     list_init(&swap_inactive);
+     swap_nr_inactive = 0;
+}
+
+/**
+ * 分配一个空闲的槽位，引用数为 1，交换区已满时返回 0
+ */
+static swap_entry_t
+swap_alloc(void) {
+     size_t words = ROUNDUP(max_swap_offset, 32) / 32, n, i;
+     size_t offset = swap_next;
+     for (n = 0; n <= words; n ++) {
+          i = offset / 32;
+          uint32_t avail = ~swap_bitmap[i] & (~0u << (offset % 32));
+          if (avail != 0) {
+               offset = i * 32;
+               while (!(avail & 1)) {
+                    avail >>= 1, offset ++;
+               }
+               if (offset < max_swap_offset) {
+                    swap_bitmap[i] |= 1u << (offset % 32);
+                    swap_map[offset] = 1;
+                    swap_nr_used ++;
+                    swap_next = offset + 1 < max_swap_offset ? offset + 1 : 1;
+                    return offset << 8;
+               }
+          }
+          offset = (i + 1 < words) ? (i + 1) * 32 : 0;
+     }
+     return 0;
+}
+
+static struct Page *
+swap_cache_lookup(swap_entry_t entry) {
+     list_entry_t *list = swap_hash + swap_hashfn(entry), *le = list;
+     while ((le = list_next(le)) != list) {
+          struct Page *page = le2page(le, page_link);
+          if (page->swap_entry == entry) {
+               return page;
+          }
+     }
+     return NULL;
+}
+
+// 把页面加入交换缓存，页面的内容必须和槽位中的数据一致
+static void
+swap_cache_add(struct Page *page, swap_entry_t entry) {
+     assert(page->swap_entry == 0 && swap_cache_lookup(entry) == NULL);
+     swap_duplicate(entry);
+     page->swap_entry = entry;
+     list_add(swap_hash + swap_hashfn(entry), &(page->page_link));
+}
+
+/**
+ * 页表项复制了一份交换项（fork），增加槽位的引用数
+ */
+void
+swap_duplicate(swap_entry_t entry) {
+     size_t offset = swap_offset(entry);
+     assert(swap_map[offset] != 0 && swap_map[offset] != (unsigned short)~0);
+     swap_map[offset] ++;
+}
+
+/**
+ * 减少槽位的引用数。若只剩下交换缓存中的页面引用它，且该页面也没有被映射，
+ * 那么这个页面已经不会再被用到了，直接释放它；引用数降为 0 时释放槽位。
+ */
+void
+swap_free(swap_entry_t entry) {
+     size_t offset = swap_offset(entry);
+     assert(swap_map[offset] != 0);
+     if (-- swap_map[offset] == 0) {
+          swap_bitmap[offset / 32] &= ~(1u << (offset % 32));
+          swap_nr_used --;
+     }
+     else if (swap_map[offset] == 1) {
+          struct Page *page = swap_cache_lookup(entry);
+          if (page != NULL && page_ref(page) == 0) {
+               list_del_init(&(page->pra_page_link));
+               swap_nr_inactive --;
+               swap_cache_del(page);
+               free_page(page);
+          }
+     }
+}
+
+/**
+ * 槽位当前的引用数
+ */
+int
+swap_count(swap_entry_t entry) {
+     return swap_map[swap_offset(entry)];
+}
+
+/**
+ * 把页面从交换缓存中删除，之后页面的内容可以和槽位中的数据不同
+ */
+void
+swap_cache_del(struct Page *page) {
+     swap_entry_t entry = page->swap_entry;
+     assert(entry != 0);
+     list_del_init(&(page->page_link));
+     page->swap_entry = 0;
+     swap_free(entry);
+}
+
+/**
+ * 回收 swap_inactive 中最早换出的至多 n 个页面，返回回收的页面数。
+ * 这些页面的数据已经保存在交换区中，可以直接释放。
+ */
+size_t
+swap_cache_reclaim(size_t n) {
+     size_t i;
+     for (i = 0; i < n && !list_empty(&swap_inactive); i ++) {
+          struct Page *page = le2page(list_next(&swap_inactive), pra_page_link);
+          assert(page_ref(page) == 0);
+          list_del_init(&(page->pra_page_link));
+          swap_nr_inactive --;
+          swap_cache_del(page);
+          free_page(page);
+     }
+     return i;
+}
+
+/**
+ * 按 mm_list 的顺序轮流从各个 mm 中换出共 n 个页面，每个 mm 最多换出 SWAP_CLUSTER 个页面后移到 mm_list 的末尾。
+ * 换出的页面留在交换缓存的 swap_inactive 中，由 swap_cache_reclaim 释放。
+ * 被锁住的 mm（如 dup_mmap 正在复制它的页表）会被跳过。返回换出的页面数。
+ * 写入交换区时会睡眠，换出期间持有 mm 的引用和锁：进程在此期间退出时由这里释放 mm，
+ * 其它进程也不能复制（fork）或固定（user_mem_pin）其中的页面。
+ */
+size_t
+swap_shrink(size_t n) {
+     size_t evicted = 0, nr_mm = 0, idle = 0;
+     list_entry_t *le = &mm_list;
+     while ((le = list_next(le)) != &mm_list) {
+          nr_mm ++;
+     }
+     // 连续 nr_mm 次没有换出页面，说明所有的 mm 都没有可以换出的页面了
+     while (evicted < n && idle < nr_mm) {
+          le = list_next(&mm_list);
+          struct mm_struct *mm = le2mm(le, mm_link);
+          list_del(le);
+          list_add_before(&mm_list, le);
+          idle ++;
+          if (mm == check_mm_struct || mm->sm_priv == NULL || list_empty(&(mm->pra_list))
+              || mm->mm_sem.value <= 0) {
+               continue;
+          }
+          size_t inactive = swap_nr_inactive, nr = n - evicted;
+          mm_count_inc(mm);
+          lock_mm(mm);
+          swap_out(mm, (nr < SWAP_CLUSTER) ? nr : SWAP_CLUSTER, 0);
+          unlock_mm(mm);
+          mm_put(mm);
+          if (swap_nr_inactive != inactive) {
+               evicted += swap_nr_inactive - inactive, idle = 0;
+          }
+     }
+     return evicted;
+}
+
+/**
+ * 直接回收 n 个页面：先释放交换缓存中已经换出的页面和文件页缓存中的页面，不够时通过 swap_shrink 换出页面后再释放。
+ * 返回回收的页面数，没有可以回收的页面时返回 0。
+ */
+size_t
+swap_reclaim(size_t n) {
+     size_t reclaimed = swap_cache_reclaim(n);
+     reclaimed += filemap_reclaim(n - reclaimed);
+     while (reclaimed < n && swap_shrink(n - reclaimed) != 0) {
+          reclaimed += swap_cache_reclaim(n - reclaimed);
+     }
+     return reclaimed;
+}
+
 volatile unsigned int swap_out_num=0;
 
+/**
+ * 换出 mm 中的 n 个页面。
+ * 页面写入新分配的槽位后留在交换缓存中，移入 swap_inactive 等待回收。
+ * 如果页面在交换缓存中，并且没有被修改过（页表项中 D 位为 0），槽位中的数据仍然有效，不需要写回磁盘。
+ * 被 user_mem_pin 固定的页面，以及 fork 后仍被其它 mm 共享的页面不会被换出，它们被放回置换链表。
+ * 写入交换区时可能睡眠，调用者持有 mm 的引用和锁。睡眠期间页表项仍然有效，用户可以继续访问页面：
+ * 写入之前清除页表项中的 A、D 位，写完之后若页面被访问过就放弃换出，被修改过的页面也不能留在交换缓存中。
+ */
 int
 swap_out(struct mm_struct *mm, int n, int in_tick)
 {
@@ -87,9 +364,7 @@ swap_out(struct mm_struct *mm, int n, int in_tick)
      for (i = 0; i != n; ++ i)
      {
           uintptr_t v;
-          //struct Page **ptr_page=NULL;
           struct Page *page;
-          // cprintf("i %d, SWAP: call swap_out_victim\n",i);
           int r = sm->swap_out_victim(mm, &page, in_tick);
           if (r != 0) {
                     cprintf("i %d, swap_out: call swap_out_victim failed\n",i);
@@ -97,45 +372,133 @@ swap_out(struct mm_struct *mm, int n, int in_tick)
           }          
           //assert(!PageReserved(page));
 
-          //cprintf("SWAP: choose victim page 0x%08x\n", page);
-          
           v=page->pra_vaddr; 
           pte_t *ptep = get_pte(mm->pgdir, v, 0);
           assert((*ptep & PTE_P) != 0);
 
-          if (swapfs_write( (page->pra_vaddr/PGSIZE+1)<<8, page) != 0) {
-                    cprintf("SWAP: failed to save\n");
+          if (page->pinned != 0) {
+                    // 内核正在通过 page2kva 读写页面，放回置换链表
                     sm->map_swappable(mm, v, page, 0);
                     continue;
           }
+          if (page_ref(page) > 1) {
+                    // fork 后与其它 mm 共享的页面，不能只按照本 mm 的页表换出，其它 mm 不再映射它之后才能换出
+                    sm->map_swappable(mm, v, page, 0);
+                    continue;
+          }
+
+          swap_entry_t entry = page->swap_entry;
+          if (entry != 0 && !(*ptep & PTE_D)) {
+                    vmstat.swap_clean ++;
+          }
           else {
-                    cprintf("swap_out: i %d, store page in vaddr 0x%x to disk swap entry %d\n", i, v, page->pra_vaddr/PGSIZE+1);
-                    *ptep = (page->pra_vaddr/PGSIZE+1)<<8;
-                    free_page(page);
+                    // 页面被修改过，交换区中原有的数据已经过时
+                    if (entry != 0) {
+                              swap_cache_del(page);
+                    }
+                    if ((entry = swap_alloc()) == 0) {
+                              cprintf("SWAP: failed to save\n");
+                              sm->map_swappable(mm, v, page, 0);
+                              continue;
+                    }
+                    *ptep &= ~(PTE_A | PTE_D);
+                    tlb_invalidate(mm->pgdir, v);
+                    page_ref_inc(page);
+                    r = swapfs_write(entry, page);
+                    ptep = get_pte(mm->pgdir, v, 0);
+                    if (ptep == NULL || !(*ptep & PTE_P) || pte2page(*ptep) != page) {
+                              // 同一 mm 的另一个线程写时复制了页面，这里的引用是最后一个
+                              swap_free(entry);
+                              if (page_ref_dec(page) == 0) {
+                                        free_page(page);
+                              }
+                              continue;
+                    }
+                    page_ref_dec(page);
+                    if (r != 0 || (*ptep & (PTE_A | PTE_D)) || page->pinned != 0) {
+                              if (r != 0) {
+                                        cprintf("SWAP: failed to save\n");
+                              }
+                              else if (!(*ptep & PTE_D) && page->pinned == 0) {
+                                        // 页面只是被读过，槽位中的数据仍然有效，下次换出时不需要写回
+                                        swap_cache_add(page, entry);
+                              }
+                              swap_free(entry);
+                              // 缺页处理可能已经把页面放回置换链表
+                              if (list_empty(&(page->pra_page_link))) {
+                                        sm->map_swappable(mm, v, page, 0);
+                              }
+                              continue;
+                    }
+                    // swap_alloc 得到的引用转交给交换缓存
+                    swap_cache_add(page, entry);
+                    swap_free(entry);
+                    vmstat.swap_out ++;
           }
-          
+          swap_duplicate(entry);
+          *ptep = entry;
           tlb_invalidate(mm->pgdir, v);
+          if (page_ref_dec(page) == 0) {
+                    list_add_before(&swap_inactive, &(page->pra_page_link));
+                    page->pra_mm = NULL;
+                    swap_nr_inactive ++;
+          }
      }
      return i;
 }
 
+/**
+ * 换入 addr 处的页面，页表项中保存着它的交换项。
+ * 页面已经在交换缓存中时直接使用缓存中的页面，否则从交换区读入并加入交换缓存。
+ * 页表项对槽位的引用由调用者在建立映射后通过 swap_free 释放。
+ * alloc_page 和 swapfs_read 都可能睡眠，期间共享槽位的其它进程或共享 mm 的线程可能已经把槽位读入交换缓存，
+ * 甚至已经处理了这个页表项，因此每次醒来后都重新检查：页表项已经改变时 *ptr_result 为 NULL，不需要再建立映射。
+ */
 int
 swap_in(struct mm_struct *mm, uintptr_t addr, struct Page **ptr_result)
 {
-     struct Page *result = alloc_page();
-     assert(result!=NULL);
-
      pte_t *ptep = get_pte(mm->pgdir, addr, 0);
-     // cprintf("SWAP: load ptep %x swap entry %d to vaddr 0x%08x, page %x, No %d\n", ptep, (*ptep)>>8, addr, result, (result-pages));
-    
-     int r;
-     if ((r = swapfs_read((*ptep), result)) != 0)
-     {
-        assert(r!=0);
+     swap_entry_t entry = *ptep;
+     struct Page *page = NULL, *result = NULL;
+     bool loaded = 0;
+     int r = 0;
+
+     while (*ptep == entry) {
+          if ((result = swap_cache_lookup(entry)) != NULL) {
+               // 没有被映射的页面在 swap_inactive 中，由调用者加入本 mm 的置换链表；
+               // 否则页面留在映射它的 mm 的置换链表中，被共享期间不会被换出
+               if (page_ref(result) == 0) {
+                    list_del_init(&(result->pra_page_link));
+                    swap_nr_inactive --;
+               }
+               vmstat.swap_cache_hit ++;
+               break;
+          }
+          if (page == NULL) {
+               if ((page = alloc_page()) == NULL) {
+                    r = -E_NO_MEM;
+                    break;
+               }
+               pra_page_init(page);
+          }
+          else if (!loaded) {
+               if ((r = swapfs_read(entry, page)) != 0) {
+                    break;
+               }
+               loaded = 1;
+          }
+          else {
+               swap_cache_add(page, entry);
+               vmstat.swap_in ++;
+               result = page, page = NULL;
+               break;
+          }
      }
-     cprintf("swap_in: load disk swap entry %d with swap_page in vadr 0x%x\n", (*ptep)>>8, addr);
-     *ptr_result=result;
-     return 0;
+     if (page != NULL) {
+          free_page(page);
+     }
+     *ptr_result = result;
+     return r;
 }
 
 
@@ -172,24 +535,63 @@ struct Page * check_rp[CHECK_VALID_PHY_PAGE_NUM];
 pte_t * check_ptep[CHECK_VALID_PHY_PAGE_NUM];
 unsigned int check_swap_addr[CHECK_VALID_VIR_PAGE_NUM];
 
-extern free_area_t free_area;
+/**
+ * check_swap 需要让物理内存中只剩下 CHECK_VALID_PHY_PAGE_NUM 个空闲页面，
+ * 从而触发页面置换。这里把其余的空闲页面全部分配出来暂存到 hold_list 中，
+ * 检查结束后再释放，这样不依赖于具体的 pmm_manager 实现。
+ */
+static list_entry_t check_hold_list;
+
+static void
+check_hold_free_pages(void) {
+     size_t n, size;
+     list_init(&check_hold_list);
+     while ((n = nr_free_pages()) != 0) {
+          struct Page *p = NULL;
+          // 先尽量分配大块以减少次数，n > 1 时 alloc_pages 失败不会触发换出
+          for (size = 1024; size > 1; size >>= 1) {
+               if (size <= n && (p = alloc_pages(size)) != NULL) {
+                    break;
+               }
+          }
+          if (p == NULL) {
+               p = alloc_page();
+               assert(p != NULL);
+          }
+          p->property = size;
+          list_add(&check_hold_list, &(p->page_link));
+     }
+}
+
+static void
+check_release_held_pages(void) {
+     list_entry_t *le;
+     while ((le = list_next(&check_hold_list)) != &check_hold_list) {
+          struct Page *p = le2page(le, page_link);
+          list_del(le);
+          free_pages(p, p->property);
+     }
+}
 
-#define free_list (free_area.free_list)
-#define nr_free (free_area.nr_free)
+/**
+ * 删除 [start, end) 中的映射，并释放其中页表项引用的交换区槽位，检查交换区与交换缓存已经清空
+ */
+static void
+check_unmap(pde_t *pgdir, uintptr_t start, uintptr_t end) {
+     uintptr_t addr;
+     for (addr = start; addr < end; addr += PGSIZE) {
+          page_remove(pgdir, addr);
+     }
+     assert(swap_nr_used == 0 && swap_nr_inactive == 0);
+}
 
 static void
 check_swap(void)
 {
     //backup mem env
-     int ret, count = 0, total = 0, i;
-     list_entry_t *le = &free_list;
-     while ((le = list_next(le)) != &free_list) {
-        struct Page *p = le2page(le, page_link);
-        assert(PageProperty(p));
-        count ++, total += p->property;
-     }
-     assert(total == nr_free_pages());
-     cprintf("BEGIN check_swap: count %d, total %d\n",count,total);
+     int ret, i;
+     size_t total = nr_free_pages();
+     cprintf("BEGIN check_swap: total %d\n", total);
      
      //now we set the phy pages env     
      struct mm_struct *mm = mm_create();
@@ -220,18 +622,13 @@ check_swap(void)
           assert(check_rp[i] != NULL );
           assert(!PageProperty(check_rp[i]));
      }
-     list_entry_t free_list_store = free_list;
-     list_init(&free_list);
-     assert(list_empty(&free_list));
+     check_hold_free_pages();
+     assert(nr_free_pages() == 0);
      
-     //assert(alloc_page() == NULL);
-     
-     unsigned int nr_free_store = nr_free;
-     nr_free = 0;
      for (i=0;i<CHECK_VALID_PHY_PAGE_NUM;i++) {
         free_pages(check_rp[i],1);
      }
-     assert(nr_free==CHECK_VALID_PHY_PAGE_NUM);
+     assert(nr_free_pages()==CHECK_VALID_PHY_PAGE_NUM);
      
      cprintf("set up init env for check_swap begin!\n");
      //setup initial vir_page<->phy_page environment for page relpacement algorithm 
@@ -240,7 +637,7 @@ check_swap(void)
      pgfault_num=0;
      
      check_content_set();
-     assert( nr_free == 0);         
+     assert(nr_free_pages() == 0);
      for(i = 0; i<MAX_SEQ_NO ; i++) 
          swap_out_seq_no[i]=swap_in_seq_no[i]=-1;
      
@@ -249,8 +646,15 @@ check_swap(void)
          check_ptep[i] = get_pte(pgdir, (i+1)*0x1000, 0);
          //cprintf("i %d, check_ptep addr %x, value %x\n", i, check_ptep[i], *check_ptep[i]);
          assert(check_ptep[i] != NULL);
-         assert(pte2page(*check_ptep[i]) == check_rp[i]);
          assert((*check_ptep[i] & PTE_P));          
+         // 页面分配的先后顺序取决于 pmm_manager，只要求映射的是被检查的页面之一
+         int j;
+         for (j = 0; j < CHECK_VALID_PHY_PAGE_NUM; j ++) {
+             if (pte2page(*check_ptep[i]) == check_rp[j]) {
+                 break;
+             }
+         }
+         assert(j != CHECK_VALID_PHY_PAGE_NUM);
      }
      cprintf("set up init env for check_swap over!\n");
      // now access the virt pages to test  page relpacement algorithm 
@@ -258,9 +662,8 @@ check_swap(void)
      assert(ret==0);
      
      //restore kernel mem env
-     for (i=0;i<CHECK_VALID_PHY_PAGE_NUM;i++) {
-         free_pages(check_rp[i],1);
-     } 
+     check_unmap(pgdir, BEING_CHECK_VALID_VADDR, CHECK_VALID_VADDR);
+     assert(nr_free_pages() == CHECK_VALID_PHY_PAGE_NUM);
 
      //free_page(pte2page(*temp_ptep));
     free_page(pde2page(pgdir[0]));
@@ -269,17 +672,172 @@ check_swap(void)
      mm_destroy(mm);
      check_mm_struct = NULL;
      
-     nr_free = nr_free_store;
-     free_list = free_list_store;
+     check_release_held_pages();
 
-     
-     le = &free_list;
-     while ((le = list_next(le)) != &free_list) {
-         struct Page *p = le2page(le, page_link);
-         count --, total -= p->property;
-     }
-     cprintf("count is %d, total is %d\n",count,total);
-     //assert(count == 0);
+     cprintf("free pages before %d, after %d\n", total, nr_free_pages());
+     //assert(total == nr_free_pages());
      
      cprintf("check_swap() succeeded!\n");
 }
+
+/**
+ * 页面置换算法的局部性测试：分别使用 fifo、clock、aging 三种算法，
+ * 在 LOCALITY_NFRAME 个物理页面上运行访问 LOCALITY_NPAGE 个虚拟页面的几种负载：
+ *   seq    - 按行顺序访问，每个页面被连续访问多次，局部性好（related_info/lab3/locality/goodlocality.c）；
+ *   stride - 按列跨页访问，每次访问都换一个页面，局部性差（related_info/lab3/locality/badlocality.c）；
+ *   hot    - 80% 的访问落在 LOCALITY_NHOT 个热页面上，其余随机访问冷页面，25% 为写操作。
+ * 统计缺页次数以及换入、写回和不需要写回的换出次数。
+ * 这是一个性能对比测试，默认不编译，通过 make DEFS+=-DCHECK_SWAP_LOCALITY 在启动时运行。
+ */
+#ifdef CHECK_SWAP_LOCALITY
+
+#define LOCALITY_NPAGE              24
+#define LOCALITY_NFRAME             8
+#define LOCALITY_NHOT               6
+#define LOCALITY_STEP               256     // seq/stride 中同一页面内相邻两次访问的间隔（字节）
+#define LOCALITY_NACCESS            1024    // hot 负载的访问次数
+#define LOCALITY_TICK               32      // 每访问这么多次执行一次 tick_event
+
+static struct mm_struct *locality_mm;
+static int locality_naccess;
+
+static void
+locality_access(uintptr_t addr, bool write) {
+     pte_t *ptep = get_pte(locality_mm->pgdir, addr, 0);
+     if (ptep == NULL || !(*ptep & PTE_P)) {
+          // 直接调用 do_pgfault，避免 pgfault_handler 为 check_mm_struct 打印每一次缺页
+          assert(do_pgfault(locality_mm, write ? 2 : 0, addr) == 0);
+     }
+     // 通过 MMU 访问，由硬件设置访问位和修改位
+     if (write) {
+          *(volatile uintptr_t *)addr = addr;
+     }
+     else {
+          uintptr_t value = *(volatile uintptr_t *)addr;
+          assert(value == 0 || value == addr);
+     }
+     if (++ locality_naccess % LOCALITY_TICK == 0) {
+          sm->tick_event(locality_mm);
+     }
+}
+
+static void
+locality_seq(void) {
+     uintptr_t page, off;
+     int pass;
+     // 第一遍写入，第二遍读取
+     for (pass = 0; pass < 2; pass ++) {
+          bool write = (pass == 0);
+          for (page = 0; page < LOCALITY_NPAGE; page ++) {
+               for (off = 0; off < PGSIZE; off += LOCALITY_STEP) {
+                    locality_access(BEING_CHECK_VALID_VADDR + page * PGSIZE + off, write);
+               }
+          }
+     }
+}
+
+static void
+locality_stride(void) {
+     uintptr_t page, off;
+     int pass;
+     // 第一遍写入，第二遍读取
+     for (pass = 0; pass < 2; pass ++) {
+          bool write = (pass == 0);
+          for (off = 0; off < PGSIZE; off += LOCALITY_STEP) {
+               for (page = 0; page < LOCALITY_NPAGE; page ++) {
+                    locality_access(BEING_CHECK_VALID_VADDR + page * PGSIZE + off, write);
+               }
+          }
+     }
+}
+
+static void
+locality_hot(void) {
+     int i;
+     srand(LOCALITY_NACCESS);
+     for (i = 0; i < LOCALITY_NACCESS; i ++) {
+          uintptr_t page;
+          if (rand() % 5 != 0) {
+               page = rand() % LOCALITY_NHOT;
+          }
+          else {
+               page = LOCALITY_NHOT + rand() % (LOCALITY_NPAGE - LOCALITY_NHOT);
+          }
+          uintptr_t off = (rand() % (PGSIZE / LOCALITY_STEP)) * LOCALITY_STEP;
+          locality_access(BEING_CHECK_VALID_VADDR + page * PGSIZE + off, rand() % 4 == 0);
+     }
+}
+
+static void
+locality_run(struct swap_manager *policy, const char *policy_name,
+             const char *name, void (*workload)(void)) {
+     int i;
+     struct Page *frames[LOCALITY_NFRAME];
+     struct swap_manager *sm_store = sm;
+     unsigned int pgfault_num_store = pgfault_num;
+     struct vmstat before = vmstat;
+
+     sm = policy;
+     struct mm_struct *mm = mm_create();
+     assert(mm != NULL);
+     assert(check_mm_struct == NULL);
+     check_mm_struct = locality_mm = mm;
+
+     pde_t *pgdir = mm->pgdir = boot_pgdir;
+     assert(pgdir[0] == 0);
+     struct vma_struct *vma = vma_create(BEING_CHECK_VALID_VADDR,
+               BEING_CHECK_VALID_VADDR + LOCALITY_NPAGE * PGSIZE, VM_WRITE | VM_READ);
+     assert(vma != NULL);
+     insert_vma_struct(mm, vma);
+     assert(get_pte(pgdir, BEING_CHECK_VALID_VADDR, 1) != NULL);
+
+     // 只留下 LOCALITY_NFRAME 个空闲页面
+     for (i = 0; i < LOCALITY_NFRAME; i ++) {
+          assert((frames[i] = alloc_page()) != NULL);
+     }
+     check_hold_free_pages();
+     for (i = 0; i < LOCALITY_NFRAME; i ++) {
+          free_page(frames[i]);
+     }
+     assert(nr_free_pages() == LOCALITY_NFRAME);
+
+     locality_naccess = 0;
+     workload();
+     cprintf("  %-5s %-6s: %4d faults / %4d accesses, swap in %4d, out %4d, clean %4d, cache hit %d\n",
+               policy_name, name, vmstat.pgfault - before.pgfault, locality_naccess,
+               vmstat.swap_in - before.swap_in, vmstat.swap_out - before.swap_out,
+               vmstat.swap_clean - before.swap_clean, vmstat.swap_cache_hit - before.swap_cache_hit);
+
+     check_unmap(pgdir, vma->vm_start, vma->vm_end);
+     assert(nr_free_pages() == LOCALITY_NFRAME);
+     free_page(pde2page(pgdir[0]));
+     pgdir[0] = 0;
+     mm->pgdir = NULL;
+     mm_destroy(mm);
+     check_mm_struct = locality_mm = NULL;
+     check_release_held_pages();
+
+     // 测试不计入系统的统计信息
+     sm = sm_store;
+     pgfault_num = pgfault_num_store;
+     vmstat = before;
+}
+
+static void
+check_swap_locality(void) {
+     static struct swap_manager *policies[] = {
+          &swap_manager_fifo, &swap_manager_clock, &swap_manager_aging,
+     };
+     static const char *policy_names[] = {"fifo", "clock", "aging"};
+     int i;
+
+     cprintf("swap locality: %d pages on %d frames\n", LOCALITY_NPAGE, LOCALITY_NFRAME);
+     for (i = 0; i < sizeof(policies) / sizeof(policies[0]); i ++) {
+          locality_run(policies[i], policy_names[i], "seq", locality_seq);
+          locality_run(policies[i], policy_names[i], "stride", locality_stride);
+          locality_run(policies[i], policy_names[i], "hot", locality_hot);
+     }
+     cprintf("check_swap_locality() succeeded!\n");
+}
+
+#endif /* CHECK_SWAP_LOCALITY */
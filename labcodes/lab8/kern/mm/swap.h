@@ -55,9 +55,20 @@ int swap_init(void);
 int swap_init_mm(struct mm_struct *mm);
 int swap_tick_event(struct mm_struct *mm);
 int swap_map_swappable(struct mm_struct *mm, uintptr_t addr, struct Page *page, int swap_in);
+void swap_page_handoff(struct mm_struct *mm, struct Page *page);
 int swap_set_unswappable(struct mm_struct *mm, uintptr_t addr);
 int swap_out(struct mm_struct *mm, int n, int in_tick);
 int swap_in(struct mm_struct *mm, uintptr_t addr, struct Page **ptr_result);
+void swap_duplicate(swap_entry_t entry);
+void swap_free(swap_entry_t entry);
+int swap_count(swap_entry_t entry);
+void swap_cache_del(struct Page *page);
+size_t swap_cache_reclaim(size_t n);
+size_t swap_shrink(size_t n);
+size_t swap_reclaim(size_t n);
+
+// 页面回收时每次从一个 mm 中换出的最大页面数
+#define SWAP_CLUSTER                            8
 
 //#define MEMBER_OFFSET(m,t) ((int)(&((t *)0)->m))
 //#define FROM_MEMBER(m,t,a) ((t *)((char *)(a) - MEMBER_OFFSET(m,t)))
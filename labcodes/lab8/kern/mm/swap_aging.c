@@ -0,0 +1,190 @@
+#include <defs.h>
+#include <x86.h>
+#include <stdio.h>
+#include <string.h>
+#include <swap.h>
+#include <swap_aging.h>
+#include <list.h>
+#include <error.h>
+
+/**
+ * 老化（Aging）页替换算法，是对 LRU 的一种近似，用来估计进程的工作集。
+ *
+ * 每个页面有一个 8 位的老化计数器 page->pra_age。每次时钟中断（tick_event）时，
+ * 把计数器右移一位，并把页表项中的访问位 A 移入最高位，然后清除访问位：
+ *     age = (age >> 1) | (A ? 0x80 : 0)
+ * 这样最近 8 个时钟周期内的访问历史都被记录了下来，越近的访问权重越大，
+ * 计数器为 0 的页面在最近 8 个周期内都没有被访问过，已经不在工作集中了。
+ *
+ * 换出时选择 (A << 8) | age 最小的页面，即优先选择上一个时钟周期以来没有被访问过、
+ * 且历史访问最少的页面；若有多个这样的页面，优先选择干净的页面（不需要写回），
+ * 然后按进入内存的先后顺序选择。
+ *
+ * 时钟中断和换出的开销都不随页面数增长：每次时钟中断只老化链表头部的 AGING_SCAN_MAX 个页面，
+ * 然后把它们轮转到链表尾部，下一次时钟中断老化接下来的页面；换出时只在链表头部的 AGING_SCAN_MAX 个页面中选择。
+ * 页面数不超过 AGING_SCAN_MAX 时链表不会被轮转，每次时钟中断老化所有的页面。
+ */
+
+#define AGING_BITS              8
+#define AGING_SCAN_MAX          64
+
+static int
+_aging_init_mm(struct mm_struct *mm)
+{
+    list_init(&(mm->pra_list));
+    mm->sm_priv = &(mm->pra_list);
+    return 0;
+}
+
+static int
+_aging_map_swappable(struct mm_struct *mm, uintptr_t addr, struct Page *page, int swap_in)
+{
+    list_entry_t *head = (list_entry_t *) mm->sm_priv;
+    list_entry_t *entry = &(page->pra_page_link);
+
+    assert(entry != NULL && head != NULL);
+    // 新页面没有访问历史，它本身刚被访问过，访问位会在下一个时钟周期移入计数器
+    page->pra_age = 0;
+    list_add_before(head, entry);
+    return 0;
+}
+
+static int
+_aging_swap_out_victim(struct mm_struct *mm, struct Page ** ptr_page, int in_tick)
+{
+    list_entry_t *head = (list_entry_t *) mm->sm_priv, *le;
+    assert(head != NULL);
+
+    struct Page *victim = NULL;
+    uint32_t victim_key = 0;
+    bool victim_dirty = 0;
+    int scan = 0;
+    for (le = list_next(head); le != head && scan < AGING_SCAN_MAX; le = list_next(le), scan ++) {
+        struct Page *page = le2page(le, pra_page_link);
+        pte_t *ptep = get_pte(mm->pgdir, page->pra_vaddr, 0);
+        assert(ptep != NULL && (*ptep & PTE_P));
+        uint32_t key = (((*ptep & PTE_A) ? 1 : 0) << AGING_BITS) | page->pra_age;
+        bool dirty = ((*ptep & PTE_D) != 0);
+        if (victim == NULL || key < victim_key || (key == victim_key && victim_dirty && !dirty)) {
+            victim = page, victim_key = key, victim_dirty = dirty;
+        }
+    }
+    if (victim == NULL) {
+        return -E_NO_MEM;
+    }
+    list_del_init(&(victim->pra_page_link));
+    *ptr_page = victim;
+    return 0;
+}
+
+/**
+ * 时钟中断时对 mm 的置换链表头部的 AGING_SCAN_MAX 个页面执行一次老化，并把它们轮转到链表尾部
+ */
+static int
+_aging_tick_event(struct mm_struct *mm)
+{
+    list_entry_t *head = (list_entry_t *) mm->sm_priv, *le;
+    if (head == NULL) {
+        return 0;
+    }
+    int scan = 0;
+    for (le = list_next(head); le != head && scan < AGING_SCAN_MAX; le = list_next(le), scan ++) {
+        struct Page *page = le2page(le, pra_page_link);
+        pte_t *ptep = get_pte(mm->pgdir, page->pra_vaddr, 0);
+        assert(ptep != NULL && (*ptep & PTE_P));
+        page->pra_age >>= 1;
+        if (*ptep & PTE_A) {
+            page->pra_age |= 1 << (AGING_BITS - 1);
+            *ptep &= ~PTE_A;
+            tlb_invalidate(mm->pgdir, page->pra_vaddr);
+        }
+    }
+    // 把链表头移到 le 之前，老化过的页面随之到了链表尾部
+    if (le != head) {
+        list_del(head);
+        list_add_before(le, head);
+    }
+    return 0;
+}
+
+/**
+ * check_swap 设置好的环境：a、b、c、d 四个页面依次被写入，占满了 4 个物理页面，
+ * 它们的访问位和修改位都为 1，老化计数器都为 0。
+ */
+static int
+_aging_check_swap(void)
+{
+    unsigned int clean = vmstat.swap_clean;
+    int i;
+
+    // 所有页面的计数器变为 0x80，随后 a、b 被再次访问
+    _aging_tick_event(check_mm_struct);
+    assert(*(unsigned char *)0x1000 == 0x0a);
+    assert(*(unsigned char *)0x2000 == 0x0b);
+    // a、b 的计数器变为 0xc0，c、d 变为 0x40
+    _aging_tick_event(check_mm_struct);
+    cprintf("read Virt Page a, write Virt Page e in aging_check_swap\n");
+    assert(*(unsigned char *)0x1000 == 0x0a);
+    assert(pgfault_num==4);
+    // a 的访问位为 1，c、d 的计数器相同且都是脏页，换出先进入内存的 c
+    *(unsigned char *)0x5000 = 0x0e;
+    assert(pgfault_num==5);
+    // 计数器：a 0xe0，b 0x60，d 0x20，e 0x80，换出 d
+    _aging_tick_event(check_mm_struct);
+    cprintf("read Virt Page c in aging_check_swap\n");
+    assert(*(unsigned char *)0x3000 == 0x0c);
+    assert(pgfault_num==6);
+    // 计数器：a 0x70，b 0x30，e 0x40，c 0x80，换出 b
+    _aging_tick_event(check_mm_struct);
+    cprintf("read Virt Page d in aging_check_swap\n");
+    assert(*(unsigned char *)0x4000 == 0x0d);
+    assert(pgfault_num==7);
+    // 再经过 AGING_BITS + 1 个没有访问的时钟周期后所有计数器都为 0，优先换出干净的页面 c
+    for (i = 0; i <= AGING_BITS; i ++) {
+        _aging_tick_event(check_mm_struct);
+    }
+    cprintf("read Virt Page b in aging_check_swap\n");
+    assert(*(unsigned char *)0x2000 == 0x0b);
+    assert(pgfault_num==8);
+    assert(vmstat.swap_clean == clean + 1);
+    // b 的访问位为 1，剩下的干净页面 d 被换出，同样不需要写回
+    cprintf("read Virt Page c in aging_check_swap\n");
+    assert(*(unsigned char *)0x3000 == 0x0c);
+    assert(pgfault_num==9);
+    assert(vmstat.swap_clean == clean + 2);
+    // 只剩脏页 a、e 的访问位为 0，依次被换出
+    cprintf("read Virt Page d, a, e in aging_check_swap\n");
+    assert(*(unsigned char *)0x4000 == 0x0d);
+    assert(pgfault_num==10);
+    assert(*(unsigned char *)0x1000 == 0x0a);
+    assert(pgfault_num==11);
+    assert(vmstat.swap_clean == clean + 2);
+    assert(*(unsigned char *)0x5000 == 0x0e);
+    assert(pgfault_num==12);
+    return 0;
+}
+
+static int
+_aging_init(void)
+{
+    return 0;
+}
+
+static int
+_aging_set_unswappable(struct mm_struct *mm, uintptr_t addr)
+{
+    return 0;
+}
+
+
+struct swap_manager swap_manager_aging =
+{
+    .name            = "aging swap manager",
+    .init            = &_aging_init,
+    .init_mm         = &_aging_init_mm,
+    .tick_event      = &_aging_tick_event,
+    .map_swappable   = &_aging_map_swappable,
+    .set_unswappable = &_aging_set_unswappable,
+    .swap_out_victim = &_aging_swap_out_victim,
+    .check_swap      = &_aging_check_swap,
+};
@@ -5,20 +5,45 @@
 #include <swap.h>
 #include <swap_clock.h>
 #include <list.h>
+#include <error.h>
 
-static int _clock_init_mm(struct mm_struct *mm)
+/**
+ * 改进的时钟（Enhanced Clock / NRU）页替换算法。
+ *
+ * 每个 mm 的可交换页面按进入内存的顺序组成一个环形链表，链表头 mm->pra_list 充当时钟指针，
+ * 它的下一个页面就是指针当前指向的页面。按照页表项中访问位 A 和修改位 D 把页面分为 4 类：
+ *   (0,0) 最近未访问且未修改，最适合换出，若交换区中还有有效副本甚至不需要写回；
+ *   (0,1) 最近未访问但被修改过，换出前需要写回；
+ *   (1,0) 最近访问过但未修改；
+ *   (1,1) 最近访问过且修改过，最不适合换出。
+ * 选择换出页面时最多扫描 4 轮：
+ *   第 1 轮寻找 (0,0) 的页面，不修改任何访问位；
+ *   第 2 轮寻找 (0,1) 的页面，并清除经过的页面的访问位（给它们第二次机会）；
+ *   第 3、4 轮重复第 1、2 轮，此时所有页面的访问位都已被清除，一定能找到换出页面。
+ * 找到换出页面后，把时钟指针移动到它的下一个页面，经过的页面因此被转移到了队尾。
+ * 每轮最多扫描时钟指针之后的 CLOCK_SCAN_MAX 个页面，进程有大量页面时换出的开销不随页面数增长，
+ * 第 2 轮已经清除了这些页面的访问位，因此仍然一定能找到换出页面。
+ */
+
+#define CLOCK_SCAN_MAX              64
+
+static int
+_clock_init_mm(struct mm_struct *mm)
 {
-    list_init(&mm->free_page_list);
-    mm->sm_priv = &mm->free_page_list;
+    list_init(&(mm->pra_list));
+    mm->sm_priv = &(mm->pra_list);
     return 0;
 }
 
+/**
+ * 新进入内存的页面插入到时钟指针之前，即最后一个被扫描到
+ */
 static int
 _clock_map_swappable(struct mm_struct *mm, uintptr_t addr, struct Page *page, int swap_in)
 {
     list_entry_t *head = (list_entry_t *) mm->sm_priv;
     list_entry_t *entry = &(page->pra_page_link);
- 
+
     assert(entry != NULL && head != NULL);
     list_add_before(head, entry);
     return 0;
@@ -27,78 +52,86 @@ _clock_map_swappable(struct mm_struct *mm, uintptr_t addr, struct Page *page, in
 static int
 _clock_swap_out_victim(struct mm_struct *mm, struct Page ** ptr_page, int in_tick)
 {
-    struct proc_struct *least = NULL; 
-    for (list_entry_t * le = list_next(&proc_list); le != &proc_list; le = list_next(le)) {
-        struct proc_struct *proc = le2proc(le, list_link);
-        if (!proc->mm || list_empty((list_entry_t *)proc->mm->sm_priv)) continue;
-        if (!least || proc->page_fault < least->page_fault)
-            least = proc;
+    list_entry_t *head = (list_entry_t *) mm->sm_priv, *le;
+    assert(head != NULL);
+    if (list_empty(head)) {
+        return -E_NO_MEM;
     }
-    if (least) mm = least->mm;
-    list_entry_t *head = (list_entry_t *)mm->sm_priv;
-    struct Page *victim = NULL;
 
-    for (list_entry_t *le = list_next(head); le != head; le = list_next(le)) {
-        struct Page *page = le2page(le, pra_page_link);
-        pte_t *ptep = get_pte(mm->pgdir, page->pra_vaddr, 0);
-        // not accessed and not dirty
-        if (!(*ptep & PTE_A) && !(*ptep & PTE_D)) {
-            victim = page;
-            break;
-        }
-    }
-    if (victim) goto found;
-
-    for (list_entry_t *le = list_next(head); le != head; le = list_next(le)) {
-        struct Page *page = le2page(le, pra_page_link);
-        pte_t *ptep = get_pte(mm->pgdir, page->pra_vaddr, 0);
-        // not accessed and dirty
-        if (!(*ptep & PTE_A) && (*ptep & PTE_D)) {
-            victim = page;
-            break;
-        }
-        *ptep &= ~PTE_A;
-        tlb_invalidate(mm->pgdir, page->pra_vaddr);
-    }
-    if (victim) goto found;
-
-    for (list_entry_t *le = list_next(head); le != head; le = list_next(le)) {
-        struct Page *page = le2page(le, pra_page_link);
-        pte_t *ptep = get_pte(mm->pgdir, page->pra_vaddr, 0);
-        // not accessed and not dirty
-        if (!(*ptep & PTE_A) && !(*ptep & PTE_D)) {
-            victim = page;
-            break;
+    struct Page *victim = NULL;
+    int pass;
+    for (pass = 0; pass < 4 && victim == NULL; pass ++) {
+        // 偶数轮寻找 (0,0)，奇数轮寻找 (0,1) 并清除访问位
+        uint32_t want = (pass % 2 == 0) ? 0 : PTE_D;
+        int scan = 0;
+        for (le = list_next(head); le != head && scan < CLOCK_SCAN_MAX; le = list_next(le), scan ++) {
+            struct Page *page = le2page(le, pra_page_link);
+            pte_t *ptep = get_pte(mm->pgdir, page->pra_vaddr, 0);
+            assert(ptep != NULL && (*ptep & PTE_P));
+            if ((*ptep & (PTE_A | PTE_D)) == want) {
+                victim = page;
+                break;
+            }
+            if (pass % 2 == 1 && (*ptep & PTE_A)) {
+                *ptep &= ~PTE_A;
+                tlb_invalidate(mm->pgdir, page->pra_vaddr);
+            }
         }
     }
-    if (victim) goto found;
+    assert(victim != NULL);
 
-    for (list_entry_t *le = list_next(head); le != head; le = list_next(le)) {
-        struct Page *page = le2page(le, pra_page_link);
-        pte_t *ptep = get_pte(mm->pgdir, page->pra_vaddr, 0);
-        // not accessed and dirty
-        if (!(*ptep & PTE_A) && (*ptep & PTE_D)) {
-            victim = page;
-            break;
-        }
-        *ptep &= ~PTE_A;
-        tlb_invalidate(mm->pgdir, page->pra_vaddr);
+    // 时钟指针移动到换出页面的下一个页面
+    le = list_next(&(victim->pra_page_link));
+    list_del_init(&(victim->pra_page_link));
+    if (le != head) {
+        list_del(head);
+        list_add_before(le, head);
     }
-    if (victim) goto found;
-    assert(victim != NULL);
-found:
-    list_del(&victim->pra_page_link);
     *ptr_page = victim;
     return 0;
 }
 
+/**
+ * check_swap 设置好的环境：a、b、c、d 四个页面依次被写入，占满了 4 个物理页面，
+ * 它们的访问位和修改位都为 1，时钟指针指向 a。
+ */
 static int
 _clock_check_swap(void)
 {
+    unsigned int clean = vmstat.swap_clean;
+
+    // 所有页面都是 (1,1)：第 2 轮清除全部访问位，第 4 轮换出 a
+    cprintf("write Virt Page e in clock_check_swap\n");
+    *(unsigned char *)0x5000 = 0x0e;
+    assert(pgfault_num==5);
+    // b 被再次访问，换出时跳过 b，换出 (0,1) 的 c
+    cprintf("read Virt Page b in clock_check_swap\n");
+    assert(*(unsigned char *)0x2000 == 0x0b);
+    assert(pgfault_num==5);
+    cprintf("write Virt Page a in clock_check_swap\n");
+    assert(*(unsigned char *)0x1000 == 0x0a);
+    *(unsigned char *)0x1000 = 0x0a;
+    assert(pgfault_num==6);
+    // 换入 c 时换出 (0,1) 的 d，c 只被读取，保持干净
+    cprintf("read Virt Page b, c in clock_check_swap\n");
+    assert(*(unsigned char *)0x2000 == 0x0b);
+    assert(*(unsigned char *)0x3000 == 0x0c);
+    assert(pgfault_num==7);
+    // 所有页面的访问位都为 1，清除后第 3 轮换出干净的 c，它在交换区中的副本仍然有效，不需要写回
+    cprintf("read Virt Page d in clock_check_swap\n");
+    assert(*(unsigned char *)0x4000 == 0x0d);
+    assert(pgfault_num==8);
+    assert(vmstat.swap_clean == clean + 1);
+    // 换出 (0,1) 的 e，c 的内容从交换区中正确读回
+    cprintf("read Virt Page c in clock_check_swap\n");
+    assert(*(unsigned char *)0x3000 == 0x0c);
+    assert(pgfault_num==9);
+    cprintf("read Virt Page e in clock_check_swap\n");
+    assert(*(unsigned char *)0x5000 == 0x0e);
+    assert(pgfault_num==10);
     return 0;
 }
 
-
 static int
 _clock_init(void)
 {
@@ -20,17 +20,16 @@
  * (1) 准备：我们首先接管所有可交换的页面，然后根据时间顺序加入到 pra_list 中。
  */
 
-list_entry_t pra_list_head;
 /*
- * (2) _fifo_init_mm: init pra_list_head and let  mm->sm_priv point to the addr of pra_list_head.
+ * (2) _fifo_init_mm: init mm->pra_list and let mm->sm_priv point to it.
  *              Now, From the memory control struct mm_struct, we can access FIFO PRA
+ *              每个 mm 都有自己的队列，换出时只在该 mm 的页面中选择。
  */
 static int
 _fifo_init_mm(struct mm_struct *mm)
 {     
-     list_init(&pra_list_head);
-     mm->sm_priv = &pra_list_head;
-     //cprintf(" mm->sm_priv %x in fifo_init_mm\n",mm->sm_priv);
+     list_init(&(mm->pra_list));
+     mm->sm_priv = &(mm->pra_list);
      return 0;
 }
 /*
@@ -63,7 +62,7 @@ _fifo_swap_out_victim(struct mm_struct *mm, struct Page ** ptr_page, int in_tick
      list_entry_t *entry = list_next(head);
      assert(entry != NULL);
      *ptr_page = le2page(entry, pra_page_link);
-     list_del(entry);
+     list_del_init(entry);
      //(1)  unlink the  earliest arrival page in front of pra_list_head queue
      //(2)  assign the value of *ptr_page to the addr of this page
      return 0;
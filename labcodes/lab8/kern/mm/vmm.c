@@ -8,6 +8,7 @@
 #include <x86.h>
 #include <swap.h>
 #include <kmalloc.h>
+#include <stdlib.h>
 
 /* 
   vmm design include two parts: mm_struct (mm) & vma_struct (vma)
@@ -26,35 +27,49 @@
      struct vma_struct * vma_create (uintptr_t vm_start, uintptr_t vm_end,...)
      void insert_vma_struct(struct mm_struct *mm, struct vma_struct *vma)
      struct vma_struct * find_vma(struct mm_struct *mm, uintptr_t addr)
+     struct vma_struct * find_vma_intersection(struct mm_struct *mm, uintptr_t start, uintptr_t end)
    local functions
      inline void check_vma_overlap(struct vma_struct *prev, struct vma_struct *next)
+     struct vma_struct * find_vma_lower(struct mm_struct *mm, uintptr_t addr)
 ---------------
    check correctness functions
      void check_vmm(void);
      void check_vma_struct(void);
+     void check_vma_rb(void);
      void check_pgfault(void);
 */
 
 static void check_vmm(void);
 static void check_vma_struct(void);
+static void check_vma_rb(void);
 static void check_pgfault(void);
 
+static struct kmem_cache *mm_cachep, *vma_cachep;
+
+// 所有的 mm，页面回收时按顺序轮流从中换出页面
+list_entry_t mm_list;
+
 // mm_create -  alloc a mm_struct & initialize it.
 struct mm_struct *
 mm_create(void) {
-    struct mm_struct *mm = kmalloc(sizeof(struct mm_struct));
+    struct mm_struct *mm = kmem_cache_alloc(mm_cachep);
 
     if (mm != NULL) {
         list_init(&(mm->mmap_list));
+        mm->mmap_tree = NULL;
         mm->mmap_cache = NULL;
         mm->pgdir = NULL;
         mm->map_count = 0;
+        mm->fa_start = mm->fa_end = 0;
+        mm->fa_window = 1;
 
+        list_init(&(mm->pra_list));
         if (swap_init_ok) swap_init_mm(mm);
         else mm->sm_priv = NULL;
         
         set_mm_count(mm, 0);
         sem_init(&(mm->mm_sem), 1);
+        list_add_before(&mm_list, &(mm->mm_link));
     }    
     return mm;
 }
@@ -62,7 +77,7 @@ mm_create(void) {
 // vma_create - alloc a vma_struct & initialize it. (addr range: vm_start~vm_end)
 struct vma_struct *
 vma_create(uintptr_t vm_start, uintptr_t vm_end, uint32_t vm_flags) {
-    struct vma_struct *vma = kmalloc(sizeof(struct vma_struct));
+    struct vma_struct *vma = kmem_cache_alloc(vma_cachep);
 
     if (vma != NULL) {
         vma->vm_start = vm_start;
@@ -73,6 +88,52 @@ vma_create(uintptr_t vm_start, uintptr_t vm_end, uint32_t vm_flags) {
 }
 
 
+// vma_compare - compare two vmas by vm_start, used by mm->mmap_tree
+static inline int
+vma_compare(rb_node *node1, rb_node *node2) {
+    struct vma_struct *vma1 = rbn2vma(node1, rb_link);
+    struct vma_struct *vma2 = rbn2vma(node2, rb_link);
+    uintptr_t start1 = vma1->vm_start, start2 = vma2->vm_start;
+    return (start1 < start2) ? -1 : (start1 > start2) ? 1 : 0;
+}
+
+/**
+ * 找到第一个满足 vm_end > addr 的 vma，即包含 addr 或位于 addr 之后的第一个 vma。
+ * vma 之间互不重叠，因此按 vm_start 排序与按 vm_end 排序是一致的。
+ * 建立了红黑树时复杂度为 O(log n)，否则线性查找链表。
+ */
+static struct vma_struct *
+find_vma_lower(struct mm_struct *mm, uintptr_t addr) {
+    struct vma_struct *vma = NULL, *tmp;
+    if (mm->mmap_tree != NULL) {
+        rb_node *node = rb_node_root(mm->mmap_tree);
+        while (node != NULL) {
+            tmp = rbn2vma(node, rb_link);
+            if (tmp->vm_end > addr) {
+                vma = tmp;
+                if (tmp->vm_start <= addr) {
+                    break;
+                }
+                node = rb_node_left(mm->mmap_tree, node);
+            }
+            else {
+                node = rb_node_right(mm->mmap_tree, node);
+            }
+        }
+    }
+    else {
+        list_entry_t *list = &(mm->mmap_list), *le = list;
+        while ((le = list_next(le)) != list) {
+            tmp = le2vma(le, list_link);
+            if (tmp->vm_end > addr) {
+                vma = tmp;
+                break;
+            }
+        }
+    }
+    return vma;
+}
+
 // find_vma - find a vma  (vma->vm_start <= addr <= vma_vm_end)
 struct vma_struct *
 find_vma(struct mm_struct *mm, uintptr_t addr) {
@@ -80,18 +141,9 @@ find_vma(struct mm_struct *mm, uintptr_t addr) {
     if (mm != NULL) {
         vma = mm->mmap_cache;
         if (!(vma != NULL && vma->vm_start <= addr && vma->vm_end > addr)) {
-                bool found = 0;
-                list_entry_t *list = &(mm->mmap_list), *le = list;
-                while ((le = list_next(le)) != list) {
-                    vma = le2vma(le, list_link);
-                    if (vma->vm_start<=addr && addr < vma->vm_end) {
-                        found = 1;
-                        break;
-                    }
-                }
-                if (!found) {
-                    vma = NULL;
-                }
+            if ((vma = find_vma_lower(mm, addr)) != NULL && vma->vm_start > addr) {
+                vma = NULL;
+            }
         }
         if (vma != NULL) {
             mm->mmap_cache = vma;
@@ -100,6 +152,15 @@ find_vma(struct mm_struct *mm, uintptr_t addr) {
     return vma;
 }
 
+// find_vma_intersection - find the first vma which overlaps [start, end)
+struct vma_struct *
+find_vma_intersection(struct mm_struct *mm, uintptr_t start, uintptr_t end) {
+    struct vma_struct *vma = find_vma_lower(mm, start);
+    if (vma != NULL && end <= vma->vm_start) {
+        vma = NULL;
+    }
+    return vma;
+}
 
 // check_vma_overlap - check if vma1 overlaps vma2 ?
 static inline void
@@ -110,6 +171,17 @@ check_vma_overlap(struct vma_struct *prev, struct vma_struct *next) {
 }
 
 
+// mmap_tree_build - vma 的数量达到 RB_MIN_MAP_COUNT 时，把链表中所有的 vma 加入红黑树
+static void
+mmap_tree_build(struct mm_struct *mm) {
+    if ((mm->mmap_tree = rb_tree_create(vma_compare)) != NULL) {
+        list_entry_t *list = &(mm->mmap_list), *le = list;
+        while ((le = list_next(le)) != list) {
+            rb_insert(mm->mmap_tree, &(le2vma(le, list_link)->rb_link));
+        }
+    }
+}
+
 // insert_vma_struct -insert vma in mm's list link
 void
 insert_vma_struct(struct mm_struct *mm, struct vma_struct *vma) {
@@ -117,6 +189,15 @@ insert_vma_struct(struct mm_struct *mm, struct vma_struct *vma) {
     list_entry_t *list = &(mm->mmap_list);
     list_entry_t *le_prev = list, *le_next;
 
+    if (mm->mmap_tree != NULL) {
+        // 红黑树中的前驱就是链表中的前一个 vma
+        rb_insert(mm->mmap_tree, &(vma->rb_link));
+        rb_node *prev = rb_node_prev(mm->mmap_tree, &(vma->rb_link));
+        if (prev != NULL) {
+            le_prev = &(rbn2vma(prev, rb_link)->list_link);
+        }
+    }
+    else {
         list_entry_t *le = list;
         while ((le = list_next(le)) != list) {
             struct vma_struct *mmap_prev = le2vma(le, list_link);
@@ -125,6 +206,7 @@ insert_vma_struct(struct mm_struct *mm, struct vma_struct *vma) {
             }
             le_prev = le;
         }
+    }
 
     le_next = list_next(le_prev);
 
@@ -140,6 +222,9 @@ insert_vma_struct(struct mm_struct *mm, struct vma_struct *vma) {
     list_add_after(le_prev, &(vma->list_link));
 
     mm->map_count ++;
+    if (mm->mmap_tree == NULL && mm->map_count >= RB_MIN_MAP_COUNT) {
+        mmap_tree_build(mm);
+    }
 }
 
 // mm_destroy - free mm and mm internal fields
@@ -150,9 +235,13 @@ mm_destroy(struct mm_struct *mm) {
     list_entry_t *list = &(mm->mmap_list), *le;
     while ((le = list_next(list)) != list) {
         list_del(le);
-        kfree(le2vma(le, list_link));  //kfree vma        
+        kmem_cache_free(vma_cachep, le2vma(le, list_link));  //kfree vma        
     }
-    kfree(mm); //kfree mm
+    if (mm->mmap_tree != NULL) {
+        rb_tree_destroy(mm->mmap_tree);
+    }
+    list_del(&(mm->mm_link));
+    kmem_cache_free(mm_cachep, mm); //kfree mm
     mm=NULL;
 }
 
@@ -169,7 +258,7 @@ mm_map(struct mm_struct *mm, uintptr_t addr, size_t len, uint32_t vm_flags,
     int ret = -E_INVAL;
 
     struct vma_struct *vma;
-    if ((vma = find_vma(mm, start)) != NULL && end > vma->vm_start) {
+    if (find_vma_intersection(mm, start, end) != NULL) {
         goto out;
     }
     ret = -E_NO_MEM;
@@ -201,7 +290,8 @@ dup_mmap(struct mm_struct *to, struct mm_struct *from) {
 
         insert_vma_struct(to, nvma);
 
-        bool share = 0; // LAB5 CHALLEGE: change to share = 1
+        // 采用写时复制，fork 的开销只与页表的大小有关
+        bool share = 1;
         if (copy_range(to->pgdir, from->pgdir, vma->vm_start, vma->vm_end, share) != 0) {
             return -E_NO_MEM;
         }
@@ -213,11 +303,20 @@ void
 exit_mmap(struct mm_struct *mm) {
     assert(mm != NULL && mm_count(mm) == 0);
     pde_t *pgdir = mm->pgdir;
-    list_entry_t *list = &(mm->mmap_list), *le = list;
+    list_entry_t *list, *le;
+    // 置换链表中的页面先全部移出链表，还被 fork 出来的其它 mm 共享的页面交给其中一个 mm 的置换链表
+    if ((list = mm->sm_priv) != NULL) {
+        while ((le = list_next(list)) != list) {
+            list_del_init(le);
+            swap_page_handoff(mm, le2page(le, pra_page_link));
+        }
+    }
+    list = le = &(mm->mmap_list);
     while ((le = list_next(le)) != list) {
         struct vma_struct *vma = le2vma(le, list_link);
         unmap_range(pgdir, vma->vm_start, vma->vm_end);
     }
+    le = list;
     while ((le = list_next(le)) != list) {
         struct vma_struct *vma = le2vma(le, list_link);
         exit_range(pgdir, vma->vm_start, vma->vm_end);
@@ -243,9 +342,14 @@ copy_to_user(struct mm_struct *mm, void *dst, const void *src, size_t len) {
 }
 
 // vmm_init - initialize virtual memory management
-//          - now just call check_vmm to check correctness of vmm
+//          - create the slab caches of mm_struct and vma_struct
+//          - call check_vmm to check correctness of vmm
 void
 vmm_init(void) {
+    list_init(&mm_list);
+    mm_cachep = kmem_cache_create("mm_struct", sizeof(struct mm_struct));
+    vma_cachep = kmem_cache_create("vma_struct", sizeof(struct vma_struct));
+    assert(mm_cachep != NULL && vma_cachep != NULL);
     check_vmm();
 }
 
@@ -255,6 +359,7 @@ check_vmm(void) {
     size_t nr_free_pages_store = nr_free_pages();
     
     check_vma_struct();
+    check_vma_rb();
     check_pgfault();
 
     cprintf("check_vmm() succeeded.\n");
@@ -320,6 +425,110 @@ check_vma_struct(void) {
     cprintf("check_vma_struct() succeeded!\n");
 }
 
+#define CHECK_VMA_NR            4096
+#define CHECK_VMA_BASE          0x10000000
+#define CHECK_VMA_LOOKUP        16384
+#define check_vma_addr(i)       (CHECK_VMA_BASE + (uintptr_t)(i) * 2 * PGSIZE)
+
+/**
+ * 红黑树索引的压力测试：以随机顺序映射 CHECK_VMA_NR 个单页的 vma（相邻 vma 之间空出一页），
+ * 检查链表、红黑树、查找与重叠检测的结果，
+ * 并比较使用红黑树与线性链表时随机 find_vma 和缺页处理的开销。
+ */
+static void
+check_vma_rb(void) {
+    size_t kallocated_store = kallocated();
+    unsigned int pgfault_num_store = pgfault_num, vmstat_pgfault_store = vmstat.pgfault;
+
+    check_rb_tree();
+
+    struct mm_struct *mm = mm_create();
+    assert(mm != NULL);
+    struct Page *pgdir_page = alloc_page();
+    assert(pgdir_page != NULL);
+    mm->pgdir = page2kva(pgdir_page);
+    memcpy(mm->pgdir, boot_pgdir, PGSIZE);
+
+    int i, *order = kmalloc(sizeof(int) * CHECK_VMA_NR);
+    assert(order != NULL);
+    for (i = 0; i < CHECK_VMA_NR; i ++) {
+        order[i] = i;
+    }
+    srand(0x5eed);
+    for (i = CHECK_VMA_NR - 1; i > 0; i --) {
+        int j = rand() % (i + 1), tmp = order[i];
+        order[i] = order[j], order[j] = tmp;
+    }
+    for (i = 0; i < CHECK_VMA_NR; i ++) {
+        assert(mm_map(mm, check_vma_addr(order[i]), PGSIZE, VM_READ | VM_WRITE, NULL) == 0);
+    }
+    assert(mm->map_count == CHECK_VMA_NR && mm->mmap_tree != NULL);
+
+    // 链表有序，且与红黑树的中序遍历一致
+    list_entry_t *le = &(mm->mmap_list);
+    struct vma_struct *vma = find_vma_lower(mm, 0);
+    for (i = 0; i < CHECK_VMA_NR; i ++) {
+        le = list_next(le);
+        assert(vma == le2vma(le, list_link) && vma->vm_start == check_vma_addr(i));
+        rb_node *node = rb_node_next(mm->mmap_tree, &(vma->rb_link));
+        vma = (node != NULL) ? rbn2vma(node, rb_link) : NULL;
+    }
+    assert(vma == NULL && list_next(le) == &(mm->mmap_list));
+
+    // 查找与重叠检测
+    assert(find_vma(mm, CHECK_VMA_BASE - 1) == NULL);
+    for (i = 0; i < CHECK_VMA_NR; i ++) {
+        uintptr_t start = check_vma_addr(i);
+        assert((vma = find_vma(mm, start + PGSIZE - 1)) != NULL && vma->vm_start == start);
+        assert(find_vma(mm, start + PGSIZE) == NULL);
+        assert(find_vma_intersection(mm, start + PGSIZE, start + 2 * PGSIZE) == NULL);
+        vma = find_vma_intersection(mm, start + PGSIZE, start + 3 * PGSIZE);
+        assert(i + 1 < CHECK_VMA_NR ? (vma != NULL && vma->vm_start == start + 2 * PGSIZE) : vma == NULL);
+        assert(mm_map(mm, start - PGSIZE, 2 * PGSIZE, 0, NULL) == -E_INVAL);
+    }
+
+    // 第 0 轮使用红黑树，第 1 轮暂时摘掉红黑树退化为线性查找，
+    // 每一轮随机查找 CHECK_VMA_LOOKUP 次，并在一半的 vma 中按随机顺序各触发一次缺页
+    uint64_t start, lookup_cycles[2] = {0, 0}, fault_cycles[2] = {0, 0};
+    rb_tree *tree = mm->mmap_tree;
+    int round;
+    for (round = 0; round < 2; round ++) {
+        mm->mmap_tree = (round == 0) ? tree : NULL;
+        for (i = 0; i < CHECK_VMA_LOOKUP; i ++) {
+            uintptr_t addr = check_vma_addr(rand() % CHECK_VMA_NR) + rand() % PGSIZE;
+            mm->mmap_cache = NULL;
+            start = rdtsc();
+            vma = find_vma(mm, addr);
+            lookup_cycles[round] += rdtsc() - start;
+            assert(vma != NULL && vma->vm_start == ROUNDDOWN(addr, PGSIZE));
+        }
+        for (i = round * CHECK_VMA_NR / 2; i < (round + 1) * CHECK_VMA_NR / 2; i ++) {
+            mm->mmap_cache = NULL;
+            start = rdtsc();
+            assert(do_pgfault(mm, 2, check_vma_addr(order[i])) == 0);
+            fault_cycles[round] += rdtsc() - start;
+        }
+    }
+    mm->mmap_tree = tree;
+    for (round = 0; round < 2; round ++) {
+        do_div(lookup_cycles[round], CHECK_VMA_LOOKUP);
+        do_div(fault_cycles[round], CHECK_VMA_NR / 2);
+    }
+    cprintf("check_vma_rb: %d vmas, find_vma %llu cycles (list %llu), pgfault %llu cycles (list %llu)\n",
+            CHECK_VMA_NR, lookup_cycles[0], lookup_cycles[1], fault_cycles[0], fault_cycles[1]);
+
+    kfree(order);
+    exit_mmap(mm);
+    free_page(pgdir_page);
+    mm->pgdir = NULL;
+    mm_destroy(mm);
+
+    pgfault_num = pgfault_num_store, vmstat.pgfault = vmstat_pgfault_store;
+    assert(kallocated_store == kallocated());
+
+    cprintf("check_vma_rb() succeeded!\n");
+}
+
 struct mm_struct *check_mm_struct;
 
 // check_pgfault - check correctness of pgfault handler
@@ -367,6 +576,82 @@ check_pgfault(void) {
 //page fault number
 volatile unsigned int pgfault_num=0;
 
+// 虚拟内存事件计数器，可通过 SYS_vmstat 读取
+struct vmstat vmstat;
+
+// fault-around 窗口的上限（页数），可通过 SYS_fault_around 修改
+int fault_around_max = FAULT_AROUND_MAX;
+
+/**
+ * 在缺页地址附近预先映射匿名页面，减少顺序访问时的缺页次数。
+ *
+ * mm->fa_start/fa_end 记录上一次映射的窗口 [fa_start, fa_end)。若本次缺页的页面紧挨着
+ * 上一个窗口，说明程序正在顺序访问（向高地址或向低地址，例如栈），窗口大小翻倍，
+ * 但不超过 fault_around_max，并沿着访问的方向预映射；否则窗口回到 1 个页面，不做预映射。
+ * 预映射只在同一个 vma、同一张页表中进行，遇到已经存在的页表项就停止。
+ *
+ * @param addr 已经映射好的缺页地址（页对齐）
+ */
+// 新分配的匿名页面交给页面置换算法管理，check_swap 中 pgdir_alloc_page 已经处理过了
+static inline void
+anon_page_swappable(struct mm_struct *mm, uintptr_t addr, struct Page *page) {
+    if (swap_init_ok && mm->sm_priv != NULL && list_empty(&(page->pra_page_link))) {
+        page->pra_vaddr = addr;
+        swap_map_swappable(mm, addr, page, 0);
+    }
+}
+
+static void
+do_fault_around(struct mm_struct *mm, struct vma_struct *vma, uintptr_t addr, uint32_t perm) {
+    int dir = 0;
+    if (addr == mm->fa_end) {
+        dir = 1;
+    }
+    else if (addr + PGSIZE == mm->fa_start) {
+        dir = -1;
+    }
+    if (dir != 0) {
+        mm->fa_window *= 2;
+        if (mm->fa_window > fault_around_max) {
+            mm->fa_window = fault_around_max;
+        }
+    }
+    else {
+        mm->fa_window = 1;
+    }
+
+    uintptr_t start = addr, end = addr + PGSIZE;
+    int n;
+    for (n = 1; n < mm->fa_window; n ++) {
+        uintptr_t la = (dir > 0) ? end : start - PGSIZE;
+        if (la < vma->vm_start || la >= vma->vm_end || PDX(la) != PDX(addr)) {
+            break;
+        }
+        pte_t *ptep = get_pte(mm->pgdir, la, 0);
+        if (ptep == NULL || *ptep != 0) {
+            break;
+        }
+        // 内存紧张时不做预映射，避免为了预映射而回收页面
+        if (pages_low != 0 && nr_free_pages() < pages_low) {
+            break;
+        }
+        struct Page *page;
+        if ((page = pgdir_alloc_page(mm->pgdir, la, perm)) == NULL) {
+            break;
+        }
+        memset(page2kva(page), 0, PGSIZE);
+        anon_page_swappable(mm, la, page);
+        if (dir > 0) {
+            end += PGSIZE;
+        }
+        else {
+            start -= PGSIZE;
+        }
+        vmstat.fault_around ++;
+    }
+    mm->fa_start = start, mm->fa_end = end;
+}
+
 /**
  * 处理缺页异常的中断处理程序.
  * 
@@ -385,6 +670,7 @@ do_pgfault(struct mm_struct *mm, uint32_t error_code, uintptr_t addr) {
     struct vma_struct *vma = find_vma(mm, addr);
 
     pgfault_num++;
+    vmstat.pgfault ++;
     //If the addr is in the range of a mm's vma?
     if (vma == NULL || vma->vm_start > addr) {
         cprintf("not valid addr %x, and  can not find it in vma\n", addr);
@@ -433,47 +719,55 @@ do_pgfault(struct mm_struct *mm, uint32_t error_code, uintptr_t addr) {
     if (!*ptep) {
         // (2) if the phy addr isn't exist (No page table entry exists),
         // then alloc a page & map the phy addr with logical addr
-        if (!pgdir_alloc_page(mm->pgdir, addr, perm)) {
+        struct Page *page;
+        if ((page = pgdir_alloc_page(mm->pgdir, addr, perm)) == NULL) {
             cprintf("do_pgfault failed: no enough space for allocating a page for user");
             goto failed;
         }
+        // 匿名页面（栈、BSS）的内容必须为 0
+        memset(page2kva(page), 0, PGSIZE);
+        anon_page_swappable(mm, addr, page);
+        // check_swap 依赖精确的缺页次数，不做预映射
+        if (mm != check_mm_struct) {
+            do_fault_around(mm, vma, addr, perm);
+        }
     }
     else {
         struct Page *page = NULL;
+        swap_entry_t entry = 0;
         /*
          * LAB5 CHALLENGE (the implmentation Copy on Write)
          */
         if (*ptep & PTE_P) {
             // 如果我们写入一个已经在内存中的页面而导致缺页异常，
-            // 一定是用户程序没有该页的写入权限（页面写保护/只读），
-            // 页面只读是因为我们采取了页面共享的策略以减少内存占用，
-            // 因此我们需要实现 copy-on-write 算法来保证用户仍能
-            // 对这些页面进行写入操作。
-            // 若查询 VMA 已知该页面是真的可写的，我们创建一个新的
-            // 页面，并修改 *ptep
-            if (vma->vm_flags & VM_WRITE) {
-                struct Page *opage = pte2page(*ptep);
-                if (page_ref(opage) == 1) {
-                    cprintf("do_pgfault: COW");
-                    // 如果我们写入的页面引用数刚好为 1，
-                    // 那么当前页面就可以直接设置为可写
-                    page = opage;
-                } else if (page_ref(opage) > 1) {
-                    // 否则复制出来一个新页面
-                    cprintf("do_pgfault: COW: allocating a new page");
-                    page_ref_dec(opage);
-                    if ((page = alloc_page()) == NULL) {
-                        cprintf("do_pgfault failed: no enough space for allocating a page for user");
-                        goto failed;
-                    }
-                    void *src_kvaddr = page2kva(opage);
-                    void *dst_kvaddr = page2kva(page);
-                    memcpy(dst_kvaddr, src_kvaddr, PGSIZE);
-                } else {
-                    panic("error writing to a non-ref page");
+            // 一定是 fork 时 copy_range 将该页面设为只读并在父子进程间共享了，
+            // 上面的 switch 已经保证了 VMA 是可写的，因此这里需要执行写时复制。
+            struct Page *opage = pte2page(*ptep);
+            assert(page_ref(opage) > 0);
+            vmstat.cow_fault ++;
+            if (page_ref(opage) == 1) {
+                // 其它进程都已经复制或释放了该页面，直接恢复写权限即可
+                page = opage;
+                vmstat.cow_reused ++;
+                // 页面即将被修改，它不再是交换区中槽位的有效副本
+                if (page->swap_entry != 0) {
+                    swap_cache_del(page);
                 }
             } else {
-                panic("error writing to a non-writable page");
+                // 否则复制出来一个新页面，原页面的引用计数由 page_insert 减少。
+                // 原页面在本 mm 的置换链表中时，此后本 mm 不再映射它，移出链表并交给仍映射它的 mm；
+                // 在其它 mm 的置换链表中时保持不变
+                if (!list_empty(&(opage->pra_page_link)) && opage->pra_mm == mm) {
+                    list_del_init(&(opage->pra_page_link));
+                    swap_page_handoff(mm, opage);
+                }
+                if ((page = alloc_page()) == NULL) {
+                    cprintf("do_pgfault failed: no enough space for allocating a page for user\n");
+                    goto failed;
+                }
+                pra_page_init(page);
+                memcpy(page2kva(page), page2kva(opage), PGSIZE);
+                vmstat.cow_copied ++;
             }
         } else {
             // 若页面不存在，表明该页被交换进磁盘了，我们需要执行页交换操作
@@ -483,20 +777,46 @@ do_pgfault(struct mm_struct *mm, uint32_t error_code, uintptr_t addr) {
             * and map the phy addr with logical addr, trigger swap manager to record the access situation of this page.
             */
             if (swap_init_ok) {
+                entry = *ptep;
                 if (swap_in(mm, addr, &page) != 0) {        // (1) According to the mm AND addr, try to load the content of right disk page
                     cprintf("do_pgfault failed: swap_in");  //     into the memory which page managed.
                     goto failed;
                 }
+                if (page == NULL) {
+                    // 换入期间页表项已经被另一次缺页处理了
+                    ret = 0;
+                    goto failed;
+                }
                 current->page_fault++;
+                // 页面仍被其它进程映射，或者槽位还被其它页表项引用（除了本页表项和交换缓存），
+                // 说明页面是共享的，只读映射，写入时再执行写时复制
+                if (page_ref(page) > 0 || swap_count(entry) > 2) {
+                    perm &= ~PTE_W;
+                }
             }
             else {
                 cprintf("no swap_init_ok but ptep is %x, failed\n",*ptep);
                 goto failed;
             }
         }
-        page_insert(mm->pgdir, page, addr, perm);   // (2) According to the mm, addr AND page, setup the map of phy addr <---> logical addr
-        swap_map_swappable(mm, addr, page, true);   // (3) make the page swappable.
+        if (page_insert(mm->pgdir, page, addr, perm) != 0) { // (2) According to the mm, addr AND page, setup the map of phy addr <---> logical addr
+            if (page_ref(page) == 0) {
+                if (page->swap_entry != 0) {
+                    swap_cache_del(page);
+                }
+                free_page(page);
+            }
+            goto failed;
+        }
+        // 页表项不再引用交换区中的槽位
+        if (entry != 0) {
+            swap_free(entry);
+        }
         page->pra_vaddr = addr;
+        // 只有被一个 mm 独占的页面才能换出
+        if (page_ref(page) == 1 && list_empty(&(page->pra_page_link))) {
+            swap_map_swappable(mm, addr, page, true); // (3) make the page swappable.
+        }
    }
    ret = 0;
 failed:
@@ -530,6 +850,57 @@ user_mem_check(struct mm_struct *mm, uintptr_t addr, size_t len, bool write) {
     return KERN_ACCESS(addr, addr + len);
 }
 
+/*
+ * user_mem_pin - pin the pages of [addr, addr + len) in mm, which user_mem_check has accepted, and store them in pages.
+ *                the pages are faulted in as a user access would do, private and writable if write.
+ *                a pinned page is not swapped out, and not freed even if it is unmapped meanwhile, so the kernel can
+ *                move data through page2kva without faulting, or sleeping, while it holds a page of a cache.
+ *                the caller holds the lock of mm. return the # of pages pinned, or an error.
+ */
+int
+user_mem_pin(struct mm_struct *mm, uintptr_t addr, size_t len, bool write, struct Page **pages) {
+    uintptr_t start = ROUNDDOWN(addr, PGSIZE), end = ROUNDUP(addr + len, PGSIZE);
+    int npages = 0, ret;
+    pte_t *ptep;
+    for (; start < end; start += PGSIZE) {
+        while ((ptep = get_pte(mm->pgdir, start, 0)) == NULL || !(*ptep & PTE_P) || (write && !(*ptep & PTE_W))) {
+            // 换入或写时复制，写入一个换入的共享页面需要两次
+            uint32_t error_code = ((ptep != NULL && (*ptep & PTE_P)) ? 1 : 0) | (write ? 2 : 0);
+            if ((ret = do_pgfault(mm, error_code, start)) != 0) {
+                user_mem_unpin(pages, npages);
+                return ret;
+            }
+        }
+        struct Page *page = pte2page(*ptep);
+        if (write && page->swap_entry != 0) {
+            // 内核通过 page2kva 写入页面不会设置页表项中的 D 位，交换区中的副本在写入之前就不再有效
+            swap_cache_del(page);
+        }
+        page_ref_inc(page);
+        page->pinned ++;
+        pages[npages ++] = page;
+    }
+    return npages;
+}
+
+/*
+ * user_mem_unpin - unpin npages pages pinned by user_mem_pin, a page unmapped while it was pinned is freed
+ */
+void
+user_mem_unpin(struct Page **pages, int npages) {
+    while (npages > 0) {
+        struct Page *page = pages[-- npages];
+        assert(page->pinned > 0);
+        page->pinned --;
+        if (page_ref_dec(page) == 0) {
+            if (page->swap_entry != 0) {
+                swap_cache_del(page);
+            }
+            free_page(page);
+        }
+    }
+}
+
 bool
 copy_string(struct mm_struct *mm, char *dst, const char *src, size_t maxn) {
     size_t alen, part = ROUNDDOWN((uintptr_t)src + PGSIZE, PGSIZE) - (uintptr_t)src;
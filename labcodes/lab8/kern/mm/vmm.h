@@ -3,10 +3,12 @@
 
 #include <defs.h>
 #include <list.h>
+#include <rb_tree.h>
 #include <memlayout.h>
 #include <sync.h>
 #include <proc.h>
 #include <sem.h>
+#include <vmstat.h>
 
 //pre define
 struct mm_struct;
@@ -19,11 +21,15 @@ struct vma_struct {
     uintptr_t vm_end;        // end addr of vma, not include the vm_end itself
     uint32_t vm_flags;       // flags of vma
     list_entry_t list_link;  // linear list link which sorted by start addr of vma
+    rb_node rb_link;         // redblack link which sorted by start addr of vma
 };
 
 #define le2vma(le, member)                  \
     to_struct((le), struct vma_struct, member)
 
+#define rbn2vma(node, member)               \
+    to_struct((node), struct vma_struct, member)
+
 #define VM_READ                 0x00000001
 #define VM_WRITE                0x00000002
 #define VM_EXEC                 0x00000004
@@ -32,6 +38,7 @@ struct vma_struct {
 // the control struct for a set of vma using the same PDT
 struct mm_struct {
     list_entry_t mmap_list;        // linear list link which sorted by start addr of vma
+    rb_tree *mmap_tree;            // redblack tree link which sorted by start addr of vma, NULL if map_count < RB_MIN_MAP_COUNT
     struct vma_struct *mmap_cache; // current accessed vma, used for speed purpose
     pde_t *pgdir;                  // the PDT of these vma
     int map_count;                 // the count of these vma
@@ -39,10 +46,20 @@ struct mm_struct {
     int mm_count;                  // the number ofprocess which shared the mm
     semaphore_t mm_sem;            // mutex for using dup_mmap fun to duplicat the mm 
     int locked_by;                 // the lock owner process's pid
-    list_entry_t free_page_list;   // LAB9: for clock algorithm
+    list_entry_t pra_list;         // swappable pages of this mm, used by swap manager
+    list_entry_t mm_link;          // link in mm_list, used by page reclaim
+    uintptr_t fa_start, fa_end;    // the last fault-around window [fa_start, fa_end)
+    int fa_window;                 // current fault-around window size in pages
 };
 
+// 缺页时最多连续映射的页面数的默认值，1 表示关闭 fault-around
+#define FAULT_AROUND_MAX        16
+
+// vma 的数量达到 RB_MIN_MAP_COUNT 后，mm 会额外用红黑树索引所有的 vma
+#define RB_MIN_MAP_COUNT        32
+
 struct vma_struct *find_vma(struct mm_struct *mm, uintptr_t addr);
+struct vma_struct *find_vma_intersection(struct mm_struct *mm, uintptr_t start, uintptr_t end);
 struct vma_struct *vma_create(uintptr_t vm_start, uintptr_t vm_end, uint32_t vm_flags);
 void insert_vma_struct(struct mm_struct *mm, struct vma_struct *vma);
 
@@ -61,12 +78,20 @@ uintptr_t get_unmapped_area(struct mm_struct *mm, size_t len);
 int mm_brk(struct mm_struct *mm, uintptr_t addr, size_t len);
 
 extern volatile unsigned int pgfault_num;
+extern struct vmstat vmstat;
+extern int fault_around_max;
 extern struct mm_struct *check_mm_struct;
+extern list_entry_t mm_list;
+
+#define le2mm(le, member)                   \
+    to_struct((le), struct mm_struct, member)
 
 bool user_mem_check(struct mm_struct *mm, uintptr_t start, size_t len, bool write);
 bool copy_from_user(struct mm_struct *mm, void *dst, const void *src, size_t len, bool writable);
 bool copy_to_user(struct mm_struct *mm, void *dst, const void *src, size_t len);
 bool copy_string(struct mm_struct *mm, char *dst, const char *src, size_t maxn);
+int user_mem_pin(struct mm_struct *mm, uintptr_t addr, size_t len, bool write, struct Page **pages);
+void user_mem_unpin(struct Page **pages, int npages);
 
 static inline int
 mm_count(struct mm_struct *mm) {
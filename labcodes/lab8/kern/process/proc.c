@@ -16,6 +16,7 @@
 #include <vfs.h>
 #include <sysfile.h>
 #include <swap.h>
+#include <kswapd.h>
 
 /* ------------- process/thread mechanism design&implementation -------------
 (an simplified Linux process/thread mechanism )
@@ -73,6 +74,9 @@ list_entry_t proc_list;
 // has list for process set based on pid
 static list_entry_t hash_list[HASH_LIST_SIZE];
 
+// slab cache of proc_struct
+static struct kmem_cache *proc_cachep;
+
 // idle proc
 struct proc_struct *idleproc = NULL;
 // init proc
@@ -89,7 +93,7 @@ void switch_to(struct context *from, struct context *to);
 // alloc_proc - alloc a proc_struct and init all fields of proc_struct
 static struct proc_struct *
 alloc_proc(void) {
-    struct proc_struct *proc = kmalloc(sizeof(struct proc_struct));
+    struct proc_struct *proc = kmem_cache_alloc(proc_cachep);
     if (proc != NULL) {
         //LAB4:EXERCISE1 YOUR CODE
         /*
@@ -347,6 +351,16 @@ put_pgdir(struct mm_struct *mm) {
     free_page(kva2page(mm->pgdir));
 }
 
+// mm_put - drop a reference of mm, free its memory space and mm itself with the last one
+void
+mm_put(struct mm_struct *mm) {
+    if (mm_count_dec(mm) == 0) {
+        exit_mmap(mm);
+        put_pgdir(mm);
+        mm_destroy(mm);
+    }
+}
+
 // copy_mm - process "proc" duplicate OR share process "current"'s mm according clone_flags
 //         - if clone_flags & CLONE_VM, then "share" ; else "duplicate"
 static int
@@ -457,10 +471,31 @@ put_files(struct proc_struct *proc) {
     }
 }
 
+/**
+ * vfork 的子进程不再借用父进程的 mm（调用了 exec 或者退出），
+ * 唤醒在 do_fork 中等待的父进程。
+ */
+static void
+vfork_done(struct proc_struct *proc) {
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        if (proc->flags & PF_VFORK) {
+            proc->flags &= ~PF_VFORK;
+            if (proc->parent->wait_state == WT_VFORK) {
+                wakeup_proc(proc->parent);
+            }
+        }
+    }
+    local_intr_restore(intr_flag);
+}
+
 /**
  * 根据父进程状态拷贝出一个状态相同的子进程。
  * 
- * @param clone_flags 标记子进程资源是共享还是拷贝，若 clone_flags & CLONE_VM，则共享，否则拷贝
+ * @param clone_flags 标记子进程资源是共享还是拷贝，若 clone_flags & CLONE_VM，则共享，否则拷贝；
+ *                    若 clone_flags & CLONE_VFORK，父进程会睡眠直到子进程 exec 或退出，
+ *                    这期间子进程使用父进程的地址空间和用户栈
  * @param stack 父进程的用户栈指针，如果为 0，表示该进程是内核线程
  * @param tf 父进程的中断帧，将被拷贝给子进程，保证状态一致
  */
@@ -503,6 +538,9 @@ do_fork(uint32_t clone_flags, uintptr_t stack, struct trapframe *tf) {
     //    4. call copy_thread to setup tf & context in proc_struct
     // 初始化进程内核栈中的 trapframe 结构体，并保存进程的内核入口和内核栈
     copy_thread(proc, stack, tf);
+    if (clone_flags & CLONE_VFORK) {
+        proc->flags |= PF_VFORK;
+    }
     //    5. insert proc_struct into hash_list && proc_list
     bool intr_flag;
     local_intr_save(intr_flag); // 关闭中断确保安全
@@ -516,6 +554,13 @@ do_fork(uint32_t clone_flags, uintptr_t stack, struct trapframe *tf) {
     wakeup_proc(proc); // 令子进程的状态为运行中：PROC_RUNNABLE
     //    7. set ret vaule using child proc's pid
     ret = proc->pid; // 返回子进程的 pid
+
+    // 子进程借用着父进程的用户栈，父进程在它 exec 或退出之前不能返回用户态
+    while (proc->flags & PF_VFORK) {
+        current->state = PROC_SLEEPING;
+        current->wait_state = WT_VFORK;
+        schedule();
+    }
 	
 fork_out:
     return ret;
@@ -525,7 +570,7 @@ bad_fork_cleanup_fs:  //for LAB8
 bad_fork_cleanup_kstack:
     put_kstack(proc);
 bad_fork_cleanup_proc:
-    kfree(proc);
+    kmem_cache_free(proc_cachep, proc);
     goto fork_out;
 }
 
@@ -545,13 +590,10 @@ do_exit(int error_code) {
     struct mm_struct *mm = current->mm;
     if (mm != NULL) {
         lcr3(boot_cr3);
-        if (mm_count_dec(mm) == 0) {
-            exit_mmap(mm);
-            put_pgdir(mm);
-            mm_destroy(mm);
-        }
+        mm_put(mm);
         current->mm = NULL;
     }
+    vfork_done(current);
     put_files(current); //for LAB8
     current->state = PROC_ZOMBIE;
     current->exit_code = error_code;
@@ -689,7 +731,7 @@ load_icode(int fd, int argc, char **kargv) {
             start += size, offset += size;
         }
 
-        // (3.5) call pgdir_alloc_page to allocate pages for BSS, memset zero in these pages
+        // (3.5) memset zero the BSS part of the last TEXT/DATA page
         end = ph->p_va + ph->p_memsz;
         if (start < la) {
             // ph->p_memsz == ph->p_filesz
@@ -704,18 +746,8 @@ load_icode(int fd, int argc, char **kargv) {
             start += size;
             assert((end < la && start == end) || (end >= la && start == la));
         }
-        while (start < end) {
-            if ((page = pgdir_alloc_page(mm->pgdir, la, perm)) == NULL) {
-                ret = -E_NO_MEM;
-                goto bad_cleanup_mmap;
-            }
-            off = start - la, size = PGSIZE - off, la += PGSIZE;
-            if (end < la) {
-                size -= la - end;
-            }
-            memset(page2kva(page) + off, 0, size);
-            start += size;
-        }
+        // 剩余的 BSS 页面不在这里分配，由 do_pgfault 在第一次访问时按需分配并清零，
+        // 顺序访问时 fault-around 会一次映射多个页面
     }
     sysfile_close(fd);
 
@@ -853,13 +885,10 @@ do_execve(const char *name, int argc, const char **argv) {
     }
     if (mm != NULL) {
         lcr3(boot_cr3);
-        if (mm_count_dec(mm) == 0) {
-            exit_mmap(mm);
-            put_pgdir(mm);
-            mm_destroy(mm);
-        }
+        mm_put(mm);
         current->mm = NULL;
     }
+    vfork_done(current);
     ret= -E_NO_MEM;;
     if ((ret = load_icode(fd, argc, kargv)) != 0) {
         goto execve_exit;
@@ -940,7 +969,7 @@ found:
     }
     local_intr_restore(intr_flag);
     put_kstack(proc);
-    kfree(proc);
+    kmem_cache_free(proc_cachep, proc);
     return 0;
 }
 
@@ -1031,10 +1060,17 @@ init_main(void *arg) {
     fs_cleanup();
         
     cprintf("all user-mode processes have quit.\n");
+    print_page_cache();
     assert(initproc->cptr == NULL && initproc->yptr == NULL && initproc->optr == NULL);
-    assert(nr_process == 2);
-    assert(list_next(&proc_list) == &(initproc->list_link));
-    assert(list_prev(&proc_list) == &(initproc->list_link));
+    // 除了 idle 之外只剩下 init 和常驻的内核线程（kswapd、kreadahead），它们都是 idle 的子进程
+    int nr_resident = 0;
+    list_entry_t *le = &proc_list;
+    while ((le = list_next(le)) != &proc_list) {
+        struct proc_struct *proc = le2proc(le, list_link);
+        assert(proc->parent == idleproc);
+        nr_resident ++;
+    }
+    assert(nr_process == 1 + nr_resident);
 
     cprintf("init check memory pass.\n");
     return 0;
@@ -1051,6 +1087,11 @@ proc_init(void) {
         list_init(hash_list + i);
     }
 
+    if ((proc_cachep = kmem_cache_create("proc_struct", sizeof(struct proc_struct))) == NULL) {
+        panic("cannot create proc_struct cache.\n");
+    }
+    files_init();
+
     // 创建系统空闲进程，用于选择进程进行调度
     if ((idleproc = alloc_proc()) == NULL) {
         panic("cannot alloc idleproc.\n");
@@ -91,12 +91,19 @@ struct proc_struct {
 };
 
 #define PF_EXITING                  0x00000001      // getting shutdown
+#define PF_VFORK                    0x00000002      // borrowing parent's mm, parent waits until exec or exit
 
 #define WT_INTERRUPTED               0x80000000                    // the wait state could be interrupted
 #define WT_CHILD                    (0x00000001 | WT_INTERRUPTED)  // wait child process
 #define WT_KSEM                      0x00000100                    // wait kernel semaphore
 #define WT_TIMER                    (0x00000002 | WT_INTERRUPTED)  // wait timer
 #define WT_KBD                      (0x00000004 | WT_INTERRUPTED)  // wait the input of keyboard
+#define WT_VFORK                     0x00000008                    // wait vfork child to exec or exit
+#define WT_KSWAPD                    0x00000010                    // kswapd waits for free pages to drop below pages_low
+#define WT_READAHEAD                 0x00000020                    // kreadahead waits for readahead requests
+#define WT_JOURNAL                   0x00000040                    // wait for the sfs journal to commit or for its operations
+#define WT_BIO                       0x00000080                    // wait for a block I/O request to complete
+#define WT_PIPE                     (0x00000200 | WT_INTERRUPTED)  // wait for the other end of a pipe
 
 #define le2proc(le, member)         \
     to_struct((le), struct proc_struct, member)
@@ -118,6 +125,7 @@ int do_yield(void);
 int do_execve(const char *name, int argc, const char **argv);
 int do_wait(int pid, int *code_store);
 int do_kill(int pid);
+void mm_put(struct mm_struct *mm);
 //FOR LAB6, set the process's priority (bigger value will get more CPU time) 
 void lab6_set_priority(uint32_t priority);
 int do_sleep(unsigned int time);
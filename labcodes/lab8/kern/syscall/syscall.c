@@ -10,6 +10,11 @@
 #include <stat.h>
 #include <dirent.h>
 #include <sysfile.h>
+#include <vmm.h>
+#include <kswapd.h>
+#include <ide.h>
+#include <fs.h>
+#include <error.h>
 
 static int
 sys_exit(uint32_t arg[]) {
@@ -24,6 +29,13 @@ sys_fork(uint32_t arg[]) {
     return do_fork(0, stack, tf);
 }
 
+static int
+sys_vfork(uint32_t arg[]) {
+    struct trapframe *tf = current->tf;
+    uintptr_t stack = tf->tf_esp;
+    return do_fork(CLONE_VM | CLONE_VFORK, stack, tf);
+}
+
 static int
 sys_wait(uint32_t arg[]) {
     int pid = (int)arg[0];
@@ -72,6 +84,58 @@ static int
 sys_gettime(uint32_t arg[]) {
     return (int)ticks;
 }
+
+static int
+sys_vmstat(uint32_t arg[]) {
+    struct vmstat *store = (struct vmstat *)arg[0];
+    struct mm_struct *mm = current->mm;
+    int ret = 0;
+    vmstat.nr_free_pages = nr_free_pages();
+    lock_mm(mm);
+    if (!copy_to_user(mm, store, &vmstat, sizeof(struct vmstat))) {
+        ret = -E_INVAL;
+    }
+    unlock_mm(mm);
+    return ret;
+}
+
+static int
+sys_fault_around(uint32_t arg[]) {
+    int pages = (int)arg[0], old = fault_around_max;
+    if (pages > 0) {
+        fault_around_max = pages;
+    }
+    return old;
+}
+
+static int
+sys_kswapd(uint32_t arg[]) {
+    int enable = (int)arg[0];
+    if (enable < 0) {
+        return pages_high != 0;
+    }
+    return kswapd_enable(enable != 0);
+}
+
+static int
+sys_idedma(uint32_t arg[]) {
+    int enable = (int)arg[0];
+    return ide_dma_enable(enable);
+}
+
+static int
+sys_iostat(uint32_t arg[]) {
+    struct iostat *store = (struct iostat *)arg[0];
+    struct mm_struct *mm = current->mm;
+    int ret = 0;
+    lock_mm(mm);
+    if (!copy_to_user(mm, store, &iostat, sizeof(struct iostat))) {
+        ret = -E_INVAL;
+    }
+    unlock_mm(mm);
+    return ret;
+}
+
 static int
 sys_lab6_set_priority(uint32_t arg[])
 {
@@ -136,6 +200,12 @@ sys_fsync(uint32_t arg[]) {
     return sysfile_fsync(fd);
 }
 
+static int
+sys_chdir(uint32_t arg[]) {
+    const char *path = (const char *)arg[0];
+    return sysfile_chdir(path);
+}
+
 static int
 sys_getcwd(uint32_t arg[]) {
     char *buf = (char *)arg[0];
@@ -157,9 +227,23 @@ sys_dup(uint32_t arg[]) {
     return sysfile_dup(fd1, fd2);
 }
 
+static int
+sys_pipe(uint32_t arg[]) {
+    int *fd_store = (int *)arg[0];
+    return sysfile_pipe(fd_store);
+}
+
+static int
+sys_mkfifo(uint32_t arg[]) {
+    const char *name = (const char *)arg[0];
+    uint32_t open_flags = (uint32_t)arg[1];
+    return sysfile_mkfifo(name, open_flags);
+}
+
 static int (*syscalls[])(uint32_t arg[]) = {
     [SYS_exit]              sys_exit,
     [SYS_fork]              sys_fork,
+    [SYS_vfork]             sys_vfork,
     [SYS_wait]              sys_wait,
     [SYS_exec]              sys_exec,
     [SYS_yield]             sys_yield,
@@ -168,6 +252,11 @@ static int (*syscalls[])(uint32_t arg[]) = {
     [SYS_putc]              sys_putc,
     [SYS_pgdir]             sys_pgdir,
     [SYS_gettime]           sys_gettime,
+    [SYS_vmstat]            sys_vmstat,
+    [SYS_fault_around]      sys_fault_around,
+    [SYS_kswapd]            sys_kswapd,
+    [SYS_iostat]            sys_iostat,
+    [SYS_idedma]            sys_idedma,
     [SYS_lab6_set_priority] sys_lab6_set_priority,
     [SYS_sleep]             sys_sleep,
     [SYS_open]              sys_open,
@@ -177,9 +266,12 @@ static int (*syscalls[])(uint32_t arg[]) = {
     [SYS_seek]              sys_seek,
     [SYS_fstat]             sys_fstat,
     [SYS_fsync]             sys_fsync,
+    [SYS_chdir]             sys_chdir,
     [SYS_getcwd]            sys_getcwd,
     [SYS_getdirentry]       sys_getdirentry,
     [SYS_dup]               sys_dup,
+    [SYS_pipe]              sys_pipe,
+    [SYS_mkfifo]            sys_mkfifo,
 };
 
 #define NUM_SYSCALLS        ((sizeof(syscalls)) / (sizeof(syscalls[0])))
@@ -18,6 +18,7 @@
 #include <sync.h>
 #include <proc.h>
 #include <string.h>
+#include <ide.h>
 
 #define TICK_NUM 100
 
@@ -244,6 +245,10 @@ trap_dispatch(struct trapframe *tf) {
                 proc->page_fault = 0;
             }
         }
+        // 通知页面置换算法（如 aging）采样当前进程的访问位，只在中断了用户态时进行，此时内核不会正在修改置换链表
+        if (swap_init_ok && current != NULL && current->mm != NULL && !trap_in_kernel(tf)) {
+            swap_tick_event(current->mm);
+        }
         run_timer_list();
         break;
     case IRQ_OFFSET + IRQ_COM1:
@@ -288,7 +293,7 @@ trap_dispatch(struct trapframe *tf) {
         break;
     case IRQ_OFFSET + IRQ_IDE1:
     case IRQ_OFFSET + IRQ_IDE2:
-        /* do nothing */
+        ide_intr(tf->tf_trapno - IRQ_OFFSET);
         break;
     default:
         print_trapframe(tf);
@@ -26,8 +26,10 @@
 #define E_MAX_OPEN          22  // Too Many Files are Open
 #define E_EXISTS            23  // File/Directory Already Exists
 #define E_NOTEMPTY          24  // Directory is Not Empty
+#define E_LOOP              25  // Too Many Levels of Symbolic Links
+#define E_PIPE              26  // Broken Pipe
 /* the maximum allowed */
-#define MAXERROR            24
+#define MAXERROR            26
 
 #endif /* !__LIBS_ERROR_H__ */
 
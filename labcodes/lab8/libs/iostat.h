@@ -0,0 +1,39 @@
+#ifndef __LIBS_IOSTAT_H__
+#define __LIBS_IOSTAT_H__
+
+#include <defs.h>
+
+/**
+ * 文件系统与块设备 IO 的事件计数器，内核中只有一份全局实例，
+ * 用户程序通过 SYS_iostat 取得一份拷贝，前后两次相减即可得到某段负载的开销。
+ */
+struct iostat {
+    uint32_t bcache_hit;                // block reads served from the buffer cache
+    uint32_t bcache_miss;               // block reads which had to go to the device
+    uint32_t bcache_writeback;          // dirty buffers written back to the device
+    uint32_t disk_read;                 // blocks read from disk0
+    uint32_t disk_write;                // blocks written to disk0
+    uint32_t filemap_hit;               // file blocks read from the page cache
+    uint32_t filemap_miss;              // file blocks the reader had to wait for the disk
+    uint32_t readahead;                 // file blocks read ahead into the page cache in the background
+    uint32_t dcache_hit;                // name lookups answered by a positive dentry
+    uint32_t dcache_negative;           // name lookups answered by a negative dentry
+    uint32_t dcache_miss;               // name lookups passed to the file system
+    uint32_t sfs_alloc;                 // blocks allocated by sfs
+    uint32_t sfs_alloc_goal;            // blocks allocated right after the previous block of the file
+    uint32_t journal_commit;            // transactions committed to the sfs journal
+    uint32_t journal_write;             // blocks written to the sfs journal, descriptors included
+    uint32_t freemap_load;              // sfs freemap blocks read into memory on demand
+    uint32_t ide_intr;                  // IDE interrupts handled, one per sector transferred
+    uint32_t bio_queued;                // block I/O requests which found the device busy and were queued by the I/O scheduler
+    uint32_t bio_merged;                // block I/O requests merged into a queued request of adjacent sectors
+    uint32_t ide_pio_sectors;           // sectors moved by the CPU with insl/outsl
+    uint32_t ide_pio_kcycles;           // thousands of CPU cycles the driver spent on PIO requests
+    uint32_t ide_dma_sectors;           // sectors moved by bus master DMA
+    uint32_t ide_dma_kcycles;           // thousands of CPU cycles the driver spent on DMA requests
+    uint32_t iobuf_copied;              // bytes the CPU copied between an iobuf and a cache or a device, wraps around
+    uint32_t pipe_wakeup;               // times a reader or a writer sleeping on a pipe was woken up
+};
+
+#endif /* !__LIBS_IOSTAT_H__ */
+
@@ -16,12 +16,14 @@ struct stat {
 #define S_IFLNK         030000          // symbolic link
 #define S_IFCHR         040000          // character device
 #define S_IFBLK         050000          // block device
+#define S_IFIFO         060000          // pipe or FIFO
 
 #define S_ISREG(mode)                   (((mode) & S_IFMT) == S_IFREG)      // regular file
 #define S_ISDIR(mode)                   (((mode) & S_IFMT) == S_IFDIR)      // directory
 #define S_ISLNK(mode)                   (((mode) & S_IFMT) == S_IFLNK)      // symlink
 #define S_ISCHR(mode)                   (((mode) & S_IFMT) == S_IFCHR)      // char device
 #define S_ISBLK(mode)                   (((mode) & S_IFMT) == S_IFBLK)      // block device
+#define S_ISFIFO(mode)                  (((mode) & S_IFMT) == S_IFIFO)      // pipe or FIFO
 
 #endif /* !__LIBS_STAT_H__ */
 
@@ -9,6 +9,7 @@
 #define SYS_wait            3
 #define SYS_exec            4
 #define SYS_clone           5
+#define SYS_vfork           6
 #define SYS_yield           10
 #define SYS_sleep           11
 #define SYS_kill            12
@@ -19,6 +20,11 @@
 #define SYS_shmem           22
 #define SYS_putc            30
 #define SYS_pgdir           31
+#define SYS_vmstat          32
+#define SYS_fault_around    33
+#define SYS_kswapd          34
+#define SYS_iostat          35
+#define SYS_idedma          36
 #define SYS_open            100
 #define SYS_close           101
 #define SYS_read            102
@@ -26,9 +32,12 @@
 #define SYS_seek            104
 #define SYS_fstat           110
 #define SYS_fsync           111
+#define SYS_chdir           120
 #define SYS_getcwd          121
 #define SYS_getdirentry     128
 #define SYS_dup             130
+#define SYS_pipe            140
+#define SYS_mkfifo          141
 /* OLNY FOR LAB6 */
 #define SYS_lab6_set_priority 255
 
@@ -36,6 +45,7 @@
 #define CLONE_VM            0x00000100  // set if VM shared between processes
 #define CLONE_THREAD        0x00000200  // thread group
 #define CLONE_FS            0x00000800  // set if shared between processes
+#define CLONE_VFORK         0x00004000  // set if the parent waits until the child execs or exits
 
 /* VFS flags */
 // flags for open: choose one of these
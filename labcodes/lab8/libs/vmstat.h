@@ -0,0 +1,29 @@
+#ifndef __LIBS_VMSTAT_H__
+#define __LIBS_VMSTAT_H__
+
+#include <defs.h>
+
+/**
+ * 虚拟内存子系统的事件计数器，内核中只有一份全局实例，
+ * 用户程序通过 SYS_vmstat 取得一份拷贝，前后两次相减即可得到某段负载的开销。
+ */
+struct vmstat {
+    uint32_t pgfault;                   // number of page faults handled by do_pgfault
+    uint32_t fault_around;              // pages mapped ahead by fault-around, saving one fault each
+    uint32_t fork_shared;               // pages shared read-only by copy_range on fork
+    uint32_t fork_copied;               // pages copied eagerly by copy_range on fork
+    uint32_t cow_fault;                 // write faults on present copy-on-write pages
+    uint32_t cow_copied;                // cow faults which had to copy the page
+    uint32_t cow_reused;                // cow faults which reused the last reference
+    uint32_t swap_in;                   // pages read from swap
+    uint32_t swap_out;                  // pages written to swap
+    uint32_t swap_clean;                // clean pages evicted without writeback, swap copy still valid
+    uint32_t swap_cache_hit;            // swap-ins served from the swap cache without reading the disk
+    uint32_t kswapd_wakeup;             // times kswapd was woken below the low watermark
+    uint32_t kswapd_reclaim;            // pages freed by kswapd
+    uint32_t direct_reclaim;            // pages freed by allocating processes themselves
+    uint32_t nr_free_pages;             // free pages when the snapshot was taken, not a counter
+};
+
+#endif /* !__LIBS_VMSTAT_H__ */
+
@@ -22,9 +22,11 @@
 
 static inline uint8_t inb(uint16_t port) __attribute__((always_inline));
 static inline uint16_t inw(uint16_t port) __attribute__((always_inline));
+static inline uint32_t inl(uint16_t port) __attribute__((always_inline));
 static inline void insl(uint32_t port, void *addr, int cnt) __attribute__((always_inline));
 static inline void outb(uint16_t port, uint8_t data) __attribute__((always_inline));
 static inline void outw(uint16_t port, uint16_t data) __attribute__((always_inline));
+static inline void outl(uint16_t port, uint32_t data) __attribute__((always_inline));
 static inline void outsl(uint32_t port, const void *addr, int cnt) __attribute__((always_inline));
 static inline uint32_t read_ebp(void) __attribute__((always_inline));
 static inline void breakpoint(void) __attribute__((always_inline));
@@ -50,6 +52,8 @@ static inline uintptr_t rcr1(void) __attribute__((always_inline));
 static inline uintptr_t rcr2(void) __attribute__((always_inline));
 static inline uintptr_t rcr3(void) __attribute__((always_inline));
 static inline void invlpg(void *addr) __attribute__((always_inline));
+static inline uint64_t rdtsc(void) __attribute__((always_inline));
+static inline uint32_t bsf(uint32_t word) __attribute__((always_inline));
 
 static inline uint8_t
 inb(uint16_t port) {
@@ -65,6 +69,13 @@ inw(uint16_t port) {
     return data;
 }
 
+static inline uint32_t
+inl(uint16_t port) {
+    uint32_t data;
+    asm volatile ("inl %1, %0" : "=a" (data) : "d" (port));
+    return data;
+}
+
 static inline void
 insl(uint32_t port, void *addr, int cnt) {
     asm volatile (
@@ -85,6 +96,11 @@ outw(uint16_t port, uint16_t data) {
     asm volatile ("outw %0, %1" :: "a" (data), "d" (port) : "memory");
 }
 
+static inline void
+outl(uint16_t port, uint32_t data) {
+    asm volatile ("outl %0, %1" :: "a" (data), "d" (port) : "memory");
+}
+
 static inline void
 outsl(uint32_t port, const void *addr, int cnt) {
     asm volatile (
@@ -208,6 +224,22 @@ invlpg(void *addr) {
     asm volatile ("invlpg (%0)" :: "r" (addr) : "memory");
 }
 
+/* rdtsc - read the time-stamp counter, used to measure cycles in kernel benchmarks */
+static inline uint64_t
+rdtsc(void) {
+    uint64_t tsc;
+    asm volatile ("rdtsc" : "=A" (tsc));
+    return tsc;
+}
+
+/* bsf - return the index of the lowest set bit of word, word must not be 0 */
+static inline uint32_t
+bsf(uint32_t word) {
+    uint32_t index;
+    asm ("bsf %1, %0" : "=r" (index) : "rm" (word));
+    return index;
+}
+
 static inline int __strcmp(const char *s1, const char *s2) __attribute__((always_inline));
 static inline char *__strcpy(char *dst, const char *src) __attribute__((always_inline));
 static inline void *__memset(void *s, char c, size_t n) __attribute__((always_inline));
@@ -129,10 +129,10 @@ safe_fchdir(int fd) {
 #define SFS_MAGIC                               0x2f8dbe2a
 #define SFS_NDIRECT                             12
 #define SFS_BLKSIZE                             4096                                    // 4K
-#define SFS_MAX_NBLKS                           (1024UL * 512)                          // 4K * 512K
+#define SFS_MAX_NBLKS                           (1024UL * 1024 * 32)                    // 4K * 32M, the limit of 28-bit LBA
 #define SFS_MAX_INFO_LEN                        31
 #define SFS_MAX_FNAME_LEN                       255
-#define SFS_MAX_FILE_SIZE                       (1024UL * 1024 * 128)                   // 128M
+#define SFS_MAX_FILE_SIZE                       (1024UL * 1024 * 1024)                  // 1G
 
 #define SFS_BLKBITS                             (SFS_BLKSIZE * CHAR_BIT)
 #define SFS_TYPE_FILE                           1
@@ -143,12 +143,25 @@ safe_fchdir(int fd) {
 #define SFS_BLKN_ROOT                           1
 #define SFS_BLKN_FREEMAP                        2
 
+#define SFS_VERSION_1                           1                                       // one entry per dir block
+#define SFS_VERSION_2                           2                                       // packed dir entries with a hash index
+#define SFS_VERSION_3                           3                                       // the first blocks of files in extents
+#define SFS_NEXTENT                             16
+#define SFS_JOURNAL_NBLKS                       (2 * (1 + 128))                         // two log slots
+#define SFS_DIR_NBUCKET                         (SFS_BLKSIZE / sizeof(uint32_t))
+
 struct cache_block {
     uint32_t ino;
     struct cache_block *hash_next;
     void *cache;
 };
 
+struct cache_entry {
+    uint32_t ino;
+    char *name;
+    struct cache_entry *next;
+};
+
 struct cache_inode {
     struct inode {
         uint32_t size;
@@ -158,11 +171,16 @@ struct cache_inode {
         uint32_t direct[SFS_NDIRECT];
         uint32_t indirect;
         uint32_t db_indirect;
+        uint32_t nextents;
+        struct {
+            uint32_t start, len;
+        } extents[SFS_NEXTENT];
     } inode;
     ino_t real;
     uint32_t ino;
-    uint32_t nblks;
+    uint32_t nblks, ext_nblks;
     struct cache_block *l1, *l2;
+    struct cache_entry *entries, **entries_end;
     struct cache_inode *hash_next;
 };
 
@@ -172,6 +190,9 @@ struct sfs_fs {
         uint32_t blocks;
         uint32_t unused_blocks;
         char info[SFS_MAX_INFO_LEN + 1];
+        uint32_t version;
+        uint32_t journal;
+        uint32_t nfreecounts;
     } super;
     struct subpath {
         struct subpath *next, *prev;
@@ -189,6 +210,29 @@ struct sfs_entry {
     char name[SFS_MAX_FNAME_LEN + 1];
 };
 
+struct sfs_packed_entry {
+    uint32_t ino;
+    uint32_t next;
+    uint32_t hash;
+    uint16_t rec_len;
+    uint8_t name_len;
+    uint8_t unused;
+    char name[0];
+};
+
+#define sfs_packed_entry_size(name_len)                                                 \
+    ((sizeof(struct sfs_packed_entry) + (name_len) + 3) & ~3)
+
+// FNV-1a, must be the same as sfs_name_hash in kern/fs/sfs/sfs.h
+static uint32_t
+sfs_name_hash(const char *name, size_t len) {
+    uint32_t hash = 2166136261U;
+    while (len -- > 0) {
+        hash = (hash ^ (uint8_t)*name ++) * 16777619U;
+    }
+    return hash;
+}
+
 static uint32_t
 sfs_alloc_ino(struct sfs_fs *sfs) {
     if (sfs->next_ino < sfs->ninos) {
@@ -221,7 +265,8 @@ static struct cache_inode *
 alloc_cache_inode(struct sfs_fs *sfs, ino_t real, uint32_t ino, uint16_t type) {
     struct cache_inode *ci = safe_malloc(sizeof(struct cache_inode));
     ci->ino = (ino != 0) ? ino : sfs_alloc_ino(sfs);
-    ci->real = real, ci->nblks = 0, ci->l1 = ci->l2 = NULL;
+    ci->real = real, ci->nblks = ci->ext_nblks = 0, ci->l1 = ci->l2 = NULL;
+    ci->entries = NULL, ci->entries_end = &(ci->entries);
     struct inode *inode = &(ci->inode);
     memset(inode, 0, sizeof(struct inode));
     inode->type = type;
@@ -240,7 +285,7 @@ search_cache_inode(struct sfs_fs *sfs, ino_t real) {
 }
 
 struct sfs_fs *
-create_sfs(int imgfd) {
+create_sfs(int imgfd, uint32_t version, bool journal) {
     uint32_t ninos, next_ino;
     struct stat *stat = safe_fstat(imgfd);
     if ((ninos = stat->st_size / SFS_BLKSIZE) > SFS_MAX_NBLKS) {
@@ -252,11 +297,21 @@ create_sfs(int imgfd) {
         bug("img file is too small (%llu bytes, %u blocks, bitmap use at least %u blocks).\n",
                 (unsigned long long)stat->st_size, ninos, next_ino - 2);
     }
+    // the journal follows the freemap
+    uint32_t journal_start = 0;
+    if (journal) {
+        journal_start = next_ino, next_ino += SFS_JOURNAL_NBLKS;
+        if (next_ino >= ninos) {
+            bug("img file is too small for a journal (%u blocks).\n", ninos);
+        }
+    }
 
     struct sfs_fs *sfs = safe_malloc(sizeof(struct sfs_fs));
     sfs->super.magic = SFS_MAGIC;
     sfs->super.blocks = ninos, sfs->super.unused_blocks = ninos - next_ino;
     snprintf(sfs->super.info, SFS_MAX_INFO_LEN, "simple file system");
+    sfs->super.version = version;
+    sfs->super.journal = journal_start;
 
     sfs->ninos = ninos, sfs->next_ino = next_ino, sfs->imgfd = imgfd;
     sfs->sp_root = sfs->sp_end = &(sfs->__sp_nil);
@@ -331,9 +386,18 @@ flush_cache_inode(struct sfs_fs *sfs, struct cache_inode *ci) {
 void
 close_sfs(struct sfs_fs *sfs) {
     static char buffer[SFS_BLKSIZE];
+    static char super[SFS_BLKSIZE];
     uint32_t i, j, ino = SFS_BLKN_FREEMAP;
     uint32_t ninos = sfs->ninos, next_ino = sfs->next_ino;
+    // the free count of every freemap block follows the superblock, if there is room for all of them
+    uint16_t *counts = (uint16_t *)(super + sizeof(sfs->super));
+    uint32_t ncounts = (ninos + SFS_BLKBITS - 1) / SFS_BLKBITS;
+    if (ncounts > (SFS_BLKSIZE - sizeof(sfs->super)) / sizeof(uint16_t)) {
+        ncounts = 0;
+    }
+    sfs->super.nfreecounts = ncounts;
     for (i = 0; i < ninos; ino ++, i += SFS_BLKBITS) {
+        uint32_t nfree = 0;
         memset(buffer, 0, sizeof(buffer));
         if (i + SFS_BLKBITS > next_ino) {
             uint32_t start = 0, end = SFS_BLKBITS;
@@ -348,10 +412,21 @@ close_sfs(struct sfs_fs *sfs) {
             for (j = start; j < end; j ++) {
                 data[j / bits] |= (1 << (j % bits));
             }
+            nfree = end - start;
+        }
+        if (ncounts != 0) {
+            counts[i / SFS_BLKBITS] = nfree;
         }
         write_block(sfs, buffer, sizeof(buffer), ino);
     }
-    write_block(sfs, &(sfs->super), sizeof(sfs->super), SFS_BLKN_SUPER);
+    memcpy(super, &(sfs->super), sizeof(sfs->super));
+    write_block(sfs, super, sizeof(super), SFS_BLKN_SUPER);
+    // an empty log: both descriptor blocks are zero
+    if (sfs->super.journal != 0) {
+        memset(buffer, 0, sizeof(buffer));
+        write_block(sfs, buffer, sizeof(buffer), sfs->super.journal);
+        write_block(sfs, buffer, sizeof(buffer), sfs->super.journal + SFS_JOURNAL_NBLKS / 2);
+    }
 
     for (i = 0; i < HASH_LIST_SIZE; i ++) {
         struct cache_block *cb = sfs->blocks[i];
@@ -368,7 +443,7 @@ close_sfs(struct sfs_fs *sfs) {
 }
 
 struct sfs_fs *
-open_img(const char *imgname) {
+open_img(const char *imgname, uint32_t version, bool journal) {
     const char *expect = ".img", *ext = imgname + strlen(imgname) - strlen(expect);
     if (ext <= imgname || strcmp(ext, expect) != 0) {
         bug("invalid .img file name '%s'.\n", imgname);
@@ -377,7 +452,7 @@ open_img(const char *imgname) {
     if ((imgfd = open(imgname, O_WRONLY)) < 0) {
         bug("open '%s' failed.\n", imgname);
     }
-    return create_sfs(imgfd);
+    return create_sfs(imgfd, version, journal);
 }
 
 #define open_bug(sfs, name, ...)                                                        \
@@ -413,16 +488,36 @@ update_cache(struct sfs_fs *sfs, struct cache_block **cbp, uint32_t *inop) {
     *cbp = cb, *inop = ino;
 }
 
+// append_extent - map block ino after the blocks in the extents of inode, return 0 if all extents are used
+static bool
+append_extent(struct inode *inode, uint32_t ino) {
+    uint32_t n = inode->nextents;
+    if (n != 0 && inode->extents[n - 1].start + inode->extents[n - 1].len == ino) {
+        inode->extents[n - 1].len ++;
+        return 1;
+    }
+    if (n < SFS_NEXTENT) {
+        inode->extents[n].start = ino, inode->extents[n].len = 1;
+        inode->nextents ++;
+        return 1;
+    }
+    return 0;
+}
+
 static void
 append_block(struct sfs_fs *sfs, struct cache_inode *file, size_t size, uint32_t ino, const char *filename) {
     static_assert(SFS_LN_NBLKS <= SFS_L2_NBLKS, "SFS_LN_NBLKS <= SFS_L2_NBLKS");
     assert(size <= SFS_BLKSIZE);
-    uint32_t nblks = file->nblks;
+    uint32_t nblks = file->nblks - file->ext_nblks;
     struct inode *inode = &(file->inode);
-    if (nblks >= SFS_LN_NBLKS) {
+    if (file->nblks >= SFS_LN_NBLKS) {
         open_bug(sfs, filename, "file is too big.\n");
     }
-    if (nblks < SFS_L0_NBLKS) {
+    // revision 3: the first blocks go into the extents until they are used up, the others into the block pointer tree
+    if (sfs->super.version >= SFS_VERSION_3 && nblks == 0 && append_extent(inode, ino)) {
+        file->ext_nblks ++;
+    }
+    else if (nblks < SFS_L0_NBLKS) {
         inode->direct[nblks] = ino;
     }
     else if (nblks < SFS_L1_NBLKS) {
@@ -448,6 +543,14 @@ static void
 add_entry(struct sfs_fs *sfs, struct cache_inode *current, struct cache_inode *file, const char *name) {
     static struct sfs_entry __entry, *entry = &__entry;
     assert(current->inode.type == SFS_TYPE_DIR && strlen(name) <= SFS_MAX_FNAME_LEN);
+    if (sfs->super.version >= SFS_VERSION_2) {
+        // packed dirs are written out by flush_packed_dir once all entries are known
+        struct cache_entry *ce = safe_malloc(sizeof(struct cache_entry));
+        ce->ino = file->ino, ce->name = safe_strdup(name), ce->next = NULL;
+        *(current->entries_end) = ce, current->entries_end = &(ce->next);
+        file->inode.nlinks ++;
+        return;
+    }
     entry->ino = file->ino, strcpy(entry->name, name);
     uint32_t entry_ino = sfs_alloc_ino(sfs);
     write_block(sfs, entry, sizeof(entry->name), entry_ino);
@@ -455,6 +558,52 @@ add_entry(struct sfs_fs *sfs, struct cache_inode *current, struct cache_inode *f
     file->inode.nlinks ++;
 }
 
+/*
+ * flush_packed_dir - write the entries of dir in the packed format: block 0 is the hash index,
+ * the entries follow packed in the next blocks, the last entry of each block is padded to the end of the block.
+ */
+static void
+flush_packed_dir(struct sfs_fs *sfs, struct cache_inode *dir) {
+    static uint32_t index[SFS_DIR_NBUCKET];
+    static char buffer[SFS_BLKSIZE];
+    struct sfs_packed_entry *last = NULL;
+    uint32_t index_ino = sfs_alloc_ino(sfs), blk = 0, blk_ino = 0, offset = SFS_BLKSIZE;
+    memset(index, 0, sizeof(index));
+    append_block(sfs, dir, SFS_BLKSIZE, index_ino, ".");
+
+    struct cache_entry *ce = dir->entries;
+    while (ce != NULL) {
+        size_t len = strlen(ce->name), rec_len = sfs_packed_entry_size(len);
+        if (offset + rec_len > SFS_BLKSIZE) {
+            if (last != NULL) {
+                last->rec_len += SFS_BLKSIZE - offset;
+                write_block(sfs, buffer, SFS_BLKSIZE, blk_ino);
+            }
+            blk ++, blk_ino = sfs_alloc_ino(sfs), offset = 0;
+            memset(buffer, 0, sizeof(buffer));
+            append_block(sfs, dir, SFS_BLKSIZE, blk_ino, ce->name);
+        }
+        struct sfs_packed_entry *pe = (struct sfs_packed_entry *)(buffer + offset);
+        uint32_t bucket;
+        pe->ino = ce->ino, pe->hash = sfs_name_hash(ce->name, len);
+        pe->rec_len = rec_len, pe->name_len = len;
+        memcpy(pe->name, ce->name, len);
+        bucket = pe->hash % SFS_DIR_NBUCKET;
+        pe->next = index[bucket], index[bucket] = blk * SFS_BLKSIZE + offset;
+        last = pe, offset += rec_len;
+
+        struct cache_entry *next = ce->next;
+        free(ce->name), free(ce);
+        ce = next;
+    }
+    if (last != NULL) {
+        last->rec_len += SFS_BLKSIZE - offset;
+        write_block(sfs, buffer, SFS_BLKSIZE, blk_ino);
+    }
+    write_block(sfs, index, sizeof(index), index_ino);
+    dir->entries = NULL, dir->entries_end = &(dir->entries);
+}
+
 static void
 add_dir(struct sfs_fs *sfs, struct cache_inode *parent, const char *dirname, int curfd, int fd, ino_t real) {
     assert(search_cache_inode(sfs, real) == NULL);
@@ -530,6 +679,9 @@ open_dir(struct sfs_fs *sfs, struct cache_inode *current, struct cache_inode *pa
         }
     }
     closedir(dir);
+    if (sfs->super.version >= SFS_VERSION_2) {
+        flush_packed_dir(sfs, current);
+    }
 }
 
 void
@@ -598,14 +750,20 @@ static_check(void) {
 int
 main(int argc, char **argv) {
     static_check();
-    if (argc != 3) {
-        bug("usage: <input *.img> <input dirname>\n");
+    if (argc < 3 || argc > 5) {
+        bug("usage: <input *.img> <input dirname> [format revision, %d, %d or %d (default)] [journal, 0 or 1 (default)]\n",
+                SFS_VERSION_1, SFS_VERSION_2, SFS_VERSION_3);
     }
     const char *imgname = argv[1], *home = argv[2];
-    if (create_img(open_img(imgname), home) != 0) {
+    uint32_t version = (argc >= 4) ? atoi(argv[3]) : SFS_VERSION_3;
+    if (version < SFS_VERSION_1 || version > SFS_VERSION_3) {
+        bug("unknown format revision %s.\n", argv[3]);
+    }
+    bool journal = (argc == 5) ? atoi(argv[4]) : 1;
+    if (create_img(open_img(imgname, version, journal), home) != 0) {
         bug("create img failed.\n");
     }
-    printf("create %s (%s) successfully.\n", imgname, home);
+    printf("create %s (%s, revision %u%s) successfully.\n", imgname, home, version, journal ? ", journaled" : "");
     return 0;
 }
 
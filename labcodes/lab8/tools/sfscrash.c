@@ -0,0 +1,710 @@
+/* sfscrash - crash-injection test of the replay of the sfs metadata journal.
+
+usage: sfscrash [-n ntx] [-s seed] [-v]
+
+A small revision 1 image with a journal is built in memory, and a model of the kernel (the block cache,
+sfs_journal.c and the block allocation of sfs_inode.c) runs ntx transactions of random operations on its
+files: appending blocks, truncating files and overwriting blocks in place, while the block cache writes
+dirty data blocks back at random as if they were evicted.
+Every block written to the disk is recorded. The disk is crashed after every prefix of the writes, the
+journal is replayed as sfs_journal_replay does (crashing once more at a random point of the replay, then
+replaying again from the start), and the image is checked:
+  - the freemap agrees with unused_blocks, and marks exactly the blocks reachable from the root;
+  - every file has the blocks it had when the last transaction finished before the crash was committed,
+    and its data blocks hold what was written to them in that transaction or later.
+-v prints every transaction committed.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <unistd.h>
+
+#define SFS_MAGIC                               0x2f8dbe2a
+#define SFS_NDIRECT                             12
+#define SFS_BLKSIZE                             4096
+#define SFS_MAX_INFO_LEN                        31
+#define SFS_MAX_FNAME_LEN                       255
+#define SFS_BLK_NENTRY                          (SFS_BLKSIZE / sizeof(uint32_t))
+#define SFS_NEXTENT                             16
+
+#define SFS_TYPE_FILE                           1
+#define SFS_TYPE_DIR                            2
+
+#define SFS_BLKN_SUPER                          0
+#define SFS_BLKN_ROOT                           1
+#define SFS_BLKN_FREEMAP                        2
+#define SFS_VERSION_1                           1
+
+#define SFS_JOURNAL_MAGIC                       0x6a726e6c
+#define SFS_JOURNAL_TXMAX                       128
+#define SFS_JOURNAL_SLOT                        (1 + SFS_JOURNAL_TXMAX)
+#define SFS_JOURNAL_NBLKS                       (2 * SFS_JOURNAL_SLOT)
+#define SFS_JOURNAL_CSUM_INIT                   2166136261U
+
+// the image: super, root, freemap, journal, one block per dir entry, one inode per file, then free blocks
+#define NBLKS                                   512
+#define NFILES                                  4
+#define JOURNAL_START                           3
+#define DIR_START                               (JOURNAL_START + SFS_JOURNAL_NBLKS)
+#define INODE_START                             (DIR_START + NFILES)
+#define FILE_MAXBLKS                            (SFS_NDIRECT + 36)
+
+#define DATA_MAGIC                              0xda7ada7a
+#define NOPS_MAX                                8
+
+struct sfs_super {
+    uint32_t magic;
+    uint32_t blocks;
+    uint32_t unused_blocks;
+    char info[SFS_MAX_INFO_LEN + 1];
+    uint32_t version;
+    uint32_t journal;
+};
+
+struct sfs_disk_inode {
+    uint32_t size;
+    uint16_t type;
+    uint16_t nlinks;
+    uint32_t blocks;
+    uint32_t direct[SFS_NDIRECT];
+    uint32_t indirect;
+    uint32_t db_indirect;
+    uint32_t nextents;
+    struct {
+        uint32_t start, len;
+    } extents[SFS_NEXTENT];
+};
+
+struct sfs_disk_entry {
+    uint32_t ino;
+    char name[SFS_MAX_FNAME_LEN + 1];
+};
+
+struct sfs_journal_desc {
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t nblks;
+    uint32_t checksum;
+    uint32_t blkno[SFS_JOURNAL_TXMAX];
+};
+
+typedef uint8_t block_t[SFS_BLKSIZE];
+
+/* what the files hold: the incarnation (one per block appended) and the generation of every data block */
+struct state {
+    uint32_t nblks[NFILES];
+    uint32_t inc[NFILES][FILE_MAXBLKS];
+    uint32_t gen[NFILES][FILE_MAXBLKS];
+};
+
+/* a block written to the disk */
+struct write {
+    uint32_t blkno;
+    block_t *data;
+};
+
+/* a transaction committed: its log is written by writes start ~ end - 1 */
+struct commit {
+    uint32_t start, end, seq;
+    struct state state;
+};
+
+static int verbose;
+
+static block_t *base;                           // the image before the first transaction
+static block_t *disk;                           // the disk the model writes to
+
+static struct write *writes;
+static uint32_t nwrites, writes_max, log_writes;
+static struct commit *commits;
+static uint32_t ncommits;
+
+// the model of the kernel
+static struct {
+    block_t data;
+    int valid, dirty, journal;
+} *cache;
+static struct sfs_super super;
+static uint8_t freemap[SFS_BLKSIZE];
+static struct sfs_disk_inode din[NFILES];
+static int super_dirty, din_dirty[NFILES];
+static uint8_t freed[NBLKS];
+static uint32_t seq, last[SFS_JOURNAL_TXMAX], nlast;
+static struct state cur;
+static uint32_t next_inc, next_gen;
+
+static void
+bug(const char *msg, uint32_t arg) {
+    fprintf(stderr, "sfscrash: ");
+    fprintf(stderr, msg, arg);
+    fprintf(stderr, "\n");
+    exit(-1);
+}
+
+static uint32_t
+csum(uint32_t hash, const void *data, size_t len) {
+    const uint32_t *word = data;
+    for (; len >= sizeof(uint32_t); len -= sizeof(uint32_t)) {
+        hash = (hash ^ *word ++) * 16777619U;
+    }
+    return hash;
+}
+
+static int
+map_test(const uint8_t *map, uint32_t blkno) {
+    return (map[blkno / CHAR_BIT] >> (blkno % CHAR_BIT)) & 1;
+}
+
+static void
+map_set(uint8_t *map, uint32_t blkno, int free) {
+    if (free) {
+        map[blkno / CHAR_BIT] |= (1 << (blkno % CHAR_BIT));
+    }
+    else {
+        map[blkno / CHAR_BIT] &= ~(1 << (blkno % CHAR_BIT));
+    }
+}
+
+/* ------------------------------------------------------------------------------------------------- */
+/* the disk */
+
+static void
+disk_write(uint32_t blkno, const void *data) {
+    if (nwrites == writes_max) {
+        writes_max = (writes_max == 0) ? 1024 : writes_max * 2;
+        if ((writes = realloc(writes, sizeof(struct write) * writes_max)) == NULL) {
+            bug("out of memory (%u writes).", nwrites);
+        }
+    }
+    struct write *w = writes + nwrites ++;
+    w->blkno = blkno;
+    if ((w->data = malloc(SFS_BLKSIZE)) == NULL) {
+        bug("out of memory (%u writes).", nwrites);
+    }
+    memcpy(w->data, data, SFS_BLKSIZE);
+    memcpy(disk[blkno], data, SFS_BLKSIZE);
+}
+
+static void
+mkfs(void) {
+    struct sfs_disk_inode *root;
+    struct sfs_disk_entry *entry;
+    uint32_t i;
+    memset(base, 0, sizeof(block_t) * NBLKS);
+
+    struct sfs_super *sp = (struct sfs_super *)base[SFS_BLKN_SUPER];
+    sp->magic = SFS_MAGIC, sp->blocks = NBLKS, sp->unused_blocks = NBLKS - (INODE_START + NFILES);
+    snprintf(sp->info, sizeof(sp->info), "sfscrash");
+    sp->version = SFS_VERSION_1, sp->journal = JOURNAL_START;
+
+    root = (struct sfs_disk_inode *)base[SFS_BLKN_ROOT];
+    root->type = SFS_TYPE_DIR, root->nlinks = 2, root->blocks = NFILES;
+    root->size = NFILES * sizeof(struct sfs_disk_entry);
+    for (i = 0; i < NFILES; i ++) {
+        root->direct[i] = DIR_START + i;
+        entry = (struct sfs_disk_entry *)base[DIR_START + i];
+        entry->ino = INODE_START + i;
+        snprintf(entry->name, sizeof(entry->name), "f%u", i);
+        ((struct sfs_disk_inode *)base[INODE_START + i])->type = SFS_TYPE_FILE;
+        ((struct sfs_disk_inode *)base[INODE_START + i])->nlinks = 1;
+    }
+    for (i = INODE_START + NFILES; i < NBLKS; i ++) {
+        map_set(base[SFS_BLKN_FREEMAP], i, 1);
+    }
+}
+
+/* ------------------------------------------------------------------------------------------------- */
+/* the model of the block cache and of the journal */
+
+static uint8_t *
+cache_get(uint32_t blkno, int read) {
+    if (!cache[blkno].valid) {
+        if (read) {
+            memcpy(cache[blkno].data, disk[blkno], SFS_BLKSIZE);
+        }
+        cache[blkno].valid = 1;
+    }
+    return cache[blkno].data;
+}
+
+static int
+logged(uint32_t blkno) {
+    uint32_t i;
+    for (i = 0; i < nlast; i ++) {
+        if (last[i] == blkno) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* cache_dirty - metadata go into the running transaction, so do data blocks logged by the last one (sfs_bdwrite) */
+static void
+cache_dirty(uint32_t blkno, int meta) {
+    cache[blkno].dirty = 1;
+    if (meta || logged(blkno)) {
+        cache[blkno].journal = 1;
+    }
+}
+
+/* cache_evict - write back a dirty buffer not in the running transaction, as the block cache does when it is full */
+static void
+cache_evict(void) {
+    uint32_t blkno, start = rand() % NBLKS, i;
+    for (i = 0; i < NBLKS; i ++) {
+        blkno = (start + i) % NBLKS;
+        if (cache[blkno].dirty && !cache[blkno].journal) {
+            disk_write(blkno, cache[blkno].data);
+            cache[blkno].dirty = 0;
+            return;
+        }
+    }
+}
+
+static void
+commit(void) {
+    struct sfs_journal_desc *desc;
+    block_t *data;
+    uint32_t blks[SFS_JOURNAL_TXMAX], hash, n = 0, blkno, start, i;
+
+    for (i = 0; i < NFILES; i ++) {
+        if (din_dirty[i]) {
+            memcpy(cache_get(INODE_START + i, 1), din + i, sizeof(struct sfs_disk_inode));
+            cache_dirty(INODE_START + i, 1);
+            din_dirty[i] = 0;
+        }
+    }
+    for (blkno = 0; blkno < NBLKS; blkno ++) {
+        if (freed[blkno]) {
+            freed[blkno] = 0, super_dirty = 1;
+            map_set(freemap, blkno, 1);
+            super.unused_blocks ++;
+        }
+    }
+    if (super_dirty) {
+        super_dirty = 0;
+        memcpy(cache_get(SFS_BLKN_SUPER, 1), &super, sizeof(super));
+        cache_dirty(SFS_BLKN_SUPER, 1);
+        memcpy(cache_get(SFS_BLKN_FREEMAP, 1), freemap, SFS_BLKSIZE);
+        cache_dirty(SFS_BLKN_FREEMAP, 1);
+    }
+
+    // ordered: the data, and the metadata of the last transaction, go home first
+    for (blkno = 0; blkno < NBLKS; blkno ++) {
+        if (cache[blkno].dirty && !cache[blkno].journal) {
+            disk_write(blkno, cache[blkno].data);
+            cache[blkno].dirty = 0;
+        }
+        if (cache[blkno].journal) {
+            if (n == SFS_JOURNAL_TXMAX) {
+                bug("more than %u blocks in a transaction.", n);
+            }
+            blks[n ++] = blkno;
+        }
+    }
+    if (n == 0) {
+        return;
+    }
+
+    if ((data = calloc(1 + n, SFS_BLKSIZE)) == NULL) {
+        bug("out of memory (%u blocks).", n);
+    }
+    desc = (struct sfs_journal_desc *)data[0];
+    desc->magic = SFS_JOURNAL_MAGIC, desc->seq = seq, desc->nblks = n;
+    memcpy(desc->blkno, blks, sizeof(uint32_t) * n);
+    for (i = 0; i < n; i ++) {
+        memcpy(data[1 + i], cache[blks[i]].data, SFS_BLKSIZE);
+    }
+    hash = csum(SFS_JOURNAL_CSUM_INIT, desc, SFS_BLKSIZE);
+    desc->checksum = csum(hash, data[1], n * SFS_BLKSIZE);
+    blkno = JOURNAL_START + (seq & 1) * SFS_JOURNAL_SLOT, start = nwrites;
+    for (i = 0; i <= n; i ++) {
+        disk_write(blkno + i, data[i]);
+    }
+    free(data);
+    log_writes += 1 + n;
+
+    for (i = 0; i < n; i ++) {
+        cache[blks[i]].journal = 0;
+        last[i] = blks[i];
+    }
+    nlast = n;
+    if (verbose) {
+        printf("  transaction %3u: %3u blocks logged, %5u writes\n", seq, n, nwrites);
+    }
+    seq ++;
+
+    struct commit *c = commits + ncommits ++;
+    c->start = start, c->end = nwrites, c->seq = seq - 1, c->state = cur;
+}
+
+/* ------------------------------------------------------------------------------------------------- */
+/* the model of the file operations */
+
+/* block_alloc - the lowest free block, so blocks freed by the last transactions are reused at once */
+static uint32_t
+block_alloc(void) {
+    uint32_t blkno;
+    for (blkno = 0; blkno < NBLKS; blkno ++) {
+        if (map_test(freemap, blkno)) {
+            map_set(freemap, blkno, 0);
+            super.unused_blocks --, super_dirty = 1;
+            return blkno;
+        }
+    }
+    return 0;
+}
+
+static void
+block_free(uint32_t blkno) {
+    if (freed[blkno] || map_test(freemap, blkno)) {
+        bug("block %u freed twice.", blkno);
+    }
+    freed[blkno] = 1;
+}
+
+static void
+write_data(uint32_t f, uint32_t index, uint32_t blkno) {
+    uint32_t *words = (uint32_t *)cache_get(blkno, 0), i;
+    cur.gen[f][index] = ++ next_gen;
+    words[0] = DATA_MAGIC, words[1] = f, words[2] = index;
+    words[3] = cur.inc[f][index], words[4] = cur.gen[f][index];
+    for (i = 5; i < SFS_BLK_NENTRY; i ++) {
+        words[i] = words[4] * i;
+    }
+    cache_dirty(blkno, 0);
+}
+
+static uint32_t
+data_block(uint32_t f, uint32_t index) {
+    if (index < SFS_NDIRECT) {
+        return din[f].direct[index];
+    }
+    return ((uint32_t *)cache_get(din[f].indirect, 1))[index - SFS_NDIRECT];
+}
+
+static void
+op_append(uint32_t f) {
+    uint32_t index = din[f].blocks, blkno, ent;
+    if (index == FILE_MAXBLKS) {
+        return;
+    }
+    if (index == SFS_NDIRECT) {
+        if ((ent = block_alloc()) == 0) {
+            return;
+        }
+        // sfs_clear_block, then the entries are written as metadata
+        memset(cache_get(ent, 0), 0, SFS_BLKSIZE);
+        cache_dirty(ent, 0);
+        din[f].indirect = ent;
+    }
+    if ((blkno = block_alloc()) == 0) {
+        if (index == SFS_NDIRECT) {
+            block_free(din[f].indirect);
+            din[f].indirect = 0;
+        }
+        return;
+    }
+    memset(cache_get(blkno, 0), 0, SFS_BLKSIZE);
+    cache_dirty(blkno, 0);
+    if (index < SFS_NDIRECT) {
+        din[f].direct[index] = blkno;
+    }
+    else {
+        ((uint32_t *)cache_get(din[f].indirect, 1))[index - SFS_NDIRECT] = blkno;
+        cache_dirty(din[f].indirect, 1);
+    }
+    cur.inc[f][index] = ++ next_inc;
+    write_data(f, index, blkno);
+    din[f].blocks ++, din[f].size = din[f].blocks * SFS_BLKSIZE;
+    cur.nblks[f] = din[f].blocks;
+    din_dirty[f] = 1;
+}
+
+static void
+op_truncate(uint32_t f) {
+    uint32_t index;
+    while ((index = din[f].blocks) > 0) {
+        index --;
+        if (index < SFS_NDIRECT) {
+            block_free(din[f].direct[index]);
+            din[f].direct[index] = 0;
+        }
+        else {
+            uint32_t *entries = (uint32_t *)cache_get(din[f].indirect, 1);
+            block_free(entries[index - SFS_NDIRECT]);
+            entries[index - SFS_NDIRECT] = 0;
+            cache_dirty(din[f].indirect, 1);
+            if (index == SFS_NDIRECT) {
+                block_free(din[f].indirect);
+                din[f].indirect = 0;
+            }
+        }
+        din[f].blocks = index;
+    }
+    din[f].size = 0, cur.nblks[f] = 0;
+    din_dirty[f] = 1;
+}
+
+static void
+op_overwrite(uint32_t f) {
+    if (din[f].blocks != 0) {
+        uint32_t index = rand() % din[f].blocks;
+        write_data(f, index, data_block(f, index));
+    }
+}
+
+static void
+run(uint32_t ntx) {
+    uint32_t tx, nops, i, f;
+    memcpy(disk, base, sizeof(block_t) * NBLKS);
+    memcpy(&super, base[SFS_BLKN_SUPER], sizeof(super));
+    memcpy(freemap, base[SFS_BLKN_FREEMAP], SFS_BLKSIZE);
+    for (f = 0; f < NFILES; f ++) {
+        memcpy(din + f, base[INODE_START + f], sizeof(struct sfs_disk_inode));
+    }
+    seq = 1;
+    commits[ncommits ++].end = 0;
+
+    for (tx = 0; tx < ntx; tx ++) {
+        nops = 1 + rand() % NOPS_MAX;
+        for (i = 0; i < nops; i ++) {
+            f = rand() % NFILES;
+            switch (rand() % 10) {
+            case 0: case 1: case 2: case 3: case 4:
+                op_append(f);
+                break;
+            case 5:
+                op_truncate(f);
+                break;
+            default:
+                op_overwrite(f);
+                break;
+            }
+            while (rand() % 3 == 0) {
+                cache_evict();
+            }
+        }
+        commit();
+    }
+}
+
+/* ------------------------------------------------------------------------------------------------- */
+/* the replay and the check after a crash */
+
+static uint32_t replay_budget;
+
+static int
+replay_write(block_t *img, uint32_t blkno, const void *data) {
+    if (replay_budget == 0) {
+        return -1;
+    }
+    replay_budget --;
+    memcpy(img[blkno], data, SFS_BLKSIZE);
+    return 0;
+}
+
+static uint32_t
+replay_check(block_t *img, uint32_t blkno, uint32_t *seq_store) {
+    struct sfs_journal_desc desc;
+    uint32_t checksum, hash;
+    memcpy(&desc, img[blkno], sizeof(desc));
+    if (desc.magic != SFS_JOURNAL_MAGIC || desc.nblks == 0 || desc.nblks > SFS_JOURNAL_TXMAX) {
+        return 0;
+    }
+    checksum = desc.checksum, desc.checksum = 0;
+    hash = csum(SFS_JOURNAL_CSUM_INIT, &desc, sizeof(desc));
+    hash = csum(hash, img[blkno] + sizeof(desc), SFS_BLKSIZE - sizeof(desc));
+    hash = csum(hash, img[blkno + 1], desc.nblks * SFS_BLKSIZE);
+    *seq_store = desc.seq;
+    return (hash == checksum) ? desc.nblks : 0;
+}
+
+static int
+replay_apply(block_t *img, uint32_t blkno) {
+    struct sfs_journal_desc *desc = (struct sfs_journal_desc *)img[blkno];
+    uint32_t i;
+    for (i = 0; i < desc->nblks; i ++) {
+        if (replay_write(img, desc->blkno[i], img[blkno + 1 + i]) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* replay - sfs_journal_replay, stopped after budget writes */
+static void
+replay(block_t *img, uint32_t budget) {
+    static const block_t zero;
+    uint32_t seq[2], nblks[2], i, newer, older;
+    replay_budget = budget;
+    for (i = 0; i < 2; i ++) {
+        nblks[i] = replay_check(img, JOURNAL_START + i * SFS_JOURNAL_SLOT, seq + i);
+    }
+    if (nblks[0] == 0 && nblks[1] == 0) {
+        return;
+    }
+    newer = (nblks[0] == 0 || (nblks[1] != 0 && (int32_t)(seq[1] - seq[0]) > 0)) ? 1 : 0, older = !newer;
+    if (nblks[older] != 0 && seq[older] + 1 == seq[newer]) {
+        if (replay_apply(img, JOURNAL_START + older * SFS_JOURNAL_SLOT) != 0) {
+            return;
+        }
+    }
+    if (replay_apply(img, JOURNAL_START + newer * SFS_JOURNAL_SLOT) != 0) {
+        return;
+    }
+    if (replay_write(img, JOURNAL_START + older * SFS_JOURNAL_SLOT, zero) == 0) {
+        replay_write(img, JOURNAL_START + newer * SFS_JOURNAL_SLOT, zero);
+    }
+}
+
+static char reason[256];
+
+#define fail(...)                                                       \
+    do {                                                                \
+        snprintf(reason, sizeof(reason), __VA_ARGS__);                  \
+        return -1;                                                      \
+    } while (0)
+
+static int
+use_block(uint8_t *used, uint32_t blkno, const char *what) {
+    if (blkno < INODE_START + NFILES || blkno >= NBLKS) {
+        fail("%s %u out of the data area", what, blkno);
+    }
+    if (used[blkno]) {
+        fail("%s %u used twice", what, blkno);
+    }
+    used[blkno] = 1;
+    return 0;
+}
+
+/* fsck - check the image after a crash against the state of the files committed before it */
+static int
+fsck(block_t *img, const struct state *state) {
+    struct sfs_super *sp = (struct sfs_super *)img[SFS_BLKN_SUPER];
+    struct sfs_disk_inode *root = (struct sfs_disk_inode *)img[SFS_BLKN_ROOT];
+    uint8_t used[NBLKS] = {0};
+    uint32_t f, index, blkno, nfree = 0, *entries, *words;
+
+    if (sp->magic != SFS_MAGIC || sp->blocks != NBLKS || sp->journal != JOURNAL_START) {
+        fail("bad superblock");
+    }
+    if (root->type != SFS_TYPE_DIR || root->blocks != NFILES) {
+        fail("bad root inode");
+    }
+    for (f = 0; f < NFILES; f ++) {
+        struct sfs_disk_entry *entry = (struct sfs_disk_entry *)img[root->direct[f]];
+        struct sfs_disk_inode *d = (struct sfs_disk_inode *)img[INODE_START + f];
+        if (root->direct[f] != DIR_START + f || entry->ino != INODE_START + f) {
+            fail("bad entry of f%u", f);
+        }
+        if (d->type != SFS_TYPE_FILE || d->nlinks != 1) {
+            fail("bad inode of f%u", f);
+        }
+        if (d->blocks != state->nblks[f] || d->size != d->blocks * SFS_BLKSIZE) {
+            fail("f%u has %u blocks (%u bytes), %u committed", f, d->blocks, d->size, state->nblks[f]);
+        }
+        entries = NULL;
+        if (d->blocks > SFS_NDIRECT) {
+            if (use_block(used, d->indirect, "indirect block") != 0) {
+                return -1;
+            }
+            entries = (uint32_t *)img[d->indirect];
+            for (index = d->blocks - SFS_NDIRECT; index < SFS_BLK_NENTRY; index ++) {
+                if (entries[index] != 0) {
+                    fail("f%u maps block %u after its end", f, entries[index]);
+                }
+            }
+        }
+        else if (d->indirect != 0) {
+            fail("f%u has %u blocks and indirect block %u", f, d->blocks, d->indirect);
+        }
+        for (index = 0; index < d->blocks; index ++) {
+            blkno = (index < SFS_NDIRECT) ? d->direct[index] : entries[index - SFS_NDIRECT];
+            if (use_block(used, blkno, "data block") != 0) {
+                return -1;
+            }
+            words = (uint32_t *)img[blkno];
+            if (words[0] != DATA_MAGIC || words[1] != f || words[2] != index
+                    || words[3] != state->inc[f][index] || words[4] < state->gen[f][index]) {
+                fail("block %u of f%u (%u) holds %x/%u/%u/%u/%u, committed %u/%u", index, f, blkno,
+                        words[0], words[1], words[2], words[3], words[4], state->inc[f][index], state->gen[f][index]);
+            }
+        }
+    }
+    for (blkno = 0; blkno < NBLKS; blkno ++) {
+        int free = map_test(img[SFS_BLKN_FREEMAP], blkno);
+        nfree += free;
+        if (free && (blkno < INODE_START + NFILES || used[blkno])) {
+            fail("block %u is used but free in the freemap", blkno);
+        }
+        if (!free && blkno >= INODE_START + NFILES && !used[blkno]) {
+            fail("block %u is leaked", blkno);
+        }
+    }
+    if (nfree != sp->unused_blocks) {
+        fail("%u blocks free in the freemap, unused_blocks %u", nfree, sp->unused_blocks);
+    }
+    return 0;
+}
+
+int
+main(int argc, char **argv) {
+    uint32_t ntx = 100, seed = 1, k, c, nfailed = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:v")) != -1) {
+        switch (opt) {
+        case 'n':
+            ntx = atoi(optarg);
+            break;
+        case 's':
+            seed = atoi(optarg);
+            break;
+        case 'v':
+            verbose = 1;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n ntx] [-s seed] [-v]\n", argv[0]);
+            return -1;
+        }
+    }
+    srand(seed);
+
+    block_t *prefix, *img;
+    base = malloc(sizeof(block_t) * NBLKS), disk = malloc(sizeof(block_t) * NBLKS);
+    prefix = malloc(sizeof(block_t) * NBLKS), img = malloc(sizeof(block_t) * NBLKS);
+    cache = calloc(NBLKS, sizeof(*cache)), commits = calloc(ntx + 1, sizeof(struct commit));
+    if (base == NULL || disk == NULL || prefix == NULL || img == NULL || cache == NULL || commits == NULL) {
+        bug("out of memory (%u transactions).", ntx);
+    }
+    mkfs();
+    run(ntx);
+
+    // 在第 k 次写之前崩溃：磁盘上是最初的映像加上前 k 次写，之后最后一个日志完整写入的事务应当生效
+    memcpy(prefix, base, sizeof(block_t) * NBLKS);
+    for (k = 0, c = 0; k <= nwrites; k ++) {
+        if (k != 0) {
+            memcpy(prefix[writes[k - 1].blkno], writes[k - 1].data, SFS_BLKSIZE);
+        }
+        while (c + 1 < ncommits && commits[c + 1].end <= k) {
+            c ++;
+        }
+        // 重放时再崩溃一次，然后重新挂载、重放
+        memcpy(img, prefix, sizeof(block_t) * NBLKS);
+        replay(img, rand() % (SFS_JOURNAL_NBLKS + 2));
+        replay(img, UINT_MAX);
+        // 日志中没有写完的块可能和原来的内容相同，下一个事务的校验和也可能已经正确
+        if (fsck(img, &(commits[c].state)) != 0
+                && (c + 1 == ncommits || k <= commits[c + 1].start || fsck(img, &(commits[c + 1].state)) != 0)) {
+            if (nfailed ++ < 10) {
+                printf("crash before write %u (transaction %u committed): %s\n", k, commits[c].seq, reason);
+            }
+        }
+    }
+    printf("sfscrash: %u transactions, %u writes (%u to the log), %u crash points: %u failed\n",
+            ncommits - 1, nwrites, log_writes, nwrites + 1, nfailed);
+    return (nfailed == 0) ? 0 : -1;
+}
@@ -0,0 +1,322 @@
+/* sfsfrag - report the fragmentation of the files and of the free space in an sfs image.
+
+usage: sfsfrag <sfs.img> [-v]
+
+For every file and directory reachable from the root, the data blocks (and the indirect block)
+are listed in file order, and every block which does not follow the previous one on disk starts
+a new extent. -v also prints the files made of more than one extent.
+The free blocks in the freemap are grouped into runs of contiguous free blocks.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#define SFS_MAGIC                               0x2f8dbe2a
+#define SFS_NDIRECT                             12
+#define SFS_BLKSIZE                             4096
+#define SFS_MAX_INFO_LEN                        31
+#define SFS_MAX_FNAME_LEN                       255
+#define SFS_BLK_NENTRY                          (SFS_BLKSIZE / sizeof(uint32_t))
+
+#define SFS_TYPE_FILE                           1
+#define SFS_TYPE_DIR                            2
+#define SFS_TYPE_LINK                           3
+
+#define SFS_BLKN_SUPER                          0
+#define SFS_BLKN_ROOT                           1
+#define SFS_BLKN_FREEMAP                        2
+
+#define SFS_VERSION_1                           1
+#define SFS_VERSION_2                           2
+#define SFS_NEXTENT                             16
+
+#define NR_RUN_CLASSES                          6
+
+struct sfs_super {
+    uint32_t magic;
+    uint32_t blocks;
+    uint32_t unused_blocks;
+    char info[SFS_MAX_INFO_LEN + 1];
+    uint32_t version;
+};
+
+struct sfs_disk_inode {
+    uint32_t size;
+    uint16_t type;
+    uint16_t nlinks;
+    uint32_t blocks;
+    uint32_t direct[SFS_NDIRECT];
+    uint32_t indirect;
+    uint32_t db_indirect;
+    uint32_t nextents;
+    struct {
+        uint32_t start, len;
+    } extents[SFS_NEXTENT];
+};
+
+struct sfs_disk_entry {
+    uint32_t ino;
+    char name[SFS_MAX_FNAME_LEN + 1];
+};
+
+struct sfs_disk_dirent {
+    uint32_t ino;
+    uint32_t next;
+    uint32_t hash;
+    uint16_t rec_len;
+    uint8_t name_len;
+    uint8_t unused;
+    char name[0];
+};
+
+static int imgfd, verbose;
+static struct sfs_super super;
+static uint8_t *visited;
+
+static struct {
+    uint32_t files, blocks, extents, contiguous;
+} stat_files;
+
+static void
+bug(const char *msg, uint32_t arg) {
+    fprintf(stderr, "sfsfrag: ");
+    fprintf(stderr, msg, arg);
+    fprintf(stderr, "\n");
+    exit(-1);
+}
+
+static void
+read_block(void *buf, uint32_t blkno) {
+    if (blkno >= super.blocks && blkno != SFS_BLKN_SUPER) {
+        bug("block %u out of range.", blkno);
+    }
+    if (pread(imgfd, buf, SFS_BLKSIZE, (off_t)blkno * SFS_BLKSIZE) != SFS_BLKSIZE) {
+        bug("read block %u failed.", blkno);
+    }
+}
+
+/* list_indirect - append the blocks mapped by the indirect block ent, up to nblks of them, after the block itself */
+static uint32_t
+list_indirect(uint32_t ent, uint32_t nblks, uint32_t *blks) {
+    uint32_t entries[SFS_BLK_NENTRY], i, n = 0;
+    read_block(entries, ent);
+    blks[n ++] = ent;
+    for (i = 0; i < nblks && i < SFS_BLK_NENTRY; i ++) {
+        blks[n ++] = entries[i];
+    }
+    return n;
+}
+
+/*
+ * list_blocks - return the blocks of inode din in file order in a malloced array, the indirect blocks
+ *               before the blocks they map. the # of blocks is stored to n_store.
+ */
+static uint32_t *
+list_blocks(struct sfs_disk_inode *din, uint32_t *n_store) {
+    uint32_t *blks = malloc(sizeof(uint32_t) * (din->blocks + 2 + din->blocks / SFS_BLK_NENTRY));
+    uint32_t i, j, n = 0, nblks = din->blocks;
+    for (i = 0; i < din->nextents && i < SFS_NEXTENT; i ++) {
+        for (j = 0; j < din->extents[i].len; j ++) {
+            blks[n ++] = din->extents[i].start + j;
+        }
+        nblks -= din->extents[i].len;
+    }
+    // the blocks after the extents are in the block pointer tree
+    for (i = 0; i < nblks && i < SFS_NDIRECT; i ++) {
+        blks[n ++] = din->direct[i];
+    }
+    if (nblks > SFS_NDIRECT) {
+        nblks -= SFS_NDIRECT;
+        n += list_indirect(din->indirect, nblks, blks + n);
+    }
+    if (nblks > SFS_BLK_NENTRY) {
+        uint32_t entries[SFS_BLK_NENTRY];
+        nblks -= SFS_BLK_NENTRY;
+        read_block(entries, din->db_indirect);
+        blks[n ++] = din->db_indirect;
+        for (i = 0; nblks > 0; i ++) {
+            uint32_t m = (nblks < SFS_BLK_NENTRY) ? nblks : SFS_BLK_NENTRY;
+            n += list_indirect(entries[i], m, blks + n);
+            nblks -= m;
+        }
+    }
+    *n_store = n;
+    return blks;
+}
+
+/* data_block - return the disk block of block index of inode din */
+static uint32_t
+data_block(struct sfs_disk_inode *din, uint32_t index) {
+    uint32_t entries[SFS_BLK_NENTRY], i;
+    for (i = 0; i < din->nextents && i < SFS_NEXTENT; i ++) {
+        if (index < din->extents[i].len) {
+            return din->extents[i].start + index;
+        }
+        index -= din->extents[i].len;
+    }
+    if (index < SFS_NDIRECT) {
+        return din->direct[index];
+    }
+    index -= SFS_NDIRECT;
+    if (index < SFS_BLK_NENTRY) {
+        read_block(entries, din->indirect);
+        return entries[index];
+    }
+    index -= SFS_BLK_NENTRY;
+    read_block(entries, din->db_indirect);
+    read_block(entries, entries[index / SFS_BLK_NENTRY]);
+    return entries[index % SFS_BLK_NENTRY];
+}
+
+static void walk_dir(uint32_t ino, struct sfs_disk_inode *din, const char *path);
+
+static void
+walk_inode(uint32_t ino, const char *path) {
+    union {
+        struct sfs_disk_inode din;
+        uint8_t block[SFS_BLKSIZE];
+    } u;
+    if (visited[ino / CHAR_BIT] & (1 << (ino % CHAR_BIT))) {
+        return;
+    }
+    visited[ino / CHAR_BIT] |= (1 << (ino % CHAR_BIT));
+    read_block(&u, ino);
+
+    uint32_t i, n, *blks = list_blocks(&(u.din), &n), extents = (n != 0) ? 1 : 0;
+    for (i = 1; i < n; i ++) {
+        if (blks[i] != blks[i - 1] + 1) {
+            extents ++;
+        }
+    }
+    stat_files.files ++, stat_files.blocks += n, stat_files.extents += extents;
+    if (extents <= 1) {
+        stat_files.contiguous ++;
+    }
+    else if (verbose) {
+        printf("  %-40s %5u blocks %4u extents\n", path, n, extents);
+    }
+    free(blks);
+    if (u.din.type == SFS_TYPE_DIR) {
+        walk_dir(ino, &(u.din), path);
+    }
+}
+
+static void
+walk_entry(uint32_t ino, const char *name, size_t len, const char *path) {
+    char subpath[1024];
+    if ((len == 1 && name[0] == '.') || (len == 2 && name[0] == '.' && name[1] == '.')) {
+        return;
+    }
+    snprintf(subpath, sizeof(subpath), "%s/%.*s", path, (int)len, name);
+    walk_inode(ino, subpath);
+}
+
+static void
+walk_dir(uint32_t ino, struct sfs_disk_inode *din, const char *path) {
+    uint8_t *block = malloc(SFS_BLKSIZE);
+    uint32_t index;
+    for (index = 0; index < din->blocks; index ++) {
+        read_block(block, data_block(din, index));
+        if (super.version < SFS_VERSION_2) {
+            struct sfs_disk_entry *entry = (struct sfs_disk_entry *)block;
+            if (entry->ino != 0) {
+                walk_entry(entry->ino, entry->name, strnlen(entry->name, SFS_MAX_FNAME_LEN), path);
+            }
+        }
+        else if (index != 0) {
+            // 第 0 块是哈希索引，之后的块中紧密排列着目录项
+            uint32_t pos = 0;
+            while (pos < SFS_BLKSIZE) {
+                struct sfs_disk_dirent *dirent = (struct sfs_disk_dirent *)(block + pos);
+                if (dirent->rec_len == 0 || pos + dirent->rec_len > SFS_BLKSIZE) {
+                    bug("bad directory entry in block %u.", data_block(din, index));
+                }
+                if (dirent->ino != 0) {
+                    walk_entry(dirent->ino, dirent->name, dirent->name_len, path);
+                }
+                pos += dirent->rec_len;
+            }
+        }
+    }
+    free(block);
+}
+
+static void
+report_free(void) {
+    static const uint32_t run_min[NR_RUN_CLASSES] = {1, 2, 4, 16, 64, 256};
+    uint32_t nruns[NR_RUN_CLASSES] = {0}, nblks[NR_RUN_CLASSES] = {0};
+    uint32_t nbits_per_blk = SFS_BLKSIZE * CHAR_BIT, nfree = 0, runs = 0, run = 0, largest = 0, blkno, c;
+    uint8_t *map = malloc(SFS_BLKSIZE);
+    for (blkno = 0; blkno <= super.blocks; blkno ++) {
+        if (blkno % nbits_per_blk == 0 && blkno < super.blocks) {
+            read_block(map, SFS_BLKN_FREEMAP + blkno / nbits_per_blk);
+        }
+        uint32_t bit = blkno % nbits_per_blk;
+        // 位图中 1 表示空闲
+        if (blkno < super.blocks && (map[bit / CHAR_BIT] & (1 << (bit % CHAR_BIT)))) {
+            run ++, nfree ++;
+            continue;
+        }
+        if (run != 0) {
+            c = NR_RUN_CLASSES - 1;
+            while (run < run_min[c]) {
+                c --;
+            }
+            nruns[c] ++, nblks[c] += run, runs ++;
+            largest = (run > largest) ? run : largest;
+            run = 0;
+        }
+    }
+    free(map);
+    printf("free:  %u blocks (%u%% of %u) in %u runs, largest run %u blocks\n",
+            nfree, (uint32_t)((uint64_t)nfree * 100 / super.blocks), super.blocks, runs, largest);
+    for (c = 0; c < NR_RUN_CLASSES; c ++) {
+        if (c == NR_RUN_CLASSES - 1) {
+            printf("  runs of %4u+    blocks: %6u runs, %7u blocks\n", run_min[c], nruns[c], nblks[c]);
+        }
+        else {
+            printf("  runs of %4u-%-4u blocks: %6u runs, %7u blocks\n", run_min[c], run_min[c + 1] - 1, nruns[c], nblks[c]);
+        }
+    }
+}
+
+int
+main(int argc, char **argv) {
+    if (argc < 2 || argc > 3 || (argc == 3 && strcmp(argv[2], "-v") != 0)) {
+        fprintf(stderr, "usage: %s <sfs.img> [-v]\n", argv[0]);
+        return -1;
+    }
+    verbose = (argc == 3);
+    if ((imgfd = open(argv[1], O_RDONLY)) < 0) {
+        fprintf(stderr, "sfsfrag: open %s failed: %s\n", argv[1], strerror(errno));
+        return -1;
+    }
+    uint8_t *block = malloc(SFS_BLKSIZE);
+    read_block(block, SFS_BLKN_SUPER);
+    memcpy(&super, block, sizeof(super));
+    free(block);
+    if (super.magic != SFS_MAGIC) {
+        bug("bad magic number %08x.", super.magic);
+    }
+    if (super.version == 0) {
+        super.version = SFS_VERSION_1;
+    }
+    visited = calloc(super.blocks / CHAR_BIT + 1, 1);
+
+    printf("%s: %u blocks, revision %u\n", argv[1], super.blocks, super.version);
+    walk_inode(SFS_BLKN_ROOT, "");
+    printf("files: %u files, %u blocks in %u extents (%u.%02u blocks/extent), %u%% of files contiguous\n",
+            stat_files.files, stat_files.blocks, stat_files.extents,
+            (stat_files.extents == 0) ? 0 : stat_files.blocks / stat_files.extents,
+            (stat_files.extents == 0) ? 0 : stat_files.blocks * 100 / stat_files.extents % 100,
+            (stat_files.files == 0) ? 0 : stat_files.contiguous * 100 / stat_files.files);
+    report_free();
+    close(imgfd);
+    return 0;
+}
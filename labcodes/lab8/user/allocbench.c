@@ -0,0 +1,111 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <file.h>
+#include <unistd.h>
+#include <iostat.h>
+
+/* 块分配测试：fill/f0 ~ f31 是空文件，轮流向它们追加 4KB 直到磁盘写满，每 FILL_STEP 个块报告一次分配速度，
+ * 然后清空其中 3 个文件，磁盘约 90% 满，再交替向 fill/fa 和 fill/fb 追加，统计分配速度和文件的连续程度：
+ * at goal 是紧跟在文件前一个块之后分配到的块数（包括从预留中取得的块），比例越高文件越连续。
+ * 最后清空所有文件，恢复磁盘原来的内容。可以用 tools/sfsfrag 查看磁盘映像中文件和空闲空间的碎片情况。
+ * freemap load 是分配过程中第一次用到而从磁盘读入的 freemap 块数，已满的 freemap 块不会被读入。
+ */
+
+#define BLKSIZE             4096
+#define NFILL               32
+#define FILL_STEP           4096
+#define NAPPEND             1000
+
+static char buffer[BLKSIZE];
+static char path[32];
+static int fds[NFILL];
+
+static void
+report(const char *what, int nblks, unsigned int msec, struct iostat *before) {
+    struct iostat after;
+    assert(iostat(&after) == 0);
+    int nalloc = after.sfs_alloc - before->sfs_alloc, ngoal = after.sfs_alloc_goal - before->sfs_alloc_goal;
+    cprintf("allocbench: %-8s %6d blocks in %5d msec (%4d us/block): alloc %6d, at goal %6d (%3d%%), freemap load %3d\n",
+            what, nblks, msec, (nblks == 0) ? 0 : msec * 1000 / nblks, nalloc, ngoal,
+            (nalloc == 0) ? 0 : ngoal * 100 / nalloc, after.freemap_load - before->freemap_load);
+}
+
+static int
+open_fill(const char *name, uint32_t open_flags) {
+    int fd;
+    snprintf(path, sizeof(path), "fill/f%s", name);
+    assert((fd = open(path, open_flags)) >= 0);
+    return fd;
+}
+
+static void
+truncate_fill(const char *name) {
+    close(open_fill(name, O_WRONLY | O_TRUNC));
+}
+
+/* bench_fill - append one block to each file in turn until the disk is full */
+static int
+bench_fill(void) {
+    struct iostat before;
+    char name[8];
+    int i, nblks = 0, step = 0;
+    for (i = 0; i < NFILL; i ++) {
+        snprintf(name, sizeof(name), "%d", i);
+        fds[i] = open_fill(name, O_WRONLY | O_APPEND);
+    }
+    assert(iostat(&before) == 0);
+    unsigned int start = gettime_msec();
+    for (i = 0; write(fds[i], buffer, BLKSIZE) == BLKSIZE; i = (i + 1) % NFILL) {
+        if (++ step == FILL_STEP) {
+            nblks += step;
+            snprintf(name, sizeof(name), "%dM", nblks * (BLKSIZE / 1024) / 1024);
+            report(name, step, gettime_msec() - start, &before);
+            assert(iostat(&before) == 0);
+            start = gettime_msec(), step = 0;
+        }
+    }
+    report("full", step, gettime_msec() - start, &before);
+    for (i = 0; i < NFILL; i ++) {
+        assert(fsync(fds[i]) == 0);
+        close(fds[i]);
+    }
+    return nblks + step;
+}
+
+/* bench_append - append NAPPEND blocks to each of two files in turn, on the 90%-full disk */
+static void
+bench_append(void) {
+    struct iostat before;
+    int i, fda = open_fill("a", O_WRONLY | O_APPEND), fdb = open_fill("b", O_WRONLY | O_APPEND);
+    assert(iostat(&before) == 0);
+    unsigned int start = gettime_msec();
+    for (i = 0; i < NAPPEND; i ++) {
+        assert(write(fda, buffer, BLKSIZE) == BLKSIZE);
+        assert(write(fdb, buffer, BLKSIZE) == BLKSIZE);
+    }
+    assert(fsync(fda) == 0 && fsync(fdb) == 0);
+    report("append", NAPPEND * 2, gettime_msec() - start, &before);
+    close(fda), close(fdb);
+}
+
+int
+main(void) {
+    char name[8];
+    int i;
+    memset(buffer, 0x5a, sizeof(buffer));
+    cprintf("allocbench: filled %d blocks\n", bench_fill());
+    for (i = 0; i < NFILL; i += 11) {
+        snprintf(name, sizeof(name), "%d", i);
+        truncate_fill(name);
+    }
+    bench_append();
+
+    for (i = 0; i < NFILL; i ++) {
+        snprintf(name, sizeof(name), "%d", i);
+        truncate_fill(name);
+    }
+    truncate_fill("a"), truncate_fill("b");
+    cprintf("allocbench pass.\n");
+    return 0;
+}
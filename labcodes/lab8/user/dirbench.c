@@ -0,0 +1,72 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <dir.h>
+#include <file.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <iostat.h>
+
+/* 大目录测试：bigdir 中有 NFILES 个名为 f0 ~ f999 的目录项（都是同一个空文件的硬链接），
+ * 统计在其中查找存在和不存在的名字、以及列出整个目录的开销。
+ * 第 1 版格式的目录每块只有一个目录项，查找一个名字平均要读一半的块，查找不存在的名字要读出所有块；
+ * 第 2 版格式的目录通过哈希索引只读出同一条链上的少数几个目录项。
+ */
+
+#define BIGDIR              "bigdir"
+#define NFILES              1000
+
+static char name[FS_MAX_FNAME_LEN + 1];
+
+static void
+report(const char *what, int nops, unsigned int msec, struct iostat *before) {
+    struct iostat after;
+    assert(iostat(&after) == 0);
+    cprintf("dirbench: %-8s %5d ops in %4d msec: cache hit %6d, miss %4d, disk read %4d\n",
+            what, nops, msec, after.bcache_hit - before->bcache_hit,
+            after.bcache_miss - before->bcache_miss, after.disk_read - before->disk_read);
+}
+
+static void
+bench_lookup(const char *what, const char *prefix, bool exist) {
+    struct iostat before;
+    int i, fd;
+    assert(iostat(&before) == 0);
+    unsigned int start = gettime_msec();
+    for (i = 0; i < NFILES; i ++) {
+        snprintf(name, sizeof(name), "%s%d", prefix, i);
+        if ((fd = open(name, O_RDONLY)) >= 0) {
+            close(fd);
+        }
+        assert((fd >= 0) == exist);
+    }
+    report(what, NFILES, gettime_msec() - start, &before);
+}
+
+static void
+bench_readdir(void) {
+    struct iostat before;
+    struct dirent *direntp;
+    DIR *dirp;
+    int n = 0;
+    assert(iostat(&before) == 0);
+    unsigned int start = gettime_msec();
+    assert((dirp = opendir(".")) != NULL);
+    while ((direntp = readdir(dirp)) != NULL) {
+        n ++;
+    }
+    closedir(dirp);
+    report("readdir", n, gettime_msec() - start, &before);
+    assert(n >= NFILES);
+}
+
+int
+main(void) {
+    assert(chdir(BIGDIR) == 0);
+    bench_lookup("lookup", "f", 1);
+    bench_lookup("relookup", "f", 1);
+    bench_lookup("miss", "x", 0);
+    bench_readdir();
+    cprintf("dirbench pass.\n");
+    return 0;
+}
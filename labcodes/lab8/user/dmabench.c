@@ -0,0 +1,82 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <file.h>
+#include <unistd.h>
+#include <iostat.h>
+
+/* IDE 传送方式测试：分别用 PIO 和总线主控 DMA 写入 fill/f5 并 fsync、读取 large 中没有读过的一段，
+ * 统计驱动程序在每 MB 数据上花费的 CPU 周期（发出命令和处理中断的时间，不含等待磁盘的时间）。
+ * PIO 时每个扇区都要由 CPU 用 insl/outsl 搬运 128 次双字、处理一次中断；DMA 时设备直接读写页缓存和块缓存的页，
+ * 每个请求只发出一次命令、处理一次中断。没有 DMA 时（找不到总线主控 IDE 控制器）两次都是 PIO。
+ */
+
+#define BUFSIZE             (64 * 1024)
+#define WRITE_MB            4
+#define READ_MB             4
+#define SECTS_PER_MB        2048
+
+static char buffer[BUFSIZE];
+
+static void
+report(const char *what, struct iostat *before) {
+    struct iostat after;
+    assert(iostat(&after) == 0);
+    int pio = (after.ide_pio_sectors - before->ide_pio_sectors) / SECTS_PER_MB;
+    int dma = (after.ide_dma_sectors - before->ide_dma_sectors) / SECTS_PER_MB;
+    int pio_kcycles = after.ide_pio_kcycles - before->ide_pio_kcycles;
+    int dma_kcycles = after.ide_dma_kcycles - before->ide_dma_kcycles;
+    cprintf("dmabench: %-9s pio %3d MB, %7d kcycles/MB; dma %3d MB, %7d kcycles/MB; ide intr %6d\n",
+            what, pio, (pio == 0) ? 0 : pio_kcycles / pio, dma, (dma == 0) ? 0 : dma_kcycles / dma,
+            after.ide_intr - before->ide_intr);
+}
+
+/* bench_write - write WRITE_MB MB to fill/f5 and fsync it */
+static void
+bench_write(const char *what) {
+    struct iostat before;
+    int fd, i;
+    assert(iostat(&before) == 0);
+    assert((fd = open("fill/f5", O_WRONLY | O_TRUNC)) >= 0);
+    for (i = 0; i < WRITE_MB * 1024 * 1024 / BUFSIZE; i ++) {
+        buffer[0] = i;
+        assert(write(fd, buffer, BUFSIZE) == BUFSIZE);
+    }
+    assert(fsync(fd) == 0);
+    close(fd);
+    report(what, &before);
+}
+
+/* bench_read - read READ_MB MB of large starting at MB n, which is not in the page cache yet */
+static void
+bench_read(const char *what, int n) {
+    struct iostat before;
+    int fd, i;
+    assert(iostat(&before) == 0);
+    assert((fd = open("large", O_RDONLY)) >= 0);
+    assert(seek(fd, n * 1024 * 1024, LSEEK_SET) == 0);
+    for (i = 0; i < READ_MB * 1024 * 1024 / BUFSIZE; i ++) {
+        assert(read(fd, buffer, BUFSIZE) == BUFSIZE);
+    }
+    close(fd);
+    report(what, &before);
+}
+
+int
+main(void) {
+    int old = idedma(0), fd;
+    bench_write("pio write");
+    bench_read("pio read", 0);
+    idedma(1);
+    if (!idedma(-1)) {
+        cprintf("dmabench: no bus master DMA, both rounds use PIO.\n");
+    }
+    bench_write("dma write");
+    bench_read("dma read", READ_MB);
+    idedma(old);
+    assert((fd = open("fill/f5", O_WRONLY | O_TRUNC)) >= 0);
+    assert(fsync(fd) == 0);
+    close(fd);
+    cprintf("dmabench pass.\n");
+    return 0;
+}
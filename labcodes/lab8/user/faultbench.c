@@ -0,0 +1,71 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <vmstat.h>
+
+/* fault-around 测试：分别在关闭 fault-around（窗口为 1）和使用默认窗口时，
+ * 运行顺序访问 BSS 的子进程（faultbench seq）以及 matrix，统计缺页次数。
+ * 每次测试都 exec 一个新的地址空间，BSS 页面由 do_pgfault 按需分配。
+ */
+
+#define PAGE_SIZE           4096
+#define NPAGE               1024
+
+static char buf[NPAGE][PAGE_SIZE];
+
+static int
+seq(void) {
+    int i, sum = 0;
+    for (i = 0; i < NPAGE; i ++) {
+        sum += buf[i][0];
+    }
+    for (i = NPAGE - 1; i >= 0; i --) {
+        buf[i][PAGE_SIZE - 1] = (char)i;
+    }
+    for (i = 0; i < NPAGE; i ++) {
+        sum += buf[i][PAGE_SIZE - 1] - (char)i;
+    }
+    return sum;
+}
+
+static void
+run(const char *name, int window, int is_seq) {
+    struct vmstat before, after;
+    unsigned int msec = gettime_msec();
+    int pid, code;
+
+    assert(vmstat(&before) == 0);
+    if ((pid = fork()) == 0) {
+        if (is_seq) {
+            exec("faultbench", "seq");
+        }
+        else {
+            exec("matrix");
+        }
+        exit(-1);
+    }
+    assert(pid > 0);
+    assert(waitpid(pid, &code) == 0 && code == 0);
+    assert(vmstat(&after) == 0);
+    msec = gettime_msec() - msec;
+
+    cprintf("faultbench: %-6s window %2d: %5d faults, %5d pages mapped ahead, %d ticks\n",
+            name, window, after.pgfault - before.pgfault,
+            after.fault_around - before.fault_around, msec);
+}
+
+int
+main(int argc, char **argv) {
+    if (argc == 2 && strcmp(argv[1], "seq") == 0) {
+        return seq();
+    }
+    int window = fault_around(1);
+    run("seq", 1, 1);
+    run("matrix", 1, 0);
+    fault_around(window);
+    run("seq", window, 1);
+    run("matrix", window, 0);
+    cprintf("faultbench pass.\n");
+    return 0;
+}
+
@@ -0,0 +1,66 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <x86.h>
+#include <vmstat.h>
+
+/* fork 延迟测试：父进程先写满 NPAGE 个页面，然后反复 fork，
+ * 子进程分别写入 0、一半、全部页面后退出，
+ * 统计 fork 本身的耗时以及 fork/写时复制 中共享和复制的页面数。
+ */
+
+#define PAGE_SIZE           4096
+#define NPAGE               256
+#define NROUND              16
+
+static char buf[NPAGE][PAGE_SIZE];
+
+static void
+touch(int npage, char c) {
+    int i;
+    for (i = 0; i < npage; i ++) {
+        buf[i][0] = c;
+    }
+}
+
+static void
+bench(int nwrite) {
+    struct vmstat before, after;
+    uint64_t cycles = 0;
+    unsigned int msec = gettime_msec();
+    int i, pid;
+
+    assert(vmstat(&before) == 0);
+    for (i = 0; i < NROUND; i ++) {
+        uint64_t start = rdtsc();
+        if ((pid = fork()) == 0) {
+            touch(nwrite, (char)i);
+            exit(0);
+        }
+        cycles += rdtsc() - start;
+        assert(pid > 0);
+        assert(waitpid(pid, NULL) == 0);
+    }
+    assert(vmstat(&after) == 0);
+    msec = gettime_msec() - msec;
+
+    do_div(cycles, NROUND);
+    cprintf("forkbench: child writes %3d/%d pages: fork %llu cycles, %d ticks for %d rounds\n",
+            nwrite, NPAGE, cycles, msec, NROUND);
+    cprintf("forkbench:     per fork: shared %d, copied %d (fork %d, cow %d), cow reused %d\n",
+            (after.fork_shared - before.fork_shared) / NROUND,
+            (after.fork_copied - before.fork_copied + after.cow_copied - before.cow_copied) / NROUND,
+            (after.fork_copied - before.fork_copied) / NROUND,
+            (after.cow_copied - before.cow_copied) / NROUND,
+            (after.cow_reused - before.cow_reused) / NROUND);
+}
+
+int
+main(void) {
+    touch(NPAGE, 1);
+    bench(0);
+    bench(NPAGE / 2);
+    bench(NPAGE);
+    cprintf("forkbench pass.\n");
+    return 0;
+}
+
@@ -0,0 +1,91 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <file.h>
+#include <unistd.h>
+#include <iostat.h>
+
+/* CPU 与磁盘并发测试：一个进程做纯计算，另一个进程反复清空 fill/f4、写入 64KB 并 fsync，
+ * 分别单独运行和同时运行 DURATION 毫秒，比较两者的吞吐量。
+ * IDE 请求由中断驱动，磁盘进程在传送期间睡眠，计算进程的吞吐量几乎不受影响；
+ * 轮询的驱动中磁盘进程在整个传送期间占用 CPU，同时运行时两者的吞吐量之和不超过单独运行时的一个。
+ * ide intr 是处理的 IDE 中断数，queued 是遇到磁盘忙、由 IO 调度器排队的请求数。
+ */
+
+#define DURATION            2000
+#define WRITE_SIZE          (64 * 1024)
+#define CPU_LOOP            10000
+
+static char buffer[WRITE_SIZE];
+
+/* cpu_bound - compute until the deadline, return the # of thousands of loops */
+static int
+cpu_bound(unsigned int deadline) {
+    volatile unsigned int sum = 0;
+    int i, nloops = 0;
+    while (gettime_msec() < deadline) {
+        for (i = 0; i < CPU_LOOP; i ++) {
+            sum += i;
+        }
+        nloops += CPU_LOOP / 1000;
+    }
+    return nloops;
+}
+
+/* disk_bound - rewrite fill/f4 with fsync until the deadline, return the # of KB written */
+static int
+disk_bound(unsigned int deadline) {
+    int fd, nkb = 0;
+    while (gettime_msec() < deadline) {
+        assert((fd = open("fill/f4", O_WRONLY | O_TRUNC)) >= 0);
+        buffer[0] = nkb;
+        assert(write(fd, buffer, WRITE_SIZE) == WRITE_SIZE);
+        assert(fsync(fd) == 0);
+        close(fd);
+        nkb += WRITE_SIZE / 1024;
+    }
+    return nkb;
+}
+
+/* run - run the cpu-bound and/or the disk-bound process for DURATION msec, store their throughputs per second */
+static void
+run(const char *what, bool cpu, bool disk, int *cpu_store, int *disk_store) {
+    struct iostat before, after;
+    int pid[2] = {0, 0}, code, i;
+    unsigned int deadline = gettime_msec() + DURATION;
+    assert(iostat(&before) == 0);
+    for (i = 0; i < 2; i ++) {
+        if (!(i == 0 ? cpu : disk)) {
+            continue;
+        }
+        if ((pid[i] = fork()) == 0) {
+            exit((i == 0) ? cpu_bound(deadline) : disk_bound(deadline));
+        }
+        assert(pid[i] > 0);
+    }
+    *cpu_store = *disk_store = 0;
+    for (i = 0; i < 2; i ++) {
+        if (pid[i] != 0) {
+            assert(waitpid(pid[i], &code) == 0);
+            *((i == 0) ? cpu_store : disk_store) = code * 1000 / DURATION;
+        }
+    }
+    assert(iostat(&after) == 0);
+    cprintf("idebench: %-8s cpu %6d kloops/s, disk %5d KB/s: ide intr %6d, queued %4d\n",
+            what, *cpu_store, *disk_store, after.ide_intr - before.ide_intr, after.bio_queued - before.bio_queued);
+}
+
+int
+main(void) {
+    int cpu_alone, disk_alone, cpu, disk, fd;
+    run("cpu", 1, 0, &cpu_alone, &disk);
+    run("disk", 0, 1, &cpu, &disk_alone);
+    run("both", 1, 1, &cpu, &disk);
+    cprintf("idebench: together cpu at %d%%, disk at %d%% of running alone\n",
+            (cpu_alone == 0) ? 0 : cpu * 100 / cpu_alone, (disk_alone == 0) ? 0 : disk * 100 / disk_alone);
+    assert((fd = open("fill/f4", O_WRONLY | O_TRUNC)) >= 0);
+    assert(fsync(fd) == 0);
+    close(fd);
+    cprintf("idebench pass.\n");
+    return 0;
+}
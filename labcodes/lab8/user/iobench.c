@@ -0,0 +1,97 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <file.h>
+#include <stat.h>
+#include <unistd.h>
+#include <iostat.h>
+
+/* 文件 IO 测试：统计块缓存对小块读、目录查找和小块改写的效果。
+ * 没有块缓存时，每次不足一块的读取都要读一次磁盘，每次不足一块的写入都要读写各一次磁盘，
+ * 每次路径查找都要读出目录中的所有目录项所在的块。
+ * 文件系统不支持创建文件，改写测试把本程序文件中读出的内容原样写回。
+ */
+
+#define CHUNK               64
+#define NLOOKUP             64
+#define WRITE_SIZE          (32 * 1024)
+
+static char chunk[CHUNK];
+
+static void
+report(const char *name, int nops, struct iostat *before) {
+    struct iostat after;
+    assert(iostat(&after) == 0);
+    cprintf("iobench: %-12s %5d ops: disk read %4d, disk write %4d, cache hit %5d, miss %4d, writeback %4d\n",
+            name, nops, after.disk_read - before->disk_read, after.disk_write - before->disk_write,
+            after.bcache_hit - before->bcache_hit, after.bcache_miss - before->bcache_miss,
+            after.bcache_writeback - before->bcache_writeback);
+}
+
+static int
+read_chunks(const char *path) {
+    int fd, ret, nops = 0;
+    assert((fd = open(path, O_RDONLY)) >= 0);
+    while ((ret = read(fd, chunk, CHUNK)) > 0) {
+        nops ++;
+    }
+    assert(ret == 0);
+    close(fd);
+    return nops;
+}
+
+static void
+bench_read(const char *path) {
+    struct iostat before;
+    int nops;
+    assert(iostat(&before) == 0);
+    nops = read_chunks(path);
+    report("read", nops, &before);
+
+    assert(iostat(&before) == 0);
+    nops = read_chunks(path);
+    report("reread", nops, &before);
+}
+
+static void
+bench_lookup(const char *path) {
+    struct iostat before;
+    int i, fd;
+    assert(iostat(&before) == 0);
+    for (i = 0; i < NLOOKUP; i ++) {
+        assert((fd = open(path, O_RDONLY)) >= 0);
+        close(fd);
+    }
+    report("lookup", NLOOKUP, &before);
+}
+
+static void
+bench_rewrite(const char *path) {
+    struct iostat before;
+    struct stat st;
+    int fd, nops = 0;
+    off_t pos;
+    assert((fd = open(path, O_RDWR)) >= 0);
+    assert(fstat(fd, &st) == 0);
+    assert(iostat(&before) == 0);
+    for (pos = 0; pos + CHUNK <= WRITE_SIZE && pos + CHUNK <= st.st_size; pos += CHUNK, nops ++) {
+        assert(seek(fd, pos, LSEEK_SET) == 0 && read(fd, chunk, CHUNK) == CHUNK);
+        assert(seek(fd, pos, LSEEK_SET) == 0 && write(fd, chunk, CHUNK) == CHUNK);
+    }
+    report("rewrite", nops, &before);
+
+    assert(iostat(&before) == 0);
+    assert(fsync(fd) == 0);
+    report("fsync", 1, &before);
+    close(fd);
+}
+
+int
+main(void) {
+    bench_read("sh");
+    bench_lookup("sfs_filetest1");
+    bench_rewrite("iobench");
+    cprintf("iobench pass.\n");
+    return 0;
+}
+
@@ -0,0 +1,76 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <file.h>
+#include <stat.h>
+#include <unistd.h>
+#include <iostat.h>
+
+/* 大文件测试：large 是一个 16MB 的文件，在第 3 版格式中由一个 extent 映射，
+ * 找到文件块对应的磁盘块不需要读间接块（cache hit/miss 中只剩下数据块本身）。
+ * 依次测量顺序读、再次读（页缓存命中）、清空后重新写入并 fsync 的吞吐量，写入的内容和原来一样都是 0。
+ */
+
+#define BUFSIZE             (64 * 1024)
+#define LARGE               "large"
+
+static char buffer[BUFSIZE];
+
+static void
+report(const char *what, int nbytes, unsigned int msec, struct iostat *before) {
+    struct iostat after;
+    assert(iostat(&after) == 0);
+    cprintf("largebench: %-8s %8d bytes in %5d msec (%5d KB/s): cache hit %5d, miss %5d, disk read %5d, write %5d, alloc %5d, at goal %5d\n",
+            what, nbytes, msec, (msec == 0) ? 0 : nbytes / msec * 1000 / 1024,
+            after.bcache_hit - before->bcache_hit, after.bcache_miss - before->bcache_miss,
+            after.disk_read - before->disk_read, after.disk_write - before->disk_write,
+            after.sfs_alloc - before->sfs_alloc, after.sfs_alloc_goal - before->sfs_alloc_goal);
+}
+
+static void
+bench_read(const char *what, int size) {
+    struct iostat before;
+    int fd, ret, nbytes = 0;
+    assert((fd = open(LARGE, O_RDONLY)) >= 0);
+    assert(iostat(&before) == 0);
+    unsigned int start = gettime_msec();
+    while ((ret = read(fd, buffer, BUFSIZE)) > 0) {
+        nbytes += ret;
+    }
+    report(what, nbytes, gettime_msec() - start, &before);
+    assert(ret == 0 && nbytes == size);
+    close(fd);
+}
+
+static void
+bench_rewrite(int size) {
+    struct iostat before;
+    int fd, nbytes;
+    memset(buffer, 0, sizeof(buffer));
+    assert(iostat(&before) == 0);
+    unsigned int start = gettime_msec();
+    assert((fd = open(LARGE, O_WRONLY | O_TRUNC)) >= 0);
+    for (nbytes = 0; nbytes < size; nbytes += BUFSIZE) {
+        assert(write(fd, buffer, BUFSIZE) == BUFSIZE);
+    }
+    assert(fsync(fd) == 0);
+    report("rewrite", nbytes, gettime_msec() - start, &before);
+    close(fd);
+}
+
+int
+main(void) {
+    struct stat st;
+    int fd;
+    assert((fd = open(LARGE, O_RDONLY)) >= 0);
+    assert(fstat(fd, &st) == 0 && st.st_size % BUFSIZE == 0);
+    close(fd);
+    cprintf("largebench: %s: %d bytes, %d blocks\n", LARGE, st.st_size, st.st_blocks);
+
+    bench_read("read", st.st_size);
+    bench_read("reread", st.st_size);
+    bench_rewrite(st.st_size);
+    bench_read("read", st.st_size);
+    cprintf("largebench pass.\n");
+    return 0;
+}
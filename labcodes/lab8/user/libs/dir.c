@@ -39,6 +39,11 @@ closedir(DIR *dirp) {
     close(dirp->fd);
 }
 
+int
+chdir(const char *path) {
+    return sys_chdir(path);
+}
+
 int
 getcwd(char *buffer, size_t len) {
     return sys_getcwd(buffer, len);
@@ -46,6 +46,16 @@ dup2(int fd1, int fd2) {
     return sys_dup(fd1, fd2);
 }
 
+int
+pipe(int *fd_store) {
+    return sys_pipe(fd_store);
+}
+
+int
+mkfifo(const char *name, uint32_t open_flags) {
+    return sys_mkfifo(name, open_flags);
+}
+
 static char
 transmode(struct stat *stat) {
     uint32_t mode = stat->st_mode;
@@ -54,6 +64,7 @@ transmode(struct stat *stat) {
     if (S_ISLNK(mode)) return 'l';
     if (S_ISCHR(mode)) return 'c';
     if (S_ISBLK(mode)) return 'b';
+    if (S_ISFIFO(mode)) return 'p';
     return '-';
 }
 
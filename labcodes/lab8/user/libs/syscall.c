@@ -89,6 +89,31 @@ sys_gettime(void) {
     return syscall(SYS_gettime);
 }
 
+int
+sys_vmstat(struct vmstat *store) {
+    return syscall(SYS_vmstat, store);
+}
+
+int
+sys_fault_around(int pages) {
+    return syscall(SYS_fault_around, pages);
+}
+
+int
+sys_kswapd(int enable) {
+    return syscall(SYS_kswapd, enable);
+}
+
+int
+sys_iostat(struct iostat *store) {
+    return syscall(SYS_iostat, store);
+}
+
+int
+sys_idedma(int enable) {
+    return syscall(SYS_idedma, enable);
+}
+
 int
 sys_exec(const char *name, int argc, const char **argv) {
     return syscall(SYS_exec, name, argc, argv);
@@ -129,6 +154,11 @@ sys_fsync(int fd) {
     return syscall(SYS_fsync, fd);
 }
 
+int
+sys_chdir(const char *path) {
+    return syscall(SYS_chdir, path);
+}
+
 int
 sys_getcwd(char *buffer, size_t len) {
     return syscall(SYS_getcwd, buffer, len);
@@ -143,3 +173,13 @@ int
 sys_dup(int fd1, int fd2) {
     return syscall(SYS_dup, fd1, fd2);
 }
+
+int
+sys_pipe(int *fd_store) {
+    return syscall(SYS_pipe, fd_store);
+}
+
+int
+sys_mkfifo(const char *name, uint32_t open_flags) {
+    return syscall(SYS_mkfifo, name, open_flags);
+}
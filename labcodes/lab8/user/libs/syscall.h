@@ -13,6 +13,15 @@ int sys_pgdir(void);
 int sys_sleep(unsigned int time);
 int sys_gettime(void);
 
+struct vmstat;
+int sys_vmstat(struct vmstat *store);
+int sys_fault_around(int pages);
+int sys_kswapd(int enable);
+
+struct iostat;
+int sys_iostat(struct iostat *store);
+int sys_idedma(int enable);
+
 struct stat;
 struct dirent;
 
@@ -23,9 +32,12 @@ int sys_write(int fd, void *base, size_t len);
 int sys_seek(int fd, off_t pos, int whence);
 int sys_fstat(int fd, struct stat *stat);
 int sys_fsync(int fd);
+int sys_chdir(const char *path);
 int sys_getcwd(char *buffer, size_t len);
 int sys_getdirentry(int fd, struct dirent *dirent);
 int sys_dup(int fd1, int fd2);
+int sys_pipe(int *fd_store);
+int sys_mkfifo(const char *name, uint32_t open_flags);
 void sys_lab6_set_priority(uint32_t priority); //only for lab6
 
 
@@ -77,6 +77,34 @@ gettime_msec(void) {
     return (unsigned int)sys_gettime();
 }
 
+int
+vmstat(struct vmstat *store) {
+    return sys_vmstat(store);
+}
+
+// fault_around - set the max fault-around window in pages (1 disables it), return the old one
+int
+fault_around(int pages) {
+    return sys_fault_around(pages);
+}
+
+// kswapd - enable (1) or disable (0) background page reclaim, negative only queries; return the old state
+int
+kswapd(int enable) {
+    return sys_kswapd(enable);
+}
+
+int
+iostat(struct iostat *store) {
+    return sys_iostat(store);
+}
+
+// idedma - enable (1) or disable (0) IDE bus master DMA, negative only queries; return the old state
+int
+idedma(int enable) {
+    return sys_idedma(enable);
+}
+
 int
 __exec(const char *name, const char **argv) {
     int argc = 0;
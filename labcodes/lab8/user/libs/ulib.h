@@ -27,6 +27,7 @@ int fprintf(int fd, const char *fmt, ...);
 
 void __noreturn exit(int error_code);
 int fork(void);
+int vfork(void);
 int wait(void);
 int waitpid(int pid, int *store);
 void yield(void);
@@ -35,6 +36,13 @@ int getpid(void);
 void print_pgdir(void);
 int sleep(unsigned int time);
 unsigned int gettime_msec(void);
+struct vmstat;
+int vmstat(struct vmstat *store);
+int fault_around(int pages);
+int kswapd(int enable);
+struct iostat;
+int iostat(struct iostat *store);
+int idedma(int enable);
 int __exec(const char *name, const char **argv);
 
 #define __exec0(name, path, ...)                \
@@ -0,0 +1,92 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <file.h>
+#include <unistd.h>
+#include <iostat.h>
+
+/* 元数据更新测试：反复清空 fill/f0 ~ f3 中的一个文件、写入 4KB（释放和分配块，修改 inode、freemap 和超级块）。
+ *   - fsync：每次操作之后 fsync，有日志时每次只顺序写入一个小事务，没有日志时每次都要同步写回元数据；
+ *   - nosync：不调用 fsync，由 kjournald 定期提交，多次操作的修改合并在一个事务中；
+ *   - group：NPROC 个进程同时对各自的文件做 fsync 操作，提交进行中到达的 fsync 等待同一次提交（group commit）。
+ * 用 make SFSJOURNAL=0 生成没有日志的磁盘映像（需先删除 bin/sfs.img），即可和原来同步写元数据的方式比较。
+ */
+
+#define BLKSIZE             4096
+#define NOPS                200
+#define NPROC               4
+
+static char buffer[BLKSIZE];
+static char path[32];
+
+static void
+report(const char *what, int nops, unsigned int msec, struct iostat *before) {
+    struct iostat after;
+    assert(iostat(&after) == 0);
+    cprintf("metabench: %-7s %4d ops in %5d msec (%5d ops/s): disk write %5d, journal commit %4d, log blocks %5d\n",
+            what, nops, msec, (msec == 0) ? 0 : nops * 1000 / msec, after.disk_write - before->disk_write,
+            after.journal_commit - before->journal_commit, after.journal_write - before->journal_write);
+}
+
+/* rewrite - truncate fill/f<n>, write a block to it and fsync it if sync */
+static void
+rewrite(int n, bool sync) {
+    int fd;
+    snprintf(path, sizeof(path), "fill/f%d", n);
+    assert((fd = open(path, O_WRONLY | O_TRUNC)) >= 0);
+    buffer[0] = n;
+    assert(write(fd, buffer, BLKSIZE) == BLKSIZE);
+    if (sync) {
+        assert(fsync(fd) == 0);
+    }
+    close(fd);
+}
+
+static void
+bench_rewrite(const char *what, bool sync) {
+    struct iostat before;
+    int i;
+    assert(iostat(&before) == 0);
+    unsigned int start = gettime_msec();
+    for (i = 0; i < NOPS; i ++) {
+        rewrite(i % NPROC, sync);
+    }
+    report(what, NOPS, gettime_msec() - start, &before);
+}
+
+static void
+bench_group(void) {
+    struct iostat before;
+    int i, n, pid;
+    assert(iostat(&before) == 0);
+    unsigned int start = gettime_msec();
+    for (n = 0; n < NPROC; n ++) {
+        if ((pid = fork()) == 0) {
+            for (i = 0; i < NOPS / NPROC; i ++) {
+                rewrite(n, 1);
+            }
+            exit(0);
+        }
+        assert(pid > 0);
+    }
+    for (n = 0; n < NPROC; n ++) {
+        assert(wait() == 0);
+    }
+    report("group", NOPS / NPROC * NPROC, gettime_msec() - start, &before);
+}
+
+int
+main(void) {
+    int n, fd;
+    bench_rewrite("fsync", 1);
+    bench_rewrite("nosync", 0);
+    bench_group();
+    for (n = 0; n < NPROC; n ++) {
+        snprintf(path, sizeof(path), "fill/f%d", n);
+        assert((fd = open(path, O_WRONLY | O_TRUNC)) >= 0);
+        assert(fsync(fd) == 0);
+        close(fd);
+    }
+    cprintf("metabench pass.\n");
+    return 0;
+}
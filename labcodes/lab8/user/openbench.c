@@ -0,0 +1,45 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <file.h>
+#include <unistd.h>
+#include <iostat.h>
+
+/* open() 延迟测试：反复打开同一个存在的文件、反复查找同一个不存在的名字（如 sh 在各个目录中探测程序），
+ * 第一次查找之后的结果都由目录项缓存给出，不再调用文件系统读目录。
+ */
+
+#define NOPS                2000
+
+static void
+report(const char *what, unsigned int msec, struct iostat *before) {
+    struct iostat after;
+    assert(iostat(&after) == 0);
+    cprintf("openbench: %-10s %5d ops in %4d msec (%4d us/op): dentry hit %5d, negative %5d, miss %3d, cache hit %5d\n",
+            what, NOPS, msec, msec * 1000 / NOPS, after.dcache_hit - before->dcache_hit,
+            after.dcache_negative - before->dcache_negative, after.dcache_miss - before->dcache_miss,
+            after.bcache_hit - before->bcache_hit);
+}
+
+static void
+bench_open(const char *what, const char *path, bool exist) {
+    struct iostat before;
+    int i, fd;
+    assert(iostat(&before) == 0);
+    unsigned int start = gettime_msec();
+    for (i = 0; i < NOPS; i ++) {
+        if ((fd = open(path, O_RDONLY)) >= 0) {
+            close(fd);
+        }
+        assert((fd >= 0) == exist);
+    }
+    report(what, gettime_msec() - start, &before);
+}
+
+int
+main(void) {
+    bench_open("open", "sh", 1);
+    bench_open("open-miss", "nosuchfile", 0);
+    cprintf("openbench pass.\n");
+    return 0;
+}
@@ -0,0 +1,66 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <file.h>
+#include <unistd.h>
+#include <iostat.h>
+#include <error.h>
+
+/* 多级路径测试：deep/d1/.../d16/leaf 是一个 16 层的目录树，由 sfs_lookup 在一次调用中逐个分量解析，
+ * 统计打开深层路径、带 "." 和 ".." 的路径、经过相对和绝对符号链接的路径的开销；
+ * deep/loop 是指向自己的符号链接，超过跟随深度后返回 -E_LOOP。
+ */
+
+#define NOPS                500
+#define DEEP                "deep/d1/d2/d3/d4/d5/d6/d7/d8/d9/d10/d11/d12/d13/d14/d15/d16"
+#define LEAF_CONTENT        "deep leaf\n"
+
+static char buffer[64];
+
+static void
+report(const char *what, unsigned int msec, struct iostat *before) {
+    struct iostat after;
+    assert(iostat(&after) == 0);
+    cprintf("pathbench: %-8s %4d ops in %4d msec (%4d us/op): cache hit %6d, miss %3d, disk read %3d\n",
+            what, NOPS, msec, msec * 1000 / NOPS, after.bcache_hit - before->bcache_hit,
+            after.bcache_miss - before->bcache_miss, after.disk_read - before->disk_read);
+}
+
+static void
+check_leaf(const char *path) {
+    int fd, len = strlen(LEAF_CONTENT);
+    assert((fd = open(path, O_RDONLY)) >= 0);
+    assert(read(fd, buffer, sizeof(buffer)) == len && memcmp(buffer, LEAF_CONTENT, len) == 0);
+    close(fd);
+}
+
+static void
+bench_open(const char *what, const char *path, int expect) {
+    struct iostat before;
+    int i, fd;
+    if (expect == 0) {
+        check_leaf(path);
+    }
+    assert(iostat(&before) == 0);
+    unsigned int start = gettime_msec();
+    for (i = 0; i < NOPS; i ++) {
+        if ((fd = open(path, O_RDONLY)) >= 0) {
+            close(fd);
+        }
+        assert((fd >= 0) ? expect == 0 : fd == expect);
+    }
+    report(what, gettime_msec() - start, &before);
+}
+
+int
+main(void) {
+    bench_open("deep", DEEP "/leaf", 0);
+    bench_open("dotdot", "deep/./d1/../d1/d2/../../d1/d2/d3/d4/d5/d6/d7/d8/d9/d10/d11/d12/d13/d14/d15/d16/./leaf", 0);
+    bench_open("symlink", "deep/bottom/leaf", 0);
+    bench_open("abslink", "deep/abs/leaf", 0);
+    bench_open("uplink", "deep/bottom/up3/d14/d15/d16/leaf", 0);
+    bench_open("notdir", DEEP "/leaf/x", -E_NOTDIR);
+    bench_open("loop", "deep/loop", -E_LOOP);
+    cprintf("pathbench pass.\n");
+    return 0;
+}
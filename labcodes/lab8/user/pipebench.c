@@ -0,0 +1,140 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <file.h>
+#include <unistd.h>
+#include <error.h>
+#include <iostat.h>
+
+/* 管道测试：
+ *   - 吞吐量：父进程以 64B ~ 64KB 的写入向管道写 TOTAL_SIZE 字节，子进程用 64KB 的缓冲区读出并检查内容，
+ *     统计吞吐量和唤醒次数（pipe_wakeup 的增量）。唤醒是成批的，写者填满缓冲区才唤醒一次读者，
+ *     读者取走一半以上的数据才唤醒一次写者，唤醒次数与写入的大小基本无关；
+ *   - 延迟：两个进程通过两个管道来回传递 1 字节 NROUNDS 次，统计一次往返的时间；
+ *   - 命名管道（mkfifo）的打开、读写和写端关闭后读到文件尾，以及读端关闭后写入返回 -E_PIPE。
+ */
+
+#define TOTAL_SIZE          (1024 * 1024)
+#define MAX_WRITE           (64 * 1024)
+#define READ_SIZE           (64 * 1024)
+#define NROUNDS             1000
+#define FIFO_NAME           "pipebench.fifo"
+
+static char buffer[MAX_WRITE];
+
+static char
+pattern(int pos) {
+    return (char)(pos * 7 + pos / 4096);
+}
+
+/* reader - read the pipe until the end of file and check the data, return the # of bytes read */
+static int
+reader(int fd) {
+    int pos = 0, i, ret;
+    while ((ret = read(fd, buffer, READ_SIZE)) > 0) {
+        for (i = 0; i < ret; i ++) {
+            assert(buffer[i] == pattern(pos + i));
+        }
+        pos += ret;
+    }
+    assert(ret == 0);
+    return pos;
+}
+
+/* bench_throughput - write TOTAL_SIZE bytes to a reader process with writes of wsize bytes */
+static void
+bench_throughput(int wsize) {
+    struct iostat before, after;
+    int p[2], pid, code, pos, i;
+    assert(pipe(p) == 0);
+    if ((pid = fork()) == 0) {
+        close(p[1]);
+        exit(reader(p[0]));
+    }
+    assert(pid > 0);
+    close(p[0]);
+    assert(iostat(&before) == 0);
+    unsigned int start = gettime_msec();
+    for (pos = 0; pos < TOTAL_SIZE; pos += wsize) {
+        for (i = 0; i < wsize; i ++) {
+            buffer[i] = pattern(pos + i);
+        }
+        assert(write(p[1], buffer, wsize) == wsize);
+    }
+    close(p[1]);
+    assert(waitpid(pid, &code) == 0 && code == TOTAL_SIZE);
+    unsigned int msec = gettime_msec() - start;
+    assert(iostat(&after) == 0);
+    cprintf("pipebench: write %5d B x %5d: %5d msec, %6d KB/s, %5d wakeups\n",
+            wsize, TOTAL_SIZE / wsize, msec, (msec == 0) ? 0 : TOTAL_SIZE / 1024 * 1000 / msec,
+            after.pipe_wakeup - before.pipe_wakeup);
+}
+
+/* bench_latency - pass a byte back and forth between two processes NROUNDS times */
+static void
+bench_latency(void) {
+    int to[2], from[2], pid, code, i;
+    char c = 0;
+    assert(pipe(to) == 0 && pipe(from) == 0);
+    if ((pid = fork()) == 0) {
+        close(to[1]), close(from[0]);
+        while (read(to[0], &c, 1) == 1) {
+            c ++;
+            assert(write(from[1], &c, 1) == 1);
+        }
+        exit(0);
+    }
+    assert(pid > 0);
+    close(to[0]), close(from[1]);
+    unsigned int start = gettime_msec();
+    for (i = 0; i < NROUNDS; i ++) {
+        char expected = c + 1;
+        assert(write(to[1], &c, 1) == 1);
+        assert(read(from[0], &c, 1) == 1 && c == expected);
+    }
+    unsigned int msec = gettime_msec() - start;
+    close(to[1]);
+    assert(read(from[0], &c, 1) == 0);
+    close(from[0]);
+    assert(waitpid(pid, &code) == 0 && code == 0);
+    cprintf("pipebench: ping-pong x %d: %d msec, %d usec per round trip\n", NROUNDS, msec, msec * 1000 / NROUNDS);
+}
+
+/* test_fifo - talk through a FIFO, check the end of file, then the broken pipe of a pipe */
+static void
+test_fifo(void) {
+    static const char msg[] = "hello, fifo";
+    char buf[sizeof(msg)];
+    int fd, p[2], pid, code;
+    if ((pid = fork()) == 0) {
+        assert((fd = mkfifo(FIFO_NAME, O_WRONLY)) >= 0);
+        assert(write(fd, (void *)msg, sizeof(msg)) == sizeof(msg));
+        close(fd);
+        exit(0);
+    }
+    assert(pid > 0);
+    assert((fd = mkfifo(FIFO_NAME, O_RDONLY)) >= 0);
+    assert(read(fd, buf, sizeof(buf)) == sizeof(msg) && strcmp(buf, msg) == 0);
+    assert(read(fd, buf, sizeof(buf)) == 0);
+    close(fd);
+    assert(waitpid(pid, &code) == 0 && code == 0);
+    assert(mkfifo(FIFO_NAME, O_RDWR) == -E_INVAL);
+
+    assert(pipe(p) == 0);
+    close(p[0]);
+    assert(write(p[1], (void *)msg, sizeof(msg)) == -E_PIPE);
+    close(p[1]);
+    cprintf("pipebench: fifo ok.\n");
+}
+
+int
+main(void) {
+    int wsize;
+    for (wsize = 64; wsize <= MAX_WRITE; wsize *= 4) {
+        bench_throughput(wsize);
+    }
+    bench_latency();
+    test_fifo();
+    cprintf("pipebench pass.\n");
+    return 0;
+}
@@ -0,0 +1,94 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <dir.h>
+#include <file.h>
+#include <stat.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <iostat.h>
+
+/* 顺序读写测试：用 4KB 的缓冲区依次读完根目录下的所有文件，统计页缓存和预读的效果。
+ * 第一遍读取时大部分块由 kreadahead 在后台提前读入，读者只需等待每个文件开头的几个块；
+ * 第二遍读取时所有块都在页缓存中，不再访问块缓存和磁盘。
+ * 最后把本程序文件的内容按 4KB 原样写回并 fsync，统计顺序写的速度（文件系统不支持创建文件）。
+ * disk read/write 统计的是传送的块数；连续的块合并成一个 IDE 请求传送，请求数少了，吞吐量随之提高。
+ */
+
+#define BUFSIZE             4096
+#define FILE_MAXSIZE        (128 * 1024)
+
+static char buffer[BUFSIZE];
+static char content[FILE_MAXSIZE];
+
+static void
+report(const char *name, int nbytes, unsigned int msec, struct iostat *before) {
+    struct iostat after;
+    assert(iostat(&after) == 0);
+    cprintf("readbench: %-8s %7d bytes in %4d msec (%5d KB/s): disk read %4d, write %4d, page hit %4d, miss %4d, readahead %4d\n",
+            name, nbytes, msec, (msec == 0) ? 0 : nbytes / msec * 1000 / 1024,
+            after.disk_read - before->disk_read, after.disk_write - before->disk_write,
+            after.filemap_hit - before->filemap_hit, after.filemap_miss - before->filemap_miss,
+            after.readahead - before->readahead);
+}
+
+static int
+read_file(const char *path) {
+    struct stat st;
+    int fd, ret, nbytes = 0;
+    assert((fd = open(path, O_RDONLY)) >= 0);
+    assert(fstat(fd, &st) == 0);
+    if (S_ISREG(st.st_mode)) {
+        while ((ret = read(fd, buffer, BUFSIZE)) > 0) {
+            nbytes += ret;
+        }
+        assert(ret == 0 && nbytes == st.st_size);
+    }
+    close(fd);
+    return nbytes;
+}
+
+static void
+bench_read(const char *name) {
+    struct iostat before;
+    struct dirent *direntp;
+    DIR *dirp;
+    int nbytes = 0;
+    assert(iostat(&before) == 0);
+    unsigned int start = gettime_msec();
+    assert((dirp = opendir(".")) != NULL);
+    while ((direntp = readdir(dirp)) != NULL) {
+        nbytes += read_file(direntp->name);
+    }
+    closedir(dirp);
+    report(name, nbytes, gettime_msec() - start, &before);
+}
+
+static void
+bench_rewrite(const char *path) {
+    struct iostat before;
+    int fd, ret, nbytes = 0, pos;
+    assert((fd = open(path, O_RDWR)) >= 0);
+    while (nbytes < FILE_MAXSIZE && (ret = read(fd, content + nbytes, FILE_MAXSIZE - nbytes)) > 0) {
+        nbytes += ret;
+    }
+    assert(iostat(&before) == 0);
+    unsigned int start = gettime_msec();
+    assert(seek(fd, 0, LSEEK_SET) == 0);
+    for (pos = 0; pos < nbytes; pos += ret) {
+        ret = (nbytes - pos < BUFSIZE) ? nbytes - pos : BUFSIZE;
+        assert(write(fd, content + pos, ret) == ret);
+    }
+    assert(fsync(fd) == 0);
+    report("rewrite", nbytes, gettime_msec() - start, &before);
+    close(fd);
+}
+
+int
+main(void) {
+    bench_read("read");
+    bench_read("reread");
+    bench_rewrite("readbench");
+    cprintf("readbench pass.\n");
+    return 0;
+}
@@ -149,27 +149,28 @@ again:
             }
             break;
         case '|':
-          //  if ((ret = pipe(p)) != 0) {
-          //      return ret;
-          //  }
+            if ((ret = pipe(p)) != 0) {
+                return ret;
+            }
+            // 子进程执行左边的命令，本进程接着解析并执行右边的命令，sh 等待的是管道中最后一个命令
             if ((ret = fork()) == 0) {
-                close(0);
-                if ((ret = dup2(p[0], 0)) < 0) {
+                close(1);
+                if ((ret = dup2(p[1], 1)) < 0) {
                     return ret;
                 }
                 close(p[0]), close(p[1]);
-                goto again;
+                goto runit;
             }
             else {
                 if (ret < 0) {
                     return ret;
                 }
-                close(1);
-                if ((ret = dup2(p[1], 1)) < 0) {
+                close(0);
+                if ((ret = dup2(p[0], 0)) < 0) {
                     return ret;
                 }
                 close(p[0]), close(p[1]);
-                goto runit;
+                goto again;
             }
             break;
         case 0:
@@ -235,7 +236,8 @@ main(int argc, char **argv) {
     while ((buffer = readline((interactive) ? "$ " : NULL)) != NULL) {
         shcwd[0] = '\0';
         int pid;
-        if ((pid = fork()) == 0) {
+        // 子进程只会 exec 或退出，用 vfork 避免复制 sh 的页表
+        if ((pid = vfork()) == 0) {
             ret = runcmd(buffer);
             exit(ret);
         }
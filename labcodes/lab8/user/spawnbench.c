@@ -0,0 +1,52 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <x86.h>
+
+/* 进程创建延迟测试：比较 fork+exec 与 vfork+exec 启动一个立即退出的程序的开销。
+ * 父进程先写满 NPAGE 个页面，使 fork 需要处理的页表更大一些。
+ */
+
+#define PAGE_SIZE           4096
+#define NPAGE               256
+#define NROUND              16
+
+static char buf[NPAGE][PAGE_SIZE];
+
+static void
+bench(const char *name, int (*spawn)(void)) {
+    uint64_t cycles = 0;
+    unsigned int msec = gettime_msec();
+    int i, pid, code;
+
+    for (i = 0; i < NROUND; i ++) {
+        uint64_t start = rdtsc();
+        if ((pid = spawn()) == 0) {
+            exec("spawnbench", "child");
+            exit(-1);
+        }
+        assert(pid > 0);
+        assert(waitpid(pid, &code) == 0 && code == 0);
+        cycles += rdtsc() - start;
+    }
+    msec = gettime_msec() - msec;
+
+    do_div(cycles, NROUND);
+    cprintf("spawnbench: %-5s + exec + wait: %llu cycles, %d ticks for %d rounds\n",
+            name, cycles, msec, NROUND);
+}
+
+int
+main(int argc, char **argv) {
+    if (argc == 2 && strcmp(argv[1], "child") == 0) {
+        return 0;
+    }
+    int i;
+    for (i = 0; i < NPAGE; i ++) {
+        buf[i][0] = 1;
+    }
+    bench("fork", fork);
+    bench("vfork", vfork);
+    cprintf("spawnbench pass.\n");
+    return 0;
+}
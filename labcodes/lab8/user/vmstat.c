@@ -0,0 +1,23 @@
+#include <stdio.h>
+#include <ulib.h>
+#include <vmstat.h>
+
+/* 打印虚拟内存子系统的事件计数器 */
+
+int
+main(void) {
+    struct vmstat st;
+    assert(vmstat(&st) == 0);
+    cprintf("pgfault        %d\n", st.pgfault);
+    cprintf("fault_around   %d\n", st.fault_around);
+    cprintf("fork_shared    %d\n", st.fork_shared);
+    cprintf("fork_copied    %d\n", st.fork_copied);
+    cprintf("cow_fault      %d\n", st.cow_fault);
+    cprintf("cow_copied     %d\n", st.cow_copied);
+    cprintf("cow_reused     %d\n", st.cow_reused);
+    cprintf("swap_in        %d\n", st.swap_in);
+    cprintf("swap_out       %d\n", st.swap_out);
+    cprintf("swap_clean     %d\n", st.swap_clean);
+    cprintf("swap_cache_hit %d\n", st.swap_cache_hit);
+    return 0;
+}